@@ -201,6 +201,7 @@ OBJS = strlcat.obj &
 	net_dgrm.obj &
 	net_loop.obj &
 	net_main.obj &
+	bench.obj &
 	chase.obj &
 	cl_demo.obj &
 	cl_input.obj &
@@ -217,6 +218,7 @@ OBJS = strlcat.obj &
 	common.obj &
 	mdfour.obj &
 	fs_zip.obj &
+	demostream.obj &
 	crc.obj &
 	cvar.obj &
 	cfgfile.obj &
@@ -227,9 +229,12 @@ OBJS = strlcat.obj &
 	pr_ext.obj &
 	pr_edict.obj &
 	pr_exec.obj &
+	sv_demo.obj &
 	sv_main.obj &
+	sv_metrics.obj &
 	sv_move.obj &
 	sv_phys.obj &
+	sv_replay.obj &
 	sv_user.obj &
 	world.obj &
 	zone.obj &
@@ -0,0 +1,510 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+//bench.c -- engine microbenchmarks against the currently loaded map
+
+#include "quakedef.h"
+
+static cvar_t	bench_samples = {"bench_samples", "15", CVAR_NONE};	//timed batches per benchmark, the median is reported
+static cvar_t	bench_sampletime = {"bench_sampletime", "0.02", CVAR_NONE};	//target seconds per batch
+
+typedef struct
+{
+	const char	*name;
+	qboolean	(*setup) (void);	//false skips the benchmark, eg: no map or no sound device
+	void		(*run) (int i);		//one operation
+	void		(*shutdown) (void);
+} benchmark_t;
+
+typedef struct
+{
+	const char	*name;
+	int			iterations;		//per batch
+	double		median, min, max;	//nanoseconds per operation
+} benchresult_t;
+
+static unsigned int	bench_seed;
+static int			bench_retries;
+static qboolean		bench_auto;
+
+//keep inputs identical between runs and builds
+static unsigned int Bench_Rand (void)
+{
+	bench_seed = bench_seed * 1103515245 + 12345;
+	return (bench_seed >> 16) & 0x7fff;
+}
+
+static float Bench_RandRange (float lo, float hi)
+{
+	return lo + (hi - lo) * (Bench_Rand () / 32767.f);
+}
+
+/*
+=============================================================================
+
+BENCHMARKS
+
+=============================================================================
+*/
+
+#define BENCH_POINTS 1024
+static vec3_t		bench_start[BENCH_POINTS], bench_end[BENCH_POINTS];
+static const vec3_t	bench_mins = {-16, -16, -24}, bench_maxs = {16, 16, 32};
+
+static qboolean Bench_WorldPoints (void)
+{
+	qmodel_t	*mod = sv.qcvm.worldmodel;
+	int			i, j;
+
+	if (!sv.active || !mod)
+		return false;
+	bench_seed = 1;
+	for (i = 0; i < BENCH_POINTS; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			bench_start[i][j] = Bench_RandRange (mod->mins[j], mod->maxs[j]);
+			bench_end[i][j] = bench_start[i][j] + Bench_RandRange (-512, 512);
+		}
+	}
+	PR_SwitchQCVM (&sv.qcvm);
+	return true;
+}
+
+static void Bench_EndQCVM (void)
+{
+	PR_SwitchQCVM (NULL);
+}
+
+static void Bench_SVMove (int i)
+{
+	i &= BENCH_POINTS-1;
+	SV_Move (bench_start[i], (float *)bench_mins, (float *)bench_maxs, bench_end[i], MOVE_NORMAL, qcvm->edicts);
+}
+
+static void Bench_HullCheck (int i)
+{
+	trace_t	trace;
+
+	i &= BENCH_POINTS-1;
+	memset (&trace, 0, sizeof(trace));
+	trace.fraction = 1;
+	trace.allsolid = true;
+	VectorCopy (bench_end[i], trace.endpos);
+	SV_RecursiveHullCheck (&sv.qcvm.worldmodel->hulls[1], bench_start[i], bench_end[i], &trace, CONTENTMASK_ANYSOLID);
+}
+
+static qboolean Bench_LeafPVSSetup (void)
+{
+	return sv.active && sv.qcvm.worldmodel && sv.qcvm.worldmodel->numleafs > 0;
+}
+
+static void Bench_LeafPVS (int i)
+{
+	qmodel_t *mod = sv.qcvm.worldmodel;
+	Mod_LeafPVS (&mod->leafs[1 + i % mod->numleafs], mod);
+}
+
+static dfunction_t	*bench_qcfunc;
+
+static qboolean Bench_QCSetup (void)
+{
+	if (!sv.active)
+		return false;
+	PR_SwitchQCVM (&sv.qcvm);
+	bench_qcfunc = ED_FindFunction ("StartFrame");
+	if (!bench_qcfunc)
+	{
+		PR_SwitchQCVM (NULL);
+		return false;
+	}
+	return true;
+}
+
+static void Bench_QCExec (int i)
+{
+	pr_global_struct->self = EDICT_TO_PROG(qcvm->edicts);
+	pr_global_struct->other = EDICT_TO_PROG(qcvm->edicts);
+	pr_global_struct->time = qcvm->time;
+	PR_ExecuteProgram (bench_qcfunc - qcvm->functions);
+}
+
+static const char *bench_files[] = {"progs.dat", "gfx.wad", "gfx/conback.lmp", "sound/misc/menu1.wav", "maps/bench_missing.bsp"};
+
+static qboolean Bench_FindFileSetup (void)
+{
+	return true;
+}
+
+static void Bench_FindFile (int i)
+{
+	COM_FileExists (bench_files[i % countof(bench_files)], NULL);
+}
+
+static byte			bench_msgdata[1024];
+static sizebuf_t	bench_msg;
+
+static qboolean Bench_MsgSetup (void)
+{
+	bench_msg.data = bench_msgdata;
+	bench_msg.maxsize = sizeof(bench_msgdata);
+	bench_msg.allowoverflow = true;
+	return true;
+}
+
+static void Bench_Msg (int i)
+{
+	sizebuf_t	saved = net_message;
+	int			savedcount = msg_readcount;
+	qboolean	savedbad = msg_badread;
+	int			j;
+
+	SZ_Clear (&bench_msg);
+	for (j = 0; j < 16; j++)
+	{
+		MSG_WriteByte (&bench_msg, j);
+		MSG_WriteShort (&bench_msg, i + j);
+		MSG_WriteLong (&bench_msg, i * j);
+		MSG_WriteFloat (&bench_msg, j * 0.5f);
+		MSG_WriteCoord (&bench_msg, j * 3.125f, PRFL_FLOATCOORD);
+		MSG_WriteAngle16 (&bench_msg, j * 22.5f, 0);
+		MSG_WriteString (&bench_msg, "bench");
+	}
+
+	net_message = bench_msg;
+	MSG_BeginReading ();
+	for (j = 0; j < 16; j++)
+	{
+		MSG_ReadByte ();
+		MSG_ReadShort ();
+		MSG_ReadLong ();
+		MSG_ReadFloat ();
+		MSG_ReadCoord (PRFL_FLOATCOORD);
+		MSG_ReadAngle16 (0);
+		MSG_ReadString ();
+	}
+	net_message = saved;
+	msg_readcount = savedcount;
+	msg_badread = savedbad;
+}
+
+#define BENCH_PAINTCHANNELS	8
+#define BENCH_PAINTSAMPLES	512
+static sfx_t	*bench_sfx;
+static int		bench_paintbase;
+
+static qboolean Bench_PaintSetup (void)
+{
+	if (!shm || !snd_channels)
+		return false;
+	bench_sfx = S_PrecacheSound ("ambience/water1.wav");
+	if (!bench_sfx || !S_LoadSound (bench_sfx))
+		return false;
+	S_StopAllSounds (true);
+	bench_paintbase = paintedtime;
+	return true;
+}
+
+static void Bench_Paint (int i)
+{
+	sfxcache_t	*sc = S_LoadSound (bench_sfx);
+	channel_t	*ch;
+	int			j;
+
+	//repaint the same window every time so the op stays identical
+	for (j = 0, ch = snd_channels; j < BENCH_PAINTCHANNELS; j++, ch++)
+	{
+		ch->sfx = bench_sfx;
+		ch->leftvol = 255 - j*16;
+		ch->rightvol = 128 + j*16;
+		ch->pos = 0;
+		ch->end = bench_paintbase + sc->length;
+		ch->looping = sc->loopstart;
+	}
+	paintedtime = bench_paintbase;
+	SNDDMA_LockBuffer ();
+	S_PaintChannels (bench_paintbase + BENCH_PAINTSAMPLES);
+	SNDDMA_Submit ();
+}
+
+static void Bench_PaintShutdown (void)
+{
+	S_StopAllSounds (true);
+	paintedtime = bench_paintbase;
+}
+
+#define BENCH_TEXSIZE	(320*200)
+static unsigned	*bench_texture;
+
+static qboolean Bench_ResampleSetup (void)
+{
+	int i;
+
+	if (cls.state == ca_dedicated)
+		return false;
+	bench_texture = (unsigned *) malloc (BENCH_TEXSIZE * sizeof(unsigned));
+	bench_seed = 1;
+	for (i = 0; i < BENCH_TEXSIZE; i++)
+		bench_texture[i] = Bench_Rand () | (Bench_Rand () << 16);
+	return true;
+}
+
+static void Bench_Resample (int i)
+{
+	//the mipmaps work in place, the values stay in range so reusing the buffer is fine
+	TexMgr_ResampleMipMap (bench_texture, 320, 200);
+}
+
+static void Bench_ResampleShutdown (void)
+{
+	free (bench_texture);
+	bench_texture = NULL;
+}
+
+static msurface_t	**bench_surfs;
+static int			bench_numsurfs;
+static byte			*bench_lightmap;
+
+static qboolean Bench_LightmapSetup (void)
+{
+	qmodel_t	*mod = cl.worldmodel;
+	int			i;
+
+	if (cls.state == ca_dedicated || cls.signon != SIGNONS || !mod)
+		return false;
+	bench_surfs = (msurface_t **) malloc (mod->numsurfaces * sizeof(*bench_surfs));
+	for (i = 0, bench_numsurfs = 0; i < mod->numsurfaces; i++)
+		if (mod->surfaces[i].lightmaptexturenum >= 0 && !(mod->surfaces[i].flags & SURF_DRAWTILED))
+			bench_surfs[bench_numsurfs++] = &mod->surfaces[i];
+	if (!bench_numsurfs)
+	{
+		free (bench_surfs);
+		return false;
+	}
+	bench_lightmap = (byte *) malloc (LMBLOCK_WIDTH*LMBLOCK_HEIGHT*4);
+	return true;
+}
+
+static void Bench_Lightmap (int i)
+{
+	R_BuildLightMap (cl.worldmodel, bench_surfs[i % bench_numsurfs], bench_lightmap, LMBLOCK_WIDTH*lightmap_bytes);
+}
+
+static void Bench_LightmapShutdown (void)
+{
+	free (bench_surfs);
+	free (bench_lightmap);
+	bench_surfs = NULL;
+	bench_lightmap = NULL;
+}
+
+#define BENCH_ZONESLOTS 64
+static void	*bench_zone[BENCH_ZONESLOTS];
+
+static qboolean Bench_ZoneSetup (void)
+{
+	bench_seed = 1;
+	return true;
+}
+
+static void Bench_Zone (int i)
+{
+	i &= BENCH_ZONESLOTS-1;
+	if (bench_zone[i])
+		Z_Free (bench_zone[i]);
+	bench_zone[i] = Z_Malloc (16 + (Bench_Rand () & 1023));
+}
+
+static void Bench_ZoneShutdown (void)
+{
+	int i;
+	for (i = 0; i < BENCH_ZONESLOTS; i++)
+	{
+		if (bench_zone[i])
+			Z_Free (bench_zone[i]);
+		bench_zone[i] = NULL;
+	}
+}
+
+static const benchmark_t benchmarks[] =
+{
+	{"sv_move",			Bench_WorldPoints,			Bench_SVMove,		Bench_EndQCVM},
+	{"hullcheck",		Bench_WorldPoints,			Bench_HullCheck,	Bench_EndQCVM},
+	{"leafpvs",			Bench_LeafPVSSetup,			Bench_LeafPVS,		NULL},
+	{"qc_startframe",	Bench_QCSetup,				Bench_QCExec,		Bench_EndQCVM},
+	{"findfile",		Bench_FindFileSetup,		Bench_FindFile,		NULL},
+	{"msg_roundtrip",	Bench_MsgSetup,				Bench_Msg,			NULL},
+	{"paintchannels",	Bench_PaintSetup,			Bench_Paint,		Bench_PaintShutdown},
+	{"resample_mipmap",	Bench_ResampleSetup,		Bench_Resample,		Bench_ResampleShutdown},
+	{"buildlightmap",	Bench_LightmapSetup,		Bench_Lightmap,		Bench_LightmapShutdown},
+	{"zone_churn",		Bench_ZoneSetup,			Bench_Zone,			Bench_ZoneShutdown},
+};
+
+/*
+=============================================================================
+
+HARNESS
+
+=============================================================================
+*/
+
+static int Bench_CompareDouble (const void *a, const void *b)
+{
+	double d = *(const double *)a - *(const double *)b;
+	return (d > 0) - (d < 0);
+}
+
+static void Bench_Run (const benchmark_t *b, benchresult_t *res)
+{
+	double	samples[64];
+	double	start, elapsed;
+	int		numsamples, iterations, i, s, op;
+
+	numsamples = CLAMP (3, (int)bench_samples.value, (int)countof(samples));
+
+	//calibrate: grow the batch until it fills the target sample time, which also serves as warmup
+	op = 0;
+	for (iterations = 1; ; iterations *= 2)
+	{
+		start = Sys_DoubleTime ();
+		for (i = 0; i < iterations; i++)
+			b->run (op++);
+		elapsed = Sys_DoubleTime () - start;
+		if (elapsed >= bench_sampletime.value || iterations >= (1<<24))
+			break;
+	}
+
+	for (s = 0; s < numsamples; s++)
+	{
+		start = Sys_DoubleTime ();
+		for (i = 0; i < iterations; i++)
+			b->run (op++);
+		samples[s] = (Sys_DoubleTime () - start) * 1e9 / iterations;
+	}
+	qsort (samples, numsamples, sizeof(samples[0]), Bench_CompareDouble);
+
+	res->name = b->name;
+	res->iterations = iterations;
+	res->min = samples[0];
+	res->median = samples[numsamples/2];
+	res->max = samples[numsamples-1];
+}
+
+static void Bench_WriteJSON (const benchresult_t *results, int count)
+{
+	char	name[MAX_OSPATH];
+	FILE	*f;
+	int		i;
+
+	q_snprintf (name, sizeof(name), "%s/bench.json", com_gamedir);
+	f = fopen (name, "w");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open file %s.\n", name);
+		return;
+	}
+	fprintf (f, "{\"engine\":\"%s\",\"map\":\"%s\",\"samples\":%i,\"benchmarks\":[\n",
+		ENGINE_NAME_AND_VER, sv.active ? sv.name : "", CLAMP (3, (int)bench_samples.value, 64));
+	for (i = 0; i < count; i++)
+		fprintf (f, "%s{\"name\":\"%s\",\"iterations\":%i,\"ns_per_op\":%.2f,\"ns_min\":%.2f,\"ns_max\":%.2f}",
+			i ? ",\n" : "", results[i].name, results[i].iterations, results[i].median, results[i].min, results[i].max);
+	fprintf (f, "\n]}\n");
+	fclose (f);
+	Con_Printf ("Wrote %s\n", name);
+}
+
+/*
+====================
+Bench_f
+
+bench [name]
+runs every benchmark, or those whose name contains the argument, and writes <gamedir>/bench.json.
+the map-based ones are skipped when no map is loaded.
+====================
+*/
+static void Bench_f (void)
+{
+	benchresult_t	results[countof(benchmarks)];
+	const char		*filter = Cmd_Argc () > 1 ? Cmd_Argv (1) : NULL;
+	int				i, count;
+
+	if (cmd_source != src_command)
+		return;
+
+	//the auto run waits here until the map has finished loading
+	if (bench_auto && !(sv.active && (cls.state == ca_dedicated || cls.signon == SIGNONS)))
+	{
+		if (++bench_retries > 1000)
+			Sys_Error ("bench: map failed to load");
+		Cbuf_InsertText ("wait\nbench\n");
+		return;
+	}
+
+	Con_Printf ("%-16s %10s %12s %12s %12s\n", "benchmark", "batch", "ns/op", "min", "max");
+	for (i = 0, count = 0; i < (int)countof(benchmarks); i++)
+	{
+		const benchmark_t *b = &benchmarks[i];
+		if (filter && !strstr (b->name, filter))
+			continue;
+		if (!b->setup ())
+		{
+			Con_Printf ("%-16s skipped\n", b->name);
+			continue;
+		}
+		Bench_Run (b, &results[count]);
+		if (b->shutdown)
+			b->shutdown ();
+		Con_Printf ("%-16s %10i %12.1f %12.1f %12.1f\n", b->name, results[count].iterations,
+			results[count].median, results[count].min, results[count].max);
+		count++;
+	}
+	Bench_WriteJSON (results, count);
+}
+
+/*
+====================
+Bench_AutoRun
+
+-bench [-benchmap name] loads a map, runs every benchmark and quits. always on in the qss_bench build.
+====================
+*/
+void Bench_AutoRun (void)
+{
+	const char	*map = "e1m1";
+	int			p;
+
+#ifndef QSS_BENCH
+	if (!COM_CheckParm ("-bench"))
+		return;
+#endif
+	p = COM_CheckParm ("-benchmap");
+	if (p && p < com_argc-1)
+		map = com_argv[p+1];
+
+	bench_auto = true;
+	Cbuf_AddText (va ("map %s\nbench\nquit\n", map));
+}
+
+void Bench_Init (void)
+{
+	Cvar_RegisterVariable (&bench_samples);
+	Cvar_RegisterVariable (&bench_sampletime);
+	Cmd_AddCommand ("bench", Bench_f);
+}
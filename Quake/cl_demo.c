@@ -22,6 +22,13 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 
 static void CL_FinishTimeDemo (void);
+static void CL_TimeDemoFrame (void);
+static void CL_Record_Serverdata (void);
+void CL_Record_Prespawn (void);
+void CL_Record_Spawn (void);
+
+cvar_t	demo_keyframeinterval = {"demo_keyframeinterval", "10", CVAR_ARCHIVE};	// seconds between keyframes while recording, 0 = none
+cvar_t	demo_compress = {"demo_compress", "0", CVAR_ARCHIVE};	// record block compressed demos, playback detects them
 
 /*
 ==============================================================================
@@ -36,6 +43,249 @@ read from the demo file.
 ==============================================================================
 */
 
+/*
+==============================================================================
+
+DEMO KEYFRAMES
+
+While recording, a snapshot of the client state is taken every
+demo_keyframeinterval seconds, made of the same messages record uses to start
+a demo mid-map. They are kept in memory and appended after the final
+svc_disconnect when recording stops, followed by an index from server time to
+file offsets. Engines without this stop at the svc_disconnect and never see
+them.
+
+file:	"<cd track>\n" messages... svc_disconnect
+		keyframe messages...
+		index: numkeys * {time, level, streamofs, keyofs, keylen}
+		footer: indexofs, numkeys, DEMO_INDEXMAGIC
+
+All offsets are from the start of the file, everything is little endian.
+For compressed demos (see demostream.c) they are into the uncompressed data,
+and each keyframe starts a new block so seeking only decodes from there.
+
+==============================================================================
+*/
+
+#define DEMO_INDEXMAGIC		(('I'<<24)|('K'<<16)|('S'<<8)|'Q')	// "QSKI"
+#define DEMO_FOOTERSIZE		12
+#define DEMO_KEYSIZE		20
+
+typedef struct
+{
+	float	time;		// cl.mtime[0] when it was taken
+	int		level;		// cls.demolevel, so maps within one demo don't mix up
+	int		streamofs;	// the message that follows it
+	int		keyofs;		// its own messages (relative to the keyframe data while recording)
+	int		keylen;
+} demokey_t;
+
+static demokey_t	*demo_keys;
+static int			demo_numkeys, demo_maxkeys;
+
+// recording
+static byte		*demo_keydata;
+static int		demo_keydatasize, demo_keydatamax;
+static qboolean	demo_tokeydata;		// CL_WriteDemoMessage appends to demo_keydata instead of the file
+static int		demo_keylevel;
+static double	demo_nextkeytime;
+
+// playback
+static struct
+{
+	int		start;		// offset of the first message
+	int		keyend;		// while reading a keyframe, where its messages stop
+	int		resumeofs;	// and where the stream carries on from after it
+} demo_in;
+
+static double	demo_seektime;
+static int		demo_seeklevel;
+
+static void CL_DemoClearKeys (void)
+{
+	demo_numkeys = 0;
+	demo_keydatasize = 0;
+	demo_keylevel = -1;
+	demo_nextkeytime = 0;
+}
+
+/*
+====================
+CL_DemoLoadIndex
+
+Picks up the keyframe index from the end of the demo, if it has one
+====================
+*/
+static void CL_DemoLoadIndex (void)
+{
+	int		footer[3], key[5];
+	int		i, indexofs, numkeys, length;
+
+	demo_numkeys = 0;
+	length = DemoStream_Length (cls.demofile);
+	if (length < demo_in.start + DEMO_FOOTERSIZE)
+		return;
+
+	DemoStream_Seek (cls.demofile, length - DEMO_FOOTERSIZE);
+	if (DemoStream_Read (cls.demofile, footer, DEMO_FOOTERSIZE) != DEMO_FOOTERSIZE || LittleLong (footer[2]) != DEMO_INDEXMAGIC)
+		return;
+	indexofs = LittleLong (footer[0]);
+	numkeys = LittleLong (footer[1]);
+	if (numkeys <= 0 || indexofs < demo_in.start || indexofs + numkeys * DEMO_KEYSIZE > length - DEMO_FOOTERSIZE)
+		return;
+
+	if (numkeys > demo_maxkeys)
+	{
+		demo_maxkeys = numkeys;
+		demo_keys = (demokey_t *) realloc (demo_keys, sizeof(*demo_keys) * demo_maxkeys);
+	}
+
+	DemoStream_Seek (cls.demofile, indexofs);
+	for (i = 0; i < numkeys; i++)
+	{
+		demokey_t *k = &demo_keys[demo_numkeys];
+		float f;
+		if (DemoStream_Read (cls.demofile, key, DEMO_KEYSIZE) != DEMO_KEYSIZE)
+			break;
+		memcpy (&f, &key[0], 4);
+		k->time = LittleFloat (f);
+		k->level = LittleLong (key[1]);
+		k->streamofs = LittleLong (key[2]);
+		k->keyofs = LittleLong (key[3]);
+		k->keylen = LittleLong (key[4]);
+		if (k->streamofs < demo_in.start || k->streamofs >= indexofs || k->keyofs < demo_in.start || k->keylen <= 0 || k->keyofs + k->keylen > indexofs)
+			continue;	// corrupt, don't trust it
+		demo_numkeys++;
+	}
+	Con_DPrintf ("demo has %i keyframes\n", demo_numkeys);
+}
+
+/*
+====================
+CL_WriteDemoIndex
+
+Appends the keyframes and their index once the demo itself is finished
+====================
+*/
+static void CL_WriteDemoIndex (void)
+{
+	int		i, base, indexofs, v;
+	float	f;
+
+	if (!demo_numkeys)
+		return;
+
+	base = DemoStream_Tell (cls.demofile);
+	for (i = 0; i < demo_numkeys; i++)
+	{	// one block each, when compressed
+		DemoStream_Break (cls.demofile);
+		DemoStream_Write (cls.demofile, demo_keydata + demo_keys[i].keyofs, demo_keys[i].keylen);
+	}
+	DemoStream_Break (cls.demofile);
+	indexofs = DemoStream_Tell (cls.demofile);
+	for (i = 0; i < demo_numkeys; i++)
+	{
+		f = LittleFloat (demo_keys[i].time);
+		DemoStream_Write (cls.demofile, &f, 4);
+		v = LittleLong (demo_keys[i].level);
+		DemoStream_Write (cls.demofile, &v, 4);
+		v = LittleLong (demo_keys[i].streamofs);
+		DemoStream_Write (cls.demofile, &v, 4);
+		v = LittleLong (base + demo_keys[i].keyofs);
+		DemoStream_Write (cls.demofile, &v, 4);
+		v = LittleLong (demo_keys[i].keylen);
+		DemoStream_Write (cls.demofile, &v, 4);
+	}
+	v = LittleLong (indexofs);
+	DemoStream_Write (cls.demofile, &v, 4);
+	v = LittleLong (demo_numkeys);
+	DemoStream_Write (cls.demofile, &v, 4);
+	v = LittleLong (DEMO_INDEXMAGIC);
+	DemoStream_Write (cls.demofile, &v, 4);
+
+	Con_DPrintf ("wrote %i keyframes (%i bytes)\n", demo_numkeys, demo_keydatasize);
+	CL_DemoClearKeys ();
+}
+
+/*
+====================
+CL_WriteDemoKeyframe
+
+Snapshots the client state into demo_keydata. The message that was just
+received is written after it, so the snapshot is of the state before that.
+====================
+*/
+static void CL_WriteDemoKeyframe (void)
+{
+	byte		*data = net_message.data;
+	int			cursize = net_message.cursize;
+	byte		altbuffer[NET_MAXMESSAGE];
+	demokey_t	*k;
+
+	switch (cl.protocol)
+	{
+	case PROTOCOL_NETQUAKE:
+	case PROTOCOL_FITZQUAKE:
+	case PROTOCOL_RMQ:
+	case PROTOCOL_VERSION_BJP3:
+		break;
+	default:
+		return;	// same restriction as recording mid-map
+	}
+	if (cl.protocol_pext2 & PEXT2_REPLACEMENTDELTAS)
+		return;	// entities are deltas against frames a keyframe can't reproduce
+
+	if (demo_numkeys == demo_maxkeys)
+	{
+		demo_maxkeys = q_max (64, demo_maxkeys * 2);
+		demo_keys = (demokey_t *) realloc (demo_keys, sizeof(*demo_keys) * demo_maxkeys);
+	}
+	DemoStream_Break (cls.demofile);	// so seeking to it only decodes from here
+
+	k = &demo_keys[demo_numkeys++];
+	k->time = cl.mtime[0];
+	k->level = cls.demolevel;
+	k->streamofs = DemoStream_Tell (cls.demofile);
+	k->keyofs = demo_keydatasize;
+
+	net_message.data = altbuffer;
+	SZ_Clear (&net_message);
+	demo_tokeydata = true;
+
+	CL_Record_Serverdata ();
+	CL_Record_Prespawn ();
+	CL_Record_Spawn ();
+
+	demo_tokeydata = false;
+	net_message.data = data;
+	net_message.cursize = cursize;
+
+	k->keylen = demo_keydatasize - k->keyofs;
+}
+
+/*
+====================
+CL_DemoWrite
+
+Everything that goes into a demo being recorded comes through here
+====================
+*/
+void CL_DemoWrite (const void *data, int size)
+{
+	if (demo_tokeydata)
+	{
+		if (demo_keydatasize + size > demo_keydatamax)
+		{
+			demo_keydatamax = q_max (demo_keydatasize + size, demo_keydatamax * 2);
+			demo_keydata = (byte *) realloc (demo_keydata, demo_keydatamax);
+		}
+		memcpy (demo_keydata + demo_keydatasize, data, size);
+		demo_keydatasize += size;
+	}
+	else
+		DemoStream_Write (cls.demofile, data, size);
+}
+
 /*
 ==============
 CL_StopPlayback
@@ -48,10 +298,13 @@ void CL_StopPlayback (void)
 	if (!cls.demoplayback)
 		return;
 
-	fclose (cls.demofile);
+	DemoStream_Close (cls.demofile);
 	cls.demoplayback = false;
 	cls.demopaused = false;
+	cls.demoseeking = false;
 	cls.demofile = NULL;
+	demo_in.keyend = 0;
+	demo_numkeys = 0;
 	cls.state = ca_disconnected;
 
 	if (cls.timedemo)
@@ -72,26 +325,30 @@ static void CL_WriteDemoMessage (void)
 	float	f;
 
 	len = LittleLong (net_message.cursize);
-	fwrite (&len, 4, 1, cls.demofile);
+	CL_DemoWrite (&len, 4);
 	for (i = 0; i < 3; i++)
 	{
 		f = LittleFloat (cl.viewangles[i]);
-		fwrite (&f, 4, 1, cls.demofile);
+		CL_DemoWrite (&f, 4);
 	}
-	fwrite (net_message.data, net_message.cursize, 1, cls.demofile);
-	fflush (cls.demofile);
+	CL_DemoWrite (net_message.data, net_message.cursize);
+	if (!demo_tokeydata)
+		DemoStream_Flush (cls.demofile);
 }
 
 static int CL_GetDemoMessage (void)
 {
-	int	r, i;
+	int	i;
 	float	f;
 
-	if (cls.demopaused)
+	if (cls.demopaused && !cls.demoseeking)
 		return 0;
 
+	if (cls.demoseeking && cls.signon == SIGNONS && (cls.demolevel > demo_seeklevel || cl.mtime[0] >= demo_seektime))
+		cls.demoseeking = false;	// got there
+
 	// decide if it is time to grab the next message
-	if (cls.signon == SIGNONS)	// always grab until fully connected
+	if (cls.signon == SIGNONS && !cls.demoseeking)	// always grab until fully connected, or while seeking
 	{
 		if (cls.timedemo)
 		{
@@ -102,6 +359,7 @@ static int CL_GetDemoMessage (void)
 		// so the bogus time on the first frame doesn't count
 			if (host_framecount == cls.td_startframe + 1)
 				cls.td_starttime = realtime;
+			CL_TimeDemoFrame ();
 		}
 		else if (/* cl.time > 0 && */ cl.time <= cl.mtime[0])
 		{
@@ -109,20 +367,30 @@ static int CL_GetDemoMessage (void)
 		}
 	}
 
+	if (demo_in.keyend && DemoStream_Tell (cls.demofile) >= demo_in.keyend)
+	{	// finished restoring a keyframe, carry on from where it was taken
+		DemoStream_Seek (cls.demofile, demo_in.resumeofs);
+		demo_in.keyend = 0;
+	}
+
 // get the next message
-	fread (&net_message.cursize, 4, 1, cls.demofile);
+	if (DemoStream_Read (cls.demofile, &net_message.cursize, 4) != 4)
+	{
+		CL_StopPlayback ();
+		return 0;
+	}
 	VectorCopy (cl.mviewangles[0], cl.mviewangles[1]);
 	for (i = 0 ; i < 3 ; i++)
 	{
-		r = fread (&f, 4, 1, cls.demofile);
+		f = 0;
+		DemoStream_Read (cls.demofile, &f, 4);
 		cl.mviewangles[0][i] = LittleFloat (f);
 	}
 
 	net_message.cursize = LittleLong (net_message.cursize);
 	if (net_message.cursize > MAX_MSGLEN)
 		Sys_Error ("Demo message > MAX_MSGLEN");
-	r = fread (net_message.data, net_message.cursize, 1, cls.demofile);
-	if (r != 1)
+	if (DemoStream_Read (cls.demofile, net_message.data, net_message.cursize) != net_message.cursize)
 	{
 		CL_StopPlayback ();
 		return 0;
@@ -160,7 +428,16 @@ int CL_GetMessage (void)
 	}
 
 	if (cls.demorecording)
+	{
+		if (demo_keyframeinterval.value > 0 && cls.signon == SIGNONS &&
+			(cls.demolevel != demo_keylevel || cl.mtime[0] >= demo_nextkeytime))
+		{
+			demo_keylevel = cls.demolevel;
+			demo_nextkeytime = cl.mtime[0] + demo_keyframeinterval.value;
+			CL_WriteDemoKeyframe ();
+		}
 		CL_WriteDemoMessage ();
+	}
 
 	return r;
 }
@@ -188,9 +465,10 @@ void CL_Stop_f (void)
 	SZ_Clear (&net_message);
 	MSG_WriteByte (&net_message, svc_disconnect);
 	CL_WriteDemoMessage ();
+	CL_WriteDemoIndex ();
 
 // finish up
-	fclose (cls.demofile);
+	DemoStream_Close (cls.demofile);
 	cls.demofile = NULL;
 	cls.demorecording = false;
 	Con_Printf ("Completed demo\n");
@@ -439,7 +717,9 @@ void CL_Record_f (void)
 {
 	int		c;
 	char	name[MAX_OSPATH];
+	char	header[16];
 	int		track;
+	FILE	*f;
 
 	if (cmd_source != src_command)
 		return;
@@ -522,19 +802,23 @@ void CL_Record_f (void)
 
 	Cvar_SetROM(cl_recordingdemo.name, name);
 
-	Con_Printf ("recording to %s.\n", name);
-	cls.demofile = fopen (name, "wb");
-	if (!cls.demofile)
+	f = fopen (name, "wb");
+	if (!f)
 	{
 		Con_Printf ("ERROR: couldn't create %s\n", name);
 		Cvar_SetROM(cl_recordingdemo.name, "");
 		return;
 	}
+	cls.demofile = DemoStream_OpenWrite (f, demo_compress.value != 0);
+	Con_Printf ("recording to %s%s.\n", name, DemoStream_IsCompressed (cls.demofile) ? " (compressed)" : "");
 
 	cls.forcetrack = track;
-	fprintf (cls.demofile, "%i\n", cls.forcetrack);
+	q_snprintf (header, sizeof(header), "%i\n", cls.forcetrack);
+	DemoStream_Write (cls.demofile, header, strlen (header));
 
 	cls.demorecording = true;
+	cls.demolevel = 0;
+	CL_DemoClearKeys ();
 
 	// from ProQuake: initialize the demo file if we're already connected
 	if (c == 2 && cls.state == ca_connected)
@@ -553,6 +837,8 @@ void CL_Record_f (void)
 		// restore net_message
 		net_message.data = data;
 		net_message.cursize = cursize;
+
+		cls.demolevel = 1;	// the serverinfo that was just written
 	}
 }
 
@@ -567,8 +853,10 @@ play [demoname]
 void CL_PlayDemo_f (void)
 {
 	char	name[MAX_OSPATH];
-	int	i, c;
+	int	i, c, length;
+	byte	ch;
 	qboolean neg;
+	FILE	*f = NULL;
 
 	if (cmd_source != src_command)
 		return;
@@ -588,7 +876,9 @@ void CL_PlayDemo_f (void)
 
 	Con_Printf ("Playing demo from %s.\n", name);
 
-	COM_FOpenFile (name, &cls.demofile, NULL);
+	length = COM_FOpenFile (name, &f, NULL);
+	if (f)
+		cls.demofile = DemoStream_OpenRead (f, length);
 	if (!cls.demofile)
 	{
 		Con_Printf ("ERROR: couldn't open %s\n", name);
@@ -607,7 +897,8 @@ void CL_PlayDemo_f (void)
 	// followed by a '\n':
 	for (i = 0; i < 13; i++)
 	{
-		c = getc(cls.demofile);
+		ch = 0;
+		c = DemoStream_Read (cls.demofile, &ch, 1) ? ch : EOF;
 		if (c == '\n')
 			break;
 		if (c == '-') {
@@ -619,7 +910,7 @@ void CL_PlayDemo_f (void)
 	}
 	if (c != '\n')
 	{
-		fclose (cls.demofile);
+		DemoStream_Close (cls.demofile);
 		cls.demofile = NULL;
 		cls.demonum = -1;	// stop demo loop
 		Con_Printf ("ERROR: demo \"%s\" is invalid\n", name);
@@ -628,14 +919,325 @@ void CL_PlayDemo_f (void)
 	if (neg)
 		cls.forcetrack = -cls.forcetrack;
 
+	demo_in.start = DemoStream_Tell (cls.demofile);
+	demo_in.keyend = 0;
+	CL_DemoLoadIndex ();
+	DemoStream_Seek (cls.demofile, demo_in.start);
+
 	cls.demoplayback = true;
 	cls.demopaused = false;
+	cls.demoseeking = false;
+	cls.demolevel = 0;
+	cls.demoplayer = -1;
 	cls.state = ca_connected;
 
 // get rid of the menu and/or console
 	key_dest = key_game;
 }
 
+/*
+====================
+CL_DemoSeek_f
+
+demo_seek <time>, or demo_seek +/-<seconds> relative to the current time.
+Restores the nearest keyframe before that time, if there's one worth using,
+then reads through the demo as fast as possible until it gets there.
+====================
+*/
+void CL_DemoSeek_f (void)
+{
+	const char	*s;
+	double		target;
+	int			i, level;
+	demokey_t	*k;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (Cmd_Argc() != 2)
+	{
+		Con_Printf ("demo_seek <time> : skip to a time in the current map\n");
+		Con_Printf ("demo_seek +/-<seconds> : skip relative to now\n");
+		return;
+	}
+	if (!cls.demoplayback)
+	{
+		Con_Printf ("Not playing a demo.\n");
+		return;
+	}
+	if (cls.timedemo)
+	{
+		Con_Printf ("Can't seek during a timedemo.\n");
+		return;
+	}
+
+	s = Cmd_Argv(1);
+	if (*s == '+' || *s == '-')
+		target = cl.mtime[0] + atof (s);
+	else
+		target = atof (s);
+	target = q_max (target, 0);
+	level = q_max (cls.demolevel, 1);
+
+	k = NULL;
+	for (i = 0; i < demo_numkeys; i++)
+	{
+		if (demo_keys[i].level == level && demo_keys[i].time <= target)
+			k = &demo_keys[i];
+	}
+
+	if (k && (target < cl.mtime[0] || k->time > cl.mtime[0] || cls.signon != SIGNONS))
+	{	// restart from the keyframe
+		S_StopAllSounds (true);
+		cls.signon = 0;
+		cls.demolevel = k->level - 1;	// its serverinfo brings this back up
+		DemoStream_Seek (cls.demofile, k->keyofs);
+		demo_in.keyend = k->keyofs + k->keylen;
+		demo_in.resumeofs = k->streamofs;
+	}
+	else if (target < cl.mtime[0])
+	{	// no keyframe to go back to, so replay from the beginning
+		S_StopAllSounds (true);
+		cls.signon = 0;
+		cls.demolevel = 0;
+		DemoStream_Seek (cls.demofile, demo_in.start);
+		demo_in.keyend = 0;
+	}
+
+	cls.demoseeking = true;
+	demo_seektime = target;
+	demo_seeklevel = level;
+}
+
+/*
+====================
+CL_DemoView_f
+
+demo_view [player], picks whose view to follow in a server demo, by name or
+by number. With no argument it moves on to the next player.
+====================
+*/
+void CL_DemoView_f (void)
+{
+	int i, slot;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (!cls.demoplayback || !cl.scores)
+	{
+		Con_Printf ("Not playing a demo.\n");
+		return;
+	}
+
+	if (Cmd_Argc() >= 2)
+	{
+		for (slot = 0; slot < cl.maxclients; slot++)
+			if (*cl.scores[slot].name && !q_strcasecmp (cl.scores[slot].name, Cmd_Argv(1)))
+				break;
+		if (slot == cl.maxclients)
+			slot = atoi (Cmd_Argv(1)) - 1;
+		if (slot < 0 || slot >= cl.maxclients)
+		{
+			Con_Printf ("No player %s\n", Cmd_Argv(1));
+			return;
+		}
+	}
+	else
+	{
+		slot = cls.demoplayer;
+		for (i = 0; i < cl.maxclients; i++)
+		{
+			slot = (slot + 1) % cl.maxclients;
+			if (slot >= 0 && *cl.scores[slot].name)
+				break;
+		}
+		if (slot < 0)
+			return;
+	}
+
+	cls.demoplayer = slot;
+	Con_Printf ("Following %s\n", *cl.scores[slot].name ? cl.scores[slot].name : va("player %i", slot+1));
+}
+
+/*
+==============================================================================
+
+TIMEDEMO STATISTICS
+
+Every frame's duration is kept so the stutters show up, not just the average.
+
+==============================================================================
+*/
+
+cvar_t	timedemo_csv = {"timedemo_csv", "0", CVAR_NONE};		// write <gamedir>/timedemo_<demo>.csv
+cvar_t	timedemo_stutter = {"timedemo_stutter", "2", CVAR_NONE};	// frames this many times the median are stutters
+cvar_t	timedemo_warmup = {"timedemo_warmup", "1", CVAR_NONE};	// runs of each demo that timedemo_batch discards
+
+typedef struct
+{
+	float	fps;
+	float	min, p50, p95, p99, max;	// ms
+	int		stutters;
+} tdresult_t;
+
+static float	*td_frames;		// ms
+static float	*td_zones;		// [PROF_NUMZONES] per frame, ms
+static int		td_numframes, td_maxframes;
+static qboolean	td_havezones;	// the frame profiler was on for the whole run
+static double	td_lastframetime;
+static char		td_demoname[MAX_QPATH];
+
+#define TD_MAXBATCHDEMOS	32
+static struct
+{
+	qboolean	active;
+	int			numdemos;
+	int			runs;		// counted runs of each demo
+	int			warmup;		// discarded runs before those
+	int			demo, run;	// next one to play
+	char		demos[TD_MAXBATCHDEMOS][MAX_QPATH];
+	tdresult_t	*results;	// [numdemos][runs]
+} td_batch;
+
+/*
+====================
+CL_TimeDemoFrame
+
+Called once per frame of the timedemo, notes how long the last one took
+====================
+*/
+static void CL_TimeDemoFrame (void)
+{
+	float zones[PROF_NUMZONES];
+	int i;
+
+	if (host_framecount <= cls.td_startframe + 1)
+	{
+		td_lastframetime = realtime;
+		td_numframes = 0;
+		td_havezones = true;
+		return;
+	}
+
+	if (td_numframes == td_maxframes)
+	{
+		td_maxframes = td_maxframes ? td_maxframes * 2 : 4096;
+		td_frames = (float *) realloc (td_frames, sizeof(*td_frames) * td_maxframes);
+		td_zones = (float *) realloc (td_zones, sizeof(*td_zones) * td_maxframes * PROF_NUMZONES);
+		if (!td_frames || !td_zones)
+			Sys_Error ("CL_TimeDemoFrame: out of memory");
+	}
+
+	td_frames[td_numframes] = (realtime - td_lastframetime) * 1000;
+	td_lastframetime = realtime;
+	if (td_havezones && Prof_LastFrame (zones))
+	{
+		for (i = 0; i < PROF_NUMZONES; i++)
+			td_zones[td_numframes*PROF_NUMZONES + i] = zones[i] * 1000;
+	}
+	else
+		td_havezones = false;
+	td_numframes++;
+}
+
+static int CL_TimeDemoCompare (const void *a, const void *b)
+{
+	float fa = *(const float *)a, fb = *(const float *)b;
+	return (fa > fb) - (fa < fb);
+}
+
+/*
+====================
+CL_TimeDemoCSV
+====================
+*/
+static void CL_TimeDemoCSV (void)
+{
+	char	name[MAX_OSPATH];
+	FILE	*f;
+	int		i, z;
+
+	q_snprintf (name, sizeof(name), "%s/timedemo_%s.csv", com_gamedir, td_demoname);
+	COM_CreatePath (name);
+	f = fopen (name, "w");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open file %s.\n", name);
+		return;
+	}
+
+	fprintf (f, "frame,ms");
+	if (td_havezones)
+		for (z = 0; z < PROF_NUMZONES; z++)
+			fprintf (f, ",%s", Prof_ZoneName (z));
+	fprintf (f, "\n");
+	for (i = 0; i < td_numframes; i++)
+	{
+		fprintf (f, "%i,%.3f", i, td_frames[i]);
+		if (td_havezones)
+			for (z = 0; z < PROF_NUMZONES; z++)
+				fprintf (f, ",%.3f", td_zones[i*PROF_NUMZONES + z]);
+		fprintf (f, "\n");
+	}
+	fclose (f);
+	Con_Printf ("Wrote %s\n", name);
+}
+
+/*
+====================
+CL_TimeDemoBatchNext
+
+Starts the next run, or prints the summary once they're all done
+====================
+*/
+static void CL_TimeDemoBatchNext (void)
+{
+	int d, r, n, stutters;
+	float fps, minfps, maxfps, p50, p99, worst;
+	tdresult_t *res;
+
+	if (td_batch.demo < td_batch.numdemos)
+	{
+		Cbuf_AddText (va("timedemo \"%s\"\n", td_batch.demos[td_batch.demo]));
+		return;
+	}
+
+	Con_Printf ("\ntimedemo_batch: %i runs each, %i warmup\n", td_batch.runs, td_batch.warmup);
+	Con_Printf ("%-16s %7s %7s %7s %7s %7s %7s %5s\n", "demo", "fps", "min", "max", "p50 ms", "p99 ms", "max ms", "stut");
+	for (d = 0; d < td_batch.numdemos; d++)
+	{
+		fps = p50 = p99 = worst = 0;
+		minfps = 1e9;
+		maxfps = 0;
+		stutters = 0;
+		for (r = 0, n = 0; r < td_batch.runs; r++)
+		{
+			res = &td_batch.results[d*td_batch.runs + r];
+			if (!res->fps)
+				continue;	// didn't finish
+			n++;
+			fps += res->fps;
+			minfps = q_min (minfps, res->fps);
+			maxfps = q_max (maxfps, res->fps);
+			p50 += res->p50;
+			p99 += res->p99;
+			worst = q_max (worst, res->max);
+			stutters += res->stutters;
+		}
+		if (!n)
+		{
+			Con_Printf ("%-16s no results\n", td_batch.demos[d]);
+			continue;
+		}
+		Con_Printf ("%-16s %7.1f %7.1f %7.1f %7.2f %7.2f %7.2f %5i\n", td_batch.demos[d],
+					fps / n, minfps, maxfps, p50 / n, p99 / n, worst, stutters);
+	}
+
+	free (td_batch.results);
+	memset (&td_batch, 0, sizeof(td_batch));
+}
+
 /*
 ====================
 CL_FinishTimeDemo
@@ -646,6 +1248,9 @@ static void CL_FinishTimeDemo (void)
 {
 	int	frames;
 	float	time;
+	tdresult_t	res;
+	float	*sorted;
+	int		i;
 
 	cls.timedemo = false;
 
@@ -655,6 +1260,80 @@ static void CL_FinishTimeDemo (void)
 	if (!time)
 		time = 1;
 	Con_Printf ("%i frames %5.1f seconds %5.1f fps\n", frames, time, frames/time);
+
+	memset (&res, 0, sizeof(res));
+	if (td_numframes && (sorted = (float *) malloc (sizeof(*sorted) * td_numframes)))
+	{
+		memcpy (sorted, td_frames, sizeof(*sorted) * td_numframes);
+		qsort (sorted, td_numframes, sizeof(*sorted), CL_TimeDemoCompare);
+		res.fps = frames/time;
+		res.min = sorted[0];
+		res.p50 = sorted[(td_numframes-1) * 50 / 100];
+		res.p95 = sorted[(td_numframes-1) * 95 / 100];
+		res.p99 = sorted[(td_numframes-1) * 99 / 100];
+		res.max = sorted[td_numframes-1];
+		for (i = 0; i < td_numframes; i++)
+			if (td_frames[i] > res.p50 * timedemo_stutter.value)
+				res.stutters++;
+		free (sorted);
+
+		Con_Printf ("frame ms: min %.2f p50 %.2f p95 %.2f p99 %.2f max %.2f, %i stutters\n",
+					res.min, res.p50, res.p95, res.p99, res.max, res.stutters);
+		if (timedemo_csv.value)
+			CL_TimeDemoCSV ();
+	}
+
+	if (td_batch.active && td_batch.demo < td_batch.numdemos)
+	{
+		if (td_batch.run >= td_batch.warmup)
+			td_batch.results[td_batch.demo*td_batch.runs + td_batch.run - td_batch.warmup] = res;
+		if (++td_batch.run == td_batch.warmup + td_batch.runs)
+		{
+			td_batch.run = 0;
+			td_batch.demo++;
+		}
+		CL_TimeDemoBatchNext ();
+	}
+}
+
+/*
+====================
+CL_TimeDemoBatch_f
+
+timedemo_batch <runs> <demo> [demo...], or timedemo_batch stop
+====================
+*/
+void CL_TimeDemoBatch_f (void)
+{
+	int i;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (Cmd_Argc() == 2 && !strcmp (Cmd_Argv(1), "stop"))
+	{
+		free (td_batch.results);
+		memset (&td_batch, 0, sizeof(td_batch));
+		return;
+	}
+	if (Cmd_Argc() < 3 || atoi (Cmd_Argv(1)) < 1)
+	{
+		Con_Printf ("timedemo_batch <runs> <demo> [demo...] : times each demo, see timedemo_warmup\n");
+		return;
+	}
+
+	free (td_batch.results);
+	memset (&td_batch, 0, sizeof(td_batch));
+	td_batch.runs = atoi (Cmd_Argv(1));
+	td_batch.warmup = q_max (0, (int)timedemo_warmup.value);
+	for (i = 2; i < Cmd_Argc() && td_batch.numdemos < TD_MAXBATCHDEMOS; i++)
+		q_strlcpy (td_batch.demos[td_batch.numdemos++], Cmd_Argv(i), sizeof(td_batch.demos[0]));
+	td_batch.results = (tdresult_t *) calloc (td_batch.numdemos * td_batch.runs, sizeof(*td_batch.results));
+	if (!td_batch.results)
+		return;
+	td_batch.active = true;
+	cls.demonum = -1;	// stop demo loop
+	CL_TimeDemoBatchNext ();
 }
 
 /*
@@ -677,7 +1356,16 @@ void CL_TimeDemo_f (void)
 
 	CL_PlayDemo_f ();
 	if (!cls.demofile)
+	{
+		if (td_batch.active && td_batch.demo < td_batch.numdemos)
+		{	// CL_FinishTimeDemo will never run for this one, so move on without it
+			Con_Printf ("timedemo_batch: skipping %s\n", td_batch.demos[td_batch.demo]);
+			td_batch.run = 0;
+			td_batch.demo++;
+			CL_TimeDemoBatchNext ();
+		}
 		return;
+	}
 
 // cls.td_starttime will be grabbed at the second frame of the demo, so
 // all the loading time doesn't get counted
@@ -685,5 +1373,7 @@ void CL_TimeDemo_f (void)
 	cls.timedemo = true;
 	cls.td_startframe = host_framecount;
 	cls.td_lastframe = -1;	// get a new message this frame
+	COM_FileBase (Cmd_Argv(1), td_demoname, sizeof(td_demoname));
+	td_numframes = 0;
 }
 
@@ -37,6 +37,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 cvar_t	cl_name = {"name", "player", CVAR_ARCHIVE | CVAR_USERINFO};
 cvar_t	cl_topcolor = {"topcolor", "", CVAR_ARCHIVE | CVAR_USERINFO};
 cvar_t	cl_bottomcolor = {"bottomcolor", "", CVAR_ARCHIVE | CVAR_USERINFO};
+cvar_t	cl_rate = {"rate", "0", CVAR_ARCHIVE | CVAR_USERINFO};	//bytes/sec we'd like the server to limit itself to, 0 for no preference
 
 cvar_t	cl_shownet = {"cl_shownet","0",CVAR_NONE};	// can be 0, 1, or 2
 cvar_t	cl_nolerp = {"cl_nolerp","0",CVAR_NONE};
@@ -437,6 +438,179 @@ void CL_DecayLights (void)
 }
 
 
+/*
+===============================================================================
+
+JITTER BUFFER
+
+Instead of always displaying between the last two messages, cl.time is kept a
+little behind the newest snapshot, by the average snapshot interval plus a
+multiple of the measured arrival jitter. Each entity keeps a short history of
+updates, so late or lost packets are simply interpolated across.
+
+===============================================================================
+*/
+
+cvar_t	cl_lerpbuffer = {"cl_lerpbuffer", "1", CVAR_ARCHIVE};
+cvar_t	cl_lerpbuffer_jitterscale = {"cl_lerpbuffer_jitterscale", "2", CVAR_ARCHIVE};	//playout delay in multiples of the measured jitter, on top of the snapshot interval
+cvar_t	cl_lerpbuffer_maxdelay = {"cl_lerpbuffer_maxdelay", "0.25", CVAR_ARCHIVE};
+cvar_t	cl_lerpbuffer_maxextrapolate = {"cl_lerpbuffer_maxextrapolate", "0.05", CVAR_ARCHIVE};
+cvar_t	cl_lerpbuffer_show = {"cl_lerpbuffer_show", "0", CVAR_NONE};
+
+/*
+===============
+CL_NoteSnapshot
+
+Called whenever the server's time advances, to measure the snapshot rate and
+how unevenly the snapshots arrive.
+===============
+*/
+void CL_NoteSnapshot (double servertime)
+{
+	double	interval, deviation;
+
+	if (cl.snaparrival && servertime > cl.snaptime)
+	{
+		interval = servertime - cl.snaptime;
+		if (interval < 0.25)
+		{	//bigger gaps are pauses or level changes, not network conditions
+			deviation = fabs((realtime - cl.snaparrival) - interval);
+			if (!cl.snapinterval)
+				cl.snapinterval = interval;
+			else
+				cl.snapinterval += (q_min(interval, 0.1) - cl.snapinterval) / 16;
+			cl.snapjitter += (q_min(deviation, 0.25) - cl.snapjitter) / 16;
+		}
+	}
+	if (cl.lerpbuffered && servertime < cl.time)
+		cl.latesnapshots++;
+	cl.numsnapshots++;
+	cl.snaptime = servertime;
+	cl.snaparrival = realtime;
+}
+
+/*
+===============
+CL_PushEntityHistory
+
+Records the entity's latest origin+angles against the current message time.
+===============
+*/
+void CL_PushEntityHistory (entity_t *ent, qboolean reset)
+{
+	unsigned int slot;
+
+	if (reset)
+		ent->historycount = 0;
+	if (ent->historycount && ent->history[(ent->historycount-1)&(ENT_HISTORY-1)].time == cl.mtime[0])
+		slot = (ent->historycount-1)&(ENT_HISTORY-1);	//fragmented update, replace it
+	else
+		slot = (ent->historycount++)&(ENT_HISTORY-1);
+	ent->history[slot].time = cl.mtime[0];
+	VectorCopy (ent->msg_origins[0], ent->history[slot].origin);
+	VectorCopy (ent->msg_angles[0], ent->history[slot].angles);
+}
+
+/*
+===============
+CL_LerpHistory
+
+Finds the entity's position at cl.time from its history.
+Returns true if it teleported between the two updates used.
+===============
+*/
+static qboolean CL_LerpHistory (entity_t *ent, vec3_t org, vec3_t ang)
+{
+	unsigned int	count, i;
+	int				j;
+	float			f, d;
+	double			dt;
+	qboolean		teleported = false;
+	const vec_t		*from, *fromang, *to, *toang;
+	double			fromtime, totime;
+
+	count = q_min(ent->historycount, ENT_HISTORY);
+	i = ent->historycount-1;
+	to = ent->history[i&(ENT_HISTORY-1)].origin;
+	toang = ent->history[i&(ENT_HISTORY-1)].angles;
+	totime = ent->history[i&(ENT_HISTORY-1)].time;
+
+	if (count < 2 || cl.time >= totime)
+	{	//buffer ran dry, extrapolate a little from the last two updates then stop.
+		VectorCopy (to, org);
+		VectorCopy (toang, ang);
+		if (count < 2)
+			return false;
+		from = ent->history[(i-1)&(ENT_HISTORY-1)].origin;
+		fromtime = ent->history[(i-1)&(ENT_HISTORY-1)].time;
+		if (totime - fromtime <= 0 || totime - fromtime > 0.2)
+			return false;
+		dt = q_min(cl.time - totime, cl_lerpbuffer_maxextrapolate.value);
+		for (j=0 ; j<3 ; j++)
+		{
+			d = to[j] - from[j];
+			if (d > 100 || d < -100)
+				return false;
+			org[j] += d * dt / (totime - fromtime);
+		}
+		return false;
+	}
+
+	//walk back until we find the update at or before cl.time
+	for (;;)
+	{
+		if (!--count)
+		{	//older than anything we have
+			VectorCopy (to, org);
+			VectorCopy (toang, ang);
+			return false;
+		}
+		i--;
+		from = ent->history[i&(ENT_HISTORY-1)].origin;
+		fromang = ent->history[i&(ENT_HISTORY-1)].angles;
+		fromtime = ent->history[i&(ENT_HISTORY-1)].time;
+		if (fromtime <= cl.time)
+			break;
+		to = from;
+		toang = fromang;
+		totime = fromtime;
+	}
+
+	f = (totime > fromtime)?(cl.time - fromtime) / (totime - fromtime):1;
+	for (j=0 ; j<3 ; j++)
+	{
+		d = to[j] - from[j];
+		if (d > 100 || d < -100)
+			teleported = true;
+	}
+	if (teleported)
+		f = 1;
+	for (j=0 ; j<3 ; j++)
+	{
+		org[j] = from[j] + f*(to[j] - from[j]);
+
+		d = toang[j] - fromang[j];
+		if (d > 180)
+			d -= 360;
+		else if (d < -180)
+			d += 360;
+		ang[j] = fromang[j] + f*d;
+	}
+	return teleported;
+}
+
+/*
+===============
+CL_LerpBufferStats_f
+===============
+*/
+static void CL_LerpBufferStats_f (void)
+{
+	Con_Printf ("snapshot interval %.1fms, jitter %.1fms\n", cl.snapinterval*1000, cl.snapjitter*1000);
+	Con_Printf ("playout delay %.1fms, buffered %.1fms%s\n", cl.lerpdelay*1000, (cl.mtime[0]-cl.time)*1000, cl.lerpbuffered?"":" (inactive)");
+	Con_Printf ("%i late of %i snapshots\n", cl.latesnapshots, cl.numsnapshots);
+}
+
 /*
 ===============
 CL_LerpPoint
@@ -448,9 +622,34 @@ should be put at.
 float	CL_LerpPoint (void)
 {
 	float	f, frac;
+	double	target, drift;
 
 	f = cl.mtime[0] - cl.mtime[1];
 
+	cl.lerpbuffered = false;
+	if (cl_lerpbuffer.value && cl.snapinterval && !cls.demoplayback && !cls.timedemo && !(sv.active && !host_netinterval) && !cl_nolerp.value)
+	{
+		cl.lerpdelay = cl.snapinterval + cl.snapjitter*cl_lerpbuffer_jitterscale.value;
+		if (cl.lerpdelay > cl_lerpbuffer_maxdelay.value)
+			cl.lerpdelay = q_max(cl_lerpbuffer_maxdelay.value, cl.snapinterval);
+
+		//steer our clock towards the playout point, slewing rather than snapping unless we're way off.
+		target = cl.mtime[0] - cl.lerpdelay;
+		drift = target - cl.time;
+		if (drift > 0.25 || drift < -0.25)
+			cl.time = target;
+		else
+			cl.time += drift * q_min(1, host_frametime*2);
+		if (cl.time > cl.mtime[0] + cl_lerpbuffer_maxextrapolate.value)
+			cl.time = cl.mtime[0] + cl_lerpbuffer_maxextrapolate.value;
+		cl.lerpbuffered = true;
+
+		if (f <= 0)
+			return 1;
+		frac = (cl.time - cl.mtime[1]) / f;
+		return q_max(0, q_min(1, frac));
+	}
+
 	if (!f || cls.timedemo || (sv.active && !host_netinterval))
 	{
 		cl.time = cl.mtime[0];
@@ -493,6 +692,8 @@ static qboolean CL_LerpEntity(entity_t *ent, vec3_t org, vec3_t ang, float frac)
 	vec3_t delta;
 	qboolean teleported = false;
 	//figure out the pos+angles of the parent
+	if (cl.lerpbuffered && ent->historycount && !(r_lerpmove.value && (ent->lerpflags & LERP_MOVESTEP)))
+		return CL_LerpHistory (ent, org, ang);
 	if (ent->forcelink)
 	{	// the entity was not updated in the last message
 		// so move to the final spot
@@ -606,6 +807,251 @@ static qboolean CL_AttachEntity(entity_t *ent, float frac)
 	}
 }
 
+/*
+===============================================================================
+
+PREDICTION
+
+With predinfo the server acks our input sequences and tells us which movetype
+our player uses, so we can run the same PM_PlayerMove as the server from the
+acked state plus our unacked commands, instead of waiting a round trip to see
+ourselves move. Errors are measured whenever a new ack arrives and are blended
+out over a few frames.
+
+===============================================================================
+*/
+
+cvar_t	cl_prediction = {"cl_prediction", "1", CVAR_ARCHIVE};
+
+static trace_t CL_PM_ClipToModel (qmodel_t *model, vec3_t entorigin, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end)
+{
+	trace_t		trace;
+	hull_t		*hull;
+	vec3_t		size, offset, start_l, end_l;
+
+	VectorSubtract (maxs, mins, size);
+	if (size[0] < 3)
+		hull = &model->hulls[0];
+	else if (size[0] <= 32)
+		hull = &model->hulls[1];
+	else
+		hull = &model->hulls[2];
+
+	VectorSubtract (hull->clip_mins, mins, offset);
+	VectorAdd (offset, entorigin, offset);
+	VectorSubtract (start, offset, start_l);
+	VectorSubtract (end, offset, end_l);
+
+	memset (&trace, 0, sizeof(trace_t));
+	trace.fraction = 1;
+	trace.allsolid = true;
+	VectorCopy (end_l, trace.endpos);
+	SV_RecursiveHullCheck (hull, start_l, end_l, &trace, CONTENTMASK_ANYSOLID);
+	VectorAdd (trace.endpos, offset, trace.endpos);
+	return trace;
+}
+
+/*
+===============
+CL_PM_Trace
+
+Clips against the world and any brush entities in the current snapshot.
+Other players and monsters are ignored, like the server's nomonsters traces.
+===============
+*/
+static trace_t CL_PM_Trace (pmove_t *pm, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end)
+{
+	trace_t		total, trace;
+	vec3_t		boxmins, boxmaxs;
+	entity_t	*ent;
+	int			i, j;
+
+	total = CL_PM_ClipToModel (cl.worldmodel, vec3_origin, start, mins, maxs, end);
+
+	for (j = 0; j < 3; j++)
+	{
+		boxmins[j] = q_min(start[j], end[j]) + mins[j] - 1;
+		boxmaxs[j] = q_max(start[j], end[j]) + maxs[j] + 1;
+	}
+
+	for (i = 1, ent = cl.entities+1; i < cl.num_entities; i++, ent++)
+	{
+		if (!ent->model || ent->model->type != mod_brush || *ent->model->name != '*')
+			continue;
+		if (ent->msgtime != cl.mtime[0] || i == cl.viewentity)
+			continue;
+		for (j = 0; j < 3; j++)
+		{
+			if (ent->msg_origins[0][j] + ent->model->mins[j] > boxmaxs[j] ||
+				ent->msg_origins[0][j] + ent->model->maxs[j] < boxmins[j])
+				break;
+		}
+		if (j < 3)
+			continue;
+
+		trace = CL_PM_ClipToModel (ent->model, ent->msg_origins[0], start, mins, maxs, end);
+		if (trace.allsolid || trace.startsolid || trace.fraction < total.fraction)
+		{
+			if (total.startsolid)
+			{
+				total = trace;
+				total.startsolid = true;
+			}
+			else
+				total = trace;
+		}
+		else if (trace.startsolid)
+			total.startsolid = true;
+	}
+	return total;
+}
+
+static int CL_PM_PointContents (pmove_t *pm, vec3_t p)
+{
+	int c = SV_HullPointContents (&cl.worldmodel->hulls[0], 0, p);
+	if (c <= CONTENTS_CURRENT_0 && c >= CONTENTS_CURRENT_DOWN)
+		c = CONTENTS_WATER;
+	return c;
+}
+
+/*
+===============
+CL_PredictMove
+
+Sets cl.predorigin from the last acked player state plus every command the
+server hasn't applied yet.
+===============
+*/
+static void CL_PredictMove (float frametime)
+{
+	entity_t	*ent;
+	movevars_t	vars;
+	pmove_t		pm;
+	usercmd_t	*cmd;
+	int			seq, slot;
+	float		err;
+	vec3_t		delta;
+
+	cl.predicted = false;
+	if (!cl_prediction.value || cls.demoplayback || cls.signon != SIGNONS || cl.intermission || !cl.worldmodel)
+		return;
+	if (!(cl.protocol_pext2 & PEXT2_PREDINFO) || cl.qcvm.extfuncs.CSQC_UpdateView)
+		return;	//csqc does its own prediction, if any
+	if (cl.viewentity <= 0 || cl.viewentity >= cl.num_entities)
+		return;
+	ent = &cl.entities[cl.viewentity];
+	if (ent->msgtime != cl.mtime[0])
+		return;
+	switch (ent->netstate.pmovetype)
+	{
+	case MOVETYPE_WALK:
+	case MOVETYPE_FLY:
+	case MOVETYPE_NOCLIP:
+		break;
+	default:
+		return;	//the server doesn't think we can predict this.
+	}
+
+	vars.gravity = cl.statsf[STAT_MOVEVARS_GRAVITY];
+	vars.entgravity = cl.statsf[STAT_MOVEVARS_ENTGRAVITY];
+	vars.friction = cl.statsf[STAT_MOVEVARS_FRICTION];
+	vars.edgefriction = cl.statsf[STAT_MOVEVARS_EDGEFRICTION];
+	vars.stopspeed = cl.statsf[STAT_MOVEVARS_STOPSPEED];
+	vars.maxspeed = cl.statsf[STAT_MOVEVARS_MAXSPEED];
+	vars.accelerate = cl.statsf[STAT_MOVEVARS_ACCELERATE];
+	vars.jumpvelocity = cl.statsf[STAT_MOVEVARS_JUMPVELOCITY];
+	vars.stepheight = cl.statsf[STAT_MOVEVARS_STEPHEIGHT];
+	if (!vars.maxspeed)
+		return;	//older server that doesn't send movevars
+
+	memset (&pm, 0, sizeof(pm));
+	pm.vars = &vars;
+	pm.movetype = ent->netstate.pmovetype;
+	pm.viewheight = cl.stats[STAT_VIEWHEIGHT];
+	pm.dead = cl.stats[STAT_HEALTH] <= 0;
+	pm.altnoclip = true;
+	pm.mins[0] = pm.mins[1] = -16;
+	pm.mins[2] = -24;
+	pm.maxs[0] = pm.maxs[1] = 16;
+	pm.maxs[2] = 32;
+	VectorCopy (ent->msg_origins[0], pm.origin);
+	pm.velocity[0] = ent->netstate.velocity[0]*(1/8.0);
+	pm.velocity[1] = ent->netstate.velocity[1]*(1/8.0);
+	pm.velocity[2] = ent->netstate.velocity[2]*(1/8.0);
+	pm.onground = (ent->netstate.eflags & EFLAGS_ONGROUND)?true:false;
+	pm.trace = CL_PM_Trace;
+	pm.pointcontents = CL_PM_PointContents;
+
+	//measure how far off we were for the command the server just acked
+	seq = cl.ackedmovemessages;
+	if (seq != cl.predackseq)
+	{
+		slot = seq & MOVECMDS_MASK;
+		cl.predackseq = seq;
+		if (cl.predseq[slot] == seq)
+		{
+			VectorSubtract (cl.predorigins[slot], pm.origin, delta);
+			err = VectorLength (delta);
+			cl.prederror_last = err;
+			if (err > cl.prederror_max)
+				cl.prederror_max = err;
+			cl.prederror_total += err;
+			cl.prederror_count++;
+			if (err < 64)
+				VectorAdd (cl.predoffset, delta, cl.predoffset);
+			else
+				VectorCopy (vec3_origin, cl.predoffset);	//teleported or something, don't smooth
+		}
+	}
+	pm.jumpreleased = !(cl.movecmds[seq & MOVECMDS_MASK].buttons & 2);
+
+	if (cl.movemessages - seq >= (int)countof(cl.movecmds))
+		seq = cl.movemessages - countof(cl.movecmds) + 1;
+	for (seq = seq + 1; seq < cl.movemessages; seq++)
+	{
+		cmd = &cl.movecmds[seq & MOVECMDS_MASK];
+		if (cmd->sequence != seq)
+			continue;
+		pm.cmd = *cmd;
+		pm.frametime = q_min(cmd->seconds, 0.1);
+		VectorCopy (cmd->viewangles, pm.v_angle);
+		pm.angles[PITCH] = -pm.v_angle[PITCH]/3;
+		pm.angles[YAW] = pm.v_angle[YAW];
+		PM_PlayerMove (&pm);
+
+		slot = seq & MOVECMDS_MASK;
+		cl.predseq[slot] = seq;
+		VectorCopy (pm.origin, cl.predorigins[slot]);
+	}
+
+	//decay any correction over about a tenth of a second
+	VectorScale (cl.predoffset, q_max(0, 1 - frametime*10), cl.predoffset);
+
+	VectorAdd (pm.origin, cl.predoffset, cl.predorigin);
+	VectorCopy (pm.velocity, cl.velocity);
+	cl.onground = pm.onground;
+	cl.predicted = true;
+}
+
+/*
+===============
+CL_PredictionStats_f
+===============
+*/
+static void CL_PredictionStats_f (void)
+{
+	if (!cl.predicted)
+		Con_Printf ("prediction is not active\n");
+	Con_Printf ("prediction error: last %.2f, avg %.2f, max %.2f over %i acks\n",
+		cl.prederror_last, cl.prederror_count?cl.prederror_total/cl.prederror_count:0, cl.prederror_max, cl.prederror_count);
+	if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset"))
+	{
+		cl.prederror_last = cl.prederror_max = 0;
+		cl.prederror_total = 0;
+		cl.prederror_count = 0;
+	}
+}
+
 /*
 ===============
 CL_RelinkEntities
@@ -645,6 +1091,8 @@ void CL_RelinkEntities (void)
 		cl.velocity[i] = cl.mvelocity[1][i] +
 			frac * (cl.mvelocity[0][i] - cl.mvelocity[1][i]);
 
+	CL_PredictMove (frametime);
+
 	if (cls.demoplayback)
 	{
 	// interpolate the angles
@@ -687,6 +1135,8 @@ void CL_RelinkEntities (void)
 
 		if (CL_LerpEntity(ent, ent->origin, ent->angles, frac))
 			ent->lerpflags |= LERP_RESETMOVE;
+		if (i == cl.viewentity && cl.predicted)
+			VectorCopy (cl.predorigin, ent->origin);
 
 		if (ent->netstate.tagentity)
 		if (!CL_AttachEntity(ent, frac))
@@ -1128,7 +1578,9 @@ int CL_ReadFromServer (void)
 	if (cl_shownet.value)
 		Con_Printf ("\n");
 
+	PROF_BEGIN (PROF_CL_RELINKENTITIES);
 	CL_RelinkEntities ();
+	PROF_END (PROF_CL_RELINKENTITIES);
 	CL_UpdateTEnts ();
 
 //johnfitz -- devstats
@@ -1485,6 +1937,9 @@ static void SV_DecodeUserInfo(client_t *client)
 	client->edict->v.team = bot+1;
 	client->colors = (top<<4) | bot;
 
+	Info_GetKey(client->userinfo, "rate", tmp, sizeof(tmp));
+	client->rate = q_max(0, atoi(tmp));
+
 	//pick out a name and try to clean it up a little.
 	Info_GetKey(client->userinfo, "name", tmp, sizeof(tmp));
 	if (!*tmp)
@@ -1596,6 +2051,7 @@ void CL_Init (void)
 	Cvar_RegisterAlias    (&cl_name, "_cl_name");	//spike -- for compat with configs now that 'name' is a cvar in its own right.
 	Cvar_RegisterVariable (&cl_topcolor);
 	Cvar_RegisterVariable (&cl_bottomcolor);
+	Cvar_RegisterVariable (&cl_rate);
 	Cmd_AddCommand ("_cl_color", CL_LegacyColor_f);	//for loading vanilla configs (we have separate qw-style topcolor/bottomcolor userinfo cvars instead)
 	Cvar_RegisterVariable (&cl_upspeed);
 	Cvar_RegisterVariable (&cl_forwardspeed);
@@ -1624,6 +2080,14 @@ void CL_Init (void)
 	Cvar_RegisterVariable (&cl_minpitch); //johnfitz -- variable pitch clamping
 	Cvar_RegisterVariable (&cl_recordingdemo); //spike -- for mod hacks. combine with cvar_string or something
 	Cvar_RegisterVariable (&cl_demoreel);
+	Cvar_RegisterVariable (&cl_lerpbuffer);
+	Cvar_RegisterVariable (&cl_lerpbuffer_jitterscale);
+	Cvar_RegisterVariable (&cl_lerpbuffer_maxdelay);
+	Cvar_RegisterVariable (&cl_lerpbuffer_maxextrapolate);
+	Cvar_RegisterVariable (&cl_lerpbuffer_show);
+	Cmd_AddCommand ("cl_lerpbufferstats", CL_LerpBufferStats_f);
+	Cvar_RegisterVariable (&cl_prediction);
+	Cmd_AddCommand ("cl_predictionstats", CL_PredictionStats_f);
 
 	Cmd_AddCommand ("entities", CL_PrintEntities_f);
 	Cmd_AddCommand ("disconnect", CL_Disconnect_f);
@@ -1631,6 +2095,14 @@ void CL_Init (void)
 	Cmd_AddCommand ("stop", CL_Stop_f);
 	Cmd_AddCommand ("playdemo", CL_PlayDemo_f);
 	Cmd_AddCommand ("timedemo", CL_TimeDemo_f);
+	Cmd_AddCommand ("timedemo_batch", CL_TimeDemoBatch_f);
+	Cmd_AddCommand ("demo_seek", CL_DemoSeek_f);
+	Cmd_AddCommand ("demo_view", CL_DemoView_f);
+	Cvar_RegisterVariable (&demo_keyframeinterval);
+	Cvar_RegisterVariable (&demo_compress);
+	Cvar_RegisterVariable (&timedemo_csv);
+	Cvar_RegisterVariable (&timedemo_stutter);
+	Cvar_RegisterVariable (&timedemo_warmup);
 
 	Cmd_AddCommand ("tracepos", CL_Tracepos_f); //johnfitz
 	Cmd_AddCommand ("viewpos", CL_Viewpos_f); //johnfitz
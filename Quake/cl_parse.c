@@ -159,7 +159,7 @@ const char *svc_strings[128] =
 	"117", // 117
 	"118", // 118
 	"119", // 119
-	"120", // 120
+	"120 svc_mvdplayer_qss", // 120
 	"121", // 121
 	"122", // 122
 	"123", // 123
@@ -647,6 +647,7 @@ static void CL_EntitiesDeltaed(void)
 			VectorCopy (ent->msg_angles[0], ent->angles);
 			ent->forcelink = true;
 		}
+		CL_PushEntityHistory (ent, forcelink);
 	}
 }
 
@@ -677,6 +678,7 @@ static void CLFTE_ParseEntitiesUpdate(void)
 	{	//don't mess up lerps if the server is splitting entities into multiple packets.
 		cl.mtime[1] = cl.mtime[0];
 		cl.mtime[0] = newtime;
+		CL_NoteSnapshot (newtime);
 	}
 
 	for (;;)
@@ -1227,7 +1229,8 @@ static void CL_ParseStartSoundPacket(void)
 	for (i = 0; i < 3; i++)
 		pos[i] = MSG_ReadCoord (cl.protocolflags);
 
-
+	if (cls.demoseeking)
+		return;	// don't play everything that demo_seek skips over
 
 	if (cl.qcvm.extfuncs.CSQC_Event_Sound && cl.sound_precache[sound_num] && !cl.qcvm.nogameaccess)
 	{	//blocked with csqc, too easy to do dead-reckoning.
@@ -1339,6 +1342,7 @@ static void CL_ParseServerInfo (void)
 //          it will be hidden in CL_SignonReply.
 	if (cls.demoplayback)
 		SCR_BeginLoadingPlaque();
+	cls.demolevel++;
 
 //
 // wipe the client_state_t struct
@@ -1774,6 +1778,7 @@ static void CL_ParseUpdate (int bits)
 		VectorCopy (ent->msg_angles[0], ent->angles);
 		ent->forcelink = true;
 	}
+	CL_PushEntityHistory (ent, forcelink);
 }
 
 /*
@@ -2058,6 +2063,38 @@ static void CL_ParseStaticSound (int version) //johnfitz -- added argument
 	S_StaticSound (cl.sound_precache[sound_num], org, vol, atten);
 }
 
+/*
+===================
+CL_ParseMVDPlayer
+
+Server demos have a block for each player. The one being followed is
+parsed like any other data and sets the view angles, the rest are skipped.
+===================
+*/
+static void CL_ParseMVDPlayer (void)
+{
+	vec3_t	angles;
+	int		slot, len, i;
+
+	slot = MSG_ReadByte ();
+	len = (unsigned short)MSG_ReadShort ();
+	for (i = 0; i < 3; i++)
+		angles[i] = MSG_ReadAngle16 (cl.protocolflags);
+
+	if (!cls.demoplayback)
+		Host_Error ("CL_ParseMVDPlayer: not playing a demo");
+	if (cls.demoplayer < 0)
+		cls.demoplayer = slot;	//follow whoever turns up first
+	if (slot != cls.demoplayer)
+	{
+		msg_readcount += len;
+		if (msg_readcount > net_message.cursize)
+			msg_badread = true;
+		return;
+	}
+	VectorCopy (angles, cl.mviewangles[0]);
+}
+
 /*
 CL_ParsePrecache
 
@@ -2504,6 +2541,7 @@ void CL_ParseServerMessage (void)
 		case svc_time:
 			cl.mtime[1] = cl.mtime[0];
 			cl.mtime[0] = MSG_ReadFloat ();
+			CL_NoteSnapshot (cl.mtime[0]);
 			if (cl.protocol_pext2 & PEXT2_PREDINFO)
 				MSG_ReadShort();	//input sequence ack.
 			break;
@@ -2859,6 +2897,9 @@ void CL_ParseServerMessage (void)
 				Host_Error ("Received svcfte_updateentities but extension not active");
 			CLFTE_ParseEntitiesUpdate();
 			break;
+		case svcqss_mvdplayer:
+			CL_ParseMVDPlayer ();
+			break;
 
 		case svcfte_cgamepacket:
 			if (!(cl.protocol_pext1 & PEXT1_CSQC))
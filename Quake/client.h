@@ -123,10 +123,13 @@ typedef struct
 // did the user pause demo playback? (separate from cl.paused because we don't
 // want a svc_setpause inside the demo to actually pause demo playback).
 	qboolean	demopaused;
+	qboolean	demoseeking;		// demo_seek is reading ahead without waiting for cl.time
+	int		demolevel;		// serverinfos seen since the demo started, keyframes are per level
+	int		demoplayer;		// scoreboard slot being followed in a server demo, -1 for the first one seen
 
 	qboolean	timedemo;
 	int		forcetrack;		// -1 = use normal cd track
-	FILE		*demofile;
+	demostream_t	*demofile;
 	int		td_lastframe;		// to meter out one message a frame
 	int		td_startframe;		// host_framecount at start
 	float		td_starttime;		// realtime at second frame of timedemo
@@ -167,6 +170,24 @@ typedef struct
 	int			ackedmovemessages;	// echo of movemessages from the server.
 	usercmd_t	movecmds[64];	// ringbuffer of previous movement commands (journal for prediction)
 #define MOVECMDS_MASK (countof(cl.movecmds)-1)
+	vec3_t		predorigins[64];	// where prediction thought each movecmd would leave us, for error tracking
+	int			predseq[64];
+	int			predackseq;		// the last ack we measured prediction error against
+	qboolean	predicted;		// predorigin is valid this frame
+	vec3_t		predorigin;		// predicted player position for this frame
+	vec3_t		predoffset;		// decaying correction, so prediction errors don't snap the view
+	float		prederror_last, prederror_max;
+	double		prederror_total;
+	int			prederror_count;
+
+	double		snaptime;		// server time of the newest snapshot
+	double		snaparrival;	// realtime it arrived at
+	float		snapinterval;	// smoothed time between server snapshots
+	float		snapjitter;		// smoothed deviation of arrival times from snapshot times
+	float		lerpdelay;		// how far behind the newest snapshot we're currently displaying
+	qboolean	lerpbuffered;	// cl.time is being driven by the jitter buffer
+	int			latesnapshots;	// arrived after we'd already needed them
+	int			numsnapshots;
 	usercmd_t	pendingcmd;		// accumulated state from mice+joysticks.
 
 // information for local display
@@ -422,6 +443,8 @@ void CL_UpdateTEnts (void);
 void CL_FreeState(void);
 void CL_ClearState (void);
 void CL_ClearTrailStates(void);
+void CL_NoteSnapshot (double servertime);
+void CL_PushEntityHistory (entity_t *ent, qboolean reset);
 
 //
 // cl_demo.c
@@ -433,6 +456,15 @@ void CL_Stop_f (void);
 void CL_Record_f (void);
 void CL_PlayDemo_f (void);
 void CL_TimeDemo_f (void);
+void CL_TimeDemoBatch_f (void);
+void CL_DemoSeek_f (void);
+void CL_DemoView_f (void);
+void CL_DemoWrite (const void *data, int size);
+extern cvar_t demo_keyframeinterval;
+extern cvar_t demo_compress;
+extern cvar_t timedemo_csv;
+extern cvar_t timedemo_stutter;
+extern cvar_t timedemo_warmup;
 
 //
 // cl_parse.c
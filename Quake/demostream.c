@@ -0,0 +1,587 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// demostream.c -- plain and block compressed demo files
+
+#include "quakedef.h"
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+
+/*
+==============================================================================
+
+COMPRESSED DEMOS
+
+A compressed demo is the same byte stream as a plain one, cut into blocks that
+are each deflated on their own, so any block can be decoded without the ones
+before it. Writers cut a block at every keyframe, and whenever one gets large.
+
+file:	"QDMZ" version
+		blocks: rawlen complen data[complen]...
+
+There is no block table, the headers are walked when the demo is opened, so a
+recording that was never closed properly still plays up to its last whole
+block. Everything is little endian.
+
+Recording hands finished blocks to a thread that compresses and writes them,
+and playback has a thread decompressing the block after the current one.
+
+==============================================================================
+*/
+
+#if defined(USE_SDL2) && defined(USE_ZLIB)
+#define DS_THREADS
+#endif
+
+#define DS_MAGIC		(('Z'<<24)|('M'<<16)|('D'<<8)|'Q')	// "QDMZ"
+#define DS_VERSION		1
+#define DS_HEADERSIZE	8
+#define DS_MAXBLOCK		(1024*1024)	// raw bytes, cut a block here even without a keyframe
+#define DS_MAXQUEUE		8			// blocks waiting for the writer thread
+#define DS_READBUF		65536
+
+typedef struct
+{
+	int		rawofs, rawlen;
+	int		fileofs, complen;	// the deflated data, after its header
+} dsblock_t;
+
+typedef struct
+{
+	int			block;		// -1 when empty
+	qboolean	ok;			// decoded correctly
+	byte		*data;
+	int			maxsize;
+} dsslot_t;
+
+struct demostream_s
+{
+	FILE		*f;
+	qboolean	writing;
+	qboolean	compressed;
+	int			ofs;		// into the uncompressed data
+	int			length;
+	long		base;		// file position of the first byte, as demos may be inside paks
+
+// plain reading
+	byte		*buf;
+	int			bufofs, bufpos, buflen;
+
+// compressed writing
+	byte		*raw;		// the block being filled
+	int			rawsize, rawmax;
+	byte		*queue[DS_MAXQUEUE];
+	int			queuesize[DS_MAXQUEUE];
+	int			queuehead, queuecount;
+	qboolean	failed;
+
+// compressed reading
+	dsblock_t	*blocks;
+	int			numblocks;
+	dsslot_t	cur;		// the main thread's
+	dsslot_t	ahead;		// the reader thread's, until it's handed over
+	int			want;		// block the reader thread should put in ahead, -1 for none
+
+	qboolean	quit;
+#ifdef DS_THREADS
+	SDL_Thread	*thread;
+	SDL_mutex	*lock;
+	SDL_cond	*cond;
+#endif
+};
+
+#ifdef USE_ZLIB
+static void DS_WriteBlock (demostream_t *ds, const byte *data, int size)
+{
+	uLongf	outlen = compressBound (size);
+	byte	*out = (byte *) malloc (outlen);
+	int		hdr[2];
+
+	if (!out || compress2 (out, &outlen, data, size, Z_DEFAULT_COMPRESSION) != Z_OK)
+	{
+		ds->failed = true;
+		free (out);
+		return;
+	}
+	hdr[0] = LittleLong (size);
+	hdr[1] = LittleLong ((int) outlen);
+	if (fwrite (hdr, 4, 2, ds->f) != 2 || fwrite (out, outlen, 1, ds->f) != 1)
+		ds->failed = true;
+	fflush (ds->f);
+	free (out);
+}
+
+static void DS_Decode (demostream_t *ds, int b, dsslot_t *slot)
+{
+	dsblock_t	*blk = &ds->blocks[b];
+	byte		*in;
+	uLongf		outlen = blk->rawlen;
+
+	if (slot->maxsize < blk->rawlen)
+	{
+		slot->maxsize = blk->rawlen;
+		slot->data = (byte *) realloc (slot->data, slot->maxsize);
+	}
+	slot->ok = false;
+	in = (byte *) malloc (blk->complen);
+	if (!in || !slot->data)
+	{
+		free (in);
+		return;
+	}
+	fseek (ds->f, ds->base + blk->fileofs, SEEK_SET);
+	if (fread (in, blk->complen, 1, ds->f) == 1 &&
+		uncompress (slot->data, &outlen, in, blk->complen) == Z_OK && (int) outlen == blk->rawlen)
+		slot->ok = true;
+	free (in);
+}
+#endif
+
+#ifdef DS_THREADS
+static int SDLCALL DS_WriteThread (void *arg)
+{
+	demostream_t	*ds = (demostream_t *) arg;
+	byte			*data;
+	int				size;
+
+	SDL_LockMutex (ds->lock);
+	for (;;)
+	{
+		while (!ds->queuecount && !ds->quit)
+			SDL_CondWait (ds->cond, ds->lock);
+		if (!ds->queuecount)
+			break;	// told to quit, and everything's written
+		data = ds->queue[ds->queuehead];
+		size = ds->queuesize[ds->queuehead];
+		SDL_UnlockMutex (ds->lock);
+
+		DS_WriteBlock (ds, data, size);
+		free (data);
+
+		SDL_LockMutex (ds->lock);
+		ds->queuehead = (ds->queuehead + 1) % DS_MAXQUEUE;
+		ds->queuecount--;
+		SDL_CondBroadcast (ds->cond);
+	}
+	SDL_UnlockMutex (ds->lock);
+	return 0;
+}
+
+static int SDLCALL DS_ReadThread (void *arg)
+{
+	demostream_t	*ds = (demostream_t *) arg;
+	int				b;
+
+	SDL_LockMutex (ds->lock);
+	while (!ds->quit)
+	{
+		if (ds->want < 0 || ds->ahead.block == ds->want)
+		{
+			SDL_CondWait (ds->cond, ds->lock);
+			continue;
+		}
+		b = ds->want;
+		SDL_UnlockMutex (ds->lock);
+
+		DS_Decode (ds, b, &ds->ahead);
+
+		SDL_LockMutex (ds->lock);
+		ds->ahead.block = b;	// hands it over
+		SDL_CondBroadcast (ds->cond);
+	}
+	SDL_UnlockMutex (ds->lock);
+	return 0;
+}
+
+static void DS_StartThread (demostream_t *ds, SDL_ThreadFunction func, const char *name)
+{
+	ds->lock = SDL_CreateMutex ();
+	ds->cond = SDL_CreateCond ();
+	if (ds->lock && ds->cond)
+		ds->thread = SDL_CreateThread (func, name, ds);
+	if (!ds->thread)
+		Con_DPrintf ("Unable to start %s thread, demo compression will block\n", name);
+}
+
+static void DS_StopThread (demostream_t *ds)
+{
+	if (ds->thread)
+	{
+		SDL_LockMutex (ds->lock);
+		ds->quit = true;
+		SDL_CondBroadcast (ds->cond);
+		SDL_UnlockMutex (ds->lock);
+		SDL_WaitThread (ds->thread, NULL);
+		ds->thread = NULL;
+	}
+	if (ds->cond)
+		SDL_DestroyCond (ds->cond);
+	if (ds->lock)
+		SDL_DestroyMutex (ds->lock);
+	ds->cond = NULL;
+	ds->lock = NULL;
+}
+#endif
+
+/*
+====================
+DemoStream_OpenWrite
+====================
+*/
+demostream_t *DemoStream_OpenWrite (FILE *f, qboolean compress)
+{
+	demostream_t *ds = (demostream_t *) calloc (1, sizeof(*ds));
+	int hdr[2];
+
+	ds->f = f;
+	ds->writing = true;
+#ifdef USE_ZLIB
+	if (compress)
+	{
+		ds->compressed = true;
+		hdr[0] = LittleLong (DS_MAGIC);
+		hdr[1] = LittleLong (DS_VERSION);
+		fwrite (hdr, 4, 2, f);
+#ifdef DS_THREADS
+		DS_StartThread (ds, DS_WriteThread, "demowrite");
+#endif
+	}
+#else
+	(void) hdr;
+	if (compress)
+		Con_Warning ("Demo compression needs zlib, recording uncompressed\n");
+#endif
+	return ds;
+}
+
+/*
+====================
+DemoStream_OpenRead
+====================
+*/
+demostream_t *DemoStream_OpenRead (FILE *f, int length)
+{
+	demostream_t	*ds = (demostream_t *) calloc (1, sizeof(*ds));
+	int				hdr[2];
+
+	ds->f = f;
+	ds->base = ftell (f);
+	ds->length = length;
+
+	if (length >= DS_HEADERSIZE && fread (hdr, 4, 2, f) == 2 && LittleLong (hdr[0]) == DS_MAGIC)
+	{
+#ifdef USE_ZLIB
+		int pos, maxblocks = 0;
+
+		if (LittleLong (hdr[1]) != DS_VERSION)
+		{
+			Con_Printf ("Compressed demo has unsupported version %i\n", LittleLong (hdr[1]));
+			DemoStream_Close (ds);
+			return NULL;
+		}
+
+		ds->compressed = true;
+		ds->length = 0;
+		for (pos = DS_HEADERSIZE; pos + DS_HEADERSIZE <= length; )
+		{
+			dsblock_t *blk;
+			if (fread (hdr, 4, 2, f) != 2)
+				break;
+			hdr[0] = LittleLong (hdr[0]);
+			hdr[1] = LittleLong (hdr[1]);
+			if (hdr[0] <= 0 || hdr[0] > 64*1024*1024 || hdr[1] <= 0 || hdr[1] > length - pos - DS_HEADERSIZE)
+				break;	// truncated, the recording wasn't finished
+			if (ds->numblocks == maxblocks)
+			{
+				maxblocks = q_max (64, maxblocks * 2);
+				ds->blocks = (dsblock_t *) realloc (ds->blocks, sizeof(*ds->blocks) * maxblocks);
+			}
+			blk = &ds->blocks[ds->numblocks++];
+			blk->rawofs = ds->length;
+			blk->rawlen = hdr[0];
+			blk->fileofs = pos + DS_HEADERSIZE;
+			blk->complen = hdr[1];
+			ds->length += blk->rawlen;
+			pos = blk->fileofs + blk->complen;
+			fseek (f, ds->base + pos, SEEK_SET);
+		}
+
+		ds->cur.block = ds->ahead.block = -1;
+		ds->want = ds->numblocks ? 0 : -1;
+#ifdef DS_THREADS
+		DS_StartThread (ds, DS_ReadThread, "demoread");
+#endif
+		return ds;
+#else
+		Con_Printf ("Compressed demos need zlib\n");
+		DemoStream_Close (ds);
+		return NULL;
+#endif
+	}
+
+	ds->buf = (byte *) malloc (DS_READBUF);
+	ds->bufofs = -1;
+	DemoStream_Seek (ds, 0);
+	return ds;
+}
+
+/*
+====================
+DemoStream_Close
+====================
+*/
+void DemoStream_Close (demostream_t *ds)
+{
+	if (!ds)
+		return;
+
+	if (ds->writing && ds->compressed)
+		DemoStream_Break (ds);
+#ifdef DS_THREADS
+	DS_StopThread (ds);
+#endif
+	if (ds->failed)
+		Con_Warning ("Couldn't write all of the demo\n");
+
+	fclose (ds->f);
+	free (ds->buf);
+	free (ds->raw);
+	free (ds->blocks);
+	free (ds->cur.data);
+	free (ds->ahead.data);
+	free (ds);
+}
+
+qboolean DemoStream_IsCompressed (demostream_t *ds)
+{
+	return ds->compressed;
+}
+
+/*
+====================
+DemoStream_Write
+====================
+*/
+void DemoStream_Write (demostream_t *ds, const void *data, int len)
+{
+	if (!ds->compressed)
+	{
+		fwrite (data, len, 1, ds->f);
+		ds->ofs += len;
+		return;
+	}
+
+	if (ds->rawsize + len > ds->rawmax)
+	{
+		ds->rawmax = q_max (ds->rawsize + len, q_max (ds->rawmax * 2, 65536));
+		ds->raw = (byte *) realloc (ds->raw, ds->rawmax);
+	}
+	memcpy (ds->raw + ds->rawsize, data, len);
+	ds->rawsize += len;
+	ds->ofs += len;
+
+	if (ds->rawsize >= DS_MAXBLOCK)
+		DemoStream_Break (ds);
+}
+
+void DemoStream_Flush (demostream_t *ds)
+{
+	if (!ds->compressed)
+		fflush (ds->f);
+}
+
+/*
+====================
+DemoStream_Break
+====================
+*/
+void DemoStream_Break (demostream_t *ds)
+{
+	if (!ds->compressed || !ds->rawsize)
+		return;
+
+#ifdef DS_THREADS
+	if (ds->thread)
+	{
+		SDL_LockMutex (ds->lock);
+		while (ds->queuecount == DS_MAXQUEUE)
+			SDL_CondWait (ds->cond, ds->lock);	// the disk can't keep up
+		ds->queue[(ds->queuehead + ds->queuecount) % DS_MAXQUEUE] = ds->raw;
+		ds->queuesize[(ds->queuehead + ds->queuecount) % DS_MAXQUEUE] = ds->rawsize;
+		ds->queuecount++;
+		SDL_CondBroadcast (ds->cond);
+		SDL_UnlockMutex (ds->lock);
+
+		ds->raw = NULL;	// the thread frees it
+		ds->rawsize = ds->rawmax = 0;
+		return;
+	}
+#endif
+#ifdef USE_ZLIB
+	DS_WriteBlock (ds, ds->raw, ds->rawsize);
+#endif
+	ds->rawsize = 0;
+}
+
+int DemoStream_Tell (demostream_t *ds)
+{
+	return ds->ofs;
+}
+
+int DemoStream_Length (demostream_t *ds)
+{
+	return ds->length;
+}
+
+/*
+====================
+DemoStream_Seek
+====================
+*/
+void DemoStream_Seek (demostream_t *ds, int ofs)
+{
+	ofs = CLAMP (0, ofs, ds->length);
+	if (!ds->compressed)
+	{
+		if (ofs >= ds->bufofs && ofs <= ds->bufofs + ds->buflen)
+			ds->bufpos = ofs - ds->bufofs;
+		else
+		{
+			fseek (ds->f, ds->base + ofs, SEEK_SET);
+			ds->bufofs = ofs;
+			ds->bufpos = ds->buflen = 0;
+		}
+	}
+	ds->ofs = ofs;
+}
+
+#ifdef USE_ZLIB
+static int DS_FindBlock (demostream_t *ds, int ofs)
+{
+	int lo = 0, hi = ds->numblocks - 1, mid;
+	while (lo < hi)
+	{
+		mid = (lo + hi + 1) / 2;
+		if (ds->blocks[mid].rawofs <= ofs)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+/*
+====================
+DS_GetBlock
+
+Makes block b the current one, waiting for the reader thread if it hasn't
+finished it yet, then sets it going on the next
+====================
+*/
+static qboolean DS_GetBlock (demostream_t *ds, int b)
+{
+	if (ds->cur.block == b)
+		return ds->cur.ok;
+
+#ifdef DS_THREADS
+	if (ds->thread)
+	{
+		dsslot_t tmp;
+
+		SDL_LockMutex (ds->lock);
+		if (ds->ahead.block != b)
+		{
+			ds->want = b;
+			SDL_CondBroadcast (ds->cond);
+			while (ds->ahead.block != b)
+				SDL_CondWait (ds->cond, ds->lock);
+		}
+		tmp = ds->cur;
+		ds->cur = ds->ahead;
+		ds->ahead = tmp;
+		ds->ahead.block = -1;
+		ds->want = (b + 1 < ds->numblocks) ? b + 1 : -1;
+		SDL_CondBroadcast (ds->cond);
+		SDL_UnlockMutex (ds->lock);
+	}
+	else
+#endif
+	{
+		DS_Decode (ds, b, &ds->cur);
+		ds->cur.block = b;
+	}
+
+	if (!ds->cur.ok)
+	{
+		Con_Warning ("Demo is corrupt after %i bytes\n", ds->blocks[b].rawofs);
+		ds->length = ds->blocks[b].rawofs;
+		ds->numblocks = b;
+	}
+	return ds->cur.ok;
+}
+#endif
+
+/*
+====================
+DemoStream_Read
+====================
+*/
+int DemoStream_Read (demostream_t *ds, void *out, int len)
+{
+	byte	*dst = (byte *) out;
+	int		n, total = 0;
+
+	while (len > 0 && ds->ofs < ds->length)
+	{
+		if (ds->compressed)
+		{
+#ifdef USE_ZLIB
+			dsblock_t *blk;
+			if (!DS_GetBlock (ds, DS_FindBlock (ds, ds->ofs)))
+				break;
+			blk = &ds->blocks[ds->cur.block];
+			n = q_min (len, blk->rawofs + blk->rawlen - ds->ofs);
+			memcpy (dst, ds->cur.data + ds->ofs - blk->rawofs, n);
+#else
+			break;
+#endif
+		}
+		else
+		{
+			if (ds->bufpos == ds->buflen)
+			{
+				ds->bufofs += ds->buflen;
+				ds->bufpos = 0;
+				ds->buflen = fread (ds->buf, 1, q_min (DS_READBUF, ds->length - ds->bufofs), ds->f);
+				if (!ds->buflen)
+					break;
+			}
+			n = q_min (len, ds->buflen - ds->bufpos);
+			memcpy (dst, ds->buf + ds->bufpos, n);
+			ds->bufpos += n;
+		}
+		ds->ofs += n;
+		dst += n;
+		len -= n;
+		total += n;
+	}
+	return total;
+}
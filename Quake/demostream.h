@@ -0,0 +1,57 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef _QUAKE_DEMOSTREAM_H
+#define _QUAKE_DEMOSTREAM_H
+
+// demo files, either plain or block compressed. offsets are always into the
+// uncompressed data, so the rest of the engine doesn't care which it is.
+
+typedef struct demostream_s demostream_t;
+
+demostream_t *DemoStream_OpenWrite (FILE *f, qboolean compress);
+// takes ownership of f. compressed streams are written by a background thread
+// where one is available, and fall back to plain files without zlib.
+
+demostream_t *DemoStream_OpenRead (FILE *f, int length);
+// takes ownership of f, which is positioned at the demo's first byte and may be
+// inside a pak. the format is detected from the first few bytes.
+
+void DemoStream_Close (demostream_t *ds);
+// finishes writing anything still queued, and closes the file
+
+qboolean DemoStream_IsCompressed (demostream_t *ds);
+
+void DemoStream_Write (demostream_t *ds, const void *data, int len);
+void DemoStream_Flush (demostream_t *ds);
+// plain files are flushed, so a crash loses as little as possible.
+// compressed blocks are only written whole.
+void DemoStream_Break (demostream_t *ds);
+// starts a new independently decodable block at the current offset
+int DemoStream_Tell (demostream_t *ds);
+
+int DemoStream_Read (demostream_t *ds, void *out, int len);
+// returns the number of bytes read, short at the end of the demo
+void DemoStream_Seek (demostream_t *ds, int ofs);
+int DemoStream_Length (demostream_t *ds);
+
+#endif	/* _QUAKE_DEMOSTREAM_H */
+
@@ -199,13 +199,145 @@ byte *Mod_DecompressVis (byte *in, qmodel_t *model)
 	return mod_decompressed;
 }
 
+/*
+===================
+Mod_BuildVisRows
+
+Decompresses every leaf's pvs once, instead of every time it's asked for.
+Past VIS_MAXROWS only the most recently used rows are kept.
+===================
+*/
+#define VIS_MAXROWS	(16*1024*1024)
+
+static int mod_vissequence;
+
+static void Mod_BuildVisRows (qmodel_t *mod)
+{
+	mvisrows_t	*vr;
+	int			i, row;
+
+	mod->visrows = NULL;
+	if (!mod->visdata || mod->numleafs <= 0)
+		return;
+
+	row = (mod->numleafs+7)>>3;
+	vr = (mvisrows_t *) Hunk_AllocName (sizeof(*vr), loadname);
+	vr->numleafs = mod->numleafs;
+	vr->rowbytes = (row+7)&~7;
+	vr->sequence = ++mod_vissequence;
+
+	if ((size_t)vr->numleafs * vr->rowbytes <= VIS_MAXROWS)
+	{
+		vr->numslots = vr->numleafs;
+		vr->rows = (byte *) Hunk_AllocName ((size_t)vr->numslots * vr->rowbytes, loadname);
+		for (i = 0; i < vr->numleafs; i++)
+			memcpy (vr->rows + (size_t)i*vr->rowbytes, Mod_DecompressVis (mod->leafs[i+1].compressed_vis, mod), row);
+	}
+	else
+	{
+		vr->numslots = q_max (2, VIS_MAXROWS / vr->rowbytes);
+		vr->rows = (byte *) Hunk_AllocName ((size_t)vr->numslots * vr->rowbytes, loadname);
+		vr->slotforleaf = (int *) Hunk_AllocName (vr->numleafs * sizeof(int), loadname);
+		vr->leafforslot = (int *) Hunk_AllocName (vr->numslots * sizeof(int), loadname);
+		vr->prev = (int *) Hunk_AllocName (vr->numslots * sizeof(int), loadname);
+		vr->next = (int *) Hunk_AllocName (vr->numslots * sizeof(int), loadname);
+		for (i = 0; i < vr->numleafs; i++)
+			vr->slotforleaf[i] = -1;
+		for (i = 0; i < vr->numslots; i++)
+		{
+			vr->leafforslot[i] = -1;
+			vr->prev[i] = i-1;
+			vr->next[i] = (i+1 < vr->numslots) ? i+1 : -1;
+		}
+		vr->head = 0;
+		vr->tail = vr->numslots-1;
+	}
+	Con_DPrintf ("%s: %i of %i pvs rows resident\n", mod->name, vr->numslots, vr->numleafs);
+	mod->visrows = vr;
+}
+
+/*
+===================
+Mod_VisRow
+===================
+*/
+static byte *Mod_VisRow (mvisrows_t *vr, int leafnum, qmodel_t *model)
+{
+	byte	*row;
+	int		slot;
+
+	if (!vr->slotforleaf)
+	{
+		vr->hits++;
+		return vr->rows + (size_t)leafnum*vr->rowbytes;
+	}
+
+	slot = vr->slotforleaf[leafnum];
+	if (slot >= 0)
+		vr->hits++;
+	else
+	{	// take over the least recently used slot
+		vr->misses++;
+		slot = vr->tail;
+		if (vr->leafforslot[slot] >= 0)
+			vr->slotforleaf[vr->leafforslot[slot]] = -1;
+		vr->leafforslot[slot] = leafnum;
+		vr->slotforleaf[leafnum] = slot;
+		row = vr->rows + (size_t)slot*vr->rowbytes;
+		memcpy (row, Mod_DecompressVis (model->leafs[leafnum+1].compressed_vis, model), (vr->numleafs+7)>>3);
+	}
+
+	if (slot != vr->head)
+	{	// move it to the front
+		vr->next[vr->prev[slot]] = vr->next[slot];
+		if (vr->next[slot] >= 0)
+			vr->prev[vr->next[slot]] = vr->prev[slot];
+		else
+			vr->tail = vr->prev[slot];
+		vr->prev[slot] = -1;
+		vr->next[slot] = vr->head;
+		vr->prev[vr->head] = slot;
+		vr->head = slot;
+	}
+	return vr->rows + (size_t)slot*vr->rowbytes;
+}
+
 byte *Mod_LeafPVS (mleaf_t *leaf, qmodel_t *model)
 {
+	mvisrows_t	*vr = model->visrows;
+	int			leafnum;
+
 	if (leaf == model->leafs)
 		return Mod_NoVisPVS (model);
+	leafnum = leaf - model->leafs - 1;
+	if (vr && vr->numleafs == model->numleafs && leafnum < vr->numleafs)
+		return Mod_VisRow (vr, leafnum, model);
 	return Mod_DecompressVis (leaf->compressed_vis, model);
 }
 
+/*
+===================
+Mod_OrVis
+
+Merges one pvs row into another a word at a time.
+===================
+*/
+void Mod_OrVis (byte *dst, const byte *src, int bytes)
+{
+	uint64_t	a, b;
+	int			i;
+
+	for (i = 0; i + 8 <= bytes; i += 8)
+	{
+		memcpy (&a, dst+i, 8);
+		memcpy (&b, src+i, 8);
+		a |= b;
+		memcpy (dst+i, &a, 8);
+	}
+	for (; i < bytes; i++)
+		dst[i] |= src[i];
+}
+
 byte *Mod_NoVisPVS (qmodel_t *model)
 {
 	int pvsbytes;
@@ -2722,6 +2854,7 @@ void Mod_LoadBrushModel (qmodel_t *mod, void *buffer)
 	float		radius; //johnfitz
 
 	loadmodel->type = mod_brush;
+	loadmodel->visrows = NULL;
 
 	header = (dheader_t *)buffer;
 
@@ -2852,6 +2985,8 @@ visdone:
 		//johnfitz
 
 		mod->numleafs = bm->visleafs;
+		if (i == 0)
+			Mod_BuildVisRows (mod);	//shared with the submodels below
 
 		if (i < mod->numsubmodels-1)
 		{	// duplicate the basic information
@@ -469,6 +469,22 @@ typedef enum {mod_brush, mod_sprite, mod_alias, mod_ext_invalid} modtype_t;
 #define MOD_EMITFORWARDS 4096	//particle effect is emitted forwards, rather than downwards. why down? good question.
 //spike
 
+// every leaf's pvs, decompressed when the map loads. maps too big for that keep
+// the most recently used rows instead.
+typedef struct mvisrows_s
+{
+	int			numleafs;		// visleafs, leaf 0 isn't stored
+	int			rowbytes;		// padded to 8 bytes
+	int			numslots;
+	byte		*rows;			// [numslots][rowbytes]
+	int			*slotforleaf;	// [numleafs], -1 if not resident. NULL when every row is
+	int			*leafforslot;	// [numslots]
+	int			*prev, *next;	// [numslots], most recently used first
+	int			head, tail;
+	int			sequence;		// unique per load, for anything keyed on these rows
+	unsigned int	hits, misses;
+} mvisrows_t;
+
 typedef struct qmodel_s
 {
 	char		name[MAX_QPATH];
@@ -551,6 +567,7 @@ typedef struct qmodel_s
 	char		*entities;
 
 	qboolean	viswarn; // for Mod_DecompressVis()
+	mvisrows_t	*visrows;
 
 	int			bspversion;
 	int			contentstransparent;	//spike -- added this so we can disable glitchy wateralpha where its not supported.
@@ -583,6 +600,7 @@ void	Mod_TouchModel (const char *name);
 mleaf_t *Mod_PointInLeaf (float *p, qmodel_t *model);
 byte	*Mod_LeafPVS (mleaf_t *leaf, qmodel_t *model);
 byte	*Mod_NoVisPVS (qmodel_t *model);
+void	Mod_OrVis (byte *dst, const byte *src, int bytes);
 
 void Mod_SetExtraFlags (qmodel_t *mod);
 
@@ -0,0 +1,452 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2002-2009 John Fitzgibbons and others
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+//gl_null.c -- null opengl backend for headless cpu benchmarking (USE_NULLGL builds only)
+//every gl entry point the renderer uses is defined here and reduced to a counter, so surface
+//marking, texture chains, lightmap building and particle updates all still run at full cost.
+
+#include "quakedef.h"
+
+#ifdef USE_NULLGL
+
+typedef struct
+{
+	unsigned int	calls;		//total gl entry points hit
+	unsigned int	draws;		//glDrawArrays/glDrawElements/glDrawRangeElements/glBegin
+	unsigned int	indexes;	//vertices or indexes submitted by those draws
+	unsigned int	state;		//enable/disable/blend/depth/etc
+	unsigned int	texbinds;
+	unsigned int	texuploads;
+	size_t			texbytes;
+	unsigned int	bufuploads;
+	size_t			bufbytes;
+	unsigned int	programs;	//glUseProgram
+	unsigned int	uniforms;
+} nullglstats_t;
+
+static nullglstats_t	nullgl_frame, nullgl_total;
+static unsigned int		nullgl_frames;
+static GLuint			nullgl_nextname = 1;	//shared by textures, buffers, shaders, programs, vaos, fbos
+static GLfloat			nullgl_anisotropy = 1;
+
+#define NULLGL_COUNT(field)	(nullgl_frame.calls++, nullgl_frame.field++)
+#define NULLGL_CALL()		(nullgl_frame.calls++)
+
+static size_t NullGL_PixelBytes (GLsizei width, GLsizei height, GLenum format, GLenum type)
+{
+	size_t comps;
+	switch (format)
+	{
+	case GL_RGBA:
+	case GL_BGRA:			comps = 4; break;
+	case GL_RGB:
+	case GL_BGR:			comps = 3; break;
+	case GL_LUMINANCE_ALPHA:	comps = 2; break;
+	default:				comps = 1; break;
+	}
+	if (type != GL_UNSIGNED_BYTE)
+		comps *= 4;
+	return (size_t)width * height * comps;
+}
+
+static void NullGL_GenNames (GLsizei n, GLuint *names)
+{
+	while (n-- > 0)
+		*names++ = nullgl_nextname++;
+}
+
+/*
+=============================================================================
+
+CORE ENTRY POINTS
+
+=============================================================================
+*/
+
+void GLAPIENTRY glAlphaFunc (GLenum func, GLclampf ref)				{ NULLGL_COUNT(state); }
+void GLAPIENTRY glBegin (GLenum mode)								{ NULLGL_COUNT(draws); }
+void GLAPIENTRY glBindTexture (GLenum target, GLuint texture)		{ NULLGL_COUNT(texbinds); }
+void GLAPIENTRY glBlendFunc (GLenum sfactor, GLenum dfactor)		{ NULLGL_COUNT(state); }
+void GLAPIENTRY glClear (GLbitfield mask)							{ NULLGL_CALL(); }
+void GLAPIENTRY glClearColor (GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha)	{ NULLGL_COUNT(state); }
+void GLAPIENTRY glColor3f (GLfloat red, GLfloat green, GLfloat blue)	{ NULLGL_CALL(); }
+void GLAPIENTRY glColor3fv (const GLfloat *v)						{ NULLGL_CALL(); }
+void GLAPIENTRY glColor4f (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)	{ NULLGL_CALL(); }
+void GLAPIENTRY glColor4fv (const GLfloat *v)						{ NULLGL_CALL(); }
+void GLAPIENTRY glColorMask (GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)	{ NULLGL_COUNT(state); }
+void GLAPIENTRY glColorPointer (GLint size, GLenum type, GLsizei stride, const GLvoid *ptr)	{ NULLGL_CALL(); }
+void GLAPIENTRY glCopyTexSubImage2D (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint x, GLint y, GLsizei width, GLsizei height)	{ NULLGL_CALL(); }
+void GLAPIENTRY glCullFace (GLenum mode)							{ NULLGL_COUNT(state); }
+void GLAPIENTRY glDeleteTextures (GLsizei n, const GLuint *textures)	{ NULLGL_CALL(); }
+void GLAPIENTRY glDepthFunc (GLenum func)							{ NULLGL_COUNT(state); }
+void GLAPIENTRY glDepthMask (GLboolean flag)						{ NULLGL_COUNT(state); }
+void GLAPIENTRY glDepthRange (GLclampd near_val, GLclampd far_val)	{ NULLGL_COUNT(state); }
+void GLAPIENTRY glDisable (GLenum cap)								{ NULLGL_COUNT(state); }
+void GLAPIENTRY glDisableClientState (GLenum cap)					{ NULLGL_COUNT(state); }
+void GLAPIENTRY glDrawBuffer (GLenum mode)							{ NULLGL_COUNT(state); }
+void GLAPIENTRY glEnable (GLenum cap)								{ NULLGL_COUNT(state); }
+void GLAPIENTRY glEnableClientState (GLenum cap)					{ NULLGL_COUNT(state); }
+void GLAPIENTRY glEnd (void)										{ NULLGL_CALL(); }
+void GLAPIENTRY glFinish (void)										{ NULLGL_CALL(); }
+void GLAPIENTRY glFogi (GLenum pname, GLint param)					{ NULLGL_COUNT(state); }
+void GLAPIENTRY glFrontFace (GLenum mode)							{ NULLGL_COUNT(state); }
+void GLAPIENTRY glFrustum (GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble near_val, GLdouble far_val)	{ NULLGL_CALL(); }
+void GLAPIENTRY glHint (GLenum target, GLenum mode)					{ NULLGL_COUNT(state); }
+void GLAPIENTRY glLoadIdentity (void)								{ NULLGL_CALL(); }
+void GLAPIENTRY glLoadMatrixf (const GLfloat *m)					{ NULLGL_CALL(); }
+void GLAPIENTRY glMatrixMode (GLenum mode)							{ NULLGL_CALL(); }
+void GLAPIENTRY glMultMatrixf (const GLfloat *m)					{ NULLGL_CALL(); }
+void GLAPIENTRY glOrtho (GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble near_val, GLdouble far_val)	{ NULLGL_CALL(); }
+void GLAPIENTRY glPixelStorei (GLenum pname, GLint param)			{ NULLGL_CALL(); }
+void GLAPIENTRY glPolygonMode (GLenum face, GLenum mode)			{ NULLGL_COUNT(state); }
+void GLAPIENTRY glPolygonOffset (GLfloat factor, GLfloat units)		{ NULLGL_COUNT(state); }
+void GLAPIENTRY glPopMatrix (void)									{ NULLGL_CALL(); }
+void GLAPIENTRY glPushMatrix (void)									{ NULLGL_CALL(); }
+void GLAPIENTRY glReadBuffer (GLenum mode)							{ NULLGL_CALL(); }
+void GLAPIENTRY glRotatef (GLfloat angle, GLfloat x, GLfloat y, GLfloat z)	{ NULLGL_CALL(); }
+void GLAPIENTRY glScalef (GLfloat x, GLfloat y, GLfloat z)			{ NULLGL_CALL(); }
+void GLAPIENTRY glScissor (GLint x, GLint y, GLsizei width, GLsizei height)	{ NULLGL_COUNT(state); }
+void GLAPIENTRY glShadeModel (GLenum mode)							{ NULLGL_COUNT(state); }
+void GLAPIENTRY glStencilFunc (GLenum func, GLint ref, GLuint mask)	{ NULLGL_COUNT(state); }
+void GLAPIENTRY glStencilOp (GLenum fail, GLenum zfail, GLenum zpass)	{ NULLGL_COUNT(state); }
+void GLAPIENTRY glTexCoord2f (GLfloat s, GLfloat t)					{ NULLGL_CALL(); }
+void GLAPIENTRY glTexCoordPointer (GLint size, GLenum type, GLsizei stride, const GLvoid *ptr)	{ NULLGL_CALL(); }
+void GLAPIENTRY glTexEnvf (GLenum target, GLenum pname, GLfloat param)	{ NULLGL_COUNT(state); }
+void GLAPIENTRY glTexEnvi (GLenum target, GLenum pname, GLint param)	{ NULLGL_COUNT(state); }
+void GLAPIENTRY glTexParameteri (GLenum target, GLenum pname, GLint param)	{ NULLGL_COUNT(state); }
+void GLAPIENTRY glTranslatef (GLfloat x, GLfloat y, GLfloat z)		{ NULLGL_CALL(); }
+void GLAPIENTRY glVertex2f (GLfloat x, GLfloat y)					{ NULLGL_COUNT(indexes); }
+void GLAPIENTRY glVertex3f (GLfloat x, GLfloat y, GLfloat z)		{ NULLGL_COUNT(indexes); }
+void GLAPIENTRY glVertex3fv (const GLfloat *v)						{ NULLGL_COUNT(indexes); }
+void GLAPIENTRY glVertexPointer (GLint size, GLenum type, GLsizei stride, const GLvoid *ptr)	{ NULLGL_CALL(); }
+void GLAPIENTRY glViewport (GLint x, GLint y, GLsizei width, GLsizei height)	{ NULLGL_COUNT(state); }
+
+void GLAPIENTRY glDrawArrays (GLenum mode, GLint first, GLsizei count)
+{
+	NULLGL_COUNT(draws);
+	nullgl_frame.indexes += count;
+}
+
+void GLAPIENTRY glDrawElements (GLenum mode, GLsizei count, GLenum type, const GLvoid *indices)
+{
+	NULLGL_COUNT(draws);
+	nullgl_frame.indexes += count;
+}
+
+void GLAPIENTRY glDrawRangeElements (GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const GLvoid *indices)
+{
+	NULLGL_COUNT(draws);
+	nullgl_frame.indexes += count;
+}
+
+void GLAPIENTRY glTexImage2D (GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels)
+{
+	NULLGL_COUNT(texuploads);
+	if (pixels)
+		nullgl_frame.texbytes += NullGL_PixelBytes (width, height, format, type);
+}
+
+void GLAPIENTRY glTexSubImage2D (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const GLvoid *pixels)
+{
+	NULLGL_COUNT(texuploads);
+	nullgl_frame.texbytes += NullGL_PixelBytes (width, height, format, type);
+}
+
+void GLAPIENTRY glTexParameterf (GLenum target, GLenum pname, GLfloat param)
+{
+	NULLGL_COUNT(state);
+	if (pname == GL_TEXTURE_MAX_ANISOTROPY_EXT)
+		nullgl_anisotropy = param;
+}
+
+void GLAPIENTRY glGetTexParameterfv (GLenum target, GLenum pname, GLfloat *params)
+{
+	NULLGL_CALL();
+	*params = (pname == GL_TEXTURE_MAX_ANISOTROPY_EXT) ? nullgl_anisotropy : 0;
+}
+
+void GLAPIENTRY glGenTextures (GLsizei n, GLuint *textures)
+{
+	NULLGL_CALL();
+	NullGL_GenNames (n, textures);
+}
+
+void GLAPIENTRY glGetTexImage (GLenum target, GLint level, GLenum format, GLenum type, GLvoid *pixels)
+{
+	NULLGL_CALL();	//no storage behind the texture, leave the caller's buffer alone
+}
+
+void GLAPIENTRY glReadPixels (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid *pixels)
+{
+	NULLGL_CALL();
+	memset (pixels, 0, NullGL_PixelBytes (width, height, format, type));
+}
+
+void GLAPIENTRY glGetIntegerv (GLenum pname, GLint *params)
+{
+	NULLGL_CALL();
+	switch (pname)
+	{
+	case GL_MAX_TEXTURE_SIZE:		*params = 4096; break;
+	case GL_MAX_TEXTURE_UNITS:		*params = 8; break;
+	case GL_MAX_VERTEX_ATTRIBS:		*params = 16; break;
+	default:						*params = 0; break;
+	}
+}
+
+void GLAPIENTRY glGetFloatv (GLenum pname, GLfloat *params)
+{
+	NULLGL_CALL();
+	*params = (pname == GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT) ? 16 : 0;
+}
+
+const GLubyte * GLAPIENTRY glGetString (GLenum name)
+{
+	NULLGL_CALL();
+	switch (name)
+	{
+	case GL_VENDOR:		return (const GLubyte *) "QuakeSpasm";
+	case GL_RENDERER:	return (const GLubyte *) "Null renderer";
+	case GL_VERSION:	return (const GLubyte *) "3.3 (null)";
+	case GL_EXTENSIONS:	return (const GLubyte *) "GL_ARB_multitexture GL_ARB_texture_env_combine GL_ARB_texture_env_add "
+											"GL_EXT_texture_filter_anisotropic GL_ARB_texture_non_power_of_two";
+	default:			return NULL;
+	}
+}
+
+/*
+=============================================================================
+
+EXTENSION ENTRY POINTS
+
+=============================================================================
+*/
+
+static void APIENTRY NullGL_MultiTexCoord2f (GLenum target, GLfloat s, GLfloat t)	{ NULLGL_CALL(); }
+static void APIENTRY NullGL_ActiveTexture (GLenum texture)							{ NULLGL_COUNT(state); }
+static void APIENTRY NullGL_ClientActiveTexture (GLenum texture)					{ NULLGL_COUNT(state); }
+
+static void APIENTRY NullGL_BindBuffer (GLenum target, GLuint buffer)				{ NULLGL_COUNT(state); }
+static void APIENTRY NullGL_DeleteBuffers (GLsizei n, const GLuint *buffers)		{ NULLGL_CALL(); }
+static void APIENTRY NullGL_GenBuffers (GLsizei n, GLuint *buffers)				{ NULLGL_CALL(); NullGL_GenNames (n, buffers); }
+static void APIENTRY NullGL_BufferData (GLenum target, GLsizeiptrARB size, const void *data, GLenum usage)
+{
+	NULLGL_COUNT(bufuploads);
+	nullgl_frame.bufbytes += size;
+}
+static void APIENTRY NullGL_BufferSubData (GLenum target, GLintptrARB offset, GLsizeiptrARB size, const void *data)
+{
+	NULLGL_COUNT(bufuploads);
+	nullgl_frame.bufbytes += size;
+}
+
+static GLuint APIENTRY NullGL_CreateShader (GLenum type)							{ NULLGL_CALL(); return nullgl_nextname++; }
+static void APIENTRY NullGL_DeleteShader (GLuint shader)							{ NULLGL_CALL(); }
+static void APIENTRY NullGL_DeleteProgram (GLuint program)							{ NULLGL_CALL(); }
+static void APIENTRY NullGL_ShaderSource (GLuint shader, GLsizei count, const GLchar *const*string, const GLint *length)	{ NULLGL_CALL(); }
+static void APIENTRY NullGL_CompileShader (GLuint shader)							{ NULLGL_CALL(); }
+static void APIENTRY NullGL_GetShaderiv (GLuint shader, GLenum pname, GLint *params)
+{
+	NULLGL_CALL();
+	*params = (pname == GL_COMPILE_STATUS) ? GL_TRUE : 0;
+}
+static void APIENTRY NullGL_GetShaderInfoLog (GLuint shader, GLsizei bufSize, GLsizei *length, GLchar *infoLog)
+{
+	NULLGL_CALL();
+	if (length)
+		*length = 0;
+	if (bufSize > 0)
+		*infoLog = 0;
+}
+static void APIENTRY NullGL_GetProgramiv (GLuint program, GLenum pname, GLint *params)
+{
+	NULLGL_CALL();
+	*params = (pname == GL_LINK_STATUS) ? GL_TRUE : 0;
+}
+static GLuint APIENTRY NullGL_CreateProgram (void)									{ NULLGL_CALL(); return nullgl_nextname++; }
+static void APIENTRY NullGL_AttachShader (GLuint program, GLuint shader)			{ NULLGL_CALL(); }
+static void APIENTRY NullGL_LinkProgram (GLuint program)							{ NULLGL_CALL(); }
+static void APIENTRY NullGL_BindAttribLocation (GLuint program, GLuint index, const GLchar *name)	{ NULLGL_CALL(); }
+static void APIENTRY NullGL_UseProgram (GLuint program)							{ NULLGL_COUNT(programs); }
+static GLint APIENTRY NullGL_GetLocation (GLuint program, const GLchar *name)		{ NULLGL_CALL(); return 0; }
+static void APIENTRY NullGL_VertexAttribPointer (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer)	{ NULLGL_CALL(); }
+static void APIENTRY NullGL_VertexAttribArray (GLuint index)						{ NULLGL_COUNT(state); }
+static void APIENTRY NullGL_Uniform1i (GLint location, GLint v0)					{ NULLGL_COUNT(uniforms); }
+static void APIENTRY NullGL_Uniform1f (GLint location, GLfloat v0)					{ NULLGL_COUNT(uniforms); }
+static void APIENTRY NullGL_Uniform3f (GLint location, GLfloat v0, GLfloat v1, GLfloat v2)	{ NULLGL_COUNT(uniforms); }
+static void APIENTRY NullGL_Uniform4f (GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)	{ NULLGL_COUNT(uniforms); }
+static void APIENTRY NullGL_Uniform4fv (GLint location, GLsizei count, const GLfloat *value)	{ NULLGL_COUNT(uniforms); }
+static void APIENTRY NullGL_UniformMatrix4fv (GLuint loc, GLuint count, GLboolean row_major, const GLfloat* data)	{ NULLGL_COUNT(uniforms); }
+
+static void APIENTRY NullGL_CompressedTexImage2D (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const GLvoid *data)
+{
+	NULLGL_COUNT(texuploads);
+	nullgl_frame.texbytes += imageSize;
+}
+
+static void APIENTRY NullGL_GenNamesv (GLuint num, GLuint *ids)					{ NULLGL_CALL(); NullGL_GenNames (num, ids); }
+static void APIENTRY NullGL_DeleteNamesv (GLuint num, GLuint *ids)					{ NULLGL_CALL(); }
+static void APIENTRY NullGL_BindVertexArray (GLuint id)							{ NULLGL_COUNT(state); }
+static void APIENTRY NullGL_BindFramebuffer (GLenum target, GLuint id)				{ NULLGL_COUNT(state); }
+static GLenum APIENTRY NullGL_CheckFramebufferStatus (GLenum target)				{ NULLGL_CALL(); return GL_FRAMEBUFFER_COMPLETE; }
+static void APIENTRY NullGL_FramebufferTexture (GLenum target, GLenum attachment, GLuint tex_id, GLint level)	{ NULLGL_CALL(); }
+static void APIENTRY NullGL_FramebufferTexture2D (GLenum target, GLenum attachment, GLenum tex_target, GLuint tex_id, GLint level)	{ NULLGL_CALL(); }
+static void APIENTRY NullGL_BindBufferBase (GLenum target, GLuint index, GLuint buffer)	{ NULLGL_COUNT(state); }
+static void APIENTRY NullGL_UniformBlockBinding (GLuint program, GLuint block_index, GLuint binding_point)	{ NULLGL_CALL(); }
+static GLuint APIENTRY NullGL_GetUniformBlockIndex (GLuint program, const GLchar* name)	{ NULLGL_CALL(); return 0; }
+static GLvoid* APIENTRY NullGL_MapBuffer (GLenum target, GLenum access)			{ NULLGL_CALL(); return NULL; }
+static void APIENTRY NullGL_UnmapBuffer (GLenum target)							{ NULLGL_CALL(); }
+
+static const struct
+{
+	const char	*name;
+	void		*func;
+} nullgl_procs[] =
+{
+	{"glMultiTexCoord2fARB",		(void *) NullGL_MultiTexCoord2f},
+	{"glActiveTextureARB",			(void *) NullGL_ActiveTexture},
+	{"glClientActiveTextureARB",	(void *) NullGL_ClientActiveTexture},
+	{"glBindBufferARB",				(void *) NullGL_BindBuffer},
+	{"glBufferDataARB",				(void *) NullGL_BufferData},
+	{"glBufferSubDataARB",			(void *) NullGL_BufferSubData},
+	{"glDeleteBuffersARB",			(void *) NullGL_DeleteBuffers},
+	{"glGenBuffersARB",				(void *) NullGL_GenBuffers},
+	{"glCreateShader",				(void *) NullGL_CreateShader},
+	{"glDeleteShader",				(void *) NullGL_DeleteShader},
+	{"glDeleteProgram",				(void *) NullGL_DeleteProgram},
+	{"glShaderSource",				(void *) NullGL_ShaderSource},
+	{"glCompileShader",				(void *) NullGL_CompileShader},
+	{"glGetShaderiv",				(void *) NullGL_GetShaderiv},
+	{"glGetShaderInfoLog",			(void *) NullGL_GetShaderInfoLog},
+	{"glGetProgramiv",				(void *) NullGL_GetProgramiv},
+	{"glGetProgramInfoLog",			(void *) NullGL_GetShaderInfoLog},
+	{"glCreateProgram",				(void *) NullGL_CreateProgram},
+	{"glAttachShader",				(void *) NullGL_AttachShader},
+	{"glLinkProgram",				(void *) NullGL_LinkProgram},
+	{"glBindAttribLocation",		(void *) NullGL_BindAttribLocation},
+	{"glUseProgram",				(void *) NullGL_UseProgram},
+	{"glGetAttribLocation",			(void *) NullGL_GetLocation},
+	{"glVertexAttribPointer",		(void *) NullGL_VertexAttribPointer},
+	{"glEnableVertexAttribArray",	(void *) NullGL_VertexAttribArray},
+	{"glDisableVertexAttribArray",	(void *) NullGL_VertexAttribArray},
+	{"glGetUniformLocation",		(void *) NullGL_GetLocation},
+	{"glUniform1i",					(void *) NullGL_Uniform1i},
+	{"glUniform1f",					(void *) NullGL_Uniform1f},
+	{"glUniform3f",					(void *) NullGL_Uniform3f},
+	{"glUniform4f",					(void *) NullGL_Uniform4f},
+	{"glUniform4fv",				(void *) NullGL_Uniform4fv},
+	{"glUniformMatrix4fv",			(void *) NullGL_UniformMatrix4fv},
+	{"glCompressedTexImage2D",		(void *) NullGL_CompressedTexImage2D},
+	{"glGenVertexArrays",			(void *) NullGL_GenNamesv},
+	{"glDeleteVertexArrays",		(void *) NullGL_DeleteNamesv},
+	{"glBindVertexArray",			(void *) NullGL_BindVertexArray},
+	{"glGenFramebuffers",			(void *) NullGL_GenNamesv},
+	{"glBindFramebuffer",			(void *) NullGL_BindFramebuffer},
+	{"glCheckFramebufferStatus",	(void *) NullGL_CheckFramebufferStatus},
+	{"glFramebufferTexture",		(void *) NullGL_FramebufferTexture},
+	{"glFramebufferTexture2D",		(void *) NullGL_FramebufferTexture2D},
+	{"glBindBufferBase",			(void *) NullGL_BindBufferBase},
+	{"glUniformBlockBinding",		(void *) NullGL_UniformBlockBinding},
+	{"glGetUniformBlockIndex",		(void *) NullGL_GetUniformBlockIndex},
+	{"glMapBuffer",					(void *) NullGL_MapBuffer},
+	{"glUnmapBuffer",				(void *) NullGL_UnmapBuffer},
+};
+
+/*
+====================
+GLNull_GetProcAddress
+
+stands in for SDL_GL_GetProcAddress. unknown names return NULL, exactly like a driver lacking the extension.
+====================
+*/
+void *GLNull_GetProcAddress (const char *name)
+{
+	size_t i;
+	for (i = 0; i < sizeof(nullgl_procs)/sizeof(nullgl_procs[0]); i++)
+		if (!strcmp (nullgl_procs[i].name, name))
+			return nullgl_procs[i].func;
+	return NULL;
+}
+
+/*
+=============================================================================
+
+STATISTICS
+
+=============================================================================
+*/
+
+/*
+====================
+GLNull_EndFrame
+
+called in place of the buffer swap. folds the frame's counters into the running totals.
+====================
+*/
+void GLNull_EndFrame (void)
+{
+	nullgl_total.calls += nullgl_frame.calls;
+	nullgl_total.draws += nullgl_frame.draws;
+	nullgl_total.indexes += nullgl_frame.indexes;
+	nullgl_total.state += nullgl_frame.state;
+	nullgl_total.texbinds += nullgl_frame.texbinds;
+	nullgl_total.texuploads += nullgl_frame.texuploads;
+	nullgl_total.texbytes += nullgl_frame.texbytes;
+	nullgl_total.bufuploads += nullgl_frame.bufuploads;
+	nullgl_total.bufbytes += nullgl_frame.bufbytes;
+	nullgl_total.programs += nullgl_frame.programs;
+	nullgl_total.uniforms += nullgl_frame.uniforms;
+	memset (&nullgl_frame, 0, sizeof(nullgl_frame));
+	nullgl_frames++;
+}
+
+static void GLNull_Stats_f (void)
+{
+	double f;
+
+	if (Cmd_Argc() > 1 && !strcmp (Cmd_Argv(1), "reset"))
+	{
+		memset (&nullgl_total, 0, sizeof(nullgl_total));
+		nullgl_frames = 0;
+		return;
+	}
+
+	f = nullgl_frames ? nullgl_frames : 1;
+	Con_Printf ("null gl: %u frames\n", nullgl_frames);
+	Con_Printf ("%-12s %12s %12s\n", "", "total", "per frame");
+	Con_Printf ("%-12s %12u %12.1f\n", "gl calls", nullgl_total.calls, nullgl_total.calls / f);
+	Con_Printf ("%-12s %12u %12.1f\n", "draws", nullgl_total.draws, nullgl_total.draws / f);
+	Con_Printf ("%-12s %12u %12.1f\n", "indexes", nullgl_total.indexes, nullgl_total.indexes / f);
+	Con_Printf ("%-12s %12u %12.1f\n", "state", nullgl_total.state, nullgl_total.state / f);
+	Con_Printf ("%-12s %12u %12.1f\n", "tex binds", nullgl_total.texbinds, nullgl_total.texbinds / f);
+	Con_Printf ("%-12s %12u %12.1f\n", "tex uploads", nullgl_total.texuploads, nullgl_total.texuploads / f);
+	Con_Printf ("%-12s %12.0f %12.1f\n", "tex kb", nullgl_total.texbytes / 1024.0, nullgl_total.texbytes / 1024.0 / f);
+	Con_Printf ("%-12s %12u %12.1f\n", "buf uploads", nullgl_total.bufuploads, nullgl_total.bufuploads / f);
+	Con_Printf ("%-12s %12.0f %12.1f\n", "buf kb", nullgl_total.bufbytes / 1024.0, nullgl_total.bufbytes / 1024.0 / f);
+	Con_Printf ("%-12s %12u %12.1f\n", "programs", nullgl_total.programs, nullgl_total.programs / f);
+	Con_Printf ("%-12s %12u %12.1f\n", "uniforms", nullgl_total.uniforms, nullgl_total.uniforms / f);
+}
+
+void GLNull_Init (void)
+{
+	Cmd_AddCommand ("gl_nullstats", GLNull_Stats_f);
+}
+
+#endif /* USE_NULLGL */
@@ -980,12 +980,18 @@ void R_RenderScene (void)
 
 	Fog_EnableGFog (); //johnfitz
 
+	PROF_BEGIN (PROF_R_SKY);
 	Sky_DrawSky (); //johnfitz
+	PROF_END (PROF_R_SKY);
 
+	PROF_BEGIN (PROF_R_SHADOWMAP);
 	R_Shadow_RenderShadowMap ();
+	PROF_END (PROF_R_SHADOWMAP);
 	if (r_shadow_sundebug.value) { return; }
 
+	PROF_BEGIN (PROF_R_WORLD);
 	R_DrawWorld ();
+	PROF_END (PROF_R_WORLD);
 	currententity = NULL;
 
 	S_ExtraUpdate (); // don't let sound get messed up if going slow
@@ -993,13 +999,19 @@ void R_RenderScene (void)
 	if (r_refdef.drawworld)
 		R_DrawShadows (); //johnfitz -- render entity shadows
 
+	PROF_BEGIN (PROF_R_ENTITIES);
 	R_DrawEntitiesOnList (false); //johnfitz -- false means this is the pass for nonalpha entities
 	R_FlushSprites ();
+	PROF_END (PROF_R_ENTITIES);
 
+	PROF_BEGIN (PROF_R_WATER);
 	R_DrawWorld_Water (); //johnfitz -- drawn here since they might have transparency
+	PROF_END (PROF_R_WATER);
 
+	PROF_BEGIN (PROF_R_TRANSLUCENT);
 	R_DrawEntitiesOnList (true); //johnfitz -- true means this is the pass for alpha entities
 	R_FlushSprites ();
+	PROF_END (PROF_R_TRANSLUCENT);
 
 	R_PrintSpriteInfo ();
 
@@ -1007,15 +1019,19 @@ void R_RenderScene (void)
 
 	if (r_refdef.drawworld)
 	{
+		PROF_BEGIN (PROF_R_PARTICLES);
 		R_DrawParticles ();
 #ifdef PSET_SCRIPT
 		PScript_DrawParticles();
 #endif
+		PROF_END (PROF_R_PARTICLES);
 	}
 
 	Fog_DisableGFog (); //johnfitz
 
+	PROF_BEGIN (PROF_R_VIEWMODEL);
 	R_DrawViewModel (); //johnfitz -- moved here from R_RenderView
+	PROF_END (PROF_R_VIEWMODEL);
 
 	R_ShowTris (); //johnfitz
 
@@ -1162,6 +1178,8 @@ void R_RenderView (void)
 	if (r_refdef.drawworld && !cl.worldmodel)
 		Sys_Error ("R_RenderView: NULL worldmodel");
 
+	PROF_BEGIN (PROF_R_RENDERVIEW);
+
 	time1 = 0; /* avoid compiler warning */
 	if (r_speeds.value)
 	{
@@ -1224,7 +1242,9 @@ void R_RenderView (void)
 	skyroom_drawing = false;
 	//skyroom end
 
+	PROF_BEGIN (PROF_R_SETUPVIEW);
 	R_SetupView (); //johnfitz -- this does everything that should be done once per frame
+	PROF_END (PROF_R_SETUPVIEW);
 
 	//johnfitz -- stereo rendering -- full of hacky goodness
 	if (r_stereo.value)
@@ -1274,6 +1294,7 @@ void R_RenderView (void)
 	//skyroom end
 
 	R_ScaleView ();
+	PROF_END (PROF_R_RENDERVIEW);
 
 	//johnfitz -- modified r_speeds output
 	time2 = Sys_DoubleTime ();
@@ -639,6 +639,38 @@ void SCR_DrawDevStats (void)
 	Draw_String (x, (y++)*8-x, str);
 }
 
+/*
+==============
+SCR_DrawLerpBuffer
+==============
+*/
+void SCR_DrawLerpBuffer (void)
+{
+	extern cvar_t cl_lerpbuffer_show;
+	char	str[40];
+	int		y = 25-4-(devstats.value?9:0);
+	int		x = 0;
+
+	if (!cl_lerpbuffer_show.value || cls.state != ca_connected)
+		return;
+
+	GL_SetCanvas (CANVAS_BOTTOMLEFT);
+
+	Draw_Fill (x, y*8, 19*8, 4*8, 0, 0.5); //dark rectangle
+
+	sprintf (str, "buffer  %5.0fms", (cl.mtime[0]-cl.time)*1000);
+	Draw_String (x, (y++)*8-x, str);
+
+	sprintf (str, "delay   %5.0fms", cl.lerpdelay*1000);
+	Draw_String (x, (y++)*8-x, str);
+
+	sprintf (str, "jitter  %5.0fms", cl.snapjitter*1000);
+	Draw_String (x, (y++)*8-x, str);
+
+	sprintf (str, "late    %7i", cl.latesnapshots);
+	Draw_String (x, (y++)*8-x, str);
+}
+
 /*
 ==============
 SCR_DrawRam
@@ -1248,6 +1280,7 @@ void SCR_UpdateScreen (void)
 		SCR_DrawPause ();
 		SCR_CheckDrawCenterString ();
 		SCR_DrawDevStats (); //johnfitz
+		SCR_DrawLerpBuffer ();
 		SCR_DrawFPS (); //johnfitz
 		SCR_DrawClock (); //johnfitz
 		SCR_DrawConsole ();
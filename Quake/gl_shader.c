@@ -104,5 +104,5 @@ qboolean GL_CreateShaderFromVGF(
 }
 
 void GL_DestroyShader(gl_shader_t* sh) {
-	GL_DeleteProgramFunc (1, &sh->program_id);
+	GL_DeleteProgramFunc (sh->program_id);
 }
\ No newline at end of file
@@ -866,6 +866,36 @@ static unsigned *TexMgr_ResampleTexture (unsigned *in, int inwidth, int inheight
 	return out;
 }
 
+/*
+================
+TexMgr_ResampleMipMap -- the cpu side of a 32bit upload, for bench.c
+
+pads to power of two if the hardware needs it, then builds the whole mip chain in place.
+================
+*/
+void TexMgr_ResampleMipMap (unsigned *data, int width, int height)
+{
+	int	mark = Hunk_LowMark ();
+
+	data = TexMgr_ResampleTexture (data, width, height, true);
+	width = TexMgr_Pad (width);
+	height = TexMgr_Pad (height);
+	while (width > 1 || height > 1)
+	{
+		if (width > 1)
+		{
+			TexMgr_MipMapW (data, width, height);
+			width >>= 1;
+		}
+		if (height > 1)
+		{
+			TexMgr_MipMapH (data, width, height);
+			height >>= 1;
+		}
+	}
+	Hunk_FreeToLowMark (mark);
+}
+
 /*
 ===============
 TexMgr_AlphaEdgeFix
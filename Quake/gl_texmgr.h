@@ -105,6 +105,7 @@ void TexMgr_ReloadNobrightImages (void);
 int TexMgr_Pad(int s);
 int TexMgr_SafeTextureSize (int s);
 int TexMgr_PadConditional (int s);
+void TexMgr_ResampleMipMap (unsigned *data, int width, int height);
 
 // TEXTURE BINDING & TEXTURE UNIT SWITCHING
 
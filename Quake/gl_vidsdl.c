@@ -41,6 +41,14 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <OpenGL/OpenGL.h>
 #endif
 
+#ifdef USE_NULLGL
+#if !defined(USE_SDL2)
+#error USE_NULLGL requires SDL2
+#endif
+//no gl context exists: SDL's dummy driver provides the window and gl_null.c the entry points
+#define SDL_GL_GetProcAddress GLNull_GetProcAddress
+#endif
+
 #define MAX_MODE_LIST	600 //johnfitz -- was 30
 #define MAX_BPPS_LIST	5
 #define MAX_RATES_LIST	20
@@ -640,7 +648,11 @@ static qboolean VID_SetMode (int width, int height, int refreshrate, int bpp, qb
 	/* Create the window if needed, hidden */
 	if (!draw_context)
 	{
+#ifdef USE_NULLGL
+		flags = SDL_WINDOW_HIDDEN;
+#else
 		flags = SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN;
+#endif
 
 		if (vid_borderless.value)
 			flags |= SDL_WINDOW_BORDERLESS;
@@ -698,12 +710,14 @@ static qboolean VID_SetMode (int width, int height, int refreshrate, int bpp, qb
 
 	SDL_ShowWindow (draw_context);
 
+#ifndef USE_NULLGL
 	/* Create GL context if needed */
 	if (!gl_context) {
 		gl_context = SDL_GL_CreateContext(draw_context);
 		if (!gl_context)
 			Sys_Error("Couldn't create GL context");
 	}
+#endif
 
 	gl_swap_control = true;
 	if (SDL_GL_SetSwapInterval ((vid_vsync.value) ? 1 : 0) == -1)
@@ -1437,7 +1451,9 @@ void GL_EndRendering (void)
 {
 	if (!scr_skipupdate)
 	{
-#if defined(USE_SDL2)
+#if defined(USE_NULLGL)
+		GLNull_EndFrame ();
+#elif defined(USE_SDL2)
 		SDL_GL_SwapWindow(draw_context);
 #else
 		SDL_GL_SwapBuffers();
@@ -1649,6 +1665,9 @@ VID_Init
 void	VID_Init (void)
 {
 	static char vid_center[] = "SDL_VIDEO_CENTERED=center";
+#ifdef USE_NULLGL
+	static char vid_nulldriver[] = "SDL_VIDEODRIVER=dummy";
+#endif
 	int		p, width, height, refreshrate, bpp;
 	int		display_width, display_height, display_refreshrate, display_bpp;
 	qboolean	fullscreen;
@@ -1689,6 +1708,10 @@ void	VID_Init (void)
 	Cmd_AddCommand ("vid_describemodes", VID_DescribeModes_f);
 
 	putenv (vid_center);	/* SDL_putenv is problematic in versions <= 1.2.9 */
+#ifdef USE_NULLGL
+	if (!getenv ("SDL_VIDEODRIVER"))
+		putenv (vid_nulldriver);	/* headless unless the user asks for a real driver */
+#endif
 
 	if (SDL_InitSubSystem(SDL_INIT_VIDEO) < 0)
 		Sys_Error("Couldn't init SDL video: %s", SDL_GetError());
@@ -1818,6 +1841,9 @@ void	VID_Init (void)
 	GL_Init ();
 	GL_SetupState ();
 	Cmd_AddCommand ("gl_info", GL_Info_f); //johnfitz
+#ifdef USE_NULLGL
+	GLNull_Init ();
+#endif
 
 	//johnfitz -- removed code creating "glquake" subdirectory
 
@@ -26,6 +26,13 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 void GL_BeginRendering (int *x, int *y, int *width, int *height);
 void GL_EndRendering (void);
+
+#ifdef USE_NULLGL
+// gl_null.c -- null backend for headless cpu benchmarking
+void *GLNull_GetProcAddress (const char *name);
+void GLNull_EndFrame (void);
+void GLNull_Init (void);
+#endif
 void GL_Set2D (void);
 
 extern	int glx, gly, glwidth, glheight;
@@ -279,6 +279,885 @@ void Host_Callback_Notify (cvar_t *var)
 		SV_BroadcastPrintf ("\"%s\" changed to \"%s\"\n", var->name, var->string);
 }
 
+/*
+===============================================================================
+
+LOAD TEST
+
+Headless bots that connect to a remote server over the network drivers,
+run through signon, then send usercmds at a fixed rate. Server messages
+are read and thrown away, only their sizes and timing are kept.
+Loopback only carries one connection, so the server needs to be another
+process, eg: quakespasm -dedicated -port 26001 +loadtest 64 127.0.0.1:26000
+
+===============================================================================
+*/
+
+static cvar_t	loadtest_rate = {"loadtest_rate", "30", CVAR_NONE};		// usercmds per second per bot
+static cvar_t	loadtest_fire = {"loadtest_fire", "0.3", CVAR_NONE};		// fraction of random steps spent shooting
+static cvar_t	loadtest_script = {"loadtest_script", "", CVAR_NONE};	// eg "f:2 fl:1 fa:0.5 <:0.25 j:0.5", empty for random
+static cvar_t	loadtest_timeout = {"loadtest_timeout", "30", CVAR_NONE};	// seconds allowed for signon
+
+typedef struct
+{
+	struct qsocket_s	*sock;
+	int			signon;			// last svc_signonnum seen
+	qboolean	failed;
+	qboolean	pending;		// reliable reply waiting on NET_CanSendMessage
+	sizebuf_t	message;
+	byte		msgbuf[1024];
+
+	int			protocol;
+	unsigned int	protocolflags;
+	float		servertime;		// from the last svc_time, echoed back for the server's ping
+
+	double		connecttime;
+	double		spawntime;
+	double		nextmove;
+	double		lastkeepalive;
+	double		lastsnap;
+	double		snapinterval;	// smoothed
+	double		snapjitter;		// smoothed deviation from snapinterval
+
+	int			step;
+	double		stepend;
+	vec3_t		viewangles;
+	float		turn;			// degrees per second
+	int			forward, side, up;
+	int			buttons, impulse;
+
+	unsigned int	bytesin, bytesout;
+	unsigned int	reliablein, unreliablein;
+	unsigned int	moves;
+} loadbot_t;
+
+static loadbot_t	*loadbots;
+static int			loadtest_count;
+static int			loadtest_connected;	// next bot to connect
+static char			loadtest_host[NET_NAMELEN];
+static double		loadtest_starttime;
+
+/*
+====================
+LoadTest_Stop
+====================
+*/
+static void LoadTest_Stop (void)
+{
+	int i;
+
+	for (i = 0; i < loadtest_count; i++)
+	{
+		if (loadbots[i].sock)
+			NET_Close (loadbots[i].sock);
+	}
+	free (loadbots);
+	loadbots = NULL;
+	loadtest_count = 0;
+	loadtest_connected = 0;
+}
+
+/*
+====================
+LoadTest_Stats
+====================
+*/
+static void LoadTest_Stats (void)
+{
+	int i, ingame = 0, signon = 0, failed = 0, rtts = 0, snaps = 0;
+	double bytesin = 0, bytesout = 0, moves = 0, rtt = 0, rttmax = 0, spawn = 0, spawnmax = 0;
+	double interval = 0, jitter = 0, elapsed;
+	loadbot_t *b;
+
+	for (i = 0, b = loadbots; i < loadtest_count; i++, b++)
+	{
+		bytesin += b->bytesin;
+		bytesout += b->bytesout;
+		moves += b->moves;
+		if (b->failed)
+		{
+			failed++;
+			continue;
+		}
+		if (!b->sock)
+			continue;
+		if (!b->spawntime)
+		{
+			signon++;
+			continue;
+		}
+		ingame++;
+		spawn += b->spawntime - b->connecttime;
+		spawnmax = q_max (spawnmax, b->spawntime - b->connecttime);
+		if (NET_QSocketGetRTT (b->sock))
+		{
+			rtt += NET_QSocketGetRTT (b->sock);
+			rttmax = q_max (rttmax, NET_QSocketGetRTT (b->sock));
+			rtts++;
+		}
+		if (b->snapinterval)
+		{
+			interval += b->snapinterval;
+			jitter += b->snapjitter;
+			snaps++;
+		}
+	}
+
+	elapsed = q_max (realtime - loadtest_starttime, 0.001);
+	Con_Printf ("%i bots to %s, %i in game, %i in signon, %i failed\n", loadtest_count, loadtest_host, ingame, signon, failed);
+	Con_Printf ("in %.1f kB/s, out %.1f kB/s, %.0f moves/s\n", bytesin / 1024 / elapsed, bytesout / 1024 / elapsed, moves / elapsed);
+	if (ingame)
+		Con_Printf ("signon %.0f ms avg, %.0f ms max\n", spawn * 1000 / ingame, spawnmax * 1000);
+	if (rtts)
+		Con_Printf ("rtt %.1f ms avg, %.1f ms max\n", rtt * 1000 / rtts, rttmax * 1000);
+	if (snaps)
+		Con_Printf ("updates every %.1f ms, %.1f ms jitter\n", interval * 1000 / snaps, jitter * 1000 / snaps);
+}
+
+/*
+====================
+LoadTest_f
+
+loadtest <count> <host> to start, loadtest stop, or just loadtest for stats
+====================
+*/
+static void LoadTest_f (void)
+{
+	int count;
+
+	if (Cmd_Argc () == 2 && !q_strcasecmp (Cmd_Argv (1), "stop"))
+	{
+		if (loadtest_count)
+			LoadTest_Stats ();
+		LoadTest_Stop ();
+		return;
+	}
+	if (Cmd_Argc () != 3)
+	{
+		if (loadtest_count)
+			LoadTest_Stats ();
+		else
+			Con_Printf ("usage: loadtest <count> <host>\n       loadtest stop\n");
+		return;
+	}
+
+	count = atoi (Cmd_Argv (1));
+	if (count < 1 || count > MAX_SCOREBOARD)
+	{
+		Con_Printf ("loadtest: count must be 1 to %i\n", MAX_SCOREBOARD);
+		return;
+	}
+
+	LoadTest_Stop ();
+	loadbots = (loadbot_t *) calloc (count, sizeof(*loadbots));
+	if (!loadbots)
+		return;
+	loadtest_count = count;
+	q_strlcpy (loadtest_host, Cmd_Argv (2), sizeof(loadtest_host));
+	loadtest_starttime = realtime;
+}
+
+/*
+====================
+LoadTest_NextStep
+
+Picks the bot's next movement, either from loadtest_script or at random
+====================
+*/
+static void LoadTest_NextStep (loadbot_t *b)
+{
+	const char *s = loadtest_script.string;
+	float duration;
+	int i;
+
+	b->forward = b->side = b->up = 0;
+	b->buttons = b->impulse = 0;
+	b->turn = 0;
+
+	if (!*s)
+	{
+		b->forward = (rand () % 3 - 1) * 320;
+		if (b->forward < 0 && rand () & 1)
+			b->forward = -b->forward;	// favour running forwards
+		b->side = (rand () % 3 - 1) * 350;
+		b->turn = (rand () % 181) - 90;
+		if (rand () % 10 == 0)
+			b->buttons |= 2;
+		if ((rand () & 0x7fff) < loadtest_fire.value * 0x8000)
+			b->buttons |= 1;
+		if (rand () % 20 == 0)
+			b->impulse = 1 + rand () % 8;
+		b->stepend = realtime + 0.25 + (rand () & 0x7fff) / (float)0x7fff * 1.25;
+		return;
+	}
+
+	// find the token for this step, wrapping around
+	for (i = 0; ; )
+	{
+		while (*s == ' ')
+			s++;
+		if (!*s)
+		{
+			if (!i)
+				break;
+			b->step = 0;
+			s = loadtest_script.string;
+			i = 0;
+			continue;
+		}
+		if (i == b->step)
+			break;
+		while (*s && *s != ' ')
+			s++;
+		i++;
+	}
+	b->step++;
+
+	duration = 1;
+	for (; *s && *s != ' '; s++)
+	{
+		switch (*s)
+		{
+		case 'f':	b->forward += 320;	break;
+		case 'b':	b->forward -= 320;	break;
+		case 'l':	b->side -= 350;		break;
+		case 'r':	b->side += 350;		break;
+		case 'u':	b->up += 200;		break;
+		case 'd':	b->up -= 200;		break;
+		case 'j':	b->buttons |= 2;	break;
+		case 'a':	b->buttons |= 1;	break;
+		case '<':	b->turn += 90;		break;
+		case '>':	b->turn -= 90;		break;
+		case ':':
+			duration = atof (s + 1);
+			while (s[1] && s[1] != ' ')
+				s++;
+			break;
+		default:
+			if (*s >= '1' && *s <= '8')
+				b->impulse = *s - '0';	// weapon switch
+			break;
+		}
+	}
+	b->stepend = realtime + q_max (duration, 0.01);
+}
+
+/*
+====================
+LoadTest_Find
+
+Searches a message for a byte sequence, returns the offset or -1
+====================
+*/
+static int LoadTest_Find (const byte *data, int size, const void *pattern, int len)
+{
+	int i;
+
+	for (i = size - len; i >= 0; i--)
+	{
+		if (!memcmp (data + i, pattern, len))
+			return i;
+	}
+	return -1;
+}
+
+/*
+====================
+LoadTest_ParseReliable
+
+There's no full parser here, the few things the bot cares about are found by
+looking for their byte patterns. Signon 2 follows the baselines, which could
+contain anything, so it's only trusted at the end of the message.
+====================
+*/
+static void LoadTest_ParseReliable (loadbot_t *b, const byte *data, int size)
+{
+	static const byte pext[] = {svc_stufftext, 'c','m','d',' ','p','e','x','t','\n'};
+	static const byte reconnect[] = {svc_stufftext, 'r','e','c','o','n','n','e','c','t','\n'};
+	byte signon[2];
+	int i, protocol;
+
+	if (LoadTest_Find (data, size, reconnect, sizeof(reconnect)) >= 0)
+		b->signon = 0;	// changelevel, the server will resend everything
+
+	if (LoadTest_Find (data, size, pext, sizeof(pext)) >= 0)
+	{	// no extensions, keeps the bots on the plain protocol
+		MSG_WriteByte (&b->message, clc_stringcmd);
+		MSG_WriteString (&b->message, "pext");
+	}
+
+	for (i = 0; i + 5 <= size; i++)
+	{
+		if (data[i] != svc_serverinfo)
+			continue;
+		protocol = data[i+1] | (data[i+2]<<8) | (data[i+3]<<16) | (data[i+4]<<24);
+		if (protocol != PROTOCOL_NETQUAKE && protocol != PROTOCOL_FITZQUAKE && protocol != PROTOCOL_RMQ)
+			continue;
+		b->protocol = protocol;
+		if (protocol == PROTOCOL_RMQ && i + 9 <= size)
+			b->protocolflags = data[i+5] | (data[i+6]<<8) | (data[i+7]<<16) | (data[i+8]<<24);
+		else
+			b->protocolflags = 0;
+		break;
+	}
+
+	signon[0] = svc_signonnum;
+	signon[1] = b->signon + 1;
+	if (signon[1] == 2)
+	{
+		if (size < 2 || memcmp (data + size - 2, signon, 2))
+			return;
+	}
+	else if (LoadTest_Find (data, size, signon, 2) < 0)
+		return;
+	b->signon = signon[1];
+
+	// same replies as CL_SignonReply
+	switch (b->signon)
+	{
+	case 1:
+		MSG_WriteByte (&b->message, clc_stringcmd);
+		MSG_WriteString (&b->message, va("name \"bot%i\"\n", (int)(b - loadbots)));
+		MSG_WriteByte (&b->message, clc_stringcmd);
+		MSG_WriteString (&b->message, "prespawn");
+		break;
+	case 2:
+		MSG_WriteByte (&b->message, clc_stringcmd);
+		MSG_WriteString (&b->message, va("color %i %i\n", rand () % 14, rand () % 14));
+		MSG_WriteByte (&b->message, clc_stringcmd);
+		MSG_WriteString (&b->message, "spawn ");
+		break;
+	case 3:
+		MSG_WriteByte (&b->message, clc_stringcmd);
+		MSG_WriteString (&b->message, "begin");
+		if (!b->spawntime)
+			b->spawntime = realtime;
+		b->nextmove = realtime;
+		break;
+	}
+}
+
+/*
+====================
+LoadTest_ParseUnreliable
+====================
+*/
+static void LoadTest_ParseUnreliable (loadbot_t *b, const byte *data, int size)
+{
+	double interval;
+	float time;
+
+	if (size >= 5 && data[0] == svc_time)
+	{
+		memcpy (&time, data + 1, 4);
+		b->servertime = LittleFloat (time);
+	}
+
+	if (b->lastsnap)
+	{
+		interval = realtime - b->lastsnap;
+		if (!b->snapinterval)
+			b->snapinterval = interval;
+		b->snapjitter += (fabs (interval - b->snapinterval) - b->snapjitter) / 16;
+		b->snapinterval += (interval - b->snapinterval) / 16;
+	}
+	b->lastsnap = realtime;
+}
+
+/*
+====================
+LoadTest_SendMove
+
+Same layout as CL_SendMove for a client without protocol extensions
+====================
+*/
+static void LoadTest_SendMove (loadbot_t *b, float frametime)
+{
+	sizebuf_t	buf;
+	byte		data[64];
+	int			i;
+
+	if (realtime >= b->stepend)
+		LoadTest_NextStep (b);
+	b->viewangles[YAW] = anglemod (b->viewangles[YAW] + b->turn * frametime);
+
+	buf.maxsize = sizeof(data);
+	buf.cursize = 0;
+	buf.data = data;
+	buf.allowoverflow = false;
+	buf.overflowed = false;
+
+	MSG_WriteByte (&buf, clc_move);
+	MSG_WriteFloat (&buf, b->servertime);
+	for (i = 0; i < 3; i++)
+	{
+		if (b->protocol == PROTOCOL_NETQUAKE && !NET_QSocketGetProQuakeAngleHack (b->sock))
+			MSG_WriteAngle (&buf, b->viewangles[i], b->protocolflags);
+		else
+			MSG_WriteAngle16 (&buf, b->viewangles[i], b->protocolflags);
+	}
+	MSG_WriteShort (&buf, b->forward);
+	MSG_WriteShort (&buf, b->side);
+	MSG_WriteShort (&buf, b->up);
+	MSG_WriteByte (&buf, b->buttons);
+	MSG_WriteByte (&buf, b->impulse);
+	b->impulse = 0;
+
+	if (NET_SendUnreliableMessage (b->sock, &buf) == -1)
+	{
+		b->failed = true;
+		return;
+	}
+	b->bytesout += buf.cursize;
+	b->moves++;
+}
+
+/*
+====================
+LoadTest_Frame
+====================
+*/
+static void LoadTest_Frame (void)
+{
+	loadbot_t	*b;
+	int			i, ret;
+	float		interval;
+
+	if (!loadtest_count)
+		return;
+
+	// connecting blocks until the server answers, so only one per frame
+	if (loadtest_connected < loadtest_count)
+	{
+		b = &loadbots[loadtest_connected++];
+		b->message.data = b->msgbuf;
+		b->message.maxsize = sizeof(b->msgbuf);
+		b->protocol = PROTOCOL_NETQUAKE;
+		b->connecttime = b->lastkeepalive = realtime;
+		b->sock = NET_ConnectRemote (loadtest_host);
+		if (!b->sock)
+		{
+			Con_Printf ("loadtest: bot %i couldn't connect to %s\n", loadtest_connected-1, loadtest_host);
+			b->failed = true;
+		}
+	}
+
+	interval = 1.0 / CLAMP (1, loadtest_rate.value, 1000);
+
+	for (i = 0, b = loadbots; i < loadtest_connected; i++, b++)
+	{
+		if (!b->sock || b->failed)
+			continue;
+
+		while ((ret = NET_GetMessage (b->sock)) > 0)
+		{
+			b->bytesin += net_message.cursize;
+			if (ret == 1)
+			{
+				b->reliablein++;
+				LoadTest_ParseReliable (b, net_message.data, net_message.cursize);
+			}
+			else
+			{
+				b->unreliablein++;
+				LoadTest_ParseUnreliable (b, net_message.data, net_message.cursize);
+			}
+		}
+		if (ret == -1)
+		{
+			Con_Printf ("loadtest: bot %i lost its connection\n", i);
+			b->failed = true;
+		}
+		else if (!b->spawntime && realtime - b->connecttime > loadtest_timeout.value)
+		{
+			Con_Printf ("loadtest: bot %i stuck at signon %i\n", i, b->signon);
+			b->failed = true;
+		}
+		if (b->failed)
+		{
+			NET_Close (b->sock);
+			b->sock = NULL;
+			continue;
+		}
+
+		// reliable replies, with a nop now and then so signon doesn't time out
+		if (!b->message.cursize && realtime - b->lastkeepalive > 1 && !b->spawntime)
+			MSG_WriteByte (&b->message, clc_nop);
+		if (b->message.cursize && NET_CanSendMessage (b->sock))
+		{
+			if (NET_SendMessage (b->sock, &b->message) == -1)
+			{
+				b->failed = true;
+				continue;
+			}
+			b->bytesout += b->message.cursize;
+			b->lastkeepalive = realtime;
+			SZ_Clear (&b->message);
+		}
+
+		if (b->spawntime && realtime >= b->nextmove)
+		{
+			LoadTest_SendMove (b, interval);
+			b->nextmove += interval;
+			if (b->nextmove < realtime)
+				b->nextmove = realtime;	// fell behind, don't burst
+		}
+	}
+}
+
+/*
+===============================================================================
+
+FRAME PROFILER
+
+Scoped timers around the main phases of a frame. Every scope is kept as an
+event in a ring of the last profile_frames frames, along with per-zone
+totals, for profile_dump (chrome://tracing or ui.perfetto.dev) and
+profile_summary. Nothing is recorded while profile_frames is 0.
+
+===============================================================================
+*/
+
+#define PROF_MAXEVENTS	1024	// per frame, later scopes still count towards the totals
+#define PROF_MAXDEPTH	32
+
+static const char *prof_zonenames[PROF_NUMZONES] =
+{
+	"Host_Frame",
+	"Host_ServerFrame",
+	"SV_RunClients",
+	"SV_Physics",
+	"SV_SendClientMessages",
+	"PR_ExecuteProgram",
+	"CL_SendCmd",
+	"CL_ReadFromServer",
+	"CL_RelinkEntities",
+	"SCR_UpdateScreen",
+	"R_RenderView",
+	"R_SetupView",
+	"Sky_DrawSky",
+	"R_Shadow_RenderShadowMap",
+	"R_DrawWorld",
+	"R_DrawEntitiesOnList",
+	"R_DrawWorld_Water",
+	"R_DrawEntitiesOnList (alpha)",
+	"R_DrawParticles",
+	"R_DrawViewModel",
+	"S_Update",
+	"NET_Poll",
+	"NET_GetMessage",
+	"NET_SendMessage",
+};
+
+typedef struct
+{
+	unsigned char	zone;
+	unsigned char	depth;
+	float			start;		// seconds since the frame started
+	float			duration;
+} profevent_t;
+
+typedef struct
+{
+	double		start;
+	float		duration;
+	int			numevents;
+	int			dropped;
+	float		zonetime[PROF_NUMZONES];	// outermost scopes only, so recursion isn't counted twice
+	int			zonecalls[PROF_NUMZONES];
+	profevent_t	events[PROF_MAXEVENTS];
+} profframe_t;
+
+static void Prof_Frames_f (cvar_t *var);
+static cvar_t	profile_frames = {"profile_frames", "0", CVAR_NONE};
+
+qboolean		prof_active;
+static profframe_t	*prof_frames;
+static int		prof_numframes;		// size of the ring
+static int		prof_framecount;	// frames recorded so far
+static profframe_t	*prof_frame;	// being recorded, NULL between frames
+
+static struct
+{
+	profzone_t	zone;
+	double		start;
+	int			event;
+} prof_stack[PROF_MAXDEPTH];
+static int		prof_depth;
+static int		prof_overdepth;		// scopes too deep to track
+static int		prof_open[PROF_NUMZONES];
+
+/*
+====================
+Prof_Begin
+====================
+*/
+void Prof_Begin (profzone_t zone)
+{
+	profevent_t *ev;
+
+	if (!prof_frame)
+		return;
+	if (prof_depth == PROF_MAXDEPTH)
+	{
+		prof_overdepth++;
+		return;
+	}
+
+	prof_stack[prof_depth].zone = zone;
+	prof_stack[prof_depth].start = Sys_DoubleTime ();
+	if (prof_frame->numevents < PROF_MAXEVENTS)
+	{
+		prof_stack[prof_depth].event = prof_frame->numevents++;
+		ev = &prof_frame->events[prof_stack[prof_depth].event];
+		ev->zone = zone;
+		ev->depth = prof_depth;
+		ev->start = prof_stack[prof_depth].start - prof_frame->start;
+		ev->duration = 0;
+	}
+	else
+	{
+		prof_stack[prof_depth].event = -1;
+		prof_frame->dropped++;
+	}
+	prof_open[zone]++;
+	prof_depth++;
+}
+
+/*
+====================
+Prof_End
+====================
+*/
+void Prof_End (profzone_t zone)
+{
+	double duration;
+	int i;
+
+	if (!prof_frame)
+		return;
+	if (prof_overdepth)
+	{
+		prof_overdepth--;
+		return;
+	}
+
+	// a Host_Error can skip ends, so unwind to the matching scope
+	for (i = prof_depth - 1; i >= 0; i--)
+	{
+		if (prof_stack[i].zone == zone)
+			break;
+	}
+	if (i < 0)
+		return;
+	while (prof_depth > i)
+	{
+		prof_depth--;
+		prof_open[prof_stack[prof_depth].zone]--;
+	}
+
+	duration = Sys_DoubleTime () - prof_stack[prof_depth].start;
+	if (prof_stack[prof_depth].event >= 0)
+		prof_frame->events[prof_stack[prof_depth].event].duration = duration;
+	if (!prof_open[zone])
+		prof_frame->zonetime[zone] += duration;
+	prof_frame->zonecalls[zone]++;
+}
+
+/*
+====================
+Prof_FrameBegin
+====================
+*/
+static void Prof_FrameBegin (void)
+{
+	if (!prof_numframes)
+		return;
+
+	prof_frame = &prof_frames[prof_framecount++ % prof_numframes];
+	memset (prof_frame, 0, offsetof(profframe_t, events));
+	prof_frame->start = Sys_DoubleTime ();
+	prof_depth = prof_overdepth = 0;
+	memset (prof_open, 0, sizeof(prof_open));
+	prof_active = true;
+	Prof_Begin (PROF_FRAME);
+}
+
+/*
+====================
+Prof_FrameEnd
+====================
+*/
+static void Prof_FrameEnd (void)
+{
+	if (!prof_frame)
+		return;
+	Prof_End (PROF_FRAME);
+	prof_frame->duration = prof_frame->zonetime[PROF_FRAME];
+	prof_frame = NULL;
+	prof_active = false;
+}
+
+/*
+====================
+Prof_LastFrame
+
+Copies the zone times (in seconds) of the last finished frame, for timedemo
+====================
+*/
+qboolean Prof_LastFrame (float *zonetime)
+{
+	int done = prof_framecount - (prof_frame ? 1 : 0);
+
+	if (!prof_numframes || done <= 0)
+		return false;
+	memcpy (zonetime, prof_frames[(done - 1) % prof_numframes].zonetime, sizeof(float) * PROF_NUMZONES);
+	return true;
+}
+
+const char *Prof_ZoneName (profzone_t zone)
+{
+	return prof_zonenames[zone];
+}
+
+/*
+====================
+Prof_Frames_f
+
+(re)allocates the ring when profile_frames changes
+====================
+*/
+static void Prof_Frames_f (cvar_t *var)
+{
+	int frames = CLAMP (0, (int)var->value, 4096);
+
+	prof_frame = NULL;
+	prof_active = false;
+	free (prof_frames);
+	prof_frames = NULL;
+	prof_numframes = prof_framecount = 0;
+
+	if (frames)
+	{
+		prof_frames = (profframe_t *) malloc (frames * sizeof(*prof_frames));
+		if (!prof_frames)
+		{
+			Con_Printf ("profile_frames: couldn't allocate %i frames\n", frames);
+			return;
+		}
+		prof_numframes = frames;
+	}
+}
+
+/*
+====================
+Prof_Dump_f
+
+Writes the recorded frames as chrome trace json
+====================
+*/
+static void Prof_Dump_f (void)
+{
+	char	name[MAX_OSPATH];
+	FILE	*f;
+	int		i, j, first, count;
+	double	base;
+	profframe_t	*frame;
+	profevent_t	*ev;
+	qboolean	comma = false;
+
+	if (!prof_framecount)
+	{
+		Con_Printf ("No frames recorded, set profile_frames first\n");
+		return;
+	}
+
+	q_snprintf (name, sizeof(name), "%s/%s", com_gamedir, Cmd_Argc () > 1 ? Cmd_Argv (1) : "profile");
+	COM_AddExtension (name, ".json", sizeof(name));
+	COM_CreatePath (name);
+	f = fopen (name, "w");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open file %s.\n", name);
+		return;
+	}
+
+	count = q_min (prof_framecount - (prof_frame ? 1 : 0), prof_numframes);
+	first = prof_framecount - (prof_frame ? 1 : 0) - count;
+	base = prof_frames[first % prof_numframes].start;
+
+	fprintf (f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (i = 0; i < count; i++)
+	{
+		frame = &prof_frames[(first + i) % prof_numframes];
+		for (j = 0, ev = frame->events; j < frame->numevents; j++, ev++)
+		{
+			fprintf (f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f",
+				comma ? ",\n" : "", prof_zonenames[ev->zone],
+				(frame->start - base + ev->start) * 1000000, ev->duration * 1000000);
+			if (ev->zone == PROF_FRAME)
+				fprintf (f, ",\"args\":{\"frame\":%i,\"dropped\":%i}", first + i, frame->dropped);
+			fprintf (f, "}");
+			comma = true;
+		}
+	}
+	fprintf (f, "\n]}\n");
+	fclose (f);
+	Con_Printf ("Wrote %i frames to %s\n", count, name);
+}
+
+static int Prof_CompareFloat (const void *a, const void *b)
+{
+	float fa = *(const float *)a, fb = *(const float *)b;
+	return (fa > fb) - (fa < fb);
+}
+
+/*
+====================
+Prof_Summary_f
+
+Per-zone p50/p99/max over the recorded frames, or the last N of them
+====================
+*/
+static void Prof_Summary_f (void)
+{
+	int		i, z, first, count, calls;
+	float	*times;
+	profframe_t	*frame;
+
+	count = q_min (prof_framecount - (prof_frame ? 1 : 0), prof_numframes);
+	if (Cmd_Argc () > 1)
+		count = CLAMP (0, atoi (Cmd_Argv (1)), count);
+	if (count <= 0)
+	{
+		Con_Printf ("No frames recorded, set profile_frames first\n");
+		return;
+	}
+	first = prof_framecount - (prof_frame ? 1 : 0) - count;
+
+	times = (float *) malloc (count * sizeof(*times));
+	if (!times)
+		return;
+
+	Con_Printf ("%i frames, times in ms:\n", count);
+	Con_Printf ("%-28s %7s %7s %7s %6s\n", "zone", "p50", "p99", "max", "calls");
+	for (z = 0; z < PROF_NUMZONES; z++)
+	{
+		for (i = 0, calls = 0; i < count; i++)
+		{
+			frame = &prof_frames[(first + i) % prof_numframes];
+			times[i] = frame->zonetime[z] * 1000;
+			calls += frame->zonecalls[z];
+		}
+		if (!calls)
+			continue;
+		qsort (times, count, sizeof(*times), Prof_CompareFloat);
+		Con_Printf ("%-28s %7.3f %7.3f %7.3f %6.1f\n", prof_zonenames[z],
+			times[count / 2], times[(count * 99) / 100], times[count - 1], (float)calls / count);
+	}
+	free (times);
+}
+
 /*
 =======================
 Host_InitLocal
@@ -326,6 +1205,17 @@ void Host_InitLocal (void)
 
 	Cvar_RegisterVariable (&temp1);
 
+	Cvar_RegisterVariable (&loadtest_rate);
+	Cvar_RegisterVariable (&loadtest_fire);
+	Cvar_RegisterVariable (&loadtest_script);
+	Cvar_RegisterVariable (&loadtest_timeout);
+	Cmd_AddCommand ("loadtest", LoadTest_f);
+
+	Cvar_RegisterVariable (&profile_frames);
+	Cvar_SetCallback (&profile_frames, Prof_Frames_f);
+	Cmd_AddCommand ("profile_dump", Prof_Dump_f);
+	Cmd_AddCommand ("profile_summary", Prof_Summary_f);
+
 	Host_FindMaxClients ();
 }
 
@@ -400,6 +1290,7 @@ void SV_BroadcastPrintf (const char *fmt, ...)
 	va_list		argptr;
 	char		string[1024];
 	int			i;
+	sizebuf_t	*demo;
 
 	va_start (argptr,fmt);
 	q_vsnprintf (string, sizeof(string), fmt, argptr);
@@ -413,6 +1304,11 @@ void SV_BroadcastPrintf (const char *fmt, ...)
 			MSG_WriteString (&svs.clients[i].message, string);
 		}
 	}
+	if ((demo = SV_DemoBuffer (true)))
+	{
+		MSG_WriteByte (demo, svc_print);
+		MSG_WriteString (demo, string);
+	}
 }
 
 /*
@@ -449,6 +1345,8 @@ void SV_DropClient (qboolean crash)
 	int		i;
 	client_t *client;
 
+	SV_Replay_RecordDrop (host_client - svs.clients);
+
 	if (!crash)
 	{
 		// send any final messages (don't check for errors)
@@ -481,6 +1379,7 @@ void SV_DropClient (qboolean crash)
 	host_client->netconnection = NULL;
 
 	SVFTE_DestroyFrames(host_client);	//release any delta state
+	SV_ReleaseSignonCache(host_client);
 
 // free the client (the body stays around)
 	host_client->active = false;
@@ -488,9 +1387,7 @@ void SV_DropClient (qboolean crash)
 	host_client->old_frags = -999999;
 	net_activeconnections--;
 
-	if (host_client->download.file)
-		fclose(host_client->download.file);
-	memset(&host_client->download, 0, sizeof(host_client->download));
+	Host_CloseDownload(host_client);
 
 // send notification to all clients
 	for (i = 0, client = svs.clients; i < svs.maxclients; i++, client++)
@@ -535,8 +1432,12 @@ void Host_ShutdownServer(qboolean crash)
 	if (!sv.active)
 		return;
 
+	SV_Replay_Shutdown ();	// drops any virtual clients while their qc can still run
+
 	sv.active = false;
 
+	SV_Demo_Stop ();
+
 // stop all client sounds immediately
 	if (cls.state == ca_connected)
 		CL_Disconnect ();
@@ -643,6 +1544,12 @@ qboolean Host_FilterTime (float time)
 {
 	float maxfps; //johnfitz
 
+	if (SV_Replay_Playing ())
+	{	// the replay sets the clocks itself, and runs its frames as fast as it can
+		oldrealtime = realtime;
+		return true;
+	}
+
 	realtime += time;
 
 	//johnfitz -- max fps cvar
@@ -698,6 +1605,7 @@ void Host_ServerFrame (void)
 {
 	int		i, active; //johnfitz
 	edict_t	*ent; //johnfitz
+	double	start = svmetrics.active ? Sys_DoubleTime () : 0;
 
 // run the world state
 	pr_global_struct->frametime = host_frametime;
@@ -709,12 +1617,18 @@ void Host_ServerFrame (void)
 	SV_CheckForNewClients ();
 
 // read client messages
+	PROF_BEGIN (PROF_SV_READCLIENTS);
 	SV_RunClients ();
+	PROF_END (PROF_SV_READCLIENTS);
 
 // move things around and think
 // always pause in single player if in console or menus
-	if (!sv.paused && (svs.maxclients > 1 || key_dest == key_game) )
+	if (!sv.paused && !SV_MenuPaused ())
+	{
+		PROF_BEGIN (PROF_SV_PHYSICS);
 		SV_Physics ();
+		PROF_END (PROF_SV_PHYSICS);
+	}
 
 //johnfitz -- devstats
 	if (cls.signon == SIGNONS)
@@ -733,7 +1647,12 @@ void Host_ServerFrame (void)
 //johnfitz
 
 // send all messages to the clients
+	PROF_BEGIN (PROF_SV_SENDCLIENTS);
 	SV_SendClientMessages ();
+	PROF_END (PROF_SV_SENDCLIENTS);
+
+	if (start)
+		SV_Metrics_Tick (Sys_DoubleTime () - start);
 }
 
 //used for cl.qcvm.GetModel (so ssqc+csqc can share builtins)
@@ -872,6 +1791,8 @@ void _Host_Frame (double time)
 	if (!Host_FilterTime (time))
 		return;			// don't run too fast, or packets will flood out
 
+	Prof_FrameBegin ();
+
 // get new key events
 	Key_UpdateForDest ();
 	IN_UpdateInputMode ();
@@ -887,6 +1808,7 @@ void _Host_Frame (double time)
 	Cbuf_Execute ();
 
 	NET_Poll();
+	LoadTest_Frame ();
 
 	if (cl.sendprespawn)
 	{
@@ -906,10 +1828,12 @@ void _Host_Frame (double time)
 	CL_AccumulateCmd ();
 
 	//Run the server+networking (client->server->client), at a different rate from everything else
-	if (accumtime >= host_netinterval)
+	if (accumtime >= host_netinterval || SV_Replay_Playing ())
 	{
 		float realframetime = host_frametime;
-		if (host_netinterval)
+		if (SV_Replay_Playing ())
+			accumtime = 0;	// the replay has its own frame times
+		else if (host_netinterval)
 		{
 			host_frametime = q_max(accumtime, host_netinterval);
 			accumtime -= host_frametime;
@@ -920,16 +1844,23 @@ void _Host_Frame (double time)
 		}
 		else
 			accumtime -= host_netinterval;
+		PROF_BEGIN (PROF_CL_SENDCMD);
 		CL_SendCmd ();
+		PROF_END (PROF_CL_SENDCMD);
 		if (sv.active)
 		{
+			PROF_BEGIN (PROF_SERVERFRAME);
 			PR_SwitchQCVM(&sv.qcvm);
+			SV_Replay_FrameBegin ();
 			Host_ServerFrame ();
+			SV_Replay_FrameEnd ();
 			PR_SwitchQCVM(NULL);
+			PROF_END (PROF_SERVERFRAME);
 		}
 		host_frametime = realframetime;
 		Cbuf_Waited();
 	}
+	SV_Metrics_Poll ();
 
 	if (cl.qcvm.progs)
 	{
@@ -941,18 +1872,25 @@ void _Host_Frame (double time)
 
 // fetch results from server
 	if (cls.state == ca_connected)
+	{
+		PROF_BEGIN (PROF_CL_READFROMSERVER);
 		CL_ReadFromServer ();
+		PROF_END (PROF_CL_READFROMSERVER);
+	}
 
 // update video
 	if (host_speeds.value)
 		time1 = Sys_DoubleTime ();
 
+	PROF_BEGIN (PROF_SCREEN);
 	SCR_UpdateScreen ();
+	PROF_END (PROF_SCREEN);
 
 	if (host_speeds.value)
 		time2 = Sys_DoubleTime ();
 
 // update audio
+	PROF_BEGIN (PROF_SOUND);
 	BGM_Update();	// adds music raw samples and/or advances midi driver
 	if (cl.listener_defined)
 	{
@@ -963,6 +1901,7 @@ void _Host_Frame (double time)
 		S_Update (r_origin, vpn, vright, vup);
 	else
 		S_Update (vec3_origin, vec3_origin, vec3_origin, vec3_origin);
+	PROF_END (PROF_SOUND);
 	CL_DecayLights ();
 
 	CDAudio_Update();
@@ -979,6 +1918,7 @@ void _Host_Frame (double time)
 
 	host_framecount++;
 
+	Prof_FrameEnd ();
 }
 
 void Host_Frame (double time)
@@ -1055,6 +1995,7 @@ void Host_Init (void)
 	Mod_Init ();
 	NET_Init ();
 	SV_Init ();
+	Bench_Init ();
 
 #ifdef QSS_DATE	//avoid non-determinism.
 	Con_Printf ("Exe: " ENGINE_NAME_AND_VER "\n");
@@ -1130,6 +2071,8 @@ void Host_Init (void)
 		if (!sv.active)
 			Cbuf_AddText ("startmap_dm\n");
 	}
+
+	Bench_AutoRun ();
 }
 
 
@@ -1157,6 +2100,7 @@ void Host_Shutdown(void)
 
 	Host_WriteConfiguration ();
 
+	SV_Metrics_Shutdown ();
 	NET_Shutdown ();
 
 	if (cls.state != ca_dedicated)
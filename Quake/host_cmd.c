@@ -506,6 +506,13 @@ static void Host_Status_f (void)
 			print_fn ("   %s\n", client->netconnection?NET_QSocketGetTrueAddressString(client->netconnection):"botclient");
 		else
 			print_fn ("   %s\n", client->netconnection?NET_QSocketGetMaskedAddressString(client->netconnection):"botclient");
+		if (client->netconnection)
+		{
+			if (SV_ClientRate(client))
+				print_fn ("   %u bytes/s (rate %i), %u deferred\n", client->ratebps, SV_ClientRate(client), client->deferredents);
+			else
+				print_fn ("   %u bytes/s, %u deferred\n", client->ratebps, client->deferredents);
+		}
 	}
 }
 
@@ -2517,11 +2524,26 @@ static void Host_Stopdemo_f (void)
 
 //=============================================================================
 //download stuff
+//the file is split into DOWNLOAD_CHUNKSIZE chunks, and up to DOWNLOAD_WINDOW of them are kept in flight at once.
+//the client acks each chunk it gets (the same clcdp_ackdownloaddata that dp uses), so only the ones that actually got lost are resent, once they've been unacked for a couple of round trips.
+
+cvar_t	sv_download_maxrate = {"sv_download_maxrate", "0", CVAR_NONE};	//bytes/sec per client, 0 for no cap beyond the window
+cvar_t	sv_download_share = {"sv_download_share", "0.5", CVAR_NONE};	//fraction of a rate-limited client's bandwidth that downloads may take
+cvar_t	sv_download_frompaks = {"sv_download_frompaks", "1", CVAR_NONE};	//allow files inside mods' paks/pk3s (never the base game's)
+
+void Host_CloseDownload(client_t *client)
+{
+	if (client->download.file)
+		fclose(client->download.file);
+	free(client->download.acked);
+	memset(&client->download, 0, sizeof(client->download));
+}
 
 static void Host_Download_f(void)
 {
 	const char *fname = Cmd_Argv(1);
 	int fsize;
+	unsigned int path_id = 0;
 	if (cmd_source == src_command)
 	{
 		//FIXME: add some sort of queuing thing
@@ -2536,25 +2558,19 @@ static void Host_Download_f(void)
 			SV_ClientPrintf("cancelling previous download\n");
 			MSG_WriteByte (&host_client->message, svc_stufftext);
 			MSG_WriteString (&host_client->message, "\nstopdownload\n");
-			fclose(host_client->download.file);
-			host_client->download.file = NULL;
 		}
-
-		host_client->download.size = 0;
-		host_client->download.started = false;
-		host_client->download.sendpos = 0;
-		host_client->download.ackpos = 0;
+		Host_CloseDownload(host_client);
 		
 		fsize = -1;
 		if (!COM_DownloadNameOkay(fname))
 			SV_ClientPrintf("refusing download of %s - restricted filename\n", fname);
 		else
 		{
-			fsize = COM_FOpenFile(fname, &host_client->download.file, NULL);
+			fsize = COM_FOpenFile(fname, &host_client->download.file, &path_id);
 			if (!host_client->download.file)
 				SV_ClientPrintf("server does not have file %s\n", fname);
-			else if (file_from_pak)
-			{
+			else if (file_from_pak && (!sv_download_frompaks.value || path_id == 1))
+			{	//path_id 1 is the base gamedir, whose paks are not ours to give away.
 				SV_ClientPrintf("refusing download of %s from inside pak\n", fname);
 				fclose(host_client->download.file);
 				host_client->download.file = NULL;
@@ -2567,10 +2583,14 @@ static void Host_Download_f(void)
 			}
 		}
 
-		host_client->download.size = (unsigned int)fsize;
 		if (host_client->download.file)
 		{
+			host_client->download.size = (unsigned int)fsize;
 			host_client->download.startpos = ftell(host_client->download.file);
+			//an empty file still gets one (empty) chunk, so the client has something to ack.
+			host_client->download.numchunks = q_max(1, (host_client->download.size + DOWNLOAD_CHUNKSIZE-1) / DOWNLOAD_CHUNKSIZE);
+			host_client->download.acked = calloc((host_client->download.numchunks+7)/8, 1);
+			host_client->download.srtt = 0.2;	//guess until we've measured it
 			Con_Printf("downloading %s to %s\n", fname, host_client->name);
 			MSG_WriteByte (&host_client->message, svc_stufftext);
 			MSG_WriteString (&host_client->message, va("\ncl_downloadbegin %u \"%s\"\n", host_client->download.size, fname));
@@ -2610,76 +2630,151 @@ static void Host_StartDownload_f(void)
 	if (cmd_source != src_client)
 		return;
 	if (host_client->download.file)
+	{
 		host_client->download.started = true;
+		host_client->download.tokentime = realtime;
+	}
 	else
 		SV_ClientPrintf("no download started\n");
 }
-//just writes download data onto the end of the outgoing unreliable buffer
-void Host_AppendDownloadData(client_t *client, sizebuf_t *buf)
+
+//how many bytes/sec the client's download may use, 0 for no limit.
+static double Host_DownloadRate(client_t *client)
+{
+	double rate = SV_ClientRate(client) * sv_download_share.value;
+	if (sv_download_maxrate.value > 0 && (rate <= 0 || rate > sv_download_maxrate.value))
+		rate = sv_download_maxrate.value;
+	return rate;
+}
+
+//writes a single chunk straight from the file into the message
+static qboolean Host_WriteDownloadChunk(client_t *client, sizebuf_t *buf, unsigned int chunk)
+{
+	unsigned int start = chunk*DOWNLOAD_CHUNKSIZE;
+	unsigned int size = q_min(DOWNLOAD_CHUNKSIZE, client->download.size - start);
+
+	if (buf->cursize+7+size > (unsigned int)buf->maxsize)
+		return false;	//no space
+
+	MSG_WriteByte(buf, svcdp_downloaddata);
+	MSG_WriteLong(buf, start);
+	MSG_WriteShort(buf, size);
+	if (size)
+	{
+		fseek(client->download.file, client->download.startpos+start, SEEK_SET);
+		if (fread(buf->data+buf->cursize, 1, size, client->download.file) < size)
+			memset(buf->data+buf->cursize, 0, size);	//some kind of error... at least don't send garbage
+		buf->cursize += size;
+	}
+	client->download.tokens -= size+7;
+	return true;
+}
+
+//writes download data onto the end of the outgoing unreliable buffer. returns true if there's more that could be sent right now.
+qboolean Host_AppendDownloadData(client_t *client, sizebuf_t *buf)
 {
-	if (buf->cursize+7 > buf->maxsize)
-		return;	//no space for anything
-	if (client->download.file && client->download.started)
+	unsigned int i, chunk;
+	double rto, rate;
+
+	if (!client->download.file || !client->download.started)
+		return false;
+
+	rate = Host_DownloadRate(client);
+	if (rate > 0)
 	{
-		byte tbuf[1400];	//don't be too aggressive, ethernet mtu is about 1450
-		unsigned int size = client->download.size - client->download.sendpos;
-		//size might be 0 at eof, and that's needed to avoid failure if we drop the last few packets
-		if (size > sizeof(tbuf))
-			size = sizeof(tbuf);
-		if ((int)size > buf->maxsize-(buf->cursize+7))
-			size = (int)(buf->maxsize-(buf->cursize+7));	//don't overflow
+		client->download.tokens += (realtime - client->download.tokentime) * rate;
+		if (client->download.tokens > rate * 0.25)
+			client->download.tokens = rate * 0.25;
+	}
+	else
+		client->download.tokens = buf->maxsize;	//one packet's worth per call, the window limits it overall
+	client->download.tokentime = realtime;
 
-		if (size && fread(tbuf, 1, size, host_client->download.file) < size)
-			client->download.ackpos = client->download.sendpos = client->download.size;	//some kind of error...
-		else
+	//resend anything that's been outstanding for a couple of round trips
+	rto = q_max(client->download.srtt*2, 0.05);
+	for (i = 0; i < client->download.numinflight; i++)
+	{
+		if (client->download.tokens <= 0)
+			return false;
+		if (realtime - client->download.inflight[i].senttime < rto)
+			continue;
+		if (!Host_WriteDownloadChunk(client, buf, client->download.inflight[i].chunk))
+			return buf->cursize > 0;	//try again in a fresh packet
+		client->download.inflight[i].senttime = realtime;
+		client->download.inflight[i].resent = true;
+		client->download.resends++;
+	}
+
+	//and new chunks while there's room in the window
+	while (client->download.numinflight < DOWNLOAD_WINDOW && client->download.nextchunk < client->download.numchunks)
+	{
+		if (client->download.tokens <= 0)
+			return false;
+		chunk = client->download.nextchunk;
+		if (!(client->download.acked[chunk>>3] & (1<<(chunk&7))))
 		{
-			MSG_WriteByte(buf, svcdp_downloaddata);
-			MSG_WriteLong(buf, client->download.sendpos);
-			MSG_WriteShort(buf, size);
-			SZ_Write(buf, tbuf, size);
-			client->download.sendpos += size;
+			if (!Host_WriteDownloadChunk(client, buf, chunk))
+				return buf->cursize > 0;	//try again in a fresh packet
+			client->download.inflight[client->download.numinflight].chunk = chunk;
+			client->download.inflight[client->download.numinflight].senttime = realtime;
+			client->download.inflight[client->download.numinflight].resent = false;
+			client->download.numinflight++;
 		}
+		client->download.nextchunk++;
 	}
+	return false;
 }
+
 //parses incoming acks from the client, so we know which parts of the file the client actually received.
 void Host_DownloadAck(client_t *client)
 {
 	unsigned int start = MSG_ReadLong();
 	unsigned int size = (unsigned short)MSG_ReadShort();
+	unsigned int chunk, i;
 
 	if (!client->download.started || !client->download.file)
 		return;
+	if (start % DOWNLOAD_CHUNKSIZE)
+		return;	//not one of ours
+	chunk = start / DOWNLOAD_CHUNKSIZE;
+	if (chunk >= client->download.numchunks || size != q_min(DOWNLOAD_CHUNKSIZE, client->download.size - start))
+		return;
 
-	if (client->download.ackpos < start)
+	for (i = 0; i < client->download.numinflight; i++)
 	{
-		client->download.sendpos = client->download.ackpos;//there was a gap, rewind to the known gap
-		fseek(client->download.file, host_client->download.startpos+client->download.sendpos, SEEK_SET);
+		if (client->download.inflight[i].chunk == chunk)
+		{
+			if (!client->download.inflight[i].resent)
+				client->download.srtt = client->download.srtt*0.875 + (realtime - client->download.inflight[i].senttime)*0.125;
+			client->download.inflight[i] = client->download.inflight[--client->download.numinflight];
+			break;
+		}
 	}
-	else if (client->download.ackpos < start+size)
-		client->download.ackpos = start+size;	//no loss yet.
-	//else FIXME: build a log of parts known to be acked to avoid resending them later, skip past them in acks
+	if (client->download.acked[chunk>>3] & (1<<(chunk&7)))
+		return;	//dupe
+	client->download.acked[chunk>>3] |= 1<<(chunk&7);
+	client->download.numacked++;
 
-	if (client->download.ackpos == client->download.size)
+	if (client->download.numacked == client->download.numchunks)
 	{
 		unsigned int hash = 0;
 		byte *data;
-		client->download.started = false;
 
 		data = malloc(client->download.size);
 		if (data)
 		{
-			fseek(client->download.file, host_client->download.startpos, SEEK_SET);
-			fread(data, 1, host_client->download.size, client->download.file);
-			hash = CRC_Block(data, host_client->download.size);
+			fseek(client->download.file, client->download.startpos, SEEK_SET);
+			fread(data, 1, client->download.size, client->download.file);
+			hash = CRC_Block(data, client->download.size);
 			free(data);
 		}
-		fclose(client->download.file);
-		client->download.file = NULL;
+		if (client->download.resends)
+			Con_DPrintf("download of %s to %s needed %u resends\n", client->download.name, client->name, client->download.resends);
 
-		MSG_WriteByte (&host_client->message, svc_stufftext);
-		MSG_WriteString (&host_client->message, va("cl_downloadfinished %u %u \"%s\"\n", client->download.size, hash, client->download.name));
-		*client->download.name = 0;
-		host_client->sendsignon = true;	//override any keepalive issues.
+		MSG_WriteByte (&client->message, svc_stufftext);
+		MSG_WriteString (&client->message, va("cl_downloadfinished %u %u \"%s\"\n", client->download.size, hash, client->download.name));
+		Host_CloseDownload(client);
+		client->sendsignon = true;	//override any keepalive issues.
 	}
 }
 
@@ -57,13 +57,18 @@ struct qsocket_s	*NET_CheckNewConnections (void);
 struct qsocket_s	*NET_Connect (const char *host);
 // called by client to connect to a host.  Returns -1 if not able to
 
+struct qsocket_s	*NET_ConnectRemote (const char *host);
+// same, but skips the server list and the loopback driver
+
 double NET_QSocketGetTime (const struct qsocket_s *sock);
+float NET_QSocketGetRTT (const struct qsocket_s *sock);
 const char *NET_QSocketGetTrueAddressString (const struct qsocket_s *sock);
 const char *NET_QSocketGetMaskedAddressString (const struct qsocket_s *sock);
 qboolean NET_QSocketGetProQuakeAngleHack (const struct qsocket_s *sock);
 int NET_QSocketGetSequenceIn (const struct qsocket_s *sock);
 int NET_QSocketGetSequenceOut (const struct qsocket_s *sock);
 void NET_QSocketSetMSS(struct qsocket_s *s, int mss);
+void NET_QSocketSetCompression(struct qsocket_s *s, qboolean enable);
 
 qboolean NET_CanSendMessage (struct qsocket_s *sock);
 // Returns true or false if the given qsocket can currently accept a
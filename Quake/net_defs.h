@@ -45,6 +45,7 @@ struct qsockaddr
 #define NETFLAG_NAK		0x00040000
 #define NETFLAG_EOM		0x00080000
 #define NETFLAG_UNRELIABLE	0x00100000
+#define NETFLAG_DEFLATE		0x00200000	//payload is raw deflate data (see PEXT2_ZLIBSTREAM)
 #define NETFLAG_CTL		0x80000000
 
 #if (NETFLAG_LENGTH_MASK & NET_MAXMESSAGE) != NET_MAXMESSAGE
@@ -135,6 +136,8 @@ typedef struct qsocket_s
 	double		connecttime;
 	double		lastMessageTime;
 	double		lastSendTime;
+	double		reliableSendTime;	// when the unacked reliable fragment was first sent, 0 once resent
+	float		rtt;				// smoothed from reliable acks, using their arrival times
 
 	qboolean	isvirtual;	//qsocket is emulated by the network layer (closing will not close any system sockets).
 	qboolean	disconnected;
@@ -164,6 +167,15 @@ typedef struct qsocket_s
 	qboolean proquake_angle_hack;	//1 if we're trying, 2 if the server acked.
 	int		max_datagram;			//32000 for local, 1442 for 666, 1024 for 15. this is for reliable fragments.
 	int		pending_max_datagram;	//don't change the mtu if we're resending, as that would confuse the peer.
+
+	qboolean	compress;		//peer negotiated PEXT2_ZLIBSTREAM, deflate what we send.
+	unsigned int	sendFlags;		//extra NETFLAG_ bits for every fragment of the current reliable.
+	void		*deflater, *inflater;	//persistent per-connection streams for reliables
+	void		*udeflater, *uinflater;	//reset per unreliable
+	unsigned int	rawBytesOut, deflatedBytesOut;
+	unsigned int	rawBytesIn, deflatedBytesIn;
+	unsigned int	bytesIn;			//every packet, headers included
+	unsigned int	datagramsIn, droppedIn;	//unreliables that arrived, and that went missing on the way
 } qsocket_t;
 
 extern qsocket_t	*net_activeSockets;
@@ -269,5 +281,15 @@ typedef struct _PollProcedure
 
 void SchedulePollProcedure(PollProcedure *pp, double timeOffset);
 
+qboolean NetSim_Active (qboolean in);
+void NetSim_Queue (qboolean in, qsocket_t *loopdest, qboolean reliable, int landriver, sys_socket_t socket, struct qsockaddr *addr, const byte *data, int length);
+int NetSim_Read (int landriver, sys_socket_t socket, byte *buf, int len, struct qsockaddr *addr);
+void NetSim_Purge (qsocket_t *loopdest, int landriver, sys_socket_t socket);
+void NetSim_Run (void);
+
+extern double net_packettime;
+int NET_ReadPacket (int landriver, sys_socket_t socket, byte *buf, int len, struct qsockaddr *addr);
+void NET_RecvThread_Remove (int landriver, sys_socket_t socket);
+
 #endif	/* __NET_DEFS_H */
 
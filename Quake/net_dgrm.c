@@ -28,6 +28,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 #include "net_defs.h"
 #include "net_dgrm.h"
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
 
 // these two macros are to make the code more readable
 #define sfunc	net_landrivers[sock->landriver]
@@ -42,6 +45,8 @@ static int packetsReceived = 0;
 static int receivedDuplicateCount = 0;
 static int shortPacketCount = 0;
 static int droppedDatagrams;
+static unsigned int rawBytesOut, deflatedBytesOut;
+static unsigned int rawBytesIn, deflatedBytesIn;
 
 //cvars controlling dpmaster support:
 //our servers might as well claim to be 'FTE-Quake' servers. this means FTE can see us, we can see FTE (when its pretending to be nq).
@@ -152,6 +157,128 @@ static void NET_Ban_f (void)
 #endif	// BAN_TEST
 
 
+/*
+====================
+Reliable/unreliable compression (PEXT2_ZLIBSTREAM)
+
+Reliables go through one deflate stream per connection that is never reset, so
+later messages can back-reference anything the peer has already been sent, which
+works because reliables arrive exactly once and in order. Large unreliables may
+be lost so they are deflated on their own. Each message ends with a sync flush
+whose empty stored block is stripped here and re-added by the receiver. A
+reliable that might not fit once deflated is sent as it is, without touching
+the stream, which the receiver can tell by the missing NETFLAG_DEFLATE.
+====================
+*/
+#ifdef USE_ZLIB
+#define DEFLATE_MINUNRELIABLE	256	//smaller unreliables are rarely worth it without a shared dictionary
+static const byte deflate_tail[4] = {0x00, 0x00, 0xff, 0xff};
+
+static z_stream *Datagram_NewStream (qboolean inflating)
+{
+	z_stream *strm = calloc(1, sizeof(*strm));
+	int err;
+	if (!strm)
+		return NULL;
+	if (inflating)
+		err = inflateInit2(strm, -MAX_WBITS);
+	else
+		err = deflateInit2(strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+	if (err != Z_OK)
+	{
+		free(strm);
+		return NULL;
+	}
+	return strm;
+}
+
+static void Datagram_FreeStreams (qsocket_t *sock)
+{
+	if (sock->deflater)
+		deflateEnd(sock->deflater);
+	if (sock->udeflater)
+		deflateEnd(sock->udeflater);
+	if (sock->inflater)
+		inflateEnd(sock->inflater);
+	if (sock->uinflater)
+		inflateEnd(sock->uinflater);
+	free(sock->deflater);
+	free(sock->udeflater);
+	free(sock->inflater);
+	free(sock->uinflater);
+	sock->deflater = sock->udeflater = sock->inflater = sock->uinflater = NULL;
+}
+
+//deflateBound assumes Z_FINISH, so this leaves some slack for the sync flush and the spare byte Datagram_Deflate insists on.
+static qboolean Datagram_DeflateFits (z_stream *strm, int inlen, int outmax)
+{
+	return deflateBound(strm, inlen) + 32 <= (uLong)outmax;
+}
+
+//returns the deflated size, or -1 if it didn't fit (which leaves a persistent stream unusable).
+static int Datagram_Deflate (z_stream *strm, qboolean persistent, const byte *in, int inlen, byte *out, int outmax)
+{
+	int outlen;
+	if (!persistent)
+		deflateReset(strm);
+	strm->next_in = (Bytef *)in;
+	strm->avail_in = inlen;
+	strm->next_out = out;
+	strm->avail_out = outmax;
+	if (deflate(strm, Z_SYNC_FLUSH) != Z_OK || strm->avail_in || !strm->avail_out)
+		return -1;
+	outlen = outmax - strm->avail_out;
+	if (outlen >= 4 && !memcmp(out + outlen - 4, deflate_tail, 4))
+		outlen -= 4;
+	return outlen;
+}
+
+//returns the inflated size, or -1 if the data was corrupt or too large.
+static int Datagram_Inflate (z_stream *strm, qboolean persistent, const byte *in, int inlen, byte *out, int outmax)
+{
+	int err;
+	if (!persistent)
+		inflateReset(strm);
+	strm->next_out = out;
+	strm->avail_out = outmax;
+	strm->next_in = (Bytef *)in;
+	strm->avail_in = inlen;
+	err = inflate(strm, Z_SYNC_FLUSH);
+	if ((err != Z_OK && err != Z_BUF_ERROR) || strm->avail_in)
+		return -1;
+	strm->next_in = (Bytef *)deflate_tail;
+	strm->avail_in = sizeof(deflate_tail);
+	err = inflate(strm, Z_SYNC_FLUSH);
+	if ((err != Z_OK && err != Z_BUF_ERROR) || strm->avail_in)
+		return -1;
+	return outmax - strm->avail_out;
+}
+#endif
+
+/*
+====================
+Datagram_Write / Datagram_Read
+
+A qsocket's datagrams go through here, so the network simulator can get at them.
+====================
+*/
+static int Datagram_Write (qsocket_t *sock, byte *data, int len)
+{
+	if (NetSim_Active(false))
+	{
+		NetSim_Queue (false, NULL, false, sock->landriver, sock->socket, &sock->addr, data, len);
+		return len;
+	}
+	return sfunc.Write (sock->socket, data, len, &sock->addr);
+}
+
+static int Datagram_Read (int landriver, sys_socket_t socket, byte *buf, int len, struct qsockaddr *addr)
+{
+	if (NetSim_Active(true))
+		return NetSim_Read (landriver, socket, buf, len, addr);
+	return NET_ReadPacket (landriver, socket, buf, len, addr);
+}
+
 int Datagram_SendMessage (qsocket_t *sock, sizebuf_t *data)
 {
 	unsigned int	packetLen;
@@ -169,14 +296,37 @@ int Datagram_SendMessage (qsocket_t *sock, sizebuf_t *data)
 		Sys_Error("SendMessage: called with canSend == false\n");
 #endif
 
-	Q_memcpy(sock->sendMessage, data->data, data->cursize);
-	sock->sendMessageLength = data->cursize;
+	sock->sendFlags = 0;
+#ifdef USE_ZLIB
+	if (sock->compress && !sock->deflater && !(sock->deflater = Datagram_NewStream(false)))
+		sock->compress = false;	//nothing was deflated yet, so the peer can cope with us giving up
+	if (sock->compress && Datagram_DeflateFits(sock->deflater, data->cursize, sizeof(sock->sendMessage)))
+	{	//incompressible messages close to NET_MAXMESSAGE could grow past it, so those skip this
+		int len = Datagram_Deflate(sock->deflater, true, data->data, data->cursize, sock->sendMessage, sizeof(sock->sendMessage));
+		if (len < 0)
+		{	//the peer's dictionary can no longer match ours
+			Con_Printf("Datagram_SendMessage: deflate overflow\n");
+			return -1;
+		}
+		sock->sendMessageLength = len;
+		sock->sendFlags = NETFLAG_DEFLATE;
+		sock->rawBytesOut += data->cursize;
+		sock->deflatedBytesOut += len;
+		rawBytesOut += data->cursize;
+		deflatedBytesOut += len;
+	}
+	else
+#endif
+	{
+		Q_memcpy(sock->sendMessage, data->data, data->cursize);
+		sock->sendMessageLength = data->cursize;
+	}
 
 	sock->max_datagram = sock->pending_max_datagram;	//this can apply only at the start of a reliable, to avoid issues with acks if its resized later.
 
-	if (data->cursize <= sock->max_datagram)
+	if (sock->sendMessageLength <= sock->max_datagram)
 	{
-		dataLen = data->cursize;
+		dataLen = sock->sendMessageLength;
 		eom = NETFLAG_EOM;
 	}
 	else
@@ -186,16 +336,17 @@ int Datagram_SendMessage (qsocket_t *sock, sizebuf_t *data)
 	}
 	packetLen = NET_HEADERSIZE + dataLen;
 
-	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom));
+	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom | sock->sendFlags));
 	packetBuffer.sequence = BigLong(sock->sendSequence++);
 	Q_memcpy (packetBuffer.data, sock->sendMessage, dataLen);
 
 	sock->canSend = false;
 
-	if (sfunc.Write (sock->socket, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
+	if (Datagram_Write (sock, (byte *)&packetBuffer, packetLen) == -1)
 		return -1;
 
 	sock->lastSendTime = net_time;
+	sock->reliableSendTime = Sys_DoubleTime();
 	packetsSent++;
 	return 1;
 }
@@ -219,16 +370,17 @@ static int SendMessageNext (qsocket_t *sock)
 	}
 	packetLen = NET_HEADERSIZE + dataLen;
 
-	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom));
+	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom | sock->sendFlags));
 	packetBuffer.sequence = BigLong(sock->sendSequence++);
 	Q_memcpy (packetBuffer.data, sock->sendMessage, dataLen);
 
 	sock->sendNext = false;
 
-	if (sfunc.Write (sock->socket, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
+	if (Datagram_Write (sock, (byte *)&packetBuffer, packetLen) == -1)
 		return -1;
 
 	sock->lastSendTime = net_time;
+	sock->reliableSendTime = Sys_DoubleTime();
 	packetsSent++;
 	return 1;
 }
@@ -252,16 +404,17 @@ static int ReSendMessage (qsocket_t *sock)
 	}
 	packetLen = NET_HEADERSIZE + dataLen;
 
-	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom));
+	packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | eom | sock->sendFlags));
 	packetBuffer.sequence = BigLong(sock->sendSequence - 1);
 	Q_memcpy (packetBuffer.data, sock->sendMessage, dataLen);
 
 	sock->sendNext = false;
 
-	if (sfunc.Write (sock->socket, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
+	if (Datagram_Write (sock, (byte *)&packetBuffer, packetLen) == -1)
 		return -1;
 
 	sock->lastSendTime = net_time;
+	sock->reliableSendTime = 0;	//can't tell which copy gets acked
 	packetsReSent++;
 	return 1;
 }
@@ -294,13 +447,36 @@ int Datagram_SendUnreliableMessage (qsocket_t *sock, sizebuf_t *data)
 		Sys_Error("Datagram_SendUnreliableMessage: message too big %u\n", data->cursize);
 #endif
 
+#ifdef USE_ZLIB
+	if (sock->compress && data->cursize >= DEFLATE_MINUNRELIABLE && (sock->udeflater || (sock->udeflater = Datagram_NewStream(false))))
+	{
+		int len = Datagram_Deflate(sock->udeflater, false, data->data, data->cursize, packetBuffer.data, data->cursize-1);
+		if (len >= 0)
+		{
+			sock->rawBytesOut += data->cursize;
+			sock->deflatedBytesOut += len;
+			rawBytesOut += data->cursize;
+			deflatedBytesOut += len;
+
+			packetLen = NET_HEADERSIZE + len;
+			packetBuffer.length = BigLong(packetLen | NETFLAG_UNRELIABLE | NETFLAG_DEFLATE);
+			packetBuffer.sequence = BigLong(sock->unreliableSendSequence++);
+			if (Datagram_Write (sock, (byte *)&packetBuffer, packetLen) == -1)
+				return -1;
+			packetsSent++;
+			return 1;
+		}
+		//else didn't shrink, send it as-is
+	}
+#endif
+
 	packetLen = NET_HEADERSIZE + data->cursize;
 
 	packetBuffer.length = BigLong(packetLen | NETFLAG_UNRELIABLE);
 	packetBuffer.sequence = BigLong(sock->unreliableSendSequence++);
 	Q_memcpy (packetBuffer.data, data->data, data->cursize);
 
-	if (sfunc.Write (sock->socket, (byte *)&packetBuffer, packetLen, &sock->addr) == -1)
+	if (Datagram_Write (sock, (byte *)&packetBuffer, packetLen) == -1)
 		return -1;
 
 	packetsSent++;
@@ -329,6 +505,7 @@ qboolean Datagram_ProcessPacket(unsigned int length, qsocket_t *sock)
 
 	sequence = BigLong(packetBuffer.sequence);
 	packetsReceived++;
+	sock->bytesIn += length;
 
 	if (flags & NETFLAG_UNRELIABLE)
 	{
@@ -341,12 +518,38 @@ qboolean Datagram_ProcessPacket(unsigned int length, qsocket_t *sock)
 		{
 			count = sequence - sock->unreliableReceiveSequence;
 			droppedDatagrams += count;
+			sock->droppedIn += count;
 			Con_DPrintf("Dropped %u datagram(s)\n", count);
 		}
 		sock->unreliableReceiveSequence = sequence + 1;
+		sock->datagramsIn++;
 
 		length -= NET_HEADERSIZE;
 
+		if (flags & NETFLAG_DEFLATE)
+		{
+#ifdef USE_ZLIB
+			int len = -1;
+			if (sock->uinflater || (sock->uinflater = Datagram_NewStream(true)))
+				len = Datagram_Inflate(sock->uinflater, false, packetBuffer.data, length, net_message.data, net_message.maxsize);
+			if (len < 0)
+			{
+				Con_DPrintf("Corrupt deflated datagram\n");
+				return false;
+			}
+			net_message.cursize = len;
+			sock->rawBytesIn += len;
+			sock->deflatedBytesIn += length;
+			rawBytesIn += len;
+			deflatedBytesIn += length;
+			unreliableMessagesReceived++;
+			return true;
+#else
+			Con_DPrintf("Unsupported deflated datagram\n");
+			return false;
+#endif
+		}
+
 		if (length > (unsigned int)net_message.maxsize)
 		{	//is this even possible? maybe it will be in the future! either way, no sys_errors please.
 			Con_Printf("Over-sized unreliable\n");
@@ -377,11 +580,17 @@ qboolean Datagram_ProcessPacket(unsigned int length, qsocket_t *sock)
 			Con_DPrintf("Duplicate ACK received\n");
 			return false;
 		}
+		if (sock->reliableSendTime)
+		{
+			float rtt = net_packettime - sock->reliableSendTime;
+			sock->rtt = sock->rtt ? sock->rtt + (rtt - sock->rtt)/8 : rtt;
+		}
 		sock->sendMessageLength -= sock->max_datagram;
 		if (sock->sendMessageLength > 0)
 		{
 			memmove (sock->sendMessage, sock->sendMessage + sock->max_datagram, sock->sendMessageLength);
 			sock->sendNext = true;
+			SendMessageNext (sock);	//don't wait for the end of the frame
 		}
 		else
 		{
@@ -395,7 +604,7 @@ qboolean Datagram_ProcessPacket(unsigned int length, qsocket_t *sock)
 	{
 		packetBuffer.length = BigLong(NET_HEADERSIZE | NETFLAG_ACK);
 		packetBuffer.sequence = BigLong(sequence);
-		sfunc.Write (sock->socket, (byte *)&packetBuffer, NET_HEADERSIZE, &sock->addr);
+		Datagram_Write (sock, (byte *)&packetBuffer, NET_HEADERSIZE);
 
 		if (sequence != sock->receiveSequence)
 		{
@@ -406,6 +615,39 @@ qboolean Datagram_ProcessPacket(unsigned int length, qsocket_t *sock)
 
 		length -= NET_HEADERSIZE;
 
+		if ((flags & (NETFLAG_EOM|NETFLAG_DEFLATE)) == (NETFLAG_EOM|NETFLAG_DEFLATE))
+		{
+#ifdef USE_ZLIB
+			int len = -1;
+			if (sock->receiveMessageLength + length > sizeof(sock->receiveMessage))
+			{
+				Con_Printf("Over-sized reliable\n");
+				return -1;
+			}
+			Q_memcpy(sock->receiveMessage + sock->receiveMessageLength, packetBuffer.data, length);
+			length += sock->receiveMessageLength;
+			sock->receiveMessageLength = 0;
+
+			if (sock->inflater || (sock->inflater = Datagram_NewStream(true)))
+				len = Datagram_Inflate(sock->inflater, true, sock->receiveMessage, length, net_message.data, net_message.maxsize);
+			if (len < 0)
+			{	//can't recover from this, our dictionary no longer matches.
+				Con_Printf("Corrupt deflated reliable\n");
+				return -1;
+			}
+			net_message.cursize = len;
+			sock->rawBytesIn += len;
+			sock->deflatedBytesIn += length;
+			rawBytesIn += len;
+			deflatedBytesIn += length;
+
+			messagesReceived++;
+			return true;	//parse this reliable!
+#else
+			Con_Printf("Unsupported deflated reliable\n");
+			return -1;
+#endif
+		}
 		if (flags & NETFLAG_EOM)
 		{
 			if (sock->receiveMessageLength + length > (unsigned int)net_message.maxsize)
@@ -452,7 +694,7 @@ qsocket_t *Datagram_GetAnyMessage(void)
 
 		while(1)
 		{
-			length = dfunc.Read(sock, (byte *)&packetBuffer, NET_DATAGRAMSIZE, &addr);
+			length = Datagram_Read(net_landriverlevel, sock, (byte *)&packetBuffer, NET_DATAGRAMSIZE, &addr);
 			if (length == -1 || !length)
 			{
 				//no more packets, move on to the next.
@@ -541,7 +783,7 @@ int	Datagram_GetMessage (qsocket_t *sock)
 
 	while (1)
 	{
-		length = (unsigned int) sfunc.Read(sock->socket, (byte *)&packetBuffer,
+		length = (unsigned int) Datagram_Read(sock->landriver, sock->socket, (byte *)&packetBuffer,
 							NET_DATAGRAMSIZE, &readaddr);
 
 	//	if ((rand() & 255) > 220)
@@ -592,6 +834,7 @@ int	Datagram_GetMessage (qsocket_t *sock)
 
 		sequence = BigLong(packetBuffer.sequence);
 		packetsReceived++;
+		sock->bytesIn += length;
 
 		if (flags & NETFLAG_UNRELIABLE)
 		{
@@ -605,9 +848,11 @@ int	Datagram_GetMessage (qsocket_t *sock)
 			{
 				count = sequence - sock->unreliableReceiveSequence;
 				droppedDatagrams += count;
+				sock->droppedIn += count;
 				Con_DPrintf("Dropped %u datagram(s)\n", count);
 			}
 			sock->unreliableReceiveSequence = sequence + 1;
+			sock->datagramsIn++;
 
 			length -= NET_HEADERSIZE;
 
@@ -636,11 +881,17 @@ int	Datagram_GetMessage (qsocket_t *sock)
 				Con_DPrintf("Duplicate ACK received\n");
 				continue;
 			}
+			if (sock->reliableSendTime)
+			{
+				float rtt = net_packettime - sock->reliableSendTime;
+				sock->rtt = sock->rtt ? sock->rtt + (rtt - sock->rtt)/8 : rtt;
+			}
 			sock->sendMessageLength -= sock->max_datagram;
 			if (sock->sendMessageLength > 0)
 			{
 				memmove (sock->sendMessage, sock->sendMessage + sock->max_datagram, sock->sendMessageLength);
 				sock->sendNext = true;
+				SendMessageNext (sock);	//don't wait for the end of the frame
 			}
 			else
 			{
@@ -654,7 +905,7 @@ int	Datagram_GetMessage (qsocket_t *sock)
 		{
 			packetBuffer.length = BigLong(NET_HEADERSIZE | NETFLAG_ACK);
 			packetBuffer.sequence = BigLong(sequence);
-			sfunc.Write (sock->socket, (byte *)&packetBuffer, NET_HEADERSIZE, &readaddr);
+			Datagram_Write (sock, (byte *)&packetBuffer, NET_HEADERSIZE);
 
 			if (sequence != sock->receiveSequence)
 			{
@@ -704,9 +955,37 @@ static void PrintStats(qsocket_t *s)
 	Con_Printf("canSend = %4u   \n", s->canSend);
 	Con_Printf("sendSeq = %4u   ", s->sendSequence);
 	Con_Printf("recvSeq = %4u   \n", s->receiveSequence);
+	if (s->rtt)
+		Con_Printf("rtt = %.1fms\n", s->rtt*1000);
+	if (s->deflatedBytesOut || s->deflatedBytesIn)
+	{
+		Con_Printf("deflated out = %u/%u (%.1f%%)\n", s->deflatedBytesOut, s->rawBytesOut, s->rawBytesOut?100.0*s->deflatedBytesOut/s->rawBytesOut:0);
+		Con_Printf("deflated in  = %u/%u (%.1f%%)\n", s->deflatedBytesIn, s->rawBytesIn, s->rawBytesIn?100.0*s->deflatedBytesIn/s->rawBytesIn:0);
+	}
 	Con_Printf("\n");
 }
 
+/*
+====================
+Datagram_GetStats
+
+The counters net_stats prints, for the metrics listener
+====================
+*/
+void Datagram_GetStats (dgrmstats_t *st)
+{
+	st->packetsSent = packetsSent;
+	st->packetsReSent = packetsReSent;
+	st->packetsReceived = packetsReceived;
+	st->duplicates = receivedDuplicateCount;
+	st->shortPackets = shortPacketCount;
+	st->droppedDatagrams = droppedDatagrams;
+	st->rawBytesOut = rawBytesOut;
+	st->deflatedBytesOut = deflatedBytesOut;
+	st->rawBytesIn = rawBytesIn;
+	st->deflatedBytesIn = deflatedBytesIn;
+}
+
 static void NET_Stats_f (void)
 {
 	qsocket_t	*s;
@@ -723,6 +1002,8 @@ static void NET_Stats_f (void)
 		Con_Printf("receivedDuplicateCount     = %i\n", receivedDuplicateCount);
 		Con_Printf("shortPacketCount           = %i\n", shortPacketCount);
 		Con_Printf("droppedDatagrams           = %i\n", droppedDatagrams);
+		Con_Printf("deflated bytes sent        = %u of %u (%.1f%%)\n", deflatedBytesOut, rawBytesOut, rawBytesOut?100.0*deflatedBytesOut/rawBytesOut:0);
+		Con_Printf("deflated bytes received    = %u of %u (%.1f%%)\n", deflatedBytesIn, rawBytesIn, rawBytesIn?100.0*deflatedBytesIn/rawBytesIn:0);
 	}
 	else if (Q_strcmp(Cmd_Argv(1), "*") == 0)
 	{
@@ -1128,13 +1409,20 @@ void Datagram_Shutdown (void)
 
 void Datagram_Close (qsocket_t *sock)
 {
+#ifdef USE_ZLIB
+	Datagram_FreeStreams(sock);
+#endif
 	if (sock->isvirtual)
 	{
 		sock->isvirtual = false;
 		sock->socket = INVALID_SOCKET;
 	}
 	else
+	{
+		NetSim_Purge (NULL, sock->landriver, sock->socket);
+		NET_RecvThread_Remove (sock->landriver, sock->socket);
 		sfunc.Close_Socket(sock->socket);
+	}
 }
 
 
@@ -1150,6 +1438,8 @@ void Datagram_Listen (qboolean state)
 	{
 		if (net_landrivers[i].initialized)
 		{
+			if (net_landrivers[i].listeningSock != INVALID_SOCKET)
+				NET_RecvThread_Remove (i, net_landrivers[i].listeningSock);
 			net_landrivers[i].listeningSock = net_landrivers[i].Listen (state);
 			if (net_landrivers[i].listeningSock != INVALID_SOCKET)
 				islistening = true;
@@ -37,5 +37,14 @@ qboolean	Datagram_CanSendUnreliableMessage (qsocket_t *sock);
 void		Datagram_Close (qsocket_t *sock);
 void		Datagram_Shutdown (void);
 
+typedef struct
+{
+	int		packetsSent, packetsReSent, packetsReceived;
+	int		duplicates, shortPackets, droppedDatagrams;
+	unsigned int	rawBytesOut, deflatedBytesOut;
+	unsigned int	rawBytesIn, deflatedBytesIn;
+} dgrmstats_t;
+void		Datagram_GetStats (dgrmstats_t *st);
+
 #endif	/* __NET_DATAGRAM_H */
 
@@ -84,6 +84,7 @@ qsocket_t *Loop_Connect (const char *host)
 		Q_strcpy (loop_client->trueaddress, "localhost");
 		Q_strcpy (loop_client->maskedaddress, "localhost");
 	}
+	NetSim_Purge (loop_client, 0, 0);
 	loop_client->receiveMessageLength = 0;
 	loop_client->sendMessageLength = 0;
 	loop_client->canSend = true;
@@ -98,6 +99,7 @@ qsocket_t *Loop_Connect (const char *host)
 		Q_strcpy (loop_server->trueaddress, "LOCAL");
 		Q_strcpy (loop_server->maskedaddress, "LOCAL");
 	}
+	NetSim_Purge (loop_server, 0, 0);
 	loop_server->receiveMessageLength = 0;
 	loop_server->sendMessageLength = 0;
 	loop_server->canSend = true;
@@ -179,10 +181,33 @@ qsocket_t *Loop_GetAnyMessage(void)
 }
 
 
+/*
+====================
+Loop_Deliver
+
+Appends an already-framed message to a loopback socket's receive buffer,
+either straight from the send functions or later on from the network simulator.
+====================
+*/
+void Loop_Deliver (qsocket_t *dest, const byte *message, int length)
+{
+	if (dest->receiveMessageLength + length > NET_MAXMESSAGE)
+	{
+		if (message[0] == 1)
+			Sys_Error("Loop_SendMessage: overflow");
+		return;	//unreliable, just drop it.
+	}
+	Q_memcpy(dest->receiveMessage + dest->receiveMessageLength, message, length);
+	dest->receiveMessageLength += length;
+}
+
+static byte loop_simbuffer[NET_MAXMESSAGE];
+
 int Loop_SendMessage (qsocket_t *sock, sizebuf_t *data)
 {
 	byte *buffer;
 	int  *bufferLength;
+	qboolean simulate = NetSim_Active(sock != loop_client);
 
 	if (!sock->driverdata)
 		return -1;
@@ -192,7 +217,10 @@ int Loop_SendMessage (qsocket_t *sock, sizebuf_t *data)
 	if ((*bufferLength + data->cursize + 4) > NET_MAXMESSAGE)
 		Sys_Error("Loop_SendMessage: overflow");
 
-	buffer = ((qsocket_t *)sock->driverdata)->receiveMessage + *bufferLength;
+	if (simulate)
+		buffer = loop_simbuffer;
+	else
+		buffer = ((qsocket_t *)sock->driverdata)->receiveMessage + *bufferLength;
 
 	// message type
 	*buffer++ = 1;
@@ -206,7 +234,10 @@ int Loop_SendMessage (qsocket_t *sock, sizebuf_t *data)
 
 	// message
 	Q_memcpy(buffer, data->data, data->cursize);
-	*bufferLength = IntAlign(*bufferLength + data->cursize + 4);
+	if (simulate)
+		NetSim_Queue (sock != loop_client, sock->driverdata, true, 0, 0, NULL, loop_simbuffer, IntAlign(data->cursize + 4));
+	else
+		*bufferLength = IntAlign(*bufferLength + data->cursize + 4);
 
 	sock->canSend = false;
 	return 1;
@@ -218,6 +249,7 @@ int Loop_SendUnreliableMessage (qsocket_t *sock, sizebuf_t *data)
 	byte *buffer;
 	int  *bufferLength;
 	int   sequence = sock->unreliableSendSequence++;
+	qboolean simulate = NetSim_Active(sock != loop_client);
 
 	if (!sock->driverdata)
 		return -1;
@@ -227,7 +259,10 @@ int Loop_SendUnreliableMessage (qsocket_t *sock, sizebuf_t *data)
 	if ((*bufferLength + data->cursize + sizeof(byte) + sizeof(short)) > NET_MAXMESSAGE)
 		return 0;
 
-	buffer = ((qsocket_t *)sock->driverdata)->receiveMessage + *bufferLength;
+	if (simulate)
+		buffer = loop_simbuffer;
+	else
+		buffer = ((qsocket_t *)sock->driverdata)->receiveMessage + *bufferLength;
 
 	// message type
 	*buffer++ = 2;
@@ -246,7 +281,10 @@ int Loop_SendUnreliableMessage (qsocket_t *sock, sizebuf_t *data)
 
 	// message
 	Q_memcpy(buffer, data->data, data->cursize);
-	*bufferLength = IntAlign(*bufferLength + data->cursize + 8);
+	if (simulate)
+		NetSim_Queue (sock != loop_client, sock->driverdata, false, 0, 0, NULL, loop_simbuffer, IntAlign(data->cursize + 8));
+	else
+		*bufferLength = IntAlign(*bufferLength + data->cursize + 8);
 	return 1;
 }
 
@@ -267,14 +305,18 @@ qboolean Loop_CanSendUnreliableMessage (qsocket_t *sock)
 
 void Loop_Close (qsocket_t *sock)
 {
+	NetSim_Purge (sock, 0, 0);
 	if (sock->driverdata)
+	{
+		NetSim_Purge (sock->driverdata, 0, 0);
 		((qsocket_t *)sock->driverdata)->driverdata = NULL;
+	}
 	sock->receiveMessageLength = 0;
 	sock->sendMessageLength = 0;
 	sock->canSend = true;
 	if (sock == loop_client)
 		loop_client = NULL;
-	else
+	else if (sock == loop_server)	// replays have loopback sockets of their own
 		loop_server = NULL;
 }
 
@@ -36,6 +36,7 @@ int		Loop_SendUnreliableMessage (qsocket_t *sock, sizebuf_t *data);
 qboolean	Loop_CanSendMessage (qsocket_t *sock);
 qboolean	Loop_CanSendUnreliableMessage (qsocket_t *sock);
 void		Loop_Close (qsocket_t *sock);
+void		Loop_Deliver (qsocket_t *dest, const byte *message, int length);
 void		Loop_Shutdown (void);
 
 #endif	/* __NET_LOOP_H */
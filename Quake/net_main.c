@@ -24,6 +24,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "net_sys.h"
 #include "quakedef.h"
 #include "net_defs.h"
+#include "net_loop.h"
 
 qsocket_t	*net_activeSockets = NULL;
 qsocket_t	*net_freeSockets = NULL;
@@ -73,6 +74,7 @@ cvar_t	hostname = {"hostname", "UNNAMED", CVAR_SERVERINFO};
 int		net_driverlevel;
 
 double		net_time;
+double		net_packettime;	// when the last packet returned by NET_ReadPacket (or the simulator) arrived
 
 
 double SetNetTime (void)
@@ -128,6 +130,11 @@ qsocket_t *NET_NewQSocket (void)
 	sock->receiveMessageLength = 0;
 	sock->pending_max_datagram = 1024;
 	sock->proquake_angle_hack = false;
+	sock->compress = false;
+	sock->sendFlags = 0;
+	sock->rawBytesOut = sock->deflatedBytesOut = 0;
+	sock->rawBytesIn = sock->deflatedBytesIn = 0;
+	sock->bytesIn = sock->datagramsIn = sock->droppedIn = 0;
 
 	return sock;
 }
@@ -174,6 +181,10 @@ double NET_QSocketGetTime (const qsocket_t *s)
 {
 	return s->connecttime;
 }
+float NET_QSocketGetRTT (const qsocket_t *s)
+{	//smoothed reliable round trip time, 0 if nothing has been acked yet
+	return s->rtt;
+}
 
 
 const char *NET_QSocketGetTrueAddressString (const qsocket_t *s)
@@ -195,6 +206,10 @@ void NET_QSocketSetMSS(qsocket_t *s, int mss)
 {
 	s->pending_max_datagram = mss;
 }
+void NET_QSocketSetCompression(qsocket_t *s, qboolean enable)
+{	//only affects what we send. the receiving side copes with whatever is flagged.
+	s->compress = enable;
+}
 
 
 static void NET_Listen_f (void)
@@ -524,6 +539,32 @@ JustDoIt:
 }
 
 
+/*
+===================
+NET_ConnectRemote
+
+Like NET_Connect, but goes straight to the network drivers without
+querying the server list first. Used by the load test bots.
+===================
+*/
+qsocket_t *NET_ConnectRemote (const char *host)
+{
+	qsocket_t		*ret;
+
+	SetNetTime();
+
+	for (net_driverlevel = 1; net_driverlevel < net_numdrivers; net_driverlevel++)
+	{
+		if (net_drivers[net_driverlevel].initialized == false)
+			continue;
+		ret = dfunc.Connect (host);
+		if (ret)
+			return ret;
+	}
+	return NULL;
+}
+
+
 /*
 ===================
 NET_CheckNewConnections
@@ -598,8 +639,11 @@ int	NET_GetMessage (qsocket_t *sock)
 	}
 
 	SetNetTime();
+	PROF_BEGIN (PROF_NET_READ);
+	NetSim_Run ();
 
 	ret = sfunc.QGetMessage(sock);
+	PROF_END (PROF_NET_READ);
 
 	// see if this connection has timed out
 	if (ret == 0 && !IS_LOOP_DRIVER(sock->driver))
@@ -637,16 +681,20 @@ returns the qsocket that the message was meant to be for.
 */
 qsocket_t *NET_GetServerMessage(void)
 {
-	qsocket_t *s;
+	qsocket_t *s = NULL;
+
+	PROF_BEGIN (PROF_NET_READ);
+	NetSim_Run ();
 	for (net_driverlevel = 0; net_driverlevel < net_numdrivers; net_driverlevel++)
 	{
 		if (!net_drivers[net_driverlevel].initialized)
 			continue;
 		s = net_drivers[net_driverlevel].QGetAnyMessage();
 		if (s)
-			return s;
+			break;
 	}
-	return NULL;
+	PROF_END (PROF_NET_READ);
+	return s;
 }
 
 /*
@@ -691,7 +739,9 @@ int NET_SendMessage (qsocket_t *sock, sizebuf_t *data)
 	}
 
 	SetNetTime();
+	PROF_BEGIN (PROF_NET_SEND);
 	r = sfunc.QSendMessage(sock, data);
+	PROF_END (PROF_NET_SEND);
 	if (r == 1 && !IS_LOOP_DRIVER(sock->driver))
 		messagesSent++;
 
@@ -713,7 +763,9 @@ int NET_SendUnreliableMessage (qsocket_t *sock, sizebuf_t *data)
 	}
 
 	SetNetTime();
+	PROF_BEGIN (PROF_NET_SEND);
 	r = sfunc.SendUnreliableMessage(sock, data);
+	PROF_END (PROF_NET_SEND);
 	if (r == 1 && !IS_LOOP_DRIVER(sock->driver))
 		unreliableMessagesSent++;
 
@@ -820,6 +872,721 @@ int NET_SendToAll (sizebuf_t *data, double blocktime)
 }
 
 
+/*
+===============================================================================
+
+NETWORK SIMULATION
+
+Delays, drops, duplicates, reorders and rate-limits packets passing through
+the loopback and datagram drivers, so netcode changes can be measured on a
+single machine. "out" is what we send and "in" is what we receive. For a local
+game the client's messages count as out and the server's as in. All the
+randomness comes from a seeded generator so that runs are repeatable.
+
+Loopback has no retransmission, so reliable loopback messages are only ever
+delayed and rate limited, never lost, duplicated or reordered.
+
+===============================================================================
+*/
+
+typedef struct
+{
+	const char	*name;
+	float		latency;	// ms, one way
+	float		jitter;		// ms, +/-
+	float		loss;		// percent
+	float		reorder;	// percent
+	float		duplicate;	// percent
+	float		rate;		// bytes/sec, 0 for unlimited
+} netsim_profile_t;
+
+typedef struct netsim_packet_s
+{
+	struct netsim_packet_s	*next;
+	double				due;
+	qsocket_t			*loopdest;	// loopback message, otherwise a datagram
+	qboolean			reliable;
+	int					landriver;
+	sys_socket_t		socket;
+	struct qsockaddr	addr;
+	int					length;
+	byte				data[1];
+} netsim_packet_t;
+
+static const netsim_profile_t netsim_presets[] =
+{
+	{"off",		0,		0,		0,		0,		0,		0},
+	{"lan",		1,		0.5,	0,		0,		0,		0},
+	{"dsl",		20,		4,		0.5,	0.1,	0,		96000},
+	{"wifi",	8,		20,		2,		1,		0.5,	0},
+	{"mobile",	60,		30,		3,		1,		0.5,	48000},
+	{"awful",	150,	60,		10,		5,		2,		12000},
+};
+
+static struct
+{
+	netsim_profile_t	p;
+	double				linefree;	// when the simulated link finishes sending what's already queued
+	netsim_packet_t		*queue;		// sorted by due time
+	int					queued, sent, dropped, duplicated, reordered;
+} netsim[2];	// [0]=out, [1]=in
+
+static unsigned int	netsim_seed = 1;
+static unsigned int	netsim_rng = 1;
+static byte			netsim_buf[NET_DATAGRAMSIZE];
+
+static float NetSim_Random (void)
+{	//xorshift32, [0,1)
+	netsim_rng ^= netsim_rng << 13;
+	netsim_rng ^= netsim_rng >> 17;
+	netsim_rng ^= netsim_rng << 5;
+	return (netsim_rng >> 8) * (1.0f/16777216);
+}
+
+static qboolean NetSim_Chance (float percent)
+{
+	return percent > 0 && NetSim_Random()*100 < percent;
+}
+
+qboolean NetSim_Active (qboolean in)
+{
+	const netsim_profile_t *p = &netsim[in].p;
+	return p->latency || p->jitter || p->loss || p->reorder || p->duplicate || p->rate || netsim[in].queue;
+}
+
+static void NetSim_Insert (int dir, netsim_packet_t *p)
+{
+	netsim_packet_t **link;
+
+	for (link = &netsim[dir].queue; *link && (*link)->due <= p->due; link = &(*link)->next)
+		;
+	p->next = *link;
+	*link = p;
+	netsim[dir].queued++;
+}
+
+/*
+====================
+NetSim_Queue
+
+Takes a packet the caller would otherwise have sent or received right away.
+====================
+*/
+void NetSim_Queue (qboolean in, qsocket_t *loopdest, qboolean reliable, int landriver, sys_socket_t socket, struct qsockaddr *addr, const byte *data, int length)
+{
+	const netsim_profile_t *prof = &netsim[in].p;
+	netsim_packet_t *p;
+	double now = Sys_DoubleTime(), start;
+	qboolean lossy = !loopdest || !reliable;
+	int copies = 1, i;
+
+	if (lossy && NetSim_Chance(prof->loss))
+	{
+		netsim[in].dropped++;
+		return;
+	}
+
+	//serialise onto the link at its bandwidth, dropping when the backlog gets silly.
+	start = q_max(now, netsim[in].linefree);
+	if (prof->rate > 0)
+	{
+		if (lossy && start - now > 1)
+		{
+			netsim[in].dropped++;
+			return;
+		}
+		netsim[in].linefree = start + length / prof->rate;
+	}
+	else
+		netsim[in].linefree = start;
+
+	if (lossy && NetSim_Chance(prof->duplicate))
+	{
+		netsim[in].duplicated++;
+		copies++;
+	}
+
+	for (i = 0; i < copies; i++)
+	{
+		p = (netsim_packet_t *) malloc (sizeof(*p) + length);
+		p->loopdest = loopdest;
+		p->reliable = reliable;
+		p->landriver = landriver;
+		p->socket = socket;
+		if (addr)
+			p->addr = *addr;
+		p->length = length;
+		memcpy (p->data, data, length);
+
+		p->due = netsim[in].linefree + prof->latency/1000;
+		if (prof->jitter)
+			p->due += (NetSim_Random()*2-1) * prof->jitter/1000;
+		if (lossy && NetSim_Chance(prof->reorder))
+		{	//hold it back so that later packets overtake it
+			netsim[in].reordered++;
+			p->due += 0.01 + NetSim_Random() * (prof->latency + prof->jitter)/1000;
+		}
+		if (loopdest && reliable)	//must not overtake anything already queued
+			p->due = q_max(p->due, netsim[in].linefree);
+		if (p->due < start)
+			p->due = start;
+		NetSim_Insert (in, p);
+	}
+}
+
+static void NetSim_Deliver (int dir, netsim_packet_t *p)
+{
+	netsim[dir].queued--;
+	netsim[dir].sent++;
+	if (p->loopdest)
+		Loop_Deliver (p->loopdest, p->data, p->length);
+	else if (!dir)
+		net_landrivers[p->landriver].Write (p->socket, p->data, p->length, &p->addr);
+	free (p);
+}
+
+/*
+====================
+NetSim_Run
+
+Sends whatever is due. Incoming datagrams wait for NetSim_Read instead.
+====================
+*/
+void NetSim_Run (void)
+{
+	netsim_packet_t **link, *p;
+	double now = Sys_DoubleTime();
+	int dir;
+
+	for (dir = 0; dir < 2; dir++)
+	{
+		for (link = &netsim[dir].queue; (p = *link) && p->due <= now; )
+		{
+			if (dir && !p->loopdest)
+			{
+				if (p->due < now - 2)
+				{	//nobody's reading that socket any more
+					*link = p->next;
+					netsim[dir].queued--;
+					free (p);
+					continue;
+				}
+				link = &p->next;
+				continue;
+			}
+			*link = p->next;
+			NetSim_Deliver (dir, p);
+		}
+	}
+}
+
+/*
+====================
+NetSim_Read
+
+Replaces a landriver's Read for a qsocket's datagrams. Everything the os has
+is pulled into the simulated link, then the next packet that has 'arrived'
+is returned.
+====================
+*/
+int NetSim_Read (int landriver, sys_socket_t socket, byte *buf, int len, struct qsockaddr *addr)
+{
+	netsim_packet_t **link, *p;
+	struct qsockaddr from;
+	double now;
+	int ret;
+
+	while ((ret = NET_ReadPacket (landriver, socket, netsim_buf, sizeof(netsim_buf), &from)) > 0)
+		NetSim_Queue (true, NULL, false, landriver, socket, &from, netsim_buf, ret);
+
+	now = Sys_DoubleTime();
+	for (link = &netsim[1].queue; (p = *link) && p->due <= now; link = &p->next)
+	{
+		if (p->loopdest || p->landriver != landriver || p->socket != socket)
+			continue;
+		*link = p->next;
+		netsim[1].queued--;
+		netsim[1].sent++;
+		len = q_min(len, p->length);
+		memcpy (buf, p->data, len);
+		*addr = p->addr;
+		net_packettime = p->due;
+		free (p);
+		return len;
+	}
+	return (ret < 0) ? -1 : 0;
+}
+
+/*
+====================
+NetSim_Purge
+
+Forgets anything still queued for a loopback qsocket or a datagram socket
+that is going away.
+====================
+*/
+void NetSim_Purge (qsocket_t *loopdest, int landriver, sys_socket_t socket)
+{
+	netsim_packet_t **link, *p;
+	int dir;
+
+	for (dir = 0; dir < 2; dir++)
+	{
+		for (link = &netsim[dir].queue; (p = *link); )
+		{
+			if (loopdest ? p->loopdest == loopdest : (!p->loopdest && p->landriver == landriver && p->socket == socket))
+			{
+				*link = p->next;
+				netsim[dir].queued--;
+				free (p);
+			}
+			else
+				link = &p->next;
+		}
+	}
+}
+
+static void NetSim_PrintProfile (int dir)
+{
+	const netsim_profile_t *p = &netsim[dir].p;
+	Con_Printf ("%-3s: %gms +/-%gms, %g%% loss, %g%% reorder, %g%% dup, %s%g bytes/sec\n", dir?"in":"out",
+		p->latency, p->jitter, p->loss, p->reorder, p->duplicate, p->rate?"":"unlimited ", p->rate);
+	Con_Printf ("     %i queued, %i sent, %i dropped, %i duplicated, %i reordered\n",
+		netsim[dir].queued, netsim[dir].sent, netsim[dir].dropped, netsim[dir].duplicated, netsim[dir].reordered);
+}
+
+/*
+====================
+NetSim_f
+
+netsim [in|out|both] <preset>
+netsim [in|out|both] <latency|jitter|loss|reorder|dup|rate> <value>
+netsim seed <n>
+====================
+*/
+static void NetSim_f (void)
+{
+	int argi = 1, first = 0, last = 1, dir;
+	size_t i;
+	const char *arg;
+	float value;
+
+	if (Cmd_Argc() < 2)
+	{
+		Con_Printf ("seed %u\n", netsim_seed);
+		NetSim_PrintProfile (0);
+		NetSim_PrintProfile (1);
+		Con_Printf ("presets:");
+		for (i = 0; i < countof(netsim_presets); i++)
+			Con_Printf (" %s", netsim_presets[i].name);
+		Con_Printf ("\n");
+		return;
+	}
+
+	arg = Cmd_Argv(argi);
+	if (!strcmp(arg, "seed"))
+	{
+		netsim_seed = strtoul(Cmd_Argv(2), NULL, 0);
+		netsim_rng = netsim_seed?netsim_seed:1;
+		for (dir = 0; dir < 2; dir++)
+			netsim[dir].sent = netsim[dir].dropped = netsim[dir].duplicated = netsim[dir].reordered = 0;
+		return;
+	}
+	if (!strcmp(arg, "out"))
+		last = 0, argi++;
+	else if (!strcmp(arg, "in"))
+		first = 1, argi++;
+	else if (!strcmp(arg, "both"))
+		argi++;
+	arg = Cmd_Argv(argi);
+
+	for (i = 0; i < countof(netsim_presets); i++)
+	{
+		if (!q_strcasecmp(arg, netsim_presets[i].name))
+		{
+			for (dir = first; dir <= last; dir++)
+				netsim[dir].p = netsim_presets[i];
+			return;
+		}
+	}
+
+	if (Cmd_Argc() <= argi+1)
+	{
+		Con_Printf ("netsim: unknown preset \"%s\"\n", arg);
+		return;
+	}
+	value = q_max(0, Q_atof(Cmd_Argv(argi+1)));
+	for (dir = first; dir <= last; dir++)
+	{
+		netsim_profile_t *p = &netsim[dir].p;
+		p->name = "custom";
+		if (!strcmp(arg, "latency"))
+			p->latency = value;
+		else if (!strcmp(arg, "jitter"))
+			p->jitter = value;
+		else if (!strcmp(arg, "loss"))
+			p->loss = value;
+		else if (!strcmp(arg, "reorder"))
+			p->reorder = value;
+		else if (!strcmp(arg, "dup"))
+			p->duplicate = value;
+		else if (!strcmp(arg, "rate"))
+			p->rate = value;
+		else
+		{
+			Con_Printf ("netsim: unknown setting \"%s\"\n", arg);
+			return;
+		}
+	}
+}
+
+/*
+===============================================================================
+
+RECEIVE THREAD
+
+With net_recvthread set, a thread sleeps in select() on every datagram socket
+that's being read from and drains it into a per-socket single-producer/
+single-consumer ring of timestamped packets. The main thread then reads from
+the rings instead of the socket. This keeps long frames and map loads from
+overflowing the kernel's buffer, and the timestamps show how long packets sat
+waiting for us. The thread only queues packets; acks and everything else are
+still handled when the main thread reads them.
+
+Only the thread writes a ring's head and only the main thread writes its tail.
+The slot table itself is only changed under a mutex, which the thread holds
+while draining.
+
+===============================================================================
+*/
+
+cvar_t	net_recvthread = {"net_recvthread", "0", CVAR_ARCHIVE};
+
+#if defined(USE_SDL2)
+#define NETRX_MAXSOCKETS	8
+#define NETRX_RINGSIZE		(1<<20)
+
+typedef struct
+{
+	double				time;
+	struct qsockaddr	addr;
+	int					length;	// -1 means wrap to the start of the ring
+} netrx_header_t;
+
+typedef struct
+{
+	qboolean		active;
+	int				landriver;
+	sys_socket_t	socket;
+	byte			*ring;
+	SDL_atomic_t	head;		// written by the thread
+	SDL_atomic_t	tail;		// written by the main thread
+	SDL_atomic_t	dropped;	// ring was full
+	SDL_atomic_t	received;
+	int				maxdepth;	// bytes, as seen by the main thread
+	int				read;		// packets taken by the main thread
+	double			delaytotal, delaymax;
+	int				delaycount;
+} netrx_queue_t;
+
+static netrx_queue_t	netrx[NETRX_MAXSOCKETS];
+static SDL_Thread		*netrx_thread;
+static SDL_mutex		*netrx_lock;
+static SDL_atomic_t		netrx_quit;
+
+#define NETRX_ALIGN(x)	(((x) + 7) & ~7)
+
+static void NET_RecvThread_Drain (netrx_queue_t *q, byte *buf)
+{
+	netrx_header_t	hdr;
+	socklen_t		addrlen;
+	int				len, head, tail, need, space;
+
+	for (;;)
+	{
+		addrlen = sizeof(hdr.addr);
+		len = recvfrom (q->socket, (char *)buf, NET_DATAGRAMSIZE, 0, (struct sockaddr *)&hdr.addr, &addrlen);
+		if (len == SOCKET_ERROR)
+		{
+			if (SOCKETERRNO == NET_ECONNREFUSED)
+				continue;	//icmp noise, there may be more behind it
+			return;	//wouldblock, or something we'll let the main thread discover
+		}
+		if (len <= 0)
+			return;
+		hdr.time = Sys_DoubleTime();
+		hdr.length = len;
+
+		head = SDL_AtomicGet(&q->head);
+		tail = SDL_AtomicGet(&q->tail);
+		need = NETRX_ALIGN(sizeof(hdr) + len);
+		if (head >= tail)
+		{
+			space = NETRX_RINGSIZE - head;
+			if (space < need + (int)sizeof(hdr))
+			{	//doesn't fit at the end, wrap if there's room at the start
+				if (tail <= need)
+				{
+					SDL_AtomicIncRef(&q->dropped);
+					continue;
+				}
+				((netrx_header_t *)(q->ring + head))->length = -1;
+				head = 0;
+			}
+		}
+		else if (tail - head <= need)
+		{
+			SDL_AtomicIncRef(&q->dropped);
+			continue;
+		}
+		memcpy (q->ring + head, &hdr, sizeof(hdr));
+		memcpy (q->ring + head + sizeof(hdr), buf, len);
+		SDL_AtomicIncRef(&q->received);
+		SDL_AtomicSet(&q->head, head + need);	//publishes it
+	}
+}
+
+static int SDLCALL NET_RecvThread (void *arg)
+{
+	static byte		buf[NET_DATAGRAMSIZE];
+	fd_set			fds;
+	struct timeval	tv;
+	sys_socket_t	maxfd;
+	int				i, n;
+
+	while (!SDL_AtomicGet(&netrx_quit))
+	{
+		FD_ZERO (&fds);
+		maxfd = 0;
+		n = 0;
+		SDL_LockMutex (netrx_lock);
+		for (i = 0; i < NETRX_MAXSOCKETS; i++)
+		{
+			if (!netrx[i].active)
+				continue;
+			FD_SET (netrx[i].socket, &fds);
+			if (netrx[i].socket > maxfd)
+				maxfd = netrx[i].socket;
+			n++;
+		}
+		SDL_UnlockMutex (netrx_lock);
+		if (!n)
+		{
+			SDL_Delay (10);
+			continue;
+		}
+
+		tv.tv_sec = 0;
+		tv.tv_usec = 10000;	//so we notice new sockets and shutdowns
+		if (selectsocket (maxfd+1, &fds, NULL, NULL, &tv) <= 0)
+			continue;
+
+		SDL_LockMutex (netrx_lock);
+		for (i = 0; i < NETRX_MAXSOCKETS; i++)
+		{
+			if (netrx[i].active && FD_ISSET(netrx[i].socket, &fds))
+				NET_RecvThread_Drain (&netrx[i], buf);
+		}
+		SDL_UnlockMutex (netrx_lock);
+	}
+	return 0;
+}
+
+static void NET_RecvThread_Stop (void)
+{
+	if (!netrx_thread)
+		return;
+	SDL_AtomicSet (&netrx_quit, 1);
+	SDL_WaitThread (netrx_thread, NULL);
+	netrx_thread = NULL;
+}
+
+static void NET_RecvThread_Changed (cvar_t *var)
+{
+	if (!var->value)
+		NET_RecvThread_Stop ();	//anything already queued still gets read
+}
+
+static netrx_queue_t *NET_RecvThread_Find (int landriver, sys_socket_t socket)
+{
+	int i;
+	for (i = 0; i < NETRX_MAXSOCKETS; i++)
+		if (netrx[i].active && netrx[i].landriver == landriver && netrx[i].socket == socket)
+			return &netrx[i];
+	return NULL;
+}
+
+static netrx_queue_t *NET_RecvThread_Add (int landriver, sys_socket_t socket)
+{
+	netrx_queue_t *q = NULL;
+	int i;
+
+	if (strstr(net_landrivers[landriver].name, "IPX"))
+		return NULL;	//not a bsd socket
+	if (!netrx_lock)
+		netrx_lock = SDL_CreateMutex ();
+	if (!netrx_thread)
+	{
+		SDL_AtomicSet (&netrx_quit, 0);
+		netrx_thread = SDL_CreateThread (NET_RecvThread, "netrecv", NULL);
+		if (!netrx_thread)
+		{
+			Con_Warning ("Unable to start network thread: %s\n", SDL_GetError());
+			Cvar_SetValueQuick (&net_recvthread, 0);
+			return NULL;
+		}
+	}
+
+	for (i = 0; i < NETRX_MAXSOCKETS; i++)
+	{
+		if (!netrx[i].active)
+		{
+			q = &netrx[i];
+			break;
+		}
+	}
+	if (!q)
+		return NULL;
+
+	SDL_LockMutex (netrx_lock);
+	if (!q->ring)
+		q->ring = (byte *) malloc (NETRX_RINGSIZE);
+	q->landriver = landriver;
+	q->socket = socket;
+	SDL_AtomicSet (&q->head, 0);
+	SDL_AtomicSet (&q->tail, 0);
+	SDL_AtomicSet (&q->dropped, 0);
+	SDL_AtomicSet (&q->received, 0);
+	q->maxdepth = 0;
+	q->read = 0;
+	q->delaytotal = q->delaymax = 0;
+	q->delaycount = 0;
+	q->active = true;
+	SDL_UnlockMutex (netrx_lock);
+	return q;
+}
+
+/*
+====================
+NET_RecvThread_Remove
+
+Must be called before a socket that may have been read from is closed.
+====================
+*/
+void NET_RecvThread_Remove (int landriver, sys_socket_t socket)
+{
+	netrx_queue_t *q = NET_RecvThread_Find (landriver, socket);
+	if (!q)
+		return;
+	SDL_LockMutex (netrx_lock);
+	q->active = false;
+	SDL_UnlockMutex (netrx_lock);
+}
+
+static int NET_RecvThread_Read (netrx_queue_t *q, byte *buf, int len, struct qsockaddr *addr)
+{
+	netrx_header_t	*hdr;
+	int				head = SDL_AtomicGet(&q->head);
+	int				tail = SDL_AtomicGet(&q->tail);
+	int				depth;
+	double			delay;
+
+	if (tail == head)
+		return 0;
+	depth = (head >= tail) ? head - tail : NETRX_RINGSIZE - tail + head;
+	if (depth > q->maxdepth)
+		q->maxdepth = depth;
+
+	hdr = (netrx_header_t *)(q->ring + tail);
+	if (hdr->length < 0)
+	{	//wrapped
+		tail = 0;
+		hdr = (netrx_header_t *)q->ring;
+	}
+	len = q_min(len, hdr->length);
+	memcpy (buf, q->ring + tail + sizeof(*hdr), len);
+	*addr = hdr->addr;
+	net_packettime = hdr->time;
+
+	delay = Sys_DoubleTime() - hdr->time;
+	q->delaytotal += delay;
+	q->delaycount++;
+	if (delay > q->delaymax)
+		q->delaymax = delay;
+
+	SDL_AtomicSet (&q->tail, tail + NETRX_ALIGN(sizeof(*hdr) + hdr->length));
+	q->read++;
+	return len;
+}
+
+static void NET_RecvStats_f (void)
+{
+	int i, head, tail, received;
+	netrx_queue_t *q;
+
+	Con_Printf ("receive thread %s\n", netrx_thread?"running":"stopped");
+	for (i = 0; i < NETRX_MAXSOCKETS; i++)
+	{
+		q = &netrx[i];
+		if (!q->active)
+			continue;
+		received = SDL_AtomicGet(&q->received);
+		head = SDL_AtomicGet(&q->head);
+		tail = SDL_AtomicGet(&q->tail);
+		Con_Printf ("%s socket %i: %i received, %i dropped, %i queued (%i bytes, %i max), %.2fms avg/%.2fms max wait\n",
+			net_landrivers[q->landriver].name, (int)q->socket, received, SDL_AtomicGet(&q->dropped),
+			received - q->read, (head >= tail) ? head - tail : NETRX_RINGSIZE - tail + head,
+			q->maxdepth, q->delaycount?1000*q->delaytotal/q->delaycount:0, 1000*q->delaymax);
+	}
+}
+#else
+void NET_RecvThread_Remove (int landriver, sys_socket_t socket)
+{
+}
+static void NET_RecvThread_Stop (void)
+{
+}
+static void NET_RecvThread_Changed (cvar_t *var)
+{
+	if (var->value)
+		Con_Printf ("%s is not supported in this build\n", var->name);
+}
+static void NET_RecvStats_f (void)
+{
+	Con_Printf ("receive thread not supported in this build\n");
+}
+#endif
+
+/*
+====================
+NET_ReadPacket
+
+A datagram driver's Read, but from the receive thread's queue when that's enabled.
+Sets net_packettime to the packet's arrival time.
+====================
+*/
+int NET_ReadPacket (int landriver, sys_socket_t socket, byte *buf, int len, struct qsockaddr *addr)
+{
+	int ret;
+#if defined(USE_SDL2)
+	netrx_queue_t *q = NET_RecvThread_Find (landriver, socket);
+	if (!q && net_recvthread.value)
+		q = NET_RecvThread_Add (landriver, socket);
+	if (q)
+	{
+		ret = NET_RecvThread_Read (q, buf, len, addr);
+		if (ret || netrx_thread)
+			return ret;
+		//thread was stopped and the queue is drained, go back to reading directly.
+		NET_RecvThread_Remove (landriver, socket);
+	}
+#endif
+	ret = net_landrivers[landriver].Read (socket, buf, len, addr);
+	if (ret > 0)
+		net_packettime = Sys_DoubleTime();
+	return ret;
+}
+
 //=============================================================================
 
 /*
@@ -875,6 +1642,10 @@ void NET_Init (void)
 	Cmd_AddCommand ("listen", NET_Listen_f);
 	Cmd_AddCommand ("maxplayers", MaxPlayers_f);
 	Cmd_AddCommand ("port", NET_Port_f);
+	Cmd_AddCommand ("netsim", NetSim_f);
+	Cvar_RegisterVariable (&net_recvthread);
+	Cvar_SetCallback (&net_recvthread, NET_RecvThread_Changed);
+	Cmd_AddCommand ("net_recvstats", NET_RecvStats_f);
 
 	// initialize all the drivers
 	for (i = net_driverlevel = 0; net_driverlevel < net_numdrivers; net_driverlevel++)
@@ -924,6 +1695,7 @@ void NET_Shutdown (void)
 
 	for (sock = net_activeSockets; sock; sock = sock->next)
 		NET_Close(sock);
+	NET_RecvThread_Stop ();
 
 //
 // shutdown the drivers
@@ -946,6 +1718,8 @@ void NET_Poll(void)
 	PollProcedure *pp;
 
 	SetNetTime();
+	PROF_BEGIN (PROF_NET_POLL);
+	NetSim_Run ();
 
 	for (pp = pollProcedureList; pp; pp = pp->next)
 	{
@@ -954,6 +1728,7 @@ void NET_Poll(void)
 		pollProcedureList = pp->next;
 		pp->procedure(pp->arg);
 	}
+	PROF_END (PROF_NET_POLL);
 }
 
 
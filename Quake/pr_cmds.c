@@ -164,6 +164,7 @@ static void PF_setorigin (void)
 	e = G_EDICT(OFS_PARM0);
 	org = G_VECTOR(OFS_PARM1);
 	VectorCopy (org, e->v.origin);
+	e->sleeping = false;
 	SV_LinkEdict (e, false);
 }
 
@@ -548,6 +549,21 @@ static void PF_vectoangles (void)
 	G_FLOAT(OFS_RETURN+2) = 0;
 }
 
+/*
+=================
+PR_Rand
+
+The server has its own random numbers so that replays can repeat them.
+csqc keeps using rand().
+=================
+*/
+int PR_Rand (void)
+{
+	if (qcvm == &sv.qcvm)
+		return SV_Rand ();
+	return rand () & 0x7fff;
+}
+
 /*
 =================
 PF_Random
@@ -563,7 +579,7 @@ static void PF_random (void)
 {
 	float		num;
 
-	num = (rand() & 0x7fff) / ((float)0x8000);
+	num = PR_Rand() / ((float)0x8000);
 
 	G_FLOAT(OFS_RETURN) = num;
 }
@@ -984,6 +1000,8 @@ static void PF_cvar_set (void)
 	Cvar_Set (var, val);
 }
 
+cvar_t	pr_areaqueries = {"pr_areaqueries", "1", CVAR_NONE};	//0 to scan every edict, for mods that move solid ents without relinking them.
+
 /*
 =================
 PF_findradius
@@ -998,13 +1016,47 @@ static void PF_findradius (void)
 	edict_t	*ent, *chain;
 	float	rad;
 	float	*org;
-	vec3_t	eorg;
-	int	i, j;
+	vec3_t	eorg, mins, maxs;
+	int	i, j, cfld;
+	edict_t	**list;
+	int	listcount, mark;
 
 	chain = (edict_t *)qcvm->edicts;
 
 	org = G_VECTOR(OFS_PARM0);
 	rad = G_FLOAT(OFS_PARM1);
+	if (qcvm->argc > 2)
+		cfld = G_INT(OFS_PARM2);
+	else
+		cfld = &chain->v.chain - (int*)&chain->v;
+
+	if (pr_areaqueries.value && qcvm->numareanodes)
+	{	//only ents that are linked can be non-solid_not, so the area nodes have everything we could want.
+		for (j = 0; j < 3; j++)
+		{
+			mins[j] = org[j] - rad;
+			maxs[j] = org[j] + rad;
+		}
+		mark = Hunk_LowMark ();
+		list = (edict_t **) Hunk_Alloc (qcvm->num_edicts*sizeof(edict_t *));
+		listcount = SV_AreaEdicts (mins, maxs, list, qcvm->num_edicts);
+		for (i = 0; i < listcount; i++)
+		{
+			ent = list[i];
+			if (ent->v.solid == SOLID_NOT)
+				continue;
+			for (j = 0; j < 3; j++)
+				eorg[j] = org[j] - (ent->v.origin[j] + (ent->v.mins[j] + ent->v.maxs[j]) * 0.5);
+			if (VectorLength(eorg) > rad)
+				continue;
+
+			((int*)&ent->v)[cfld] = EDICT_TO_PROG(chain);
+			chain = ent;
+		}
+		Hunk_FreeToLowMark (mark);
+		RETURN_EDICT(chain);
+		return;
+	}
 
 	ent = NEXT_EDICT(qcvm->edicts);
 	for (i = 1; i < qcvm->num_edicts; i++, ent = NEXT_EDICT(ent))
@@ -1018,7 +1070,7 @@ static void PF_findradius (void)
 		if (VectorLength(eorg) > rad)
 			continue;
 
-		ent->v.chain = EDICT_TO_PROG(chain);
+		((int*)&ent->v)[cfld] = EDICT_TO_PROG(chain);
 		chain = ent;
 	}
 
@@ -1097,7 +1149,7 @@ static void PF_Remove (void)
 // entity (entity start, .string field, string match) find = #5;
 static void PF_Find (void)
 {
-	int		e;
+	int		e, first;
 	int		f;
 	const char	*s, *t;
 	edict_t	*ed;
@@ -1108,7 +1160,14 @@ static void PF_Find (void)
 	if (!s)
 		PR_RunError ("PF_Find: bad search string");
 
-	for (e++ ; e < qcvm->num_edicts ; e++)
+	first = ED_IndexFindString (f, e, s);
+	if (first >= 0)
+	{
+		RETURN_EDICT(EDICT_NUM(first));
+		return;
+	}
+
+	for (first = e++ ; e < qcvm->num_edicts ; e++)
 	{
 		ed = EDICT_NUM(e);
 		if (ed->free)
@@ -1118,11 +1177,13 @@ static void PF_Find (void)
 			continue;
 		if (!strcmp(t,s))
 		{
+			ED_FindStat (f, false, e-first);
 			RETURN_EDICT(ed);
 			return;
 		}
 	}
 
+	ED_FindStat (f, false, e-first);
 	RETURN_EDICT(qcvm->edicts);
 }
 
@@ -1351,6 +1412,7 @@ static void PF_sv_lightstyle (void)
 	int		style;
 	const char	*val;
 	client_t	*client;
+	sizebuf_t	*msg;
 	int	j;
 
 	style = G_FLOAT(OFS_PARM0);
@@ -1387,6 +1449,20 @@ static void PF_sv_lightstyle (void)
 			}
 		}
 	}
+	if ((msg = SV_DemoBuffer (true)))
+	{
+		if (style > 0xff)
+		{
+			MSG_WriteByte (msg, svc_stufftext);
+			MSG_WriteString (msg, va("//ls %i \"%s\"\n", style, val));
+		}
+		else
+		{
+			MSG_WriteChar (msg, svc_lightstyle);
+			MSG_WriteChar (msg, style);
+			MSG_WriteString (msg, val);
+		}
+	}
 }
 
 static void PF_rint (void)
@@ -1774,7 +1850,7 @@ void PR_spawnfunc_misc_model(edict_t *self)
 		self->v.model = PR_SetEngineString("*null");
 
 	if (self->v.angles[1] < 0)	//mimic AD. shame there's no avelocity clientside.
-		self->v.angles[1] = (rand()*(360.0f/RAND_MAX));
+		self->v.angles[1] = (PR_Rand()*(360.0f/0x7fff));
 
 	//make sure the model is precached, to avoid errors.
 	G_INT(OFS_PARM0) = self->v.model;
@@ -59,6 +59,12 @@ void ED_ClearEdict (edict_t *e)
 {
 	memset (&e->v, 0, qcvm->progs->entityfields * 4);
 	e->free = false;
+	e->sleeping = false;
+	e->sleptupon = false;
+	e->lodclass = AILOD_NEAR;
+	e->lodnext = 0;
+	e->lodwake = qcvm->time;	//give new things a chance to settle before they go dormant
+	ED_IndexDirty (e);
 }
 
 /*
@@ -95,6 +101,8 @@ edict_t *ED_Alloc (void)
 	qcvm->num_edicts++;
 	e = EDICT_NUM(i);
 	memset(e, 0, qcvm->edict_size); // ericw -- switched sv.edicts to malloc(), so we are accessing uninitialized memory and must fully zero it, not just ED_ClearEdict
+	e->lodwake = qcvm->time;	//same settle time as a reused slot gets from ED_ClearEdict
+	ED_IndexDirty (e);
 
 	return e;
 }
@@ -111,7 +119,9 @@ void ED_Free (edict_t *ed)
 {
 	SV_UnlinkEdict (ed);		// unlink from world bsp
 
+	SV_WakeGrounded (ed);
 	ed->free = true;
+	ed->sleeping = false;
 	ed->v.model = 0;
 	ed->v.takedamage = 0;
 	ed->v.modelindex = 0;
@@ -125,6 +135,495 @@ void ED_Free (edict_t *ed)
 	ed->alpha = ENTALPHA_DEFAULT; //johnfitz -- reset alpha for next entity
 
 	ed->freetime = qcvm->time;
+	ED_IndexDirty (ed);
+}
+
+//===========================================================================
+
+/*
+=================
+ED_InitFieldWatch
+
+Sets up the table that OP_ADDRESS checks to see if a qc store needs the
+engine to take note. Any write to a field that affects physics wakes the
+edict up (see SV_Physics), and writes to health count as a disturbance for
+sv_ai_lod. Progs without the system fields (menu.dat) only get the table.
+=================
+*/
+static void ED_InitFieldWatch (void)
+{
+	static const int wakefields[] = {
+		offsetof(entvars_t, origin)/4+0, offsetof(entvars_t, origin)/4+1, offsetof(entvars_t, origin)/4+2,
+		offsetof(entvars_t, velocity)/4+0, offsetof(entvars_t, velocity)/4+1, offsetof(entvars_t, velocity)/4+2,
+		offsetof(entvars_t, avelocity)/4+0, offsetof(entvars_t, avelocity)/4+1, offsetof(entvars_t, avelocity)/4+2,
+		offsetof(entvars_t, movetype)/4,
+		offsetof(entvars_t, flags)/4,
+		offsetof(entvars_t, solid)/4,
+		offsetof(entvars_t, groundentity)/4,
+	};
+	size_t i;
+
+	qcvm->fieldwatch = (unsigned char *) calloc (q_max(qcvm->progs->entityfields, 1), 1);
+	if (!qcvm->fieldwatch)
+		Sys_Error ("ED_InitFieldWatch: out of memory on %i fields", qcvm->progs->entityfields);
+	if ((size_t)qcvm->progs->entityfields * 4 < sizeof(entvars_t))
+		return;	//no entvars_t to watch
+
+	for (i = 0; i < countof(wakefields); i++)
+		qcvm->fieldwatch[wakefields[i]] |= FIELDWATCH_WAKE;
+	if (qcvm->extfields.customphysics >= 0 && qcvm->extfields.customphysics < qcvm->progs->entityfields)
+		qcvm->fieldwatch[qcvm->extfields.customphysics] |= FIELDWATCH_WAKE;
+	if (qcvm->extfields.gravity >= 0 && qcvm->extfields.gravity < qcvm->progs->entityfields)
+		qcvm->fieldwatch[qcvm->extfields.gravity] |= FIELDWATCH_WAKE;
+	//damage is health going down, so sv_ai_lod needs to know about it
+	qcvm->fieldwatch[offsetof(entvars_t, health)/4] |= FIELDWATCH_LODWAKE;
+}
+
+/*
+===============================================================================
+
+FIELD INDEXES
+
+find() and friends are linear scans with a strcmp per edict, and mods tend
+to call them in loops. Fields named in pr_findindex get a hash of edict
+numbers keyed by value, with each bucket kept sorted by edict number so that
+the results come out in the same order as a scan.
+
+The index is built lazily on the first search of an indexed field. After
+that, any OP_ADDRESS of an indexed field (ie: a qc store to it), as well as
+the engine's own bulk writes (clearing, parsing, copying), flags the edict as
+dirty, and dirty edicts are rehashed before the next search. Candidates are
+always compared against their current value, so stale entries only cost time.
+
+Empty strings and zero floats are never hashed; searches for them fall back
+to the scan. Fields the engine stores to directly (the system fields, model,
+netname and every extension field in pr_extfields_s) are refused.
+===============================================================================
+*/
+
+static void PR_FindIndex_Changed (cvar_t *var);
+cvar_t	pr_findindex = {"pr_findindex", "", CVAR_NONE};	//eg: "classname targetname target"
+static int pr_findindex_generation = 1;
+
+#define FINDINDEX_BUCKETS 1024
+typedef struct pr_fieldindex_s
+{
+	int		ofs;		//field offset, in ints
+	etype_t	type;		//ev_string, otherwise compared as floats.
+	int		head[FINDINDEX_BUCKETS];
+	int		tail[FINDINDEX_BUCKETS];
+	int		*next;		//[max_edicts]
+	int		*prev;		//[max_edicts]
+	int		*bucketof;	//[max_edicts], -1 when not in any bucket.
+} pr_fieldindex_t;
+
+struct pr_findstat_s
+{
+	unsigned int	calls;		//number of searches of this field
+	unsigned int	indexed;	//how many of those were answered from an index
+	unsigned int	visited;	//edicts looked at to answer them
+};
+
+static void ED_FreeFieldIndexes (void)
+{
+	int i;
+	for (i = 0; i < qcvm->numfieldindexes; i++)
+	{
+		free (qcvm->fieldindexes[i].next);
+		free (qcvm->fieldindexes[i].prev);
+		free (qcvm->fieldindexes[i].bucketof);
+	}
+	free (qcvm->fieldindexes);
+	if (qcvm->fieldwatch)
+	{
+		for (i = 0; i < qcvm->progs->entityfields; i++)
+			qcvm->fieldwatch[i] &= ~FIELDWATCH_INDEX;
+	}
+	free (qcvm->edictdirty);
+	free (qcvm->dirtyedicts);
+	qcvm->fieldindexes = NULL;
+	qcvm->numfieldindexes = 0;
+	qcvm->edictdirty = NULL;
+	qcvm->dirtyedicts = NULL;
+	qcvm->numdirtyedicts = 0;
+	qcvm->fieldindexgen = 0;
+}
+
+/*
+=================
+ED_IndexBucket
+
+Returns the bucket for the value, or -1 if it should not be indexed.
+=================
+*/
+static int ED_IndexBucket (etype_t type, const eval_t *val)
+{
+	if (type == ev_string)
+	{
+		const char *s = PR_GetString (val->string);
+		if (!*s)
+			return -1;
+		return COM_HashString (s) & (FINDINDEX_BUCKETS-1);
+	}
+	if (val->_float == 0)	//also catches -0
+		return -1;
+	return ((unsigned int)val->_int * 2654435761u) >> (32-10);
+}
+
+static void ED_IndexUnlink (pr_fieldindex_t *idx, int e)
+{
+	int b = idx->bucketof[e];
+	if (b < 0)
+		return;
+	if (idx->prev[e] >= 0)
+		idx->next[idx->prev[e]] = idx->next[e];
+	else
+		idx->head[b] = idx->next[e];
+	if (idx->next[e] >= 0)
+		idx->prev[idx->next[e]] = idx->prev[e];
+	else
+		idx->tail[b] = idx->prev[e];
+	idx->bucketof[e] = -1;
+}
+
+static void ED_IndexLink (pr_fieldindex_t *idx, int e, int b)
+{
+	int after;
+	//new ents are usually the highest numbered, so walk back from the tail.
+	for (after = idx->tail[b]; after >= 0 && after > e; after = idx->prev[after])
+		;
+	idx->prev[e] = after;
+	if (after >= 0)
+	{
+		idx->next[e] = idx->next[after];
+		idx->next[after] = e;
+	}
+	else
+	{
+		idx->next[e] = idx->head[b];
+		idx->head[b] = e;
+	}
+	if (idx->next[e] >= 0)
+		idx->prev[idx->next[e]] = e;
+	else
+		idx->tail[b] = e;
+	idx->bucketof[e] = b;
+}
+
+static void ED_IndexUpdate (pr_fieldindex_t *idx, int e)
+{
+	edict_t *ed = EDICT_NUM(e);
+	int b;
+	if (ed->free)
+		b = -1;
+	else
+		b = ED_IndexBucket (idx->type, (eval_t *)((int *)&ed->v + idx->ofs));
+	if (b == idx->bucketof[e])
+		return;
+	ED_IndexUnlink (idx, e);
+	if (b >= 0)
+		ED_IndexLink (idx, e, b);
+}
+
+/*
+=================
+ED_IndexDirty
+
+Flags an edict for rehashing before the next indexed search.
+=================
+*/
+void ED_IndexDirty (edict_t *ed)
+{
+	int e;
+	if (!qcvm->edictdirty)
+		return;
+	e = NUM_FOR_EDICT (ed);
+	if (qcvm->edictdirty[e])
+		return;
+	qcvm->edictdirty[e] = true;
+	qcvm->dirtyedicts[qcvm->numdirtyedicts++] = e;
+}
+
+static void ED_IndexFlush (void)
+{
+	int i, j, e;
+	for (i = 0; i < qcvm->numdirtyedicts; i++)
+	{
+		e = qcvm->dirtyedicts[i];
+		qcvm->edictdirty[e] = false;
+		for (j = 0; j < qcvm->numfieldindexes; j++)
+			ED_IndexUpdate (&qcvm->fieldindexes[j], e);
+	}
+	qcvm->numdirtyedicts = 0;
+}
+
+/*
+=================
+ED_EngineWritesField
+
+Fields the engine stores to without going through OP_ADDRESS, which the index
+would never hear about.
+=================
+*/
+static qboolean ED_EngineWritesField (const ddef_t *def, const char *name, int type)
+{
+	if (type == ev_string)
+	{
+		if (!strcmp(name, "model") || !strcmp(name, "netname"))
+			return true;
+	}
+	else if (def->ofs < (int)(sizeof(entvars_t)/4))
+		return true;	//all the system floats (flags, frame, etc)
+
+	//and any extension field it knows about (button3, ping, etc)
+#define QCEXTFIELD(n,t) if (qcvm->extfields.n >= 0 && def->ofs >= qcvm->extfields.n && def->ofs < qcvm->extfields.n + (strcmp(t, ".vector") ? 1 : 3)) return true;
+	QCEXTFIELDS_ALL
+	QCEXTFIELDS_GAME
+	QCEXTFIELDS_CL
+	QCEXTFIELDS_CS
+	QCEXTFIELDS_SS
+#undef QCEXTFIELD
+	return false;
+}
+
+/*
+=================
+ED_BuildFieldIndexes
+
+Parses pr_findindex and hashes every edict's current values.
+=================
+*/
+static void ED_BuildFieldIndexes (void)
+{
+	const char *s;
+	char name[64];
+	ddef_t *def;
+	pr_fieldindex_t *idx;
+	int i, e, type;
+
+	ED_FreeFieldIndexes ();
+	if (!qcvm->edicts || !qcvm->max_edicts)
+		return;	//try again later
+	qcvm->fieldindexgen = pr_findindex_generation;
+
+	for (s = pr_findindex.string; *s; )
+	{	//don't use COM_Parse, we might be called from inside something else that is using com_token.
+		while (*s == ' ' || *s == '\t' || *s == ',')
+			s++;
+		for (i = 0; *s && *s != ' ' && *s != '\t' && *s != ','; s++)
+			if (i < (int)sizeof(name)-1)
+				name[i++] = *s;
+		name[i] = 0;
+		if (!*name)
+			continue;
+		def = ED_FindField (name);
+		if (!def)
+			continue;	//this mod doesn't have it, don't spam.
+		type = def->type & ~DEF_SAVEGLOBAL;
+		if (type != ev_string && type != ev_float && type != ev_entity && type != ev_function)
+		{
+			Con_Warning ("pr_findindex: %s is not a string or float field\n", name);
+			continue;
+		}
+		if (ED_EngineWritesField (def, name, type))
+		{	//we'd never see the changes.
+			Con_Warning ("pr_findindex: %s is written by the engine and cannot be indexed\n", name);
+			continue;
+		}
+		for (i = 0; i < qcvm->numfieldindexes; i++)
+			if (qcvm->fieldindexes[i].ofs == def->ofs)
+				break;
+		if (i < qcvm->numfieldindexes)
+			continue;	//listed twice.
+
+		qcvm->fieldindexes = (pr_fieldindex_t *) realloc (qcvm->fieldindexes, sizeof(*qcvm->fieldindexes) * (qcvm->numfieldindexes+1));
+		idx = &qcvm->fieldindexes[qcvm->numfieldindexes++];
+		idx->ofs = def->ofs;
+		idx->type = type;
+		for (i = 0; i < FINDINDEX_BUCKETS; i++)
+			idx->head[i] = idx->tail[i] = -1;
+		idx->next = (int *) malloc (sizeof(int) * qcvm->max_edicts);
+		idx->prev = (int *) malloc (sizeof(int) * qcvm->max_edicts);
+		idx->bucketof = (int *) malloc (sizeof(int) * qcvm->max_edicts);
+		for (e = 0; e < qcvm->max_edicts; e++)
+			idx->bucketof[e] = -1;
+		for (e = 1; e < qcvm->num_edicts; e++)
+			ED_IndexUpdate (idx, e);
+	}
+
+	if (!qcvm->numfieldindexes)
+		return;
+	for (i = 0; i < qcvm->numfieldindexes; i++)
+		qcvm->fieldwatch[qcvm->fieldindexes[i].ofs] |= FIELDWATCH_INDEX;
+	qcvm->edictdirty = (unsigned char *) calloc (qcvm->max_edicts, 1);
+	qcvm->dirtyedicts = (int *) malloc (sizeof(int) * qcvm->max_edicts);
+}
+
+static pr_fieldindex_t *ED_GetFieldIndex (int fld)
+{
+	int i;
+	if (qcvm->fieldindexgen != pr_findindex_generation)
+		ED_BuildFieldIndexes ();
+	for (i = 0; i < qcvm->numfieldindexes; i++)
+	{
+		if (qcvm->fieldindexes[i].ofs == fld)
+		{
+			ED_IndexFlush ();
+			return &qcvm->fieldindexes[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+=================
+ED_FindStat
+
+Counts searches per field, for pr_findstats.
+=================
+*/
+void ED_FindStat (int fld, qboolean indexed, int visited)
+{
+	if ((unsigned int)fld >= (unsigned int)qcvm->progs->entityfields)
+		return;
+	if (!qcvm->findstats)
+		qcvm->findstats = (struct pr_findstat_s *) calloc (qcvm->progs->entityfields, sizeof(*qcvm->findstats));
+	qcvm->findstats[fld].calls++;
+	qcvm->findstats[fld].indexed += indexed;
+	qcvm->findstats[fld].visited += visited;
+}
+
+/*
+=================
+ED_IndexFindString / ED_IndexFindFloat
+
+Returns the number of the first non-free edict after start whose field
+matches, 0 if there is none, or -1 if the field/value is not indexed and the
+caller needs to do its own scan.
+=================
+*/
+int ED_IndexFindString (int fld, int start, const char *match)
+{
+	pr_fieldindex_t *idx;
+	int e, b, visited = 0;
+	edict_t *ed;
+
+	if (!*match || !(idx = ED_GetFieldIndex (fld)) || idx->type != ev_string)
+		return -1;
+	b = COM_HashString (match) & (FINDINDEX_BUCKETS-1);
+
+	if (start > 0 && start < qcvm->max_edicts && idx->bucketof[start] == b)
+		e = idx->next[start];	//the usual find loop, carry on from where we were.
+	else
+		for (e = idx->head[b]; e >= 0 && e <= start; e = idx->next[e])
+			visited++;
+	for (; e >= 0 && e < qcvm->num_edicts; e = idx->next[e])
+	{
+		visited++;
+		ed = EDICT_NUM(e);
+		if (ed->free)
+			continue;
+		if (!strcmp (E_STRING(ed, fld), match))
+			break;
+	}
+	ED_FindStat (fld, true, visited);
+	return (e >= 0 && e < qcvm->num_edicts)?e:0;
+}
+
+int ED_IndexFindFloat (int fld, int start, float match)
+{
+	pr_fieldindex_t *idx;
+	int e, b, visited = 0;
+	edict_t *ed;
+	eval_t key;
+
+	key._float = match;
+	if (!(idx = ED_GetFieldIndex (fld)) || idx->type == ev_string || (b = ED_IndexBucket (idx->type, &key)) < 0)
+		return -1;
+
+	if (start > 0 && start < qcvm->max_edicts && idx->bucketof[start] == b)
+		e = idx->next[start];
+	else
+		for (e = idx->head[b]; e >= 0 && e <= start; e = idx->next[e])
+			visited++;
+	for (; e >= 0 && e < qcvm->num_edicts; e = idx->next[e])
+	{
+		visited++;
+		ed = EDICT_NUM(e);
+		if (ed->free)
+			continue;
+		if (E_FLOAT(ed, fld) == match)
+			break;
+	}
+	ED_FindStat (fld, true, visited);
+	return (e >= 0 && e < qcvm->num_edicts)?e:0;
+}
+
+static void PR_FindIndex_Changed (cvar_t *var)
+{
+	pr_findindex_generation++;	//vms rebuild on their next search
+}
+
+static int PR_FindStats_Compare (const void *a, const void *b)
+{
+	const struct pr_findstat_s *sa = &qcvm->findstats[*(const int *)a];
+	const struct pr_findstat_s *sb = &qcvm->findstats[*(const int *)b];
+	if (sa->calls != sb->calls)
+		return (sa->calls < sb->calls)?1:-1;
+	return 0;
+}
+
+static void PR_FindStats_VM (qcvm_t *vm, const char *title, qboolean reset)
+{
+	int i, n, *order;
+	ddef_t *def;
+	qboolean indexed;
+
+	if (!vm->progs)
+		return;
+	PR_SwitchQCVM (vm);
+	if (!qcvm->findstats)
+	{
+		PR_SwitchQCVM (NULL);
+		return;
+	}
+	if (reset)
+		memset (qcvm->findstats, 0, sizeof(*qcvm->findstats) * qcvm->progs->entityfields);
+	else
+	{
+		order = (int *) malloc (sizeof(int) * qcvm->progs->entityfields);
+		for (i = 0, n = 0; i < qcvm->progs->entityfields; i++)
+			if (qcvm->findstats[i].calls)
+				order[n++] = i;
+		qsort (order, n, sizeof(*order), PR_FindStats_Compare);
+
+		Con_Printf ("%s:\n", title);
+		Con_Printf ("       calls    indexed     visited field\n");
+		for (i = 0; i < n; i++)
+		{
+			def = ED_FieldAtOfs (order[i]);
+			indexed = !!(qcvm->fieldwatch[order[i]] & FIELDWATCH_INDEX);
+			Con_Printf ("%12u %10u %11u %s%s\n", qcvm->findstats[order[i]].calls, qcvm->findstats[order[i]].indexed, qcvm->findstats[order[i]].visited,
+						def?PR_GetString(def->s_name):va("<%i>", order[i]), indexed?" (indexed)":"");
+		}
+		free (order);
+	}
+	PR_SwitchQCVM (NULL);
+}
+
+/*
+=================
+PR_FindStats_f
+
+Lists which fields find/findchain/findfloat/findflags have been searching, to
+help decide what to put in pr_findindex.
+=================
+*/
+static void PR_FindStats_f (void)
+{
+	qboolean reset = !strcmp (Cmd_Argv(1), "reset");
+	PR_FindStats_VM (&sv.qcvm, "ssqc", reset);
+	PR_FindStats_VM (&cl.qcvm, "csqc", reset);
 }
 
 //===========================================================================
@@ -574,7 +1073,10 @@ static void ED_PrintEdict_f (void)
 			else if (Cmd_Argc() < 4)
 				Con_Printf("Edict %u.%s==%s\n", i, PR_GetString(def->s_name), PR_UglyValueString(def->type&~DEF_SAVEGLOBAL, (eval_t *)((char *)&EDICT_NUM(i)->v + def->ofs*4)));
 			else
+			{
 				ED_ParseEpair((void *)&EDICT_NUM(i)->v, def, Cmd_Argv(3), false);
+				ED_IndexDirty (EDICT_NUM(i));
+			}
 		}
 
 	}
@@ -591,19 +1093,25 @@ For debugging
 static void ED_Count (void)
 {
 	edict_t	*ent;
-	int	i, active, models, solid, step;
+	int	i, active, models, solid, step, sleeping;
+	int	lod[AILOD_COUNT];
 
 	if (!sv.active)
 		return;
 
 	PR_SwitchQCVM(&sv.qcvm);
-	active = models = solid = step = 0;
+	active = models = solid = step = sleeping = 0;
+	memset (lod, 0, sizeof(lod));
 	for (i = 0; i < qcvm->num_edicts; i++)
 	{
 		ent = EDICT_NUM(i);
 		if (ent->free)
 			continue;
 		active++;
+		if (ent->sleeping)
+			sleeping++;
+		if (ent->lodclass < AILOD_COUNT)
+			lod[ent->lodclass]++;
 		if (ent->v.solid)
 			solid++;
 		if (ent->v.model)
@@ -617,6 +1125,14 @@ static void ED_Count (void)
 	Con_Printf ("view      :%3i\n", models);
 	Con_Printf ("touch     :%3i\n", solid);
 	Con_Printf ("step      :%3i\n", step);
+	Con_Printf ("sleeping  :%3i\n", sleeping);
+	Con_Printf ("awake     :%3i\n", active - sleeping);
+	if (sv_ai_lod.value)
+	{
+		Con_Printf ("lod near  :%3i\n", lod[AILOD_NEAR]);
+		Con_Printf ("lod far   :%3i\n", lod[AILOD_FAR]);
+		Con_Printf ("lod dormant:%3i\n", lod[AILOD_DORMANT]);
+	}
 	PR_SwitchQCVM(NULL);
 }
 
@@ -1001,6 +1517,7 @@ const char *ED_ParseEdict (const char *data, edict_t *ent)
 
 	if (!init)
 		ent->free = true;
+	ED_IndexDirty (ent);
 
 	return data;
 }
@@ -1132,6 +1649,10 @@ void PR_ClearProgs(qcvm_t *vm)
 	qcvm = NULL;
 	PR_SwitchQCVM(vm);
 	PR_ShutdownExtensions();
+	ED_FreeFieldIndexes ();
+	free (qcvm->findstats);
+	free (qcvm->fieldwatch);
+	PR_ProfileFree (qcvm);
 
 	if (qcvm->knownstrings)
 		Z_Free ((void *)qcvm->knownstrings);
@@ -1376,6 +1897,7 @@ qboolean PR_LoadProgs (const char *filename, qboolean fatal, unsigned int needcr
 
 	PR_SetEngineString("");
 	PR_EnableExtensions(qcvm->globaldefs);
+	ED_InitFieldWatch();
 
 	return true;
 }
@@ -1392,7 +1914,9 @@ void PR_Init (void)
 	Cmd_AddCommand ("edicts", ED_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
 	Cmd_AddCommand ("profile", PR_Profile_f);
+	Cmd_AddCommand ("pr_findstats", PR_FindStats_f);
 	Cmd_AddCommand ("pr_dumpplatform", PR_DumpPlatform_f);
+	PR_InitProfiler ();
 	Cvar_RegisterVariable (&nomonsters);
 	Cvar_RegisterVariable (&gamecfg);
 	Cvar_RegisterVariable (&scratch1);
@@ -1404,6 +1928,8 @@ void PR_Init (void)
 	Cvar_RegisterVariable (&saved2);
 	Cvar_RegisterVariable (&saved3);
 	Cvar_RegisterVariable (&saved4);
+	Cvar_RegisterVariable (&pr_findindex);
+	Cvar_SetCallback (&pr_findindex, PR_FindIndex_Changed);
 
 	PR_InitExtensions();
 }
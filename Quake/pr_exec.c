@@ -232,6 +232,388 @@ void PR_Profile_f (void)
 }
 
 
+/*
+===============================================================================
+
+CALL-GRAPH PROFILER
+
+With pr_qcprofile set, every qc function and builtin call is timed as it
+goes through the vm's call stack. Per-function inclusive/exclusive times
+and a tree of call paths are kept separately for each vm.
+
+===============================================================================
+*/
+
+cvar_t	pr_qcprofile = {"pr_qcprofile", "0", CVAR_NONE};
+
+#define PRPROF_HASHSIZE		4096
+#define PRPROF_MAXNODES		(1<<20)
+#define PRPROF_MAXDEPTH		(MAX_STACK_DEPTH*2)	// builtins and nested PR_ExecuteProgram calls go on the same stack
+
+typedef struct
+{
+	double			inclusive;	// outermost calls only, so recursion isn't counted twice
+	double			exclusive;
+	unsigned int	calls;
+	int				active;		// instances on the stack right now
+} prprof_func_t;
+
+typedef struct
+{
+	int				func;
+	int				parent;		// -1 for entry points
+	int				hashnext;
+	unsigned int	calls;
+	double			exclusive;
+} prprof_node_t;
+
+struct pr_profile_s
+{
+	prprof_func_t	*funcs;		// [numfunctions]
+	prprof_node_t	*nodes;
+	int				numnodes;
+	int				maxnodes;
+	int				hash[PRPROF_HASHSIZE];
+
+	struct
+	{
+		int		func;
+		int		node;
+		double	start;
+		double	children;
+	} stack[PRPROF_MAXDEPTH];
+	int				depth;
+	int				overdepth;	// calls too deep to track
+};
+
+/*
+============
+PR_ProfileFree
+============
+*/
+void PR_ProfileFree (qcvm_t *vm)
+{
+	if (!vm->profile)
+		return;
+	free (vm->profile->funcs);
+	free (vm->profile->nodes);
+	free (vm->profile);
+	vm->profile = NULL;
+}
+
+/*
+============
+PR_ProfileReset
+============
+*/
+static void PR_ProfileReset (struct pr_profile_s *p)
+{
+	memset (p->funcs, 0, sizeof(*p->funcs) * qcvm->progs->numfunctions);
+	memset (p->hash, 0xff, sizeof(p->hash));
+	p->numnodes = 0;
+	p->depth = p->overdepth = 0;
+}
+
+/*
+============
+PR_ProfileAbort
+
+Forgets calls that were left on the stack by an error, so that their
+functions count their inclusive time again.
+============
+*/
+static void PR_ProfileAbort (struct pr_profile_s *p)
+{
+	int i;
+	for (i = 0; i < p->depth; i++)
+	{
+		if (p->funcs[p->stack[i].func].active > 0)
+			p->funcs[p->stack[i].func].active--;
+	}
+	p->depth = p->overdepth = 0;
+}
+
+/*
+============
+PR_ProfileNode
+
+Finds or adds the call tree node for func under parent. If the tree is full
+the time goes to the parent instead.
+============
+*/
+static int PR_ProfileNode (struct pr_profile_s *p, int parent, int func)
+{
+	unsigned int h = ((unsigned int)parent * 2654435761u ^ (unsigned int)func) & (PRPROF_HASHSIZE-1);
+	prprof_node_t *n;
+	int i;
+
+	for (i = p->hash[h]; i >= 0; i = p->nodes[i].hashnext)
+	{
+		if (p->nodes[i].func == func && p->nodes[i].parent == parent)
+			return i;
+	}
+
+	if (p->numnodes == p->maxnodes)
+	{
+		prprof_node_t *nodes;
+		if (p->maxnodes == PRPROF_MAXNODES)
+			return parent;
+		nodes = (prprof_node_t *) realloc (p->nodes, sizeof(*nodes) * (p->maxnodes ? p->maxnodes * 2 : 1024));
+		if (!nodes)
+			return parent;
+		p->nodes = nodes;
+		p->maxnodes = p->maxnodes ? p->maxnodes * 2 : 1024;
+	}
+	n = &p->nodes[p->numnodes];
+	n->func = func;
+	n->parent = parent;
+	n->calls = 0;
+	n->exclusive = 0;
+	n->hashnext = p->hash[h];
+	p->hash[h] = p->numnodes;
+	return p->numnodes++;
+}
+
+/*
+============
+PR_ProfileEnter
+============
+*/
+static void PR_ProfileEnter (int func)
+{
+	struct pr_profile_s *p = qcvm->profile;
+	int parent;
+
+	if (!p)
+	{
+		p = qcvm->profile = (struct pr_profile_s *) calloc (1, sizeof(*p));
+		if (!p)
+			return;
+		p->funcs = (prprof_func_t *) calloc (qcvm->progs->numfunctions, sizeof(*p->funcs));
+		if (!p->funcs)
+		{
+			PR_ProfileFree (qcvm);
+			return;
+		}
+		memset (p->hash, 0xff, sizeof(p->hash));
+	}
+	if (p->depth == PRPROF_MAXDEPTH)
+	{
+		p->overdepth++;
+		return;
+	}
+
+	parent = p->depth ? p->stack[p->depth-1].node : -1;
+	p->stack[p->depth].func = func;
+	p->stack[p->depth].node = PR_ProfileNode (p, parent, func);
+	p->stack[p->depth].children = 0;
+	p->funcs[func].active++;
+	p->stack[p->depth++].start = Sys_DoubleTime ();
+}
+
+/*
+============
+PR_ProfileLeave
+============
+*/
+static void PR_ProfileLeave (void)
+{
+	struct pr_profile_s *p = qcvm->profile;
+	double duration, exclusive;
+	prprof_func_t *f;
+
+	if (!p || !p->depth)
+		return;
+	if (p->overdepth)
+	{
+		p->overdepth--;
+		return;
+	}
+
+	p->depth--;
+	duration = Sys_DoubleTime () - p->stack[p->depth].start;
+	exclusive = duration - p->stack[p->depth].children;
+	f = &p->funcs[p->stack[p->depth].func];
+	f->calls++;
+	f->exclusive += exclusive;
+	if (!--f->active)
+		f->inclusive += duration;
+	if (p->stack[p->depth].node >= 0)
+	{
+		p->nodes[p->stack[p->depth].node].calls++;
+		p->nodes[p->stack[p->depth].node].exclusive += exclusive;
+	}
+	if (p->depth)
+		p->stack[p->depth-1].children += duration;
+}
+
+/*
+============
+PR_ProfileVM
+
+Returns the vm named by the command's first argument, ssqc if there's none.
+============
+*/
+static qcvm_t *PR_ProfileVM (void)
+{
+	qcvm_t *vm = (!strcmp (Cmd_Argv (1), "csqc")) ? &cl.qcvm : &sv.qcvm;
+
+	if (!vm->progs || !vm->profile)
+	{
+		Con_Printf ("No profile for %s, set pr_qcprofile 1 first\n", (vm == &cl.qcvm) ? "csqc" : "ssqc");
+		return NULL;
+	}
+	return vm;
+}
+
+static int prprof_sort;	// 0 exclusive, 1 inclusive, 2 calls
+
+static int PR_ProfileCompare (const void *a, const void *b)
+{
+	const prprof_func_t *fa = &qcvm->profile->funcs[*(const int *)a];
+	const prprof_func_t *fb = &qcvm->profile->funcs[*(const int *)b];
+	double va, vb;
+
+	switch (prprof_sort)
+	{
+	case 1:		va = fa->inclusive;	vb = fb->inclusive;	break;
+	case 2:		va = fa->calls;		vb = fb->calls;		break;
+	default:	va = fa->exclusive;	vb = fb->exclusive;	break;
+	}
+	return (va < vb) - (va > vb);
+}
+
+/*
+============
+PR_QCProfile_f
+
+pr_qcprofile_print [ssqc|csqc] [excl|incl|calls] [count]
+============
+*/
+static void PR_QCProfile_f (void)
+{
+	qcvm_t	*vm;
+	int		i, n, count, *order;
+	double	total;
+	prprof_func_t *f;
+	dfunction_t *df;
+	const char *sort = Cmd_Argv (2);
+
+	if (!(vm = PR_ProfileVM ()))
+		return;
+	prprof_sort = !strcmp (sort, "incl") ? 1 : !strcmp (sort, "calls") ? 2 : 0;
+	count = (Cmd_Argc () > 3) ? atoi (Cmd_Argv (3)) : 20;
+
+	PR_SwitchQCVM (vm);
+	order = (int *) malloc (sizeof(int) * qcvm->progs->numfunctions);
+	if (!order)
+	{
+		PR_SwitchQCVM (NULL);
+		return;
+	}
+	for (i = 0, n = 0, total = 0; i < qcvm->progs->numfunctions; i++)
+	{
+		if (qcvm->profile->funcs[i].calls)
+		{
+			order[n++] = i;
+			total += qcvm->profile->funcs[i].exclusive;
+		}
+	}
+	qsort (order, n, sizeof(*order), PR_ProfileCompare);
+
+	Con_Printf ("     calls    incl ms    excl ms  excl%%  avg us function\n");
+	for (i = 0; i < n && i < count; i++)
+	{
+		f = &qcvm->profile->funcs[order[i]];
+		df = &qcvm->functions[order[i]];
+		Con_Printf ("%10u %10.2f %10.2f %5.1f%% %7.2f %s%s\n", f->calls, f->inclusive * 1000, f->exclusive * 1000,
+					total ? f->exclusive * 100 / total : 0, f->inclusive * 1000000 / f->calls,
+					PR_GetString (df->s_name), (df->first_statement < 0) ? " (builtin)" : "");
+	}
+	free (order);
+	PR_SwitchQCVM (NULL);
+}
+
+/*
+============
+PR_QCProfileDump_f
+
+Writes the call tree as folded stacks, one "entry;caller;callee usecs" line
+per path, for flamegraph.pl, speedscope and the like.
+============
+*/
+static void PR_QCProfileDump_f (void)
+{
+	qcvm_t	*vm;
+	char	name[MAX_OSPATH];
+	FILE	*f;
+	int		i, n, depth, path[256];
+	prprof_node_t *node;
+
+	if (!(vm = PR_ProfileVM ()))
+		return;
+
+	q_snprintf (name, sizeof(name), "%s/qcprofile_%s.folded", com_gamedir, (vm == &cl.qcvm) ? "csqc" : "ssqc");
+	COM_CreatePath (name);
+	f = fopen (name, "w");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open file %s.\n", name);
+		return;
+	}
+
+	PR_SwitchQCVM (vm);
+	for (i = 0; i < qcvm->profile->numnodes; i++)
+	{
+		node = &qcvm->profile->nodes[i];
+		if (node->exclusive <= 0)
+			continue;
+		for (n = i, depth = 0; n >= 0 && depth < (int)countof(path); n = qcvm->profile->nodes[n].parent)
+			path[depth++] = qcvm->profile->nodes[n].func;
+		while (depth-- > 0)
+			fprintf (f, "%s%s", PR_GetString (qcvm->functions[path[depth]].s_name), depth ? ";" : "");
+		fprintf (f, " %.0f\n", node->exclusive * 1000000);
+	}
+	PR_SwitchQCVM (NULL);
+	fclose (f);
+	Con_Printf ("Wrote %s\n", name);
+}
+
+/*
+============
+PR_QCProfileClear_f
+============
+*/
+static void PR_QCProfileClear_f (void)
+{
+	if (sv.qcvm.profile)
+	{
+		PR_SwitchQCVM (&sv.qcvm);
+		PR_ProfileReset (qcvm->profile);
+		PR_SwitchQCVM (NULL);
+	}
+	if (cl.qcvm.profile)
+	{
+		PR_SwitchQCVM (&cl.qcvm);
+		PR_ProfileReset (qcvm->profile);
+		PR_SwitchQCVM (NULL);
+	}
+}
+
+/*
+============
+PR_InitProfiler
+============
+*/
+void PR_InitProfiler (void)
+{
+	Cvar_RegisterVariable (&pr_qcprofile);
+	Cmd_AddCommand ("pr_qcprofile_print", PR_QCProfile_f);
+	Cmd_AddCommand ("pr_qcprofile_dump", PR_QCProfileDump_f);
+	Cmd_AddCommand ("pr_qcprofile_clear", PR_QCProfileClear_f);
+}
+
+
 /*
 ============
 PR_RunError
@@ -311,6 +693,8 @@ static int PR_EnterFunction (dfunction_t *f)
 	}
 
 	qcvm->xfunction = f;
+	if (qcvm->profiling)
+		PR_ProfileEnter (f - qcvm->functions);
 	return f->first_statement - 1;	// offset the s++
 }
 
@@ -326,6 +710,9 @@ static int PR_LeaveFunction (void)
 	if (qcvm->depth <= 0)
 		Host_Error("prog stack underflow");
 
+	if (qcvm->profiling)
+		PR_ProfileLeave ();
+
 	// Restore locals from the stack
 	c = qcvm->xfunction->locals;
 	qcvm->localstack_used -= c;
@@ -361,6 +748,8 @@ void PR_ExecuteProgram (func_t fnum)
 	int profile, startprofile;
 	edict_t		*ed;
 	int		exitdepth;
+	unsigned char	watch;
+	double	qcstart = 0;
 
 	if (!fnum || fnum >= qcvm->progs->numfunctions)
 	{
@@ -369,6 +758,7 @@ void PR_ExecuteProgram (func_t fnum)
 		Host_Error ("PR_ExecuteProgram: NULL function");
 	}
 
+	PROF_BEGIN (PROF_QC);
 	f = &qcvm->functions[fnum];
 
 	//FIXME: if this is a builtin, then we're going to crash.
@@ -377,6 +767,14 @@ void PR_ExecuteProgram (func_t fnum)
 
 // make a stack frame
 	exitdepth = qcvm->depth;
+	if (!exitdepth)
+	{
+		if (qcvm->profile)
+			PR_ProfileAbort (qcvm->profile);	// anything left over was aborted by an error
+		qcvm->profiling = !!pr_qcprofile.value;
+	}
+	if (!exitdepth && svmetrics.active && qcvm == &sv.qcvm)
+		qcstart = Sys_DoubleTime ();
 
 	st = &qcvm->statements[PR_EnterFunction(f)];
 	startprofile = profile = 0;
@@ -555,6 +953,18 @@ void PR_ExecuteProgram (func_t fnum)
 			PR_RunError("assignment to world entity");
 		}
 		OPC->_int = (byte *)((int *)&ed->v + OPB->_int) - (byte *)qcvm->edicts;
+		if ((unsigned int)OPB->_int < (unsigned int)qcvm->progs->entityfields && (watch = qcvm->fieldwatch[OPB->_int]))
+		{	//about to be written
+			if (watch & FIELDWATCH_WAKE)
+			{
+				ed->sleeping = false;
+				SV_WakeGrounded (ed);	//anything resting on it may no longer be
+			}
+			if (watch & FIELDWATCH_INDEX)
+				ED_IndexDirty (ed);	//make sure find() sees it.
+			if (watch & FIELDWATCH_LODWAKE)
+				ed->lodwake = qcvm->time;
+		}
 		break;
 
 	case OP_LOAD_F:
@@ -615,7 +1025,14 @@ void PR_ExecuteProgram (func_t fnum)
 			int i = -newf->first_statement;
 			if (i >= qcvm->numbuiltins)
 				i = 0;	//just invoke the fixme builtin.
-			qcvm->builtins[i]();
+			if (qcvm->profiling)
+			{
+				PR_ProfileEnter (OPA->function);
+				qcvm->builtins[i]();
+				PR_ProfileLeave ();
+			}
+			else
+				qcvm->builtins[i]();
 			break;
 		}
 		// Normal function
@@ -633,6 +1050,9 @@ void PR_ExecuteProgram (func_t fnum)
 		st = &qcvm->statements[PR_LeaveFunction()];
 		if (qcvm->depth == exitdepth)
 		{ // Done
+			if (qcstart)
+				svmetrics.qctime += Sys_DoubleTime () - qcstart;
+			PROF_END (PROF_QC);
 			return;
 		}
 		break;
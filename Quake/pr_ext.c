@@ -53,20 +53,6 @@ static int pr_ext_warned_particleeffectnum;	//so these only spam once per map
 static void *PR_FindExtGlobal(int type, const char *name);
 void SV_CheckVelocity (edict_t *ent);
 
-typedef enum multicast_e
-{
-	MULTICAST_ALL_U,
-	MULTICAST_PHS_U,
-	MULTICAST_PVS_U,
-	MULTICAST_ALL_R,
-	MULTICAST_PHS_R,
-	MULTICAST_PVS_R,
-
-	MULTICAST_ONE_U,
-	MULTICAST_ONE_R,
-	MULTICAST_INIT
-} multicast_t;
-static void SV_Multicast(multicast_t to, float *org, int msg_entity, unsigned int requireext2);
 
 #define Z_StrDup(s) strcpy(Z_Malloc(strlen(s)+1), s)
 #define	RETURN_EDICT(e) (((int *)qcvm->globals)[OFS_RETURN] = EDICT_TO_PROG(e))
@@ -3818,6 +3804,7 @@ static void PF_copyentity(void)
 	memcpy(&dst->v, &src->v, qcvm->edict_size - sizeof(entvars_t));
 	dst->alpha = src->alpha;
 	dst->sendinterval = src->sendinterval;
+	ED_IndexDirty(dst);
 	SV_LinkEdict(dst, false);
 
 	G_INT(OFS_RETURN) = EDICT_TO_PROG(dst);
@@ -3846,6 +3833,18 @@ static void PF_findchain(void)
 	else
 		cfld = &ent->v.chain - (int*)&ent->v;
 
+	if ((i = ED_IndexFindString(f, 0, s)) >= 0)
+	{
+		for (; i > 0; i = ED_IndexFindString(f, i, s))
+		{
+			ent = EDICT_NUM(i);
+			((int*)&ent->v)[cfld] = EDICT_TO_PROG(chain);
+			chain = ent;
+		}
+		RETURN_EDICT(chain);
+		return;
+	}
+
 	ent = NEXT_EDICT(qcvm->edicts);
 	for (i = 1; i < qcvm->num_edicts; i++, ent = NEXT_EDICT(ent))
 	{
@@ -3858,11 +3857,12 @@ static void PF_findchain(void)
 		chain = ent;
 	}
 
+	ED_FindStat (f, false, qcvm->num_edicts);
 	RETURN_EDICT(chain);
 }
 static void PF_findfloat(void)
 {
-	int		e;
+	int		e, first;
 	int		f;
 	float	s, t;
 	edict_t	*ed;
@@ -3871,7 +3871,14 @@ static void PF_findfloat(void)
 	f = G_INT(OFS_PARM1);
 	s = G_FLOAT(OFS_PARM2);
 
-	for (e++ ; e < qcvm->num_edicts ; e++)
+	first = ED_IndexFindFloat(f, e, s);
+	if (first >= 0)
+	{
+		RETURN_EDICT(EDICT_NUM(first));
+		return;
+	}
+
+	for (first = e++ ; e < qcvm->num_edicts ; e++)
 	{
 		ed = EDICT_NUM(e);
 		if (ed->free)
@@ -3879,11 +3886,13 @@ static void PF_findfloat(void)
 		t = E_FLOAT(ed,f);
 		if (t == s)
 		{
+			ED_FindStat (f, false, e-first);
 			RETURN_EDICT(ed);
 			return;
 		}
 	}
 
+	ED_FindStat (f, false, e-first);
 	RETURN_EDICT(qcvm->edicts);
 }
 static void PF_findchainfloat(void)
@@ -3902,6 +3911,18 @@ static void PF_findchainfloat(void)
 	else
 		cfld = &ent->v.chain - (int*)&ent->v;
 
+	if ((i = ED_IndexFindFloat(f, 0, s)) >= 0)
+	{
+		for (; i > 0; i = ED_IndexFindFloat(f, i, s))
+		{
+			ent = EDICT_NUM(i);
+			((int*)&ent->v)[cfld] = EDICT_TO_PROG(chain);
+			chain = ent;
+		}
+		RETURN_EDICT(chain);
+		return;
+	}
+
 	ent = NEXT_EDICT(qcvm->edicts);
 	for (i = 1; i < qcvm->num_edicts; i++, ent = NEXT_EDICT(ent))
 	{
@@ -3914,6 +3935,7 @@ static void PF_findchainfloat(void)
 		chain = ent;
 	}
 
+	ED_FindStat (f, false, qcvm->num_edicts);
 	RETURN_EDICT(chain);
 }
 static void PF_findflags(void)
@@ -3935,11 +3957,13 @@ static void PF_findflags(void)
 		t = E_FLOAT(ed,f);
 		if (t & s)
 		{
+			ED_FindStat (f, false, e-G_EDICTNUM(OFS_PARM0));
 			RETURN_EDICT(ed);
 			return;
 		}
 	}
 
+	ED_FindStat (f, false, e-G_EDICTNUM(OFS_PARM0));
 	RETURN_EDICT(qcvm->edicts);
 }
 static void PF_findchainflags(void)
@@ -3970,6 +3994,37 @@ static void PF_findchainflags(void)
 		chain = ent;
 	}
 
+	ED_FindStat (f, false, qcvm->num_edicts);
+	RETURN_EDICT(chain);
+}
+static void PF_findbox(void)
+{
+	edict_t	*ent, *chain;
+	float	*mins, *maxs;
+	int	i, cfld;
+	edict_t	**list;
+	int	listcount, mark;
+
+	chain = (edict_t *)qcvm->edicts;
+
+	mins = G_VECTOR(OFS_PARM0);
+	maxs = G_VECTOR(OFS_PARM1);
+	if (qcvm->argc > 2)
+		cfld = G_INT(OFS_PARM2);
+	else
+		cfld = &chain->v.chain - (int*)&chain->v;
+
+	mark = Hunk_LowMark ();
+	list = (edict_t **) Hunk_Alloc (qcvm->num_edicts*sizeof(edict_t *));
+	listcount = SV_AreaEdicts (mins, maxs, list, qcvm->num_edicts);
+	for (i = 0; i < listcount; i++)
+	{
+		ent = list[i];
+		((int*)&ent->v)[cfld] = EDICT_TO_PROG(chain);
+		chain = ent;
+	}
+	Hunk_FreeToLowMark (mark);
+
 	RETURN_EDICT(chain);
 }
 static void PF_numentityfields(void)
@@ -4028,7 +4083,10 @@ static void PF_putentfldstr(void)
 	edict_t *ent = G_EDICT(OFS_PARM1);
 	const char *value = G_STRING(OFS_PARM2);
 	if (fldidx < (unsigned int)qcvm->progs->numfielddefs)
+	{
 		G_FLOAT(OFS_RETURN) = ED_ParseEpair ((void *)&ent->v, qcvm->fielddefs+fldidx, value, true);
+		ED_IndexDirty(ent);
+	}
 	else
 		G_FLOAT(OFS_RETURN) = false;
 }
@@ -4240,98 +4298,6 @@ static void PF_infokey_f(void)
 	PF_infokey_internal(true);
 }
 
-static void PF_multicast_internal(qboolean reliable, byte *pvs, unsigned int requireext2)
-{
-	unsigned int i;
-	int cluster;
-	mleaf_t *playerleaf;
-	if (!pvs)
-	{
-		if (!requireext2)
-			SZ_Write((reliable?&sv.reliable_datagram:&sv.datagram), sv.multicast.data, sv.multicast.cursize);
-		else
-		{
-			for (i = 0; i < (unsigned int)svs.maxclients; i++)
-			{
-				if (!svs.clients[i].active)
-					continue;
-				if (!(svs.clients[i].protocol_pext2 & requireext2))
-					continue;
-				SZ_Write((reliable?&svs.clients[i].message:&svs.clients[i].datagram), sv.multicast.data, sv.multicast.cursize);
-			}
-		}
-	}
-	else
-	{
-		for (i = 0; i < (unsigned int)svs.maxclients; i++)
-		{
-			if (!svs.clients[i].active)
-				continue;
-
-			if (requireext2 && !(svs.clients[i].protocol_pext2 & requireext2))
-				continue;
-
-			//figure out which cluster (read: pvs index) to use.
-			playerleaf = Mod_PointInLeaf(svs.clients[i].edict->v.origin, qcvm->worldmodel);
-			cluster = playerleaf - qcvm->worldmodel->leafs;
-			cluster--;	//pvs is 1-based, leaf 0 is discarded.
-			if (cluster < 0 || (pvs[cluster>>3] & (1<<(cluster&7))))
-			{
-				//they can see it. add it in to whichever buffer is appropriate.
-				if (reliable)
-					SZ_Write(&svs.clients[i].message, sv.multicast.data, sv.multicast.cursize);
-				else
-					SZ_Write(&svs.clients[i].datagram, sv.multicast.data, sv.multicast.cursize);
-			}
-		}
-	}
-}
-//FIXME: shouldn't really be using pext2, but we don't track the earlier extensions, and it should be safe enough.
-static void SV_Multicast(multicast_t to, float *org, int msg_entity, unsigned int requireext2)
-{
-	unsigned int i;
-
-	if (to == MULTICAST_INIT && sv.state != ss_loading)
-	{
-		SZ_Write (&sv.signon, sv.multicast.data, sv.multicast.cursize);
-		to = MULTICAST_ALL_R;	//and send to players that are already on
-	}
-
-	switch(to)
-	{
-	case MULTICAST_INIT:
-		SZ_Write (&sv.signon, sv.multicast.data, sv.multicast.cursize);
-		break;
-	case MULTICAST_ALL_R:
-	case MULTICAST_ALL_U:
-		PF_multicast_internal(to==MULTICAST_ALL_R, NULL, requireext2);
-		break;
-	case MULTICAST_PHS_R:
-	case MULTICAST_PHS_U:
-		//we don't support phs, that would require lots of pvs decompression+merging stuff, and many q1bsps have a LOT of leafs.
-		PF_multicast_internal(to==MULTICAST_PHS_R, NULL/*Mod_LeafPHS(Mod_PointInLeaf(org, qcvm->worldmodel), qcvm->worldmodel)*/, requireext2);
-		break;
-	case MULTICAST_PVS_R:
-	case MULTICAST_PVS_U:
-		PF_multicast_internal(to==MULTICAST_PVS_R, Mod_LeafPVS(Mod_PointInLeaf(org, qcvm->worldmodel), qcvm->worldmodel), requireext2);
-		break;
-	case MULTICAST_ONE_R:
-	case MULTICAST_ONE_U:
-		i = msg_entity-1;
-		if (i >= (unsigned int)svs.maxclients)
-			break;
-		//a unicast, which ignores pvs.
-		//(unlike vanilla this allows unicast unreliables, so woo)
-		if (svs.clients[i].active)
-		{
-			SZ_Write(((to==MULTICAST_ONE_R)?&svs.clients[i].message:&svs.clients[i].datagram), sv.multicast.data, sv.multicast.cursize);
-		}
-		break;
-	default:
-		break;
-	}
-	SZ_Clear(&sv.multicast);
-}
 static void PF_multicast(void)
 {
 	float *org = G_VECTOR(OFS_PARM0);
@@ -4343,9 +4309,9 @@ static void PF_randomvector(void)
 	vec3_t temp;
 	do
 	{
-		temp[0] = (rand() & 32767) * (2.0 / 32767.0) - 1.0;
-		temp[1] = (rand() & 32767) * (2.0 / 32767.0) - 1.0;
-		temp[2] = (rand() & 32767) * (2.0 / 32767.0) - 1.0;
+		temp[0] = PR_Rand() * (2.0 / 32767.0) - 1.0;
+		temp[1] = PR_Rand() * (2.0 / 32767.0) - 1.0;
+		temp[2] = PR_Rand() * (2.0 / 32767.0) - 1.0;
 	} while (DotProduct(temp, temp) >= 1);
 	VectorCopy (temp, G_VECTOR(OFS_RETURN));
 }
@@ -7435,6 +7401,7 @@ static struct
 	{"cvar_string",		PF_cvar_string,		PF_cvar_string,		448,	PF_cvar_string,71, "string(string cvarname)"},//DP_QC_CVAR_STRING
 	{"findflags",		PF_findflags,		PF_findflags,		449,	PF_findflags,0, "entity(entity start, .float fld, float match)"},//DP_QC_FINDFLAGS
 	{"findchainflags",	PF_findchainflags,	PF_findchainflags,	450,	PF_NoMenu, "entity(.float fld, float match, optional .entity chainfield)"},//DP_QC_FINDCHAINFLAGS
+	{"findbox",			PF_findbox,			PF_findbox,			0,		PF_NoMenu, D("entity(vector mins, vector maxs, optional .entity chainfield)", "Returns a chain of entities whose absmin/absmax overlap the given box. Only entities that are linked into the world (ie: not SOLID_NOT) are considered. This is answered from the world's area nodes rather than by scanning every entity, and so is much faster than findradius on maps with many entities.")},//FTE_QC_FINDBOX
 	{"dropclient",		PF_dropclient,		PF_NoCSQC,			453,	PF_NoMenu, "void(entity player)"},//DP_SV_BOTCLIENT
 	{"spawnclient",		PF_spawnclient,		PF_NoCSQC,			454,	PF_NoMenu, "entity()", "Spawns a dummy player entity.\nNote that such dummy players will be carried from one map to the next.\nWarning: DP_SV_CLIENTCOLORS DP_SV_CLIENTNAME are not implemented in quakespasm, so use KRIMZON_SV_PARSECLIENTCOMMAND's clientcommand builtin to change the bot's name/colours/skin/team/etc, in the same way that clients would ask."},//DP_SV_BOTCLIENT
 	{"clienttype",		PF_clienttype,		PF_NoCSQC,			455,	PF_NoMenu, "float(entity client)"},//botclient
@@ -7682,6 +7649,7 @@ static struct
 #endif
 	{"FTE_QC_CHECKCOMMAND"},
 	{"FTE_QC_CROSSPRODUCT"},
+	{"FTE_QC_FINDBOX"},
 	{"FTE_QC_HARDWARECURSORS"},
 	{"FTE_QC_INFOKEY",			PR_NotQEX},
 	{"FTE_QC_INTCONV"},
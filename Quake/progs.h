@@ -49,6 +49,11 @@ typedef struct edict_s
 	unsigned char	alpha;			/* johnfitz -- hack to support alpha since it's not part of entvars_t */
 	qboolean	sendinterval;		/* johnfitz -- send time until nextthink to client for better lerp timing */
 	qboolean	onladder;			/* spike -- content_ladder stuff */
+	qboolean	sleeping;			/* resting on static ground with nothing to do, physics skips it until it's disturbed */
+	qboolean	sleptupon;			/* something sleeping rests on this, so moving or freeing it must wake them */
+	unsigned char	lodclass;		/* AILOD_* classification from the last server frame */
+	float		lodnext;			/* sv_ai_lod: earliest time a far entity may run again */
+	float		lodwake;			/* sv_ai_lod: time it was last hurt or made noise */
 
 	float		freetime;		/* sv.time when the object was freed */
 	entvars_t	v;			/* C exported fields from progs */
@@ -96,10 +101,20 @@ int PR_AllocString (int bufferlength, char **ptr);
 void PR_ClearEngineString(int num);
 
 void PR_Profile_f (void);
+void PR_InitProfiler (void);
+void PR_ProfileFree (qcvm_t *vm);
 
 edict_t *ED_Alloc (void);
 void ED_Free (edict_t *ed);
 
+void ED_IndexDirty (edict_t *ed);	//call after the engine writes to an edict's fields behind the vm's back
+#define FIELDWATCH_INDEX	1	//field is in pr_findindex, flag the edict for rehashing
+#define FIELDWATCH_WAKE		2	//field affects physics, wake the edict if it's sleeping
+#define FIELDWATCH_LODWAKE	4	//field counts as being hurt, wake the edict if sv_ai_lod made it dormant
+int ED_IndexFindString (int fld, int start, const char *match);	//-1 if not indexed
+int ED_IndexFindFloat (int fld, int start, float match);		//-1 if not indexed
+void ED_FindStat (int fld, qboolean indexed, int visited);
+
 void ED_Print (edict_t *ed);
 void ED_Write (FILE *f, edict_t *ed);
 const char *ED_ParseEdict (const char *data, edict_t *ent);
@@ -158,6 +173,7 @@ sizebuf_t *WriteDest (void);
 char *PR_GetTempString (void);
 int PR_MakeTempString (const char *val);
 char *PF_VarString (int	first);
+int PR_Rand (void);	// 0 to 0x7fff
 #define	STRINGTEMP_BUFFERS		1024
 #define	STRINGTEMP_LENGTH		1024
 void PF_Fixme(void);	//the 'unimplemented' builtin. woot.
@@ -306,6 +322,7 @@ struct pr_extfields_s
 	QCEXTFIELD(viewzoom,				".float")			/*float*/	\
 	QCEXTFIELD(SendEntity,				".float(entity to, float changedflags)")			/*function*/	\
 	QCEXTFIELD(SendFlags,				".float")			/*float. :( */	\
+	QCEXTFIELD(ai_lod,					".float")			/*float. 0=auto (monsters only), >0 never throttle, <0 throttle even non-monsters*/	\
 	//end of list
 
 #define QCEXTFIELD(n,t) int n;
@@ -413,6 +430,20 @@ struct qcvm_s
 	//originally from world.c
 	areanode_t	areanodes[AREA_NODES];
 	int			numareanodes;
+
+	int			sleeping_edicts;	//number skipped by the last SV_Physics
+
+	//find() acceleration, see pr_edict.c
+	struct pr_fieldindex_s *fieldindexes;
+	int			numfieldindexes;
+	int			fieldindexgen;		//rebuilt when this doesn't match pr_findindex's
+	unsigned char *fieldwatch;		//[entityfields] FIELDWATCH_* flags for when qc stores to the field
+	unsigned char *edictdirty;		//[max_edicts]
+	int			*dirtyedicts;
+	int			numdirtyedicts;
+	struct pr_findstat_s *findstats;	//[entityfields]
+	struct pr_profile_s *profile;		//pr_qcprofile call graph, see pr_exec.c
+	qboolean	profiling;		//pr_qcprofile, latched by the outermost PR_ExecuteProgram so enters and leaves always pair up
 };
 extern globalvars_t	*pr_global_struct;
 
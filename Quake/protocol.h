@@ -73,9 +73,15 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define PEXT2_PREDINFO				0x00000020	//provides input acks and reworks stats such that clc_clientdata becomes redundant.
 #define PEXT2_NEWSIZEENCODING		0x00000040	//richer size encoding, for more precise bboxes.
 #define PEXT2_INFOBLOBS				0x00000080	//unbounded userinfo
-#define PEXT2_ACCEPTED_CLIENT		(PEXT2_SUPPORTED_CLIENT|PEXT2_NEWSIZEENCODING|PEXT2_INFOBLOBS)	//pext2 flags that we can parse, but don't want to advertise (for demos)
-#define PEXT2_SUPPORTED_CLIENT		(PEXT2_PRYDONCURSOR|PEXT2_VOICECHAT|PEXT2_SETANGLEDELTA|PEXT2_REPLACEMENTDELTAS|PEXT2_MAXPLAYERS|PEXT2_PREDINFO)	//pext2 flags that we understand+support
-#define PEXT2_SUPPORTED_SERVER		(PEXT2_PRYDONCURSOR|PEXT2_VOICECHAT|                    PEXT2_REPLACEMENTDELTAS                 |PEXT2_PREDINFO)
+#define PEXT2_ZLIBSTREAM			0x00100000	//qss-specific: server deflates reliables through a per-connection stream (and large unreliables individually). handled by the net layer, so demos are unaffected.
+#ifdef USE_ZLIB
+#define PEXT2_ZLIB_IFAVAILABLE		PEXT2_ZLIBSTREAM
+#else
+#define PEXT2_ZLIB_IFAVAILABLE		0
+#endif
+#define PEXT2_ACCEPTED_CLIENT		(PEXT2_SUPPORTED_CLIENT|PEXT2_NEWSIZEENCODING|PEXT2_INFOBLOBS|PEXT2_ZLIBSTREAM)	//pext2 flags that we can parse, but don't want to advertise (for demos)
+#define PEXT2_SUPPORTED_CLIENT		(PEXT2_PRYDONCURSOR|PEXT2_VOICECHAT|PEXT2_SETANGLEDELTA|PEXT2_REPLACEMENTDELTAS|PEXT2_MAXPLAYERS|PEXT2_PREDINFO|PEXT2_ZLIB_IFAVAILABLE)	//pext2 flags that we understand+support
+#define PEXT2_SUPPORTED_SERVER		(PEXT2_PRYDONCURSOR|PEXT2_VOICECHAT|                    PEXT2_REPLACEMENTDELTAS                 |PEXT2_PREDINFO|PEXT2_ZLIB_IFAVAILABLE)
 
 // if the high bit of the servercmd is set, the low bits are fast update flags:
 #define	U_MOREBITS		(1<<0)
@@ -347,6 +353,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define svcfte_updateentities		86
 //spike -- end
 
+//server recorded demos, never sent over the network
+#define svcqss_mvdplayer			120		// [byte] slot [short] len [angle16*3] viewangles, then len bytes of that player's view (setview, damage, clientdata)
+
 //used by the 2021 rerelease
 //Note: same value as svcdp_effect!
 #define svcqx_achievement				52		// [string] id
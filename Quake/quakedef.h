@@ -147,6 +147,26 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define STAT_PUNCHVECTOR_X	29
 #define STAT_PUNCHVECTOR_Y	30
 #define STAT_PUNCHVECTOR_Z	31
+//movevars, for prediction. numbered to match DP.
+#define STAT_MOVEVARS_WALLFRICTION		237
+#define STAT_MOVEVARS_FRICTION			238
+#define STAT_MOVEVARS_WATERFRICTION		239
+#define STAT_MOVEVARS_TICRATE			240
+#define STAT_MOVEVARS_TIMESCALE			241
+#define STAT_MOVEVARS_GRAVITY			242
+#define STAT_MOVEVARS_STOPSPEED			243
+#define STAT_MOVEVARS_MAXSPEED			244
+#define STAT_MOVEVARS_SPECTATORMAXSPEED	245
+#define STAT_MOVEVARS_ACCELERATE		246
+#define STAT_MOVEVARS_AIRACCELERATE		247
+#define STAT_MOVEVARS_WATERACCELERATE	248
+#define STAT_MOVEVARS_ENTGRAVITY		249
+#define STAT_MOVEVARS_JUMPVELOCITY		250
+#define STAT_MOVEVARS_EDGEFRICTION		251
+#define STAT_MOVEVARS_MAXAIRSPEED		252
+#define STAT_MOVEVARS_STEPHEIGHT		253
+#define STAT_MOVEVARS_AIRACCEL_QW		254
+#define STAT_MOVEVARS_AIRACCEL_SIDEWAYS_FRICTION	255
 
 // stock defines
 //
@@ -247,6 +267,7 @@ typedef struct
 
 #include "cmd.h"
 #include "crc.h"
+#include "demostream.h"
 
 #include "snd_voip.h"
 #include "progs.h"
@@ -346,12 +367,54 @@ void Host_ClientCommands (const char *fmt, ...) FUNC_PRINTF(1,2);
 void Host_ShutdownServer (qboolean crash);
 void Host_WriteConfiguration (void);
 
-void Host_AppendDownloadData(client_t *client, sizebuf_t *buf);
+qboolean Host_AppendDownloadData(client_t *client, sizebuf_t *buf);
+void Host_CloseDownload(client_t *client);
 void Host_DownloadAck(client_t *client);
 
+// frame profiler zones, names are in host.c
+typedef enum
+{
+	PROF_FRAME,
+	PROF_SERVERFRAME,
+	PROF_SV_READCLIENTS,
+	PROF_SV_PHYSICS,
+	PROF_SV_SENDCLIENTS,
+	PROF_QC,
+	PROF_CL_SENDCMD,
+	PROF_CL_READFROMSERVER,
+	PROF_CL_RELINKENTITIES,
+	PROF_SCREEN,
+	PROF_R_RENDERVIEW,
+	PROF_R_SETUPVIEW,
+	PROF_R_SKY,
+	PROF_R_SHADOWMAP,
+	PROF_R_WORLD,
+	PROF_R_ENTITIES,
+	PROF_R_WATER,
+	PROF_R_TRANSLUCENT,
+	PROF_R_PARTICLES,
+	PROF_R_VIEWMODEL,
+	PROF_SOUND,
+	PROF_NET_POLL,
+	PROF_NET_READ,
+	PROF_NET_SEND,
+	PROF_NUMZONES
+} profzone_t;
+
+extern qboolean	prof_active;
+void Prof_Begin (profzone_t zone);
+void Prof_End (profzone_t zone);
+qboolean Prof_LastFrame (float *zonetime);
+const char *Prof_ZoneName (profzone_t zone);
+// scoped timers, a single branch when the profiler is off
+#define PROF_BEGIN(z)	do { if (prof_active) Prof_Begin (z); } while (0)
+#define PROF_END(z)		do { if (prof_active) Prof_End (z); } while (0)
+
 void ExtraMaps_Init (void);
 void Modlist_Init (void);
 void DemoList_Init (void);
+void Bench_Init (void);
+void Bench_AutoRun (void);
 
 void ExtraMaps_NewGame (void);
 void DemoList_Rebuild (void);
@@ -47,6 +47,8 @@ typedef struct efrag_s
 #define LERP_EXPLICIT	(1<<5) //for csqc, using explicit frame1/2+frac+times
 //johnfitz
 
+#define ENT_HISTORY		8	// power of two
+
 typedef struct entity_s
 {
 	qboolean				forcelink;		// model changed
@@ -61,6 +63,13 @@ typedef struct entity_s
 	vec3_t					origin;
 	vec3_t					msg_angles[2];	// last two updates (0 is newest)
 	vec3_t					angles;
+	struct
+	{
+		double				time;
+		vec3_t				origin;
+		vec3_t				angles;
+	}						history[ENT_HISTORY];	// recent updates, so the jitter buffer can interpolate across late/lost packets
+	unsigned int			historycount;	// total updates since the history was last reset
 	struct qmodel_s			*model;			// NULL = no model
 	struct efrag_s			*efrag;			// linked list of efrags
 	int						frame;
@@ -292,7 +301,7 @@ r_shadow_light_t* R_Shadow_GetSunLight ();
 
 GLuint R_Shadow_GetUniformBuffer ();
 
-void R_Shadow_BindTextures (const GLuint* sampler_locations);
+void R_Shadow_BindTextures (const GLuint* sampler_locations, const GLuint* sampler_cube_locations);
 
 void R_MarkSurfacesForLightShadowMap (r_shadow_light_t* light);
 
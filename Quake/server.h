@@ -106,6 +106,9 @@ typedef struct
 #define	NUM_BASIC_SPAWN_PARMS		16
 #define	NUM_TOTAL_SPAWN_PARMS		64
 
+#define DOWNLOAD_CHUNKSIZE	1000	//file is split into chunks of this size, acks are per chunk. small enough to fit a vanilla-sized datagram with its header
+#define DOWNLOAD_WINDOW		64		//max chunks in flight at once
+
 typedef struct client_s
 {
 	qboolean		active;				// false = client is free
@@ -117,14 +120,11 @@ typedef struct client_s
 		PRESPAWN_FLUSH=1,
 //		PRESPAWN_SERVERINFO,
 		PRESPAWN_MODELS,
-		PRESPAWN_SOUNDS,
-		PRESPAWN_PARTICLES,
-		PRESPAWN_BASELINES,
-		PRESPAWN_STATICS,
-		PRESPAWN_AMBIENTS,
+		PRESPAWN_CACHED,				// sounds, particles, baselines, statics, ambients. see SV_SendPrespawnCache
 		PRESPAWN_SIGNONMSG,
 	}				sendsignon;			// only valid before spawned
 	int				signonidx;
+	struct signoncache_s *signoncache;	// the prespawn data we're streaming to them
 	unsigned int	signon_sounds;		//
 	unsigned int	signon_models;		//
 
@@ -155,6 +155,14 @@ typedef struct client_s
 	sizebuf_t		datagram;
 	byte			datagram_buf[MAX_DATAGRAM];
 
+	int				rate;				//bytes per second from the "rate" userinfo, 0 for whatever sv_maxrate allows
+	double			ratetokens;			//bytes we may send before choking (can go negative)
+	double			ratetime;			//realtime the bucket was last refilled
+	double			ratestatstime;
+	unsigned int	ratebytes;			//bytes sent since ratestatstime
+	unsigned int	ratebps;			//bytes/sec over the last second, for status
+	unsigned int	deferredents;		//entity updates left pending after the last datagram, for status
+
 	unsigned int	limit_entities;		//vanilla is 600
 	unsigned int	limit_unreliable;	//max allowed size for unreliables
 	unsigned int	limit_reliable;		//max (total) size of a reliable message.
@@ -177,7 +185,16 @@ typedef struct client_s
 	size_t maxpreviousentities;
 	unsigned int snapshotresume;
 	unsigned int *pendingentities_bits;	//UF_ flags for each entity
+	float *pendingentities_senttime;	//when each entity was last written, for prioritising (same size as pendingentities_bits)
 	size_t numpendingentities;	//realloc if too small
+	struct entity_priority_s
+	{
+		unsigned int num;
+		float priority;
+	} *sendorder;				//the order to write pending entities in, snapshotresume indexes this
+	size_t numsendorder;
+	qboolean prioritised;		//false means sendorder wasn't built, and snapshotresume is an entity number
+	size_t maxsendorder;
 	unsigned int *pendingcsqcentities_bits;	//SendFlags bitflags for each entity
 					#define	SENDFLAG_PRESENT	0x80000000u	//tracks that we previously sent one of these ents (resulting in a remove if the ent gets remove()d).
 					#define	SENDFLAG_REMOVE		0x40000000u	//for packetloss to signal that we need to resend a remove.
@@ -216,9 +233,21 @@ typedef struct client_s
 		qboolean started;	//actually sending
 		unsigned int startpos;	//within the pak, so we don't break stuff when seeking
 		unsigned int size;
-		unsigned int sendpos;	//file offset we last tried sending
-		unsigned int ackpos;	//if they don't ack this properly, we restart sending from here instead.
-		//for more speed, the server should build a collection of blocks to track which parts were actually acked, thereby avoiding redundant resends, but in the intererest of simplicity...
+		unsigned int numchunks;	//DOWNLOAD_CHUNKSIZE each, the last may be short (or empty, for empty files)
+		unsigned int nextchunk;	//first chunk we've not sent yet
+		unsigned int numacked;
+		byte *acked;			//bitmask of chunks the client has confirmed
+		struct
+		{
+			unsigned int chunk;
+			double senttime;
+			qboolean resent;	//don't measure rtt from these, we can't tell which copy got acked
+		} inflight[DOWNLOAD_WINDOW];	//chunks sent but not acked yet
+		unsigned int numinflight;
+		double srtt;			//smoothed round trip time, for deciding when to resend
+		double tokens;			//bytes we may send (for sv_download_maxrate/sv_download_share)
+		double tokentime;
+		unsigned int resends;
 	} download;
 	qboolean		knowntoqc;			// putclientinserver was called
 	qboolean		csqcactive;			// its prepared to accept csqc entities.
@@ -308,6 +337,21 @@ extern	edict_t		*sv_player;
 
 void SV_Init (void);
 
+typedef enum multicast_e
+{	//values are shared with qc's multicast builtin
+	MULTICAST_ALL_U,
+	MULTICAST_PHS_U,
+	MULTICAST_PVS_U,
+	MULTICAST_ALL_R,
+	MULTICAST_PHS_R,
+	MULTICAST_PVS_R,
+
+	MULTICAST_ONE_U,
+	MULTICAST_ONE_R,
+	MULTICAST_INIT
+} multicast_t;
+void SV_Multicast (multicast_t to, float *org, int msg_entity, unsigned int requireext2);
+
 void SV_StartParticle (vec3_t org, vec3_t dir, int color, int count);
 void SV_StartSound (edict_t *entity, float *origin, int channel, const char *sample, int volume, float attenuation);
 void SV_StartSound2 (edict_t *entity, float *origin, int channel, const char *sample, int volume, float attenuation, float speed, int flags, float timeoffset);
@@ -317,6 +361,8 @@ void SV_DropClient (qboolean crash);
 void SVFTE_Ack(client_t *client, int sequence);
 void SVFTE_DestroyFrames(client_t *client);
 void SV_BuildEntityState(edict_t *ent, entity_state_t *state);
+unsigned int MSGFTE_DeltaCalcBits(entity_state_t *from, entity_state_t *to);
+void MSGFTE_WriteEntityUpdate(unsigned int bits, entity_state_t *state, sizebuf_t *msg, unsigned int pext2, unsigned int protocolflags);
 void SV_SendClientMessages (void);
 void SV_ClearDatagram (void);
 
@@ -332,18 +378,73 @@ void SV_AddClientToServer (struct qsocket_s	*ret);
 void SV_ClientPrintf (const char *fmt, ...) FUNC_PRINTF(1,2);
 void SV_BroadcastPrintf (const char *fmt, ...) FUNC_PRINTF(1,2);
 
+int SV_ClientRate (client_t *client);
+void SV_FlushSignonCaches (void);
+void SV_ReleaseSignonCache (client_t *client);
+void SV_WriteSignonData (unsigned int pext2, void (*write) (const byte *data, int size));
 void SV_Physics (void);
+void SV_WakeGrounded (edict_t *ground);
+
+//sv_ai_lod classifications
+#define AILOD_NEAR		0	//visible to a client (or exempt), runs every frame
+#define AILOD_FAR		1	//audible but not visible, think+physics throttled
+#define AILOD_DORMANT	2	//neither, does nothing until disturbed
+#define AILOD_COUNT		3
+extern cvar_t sv_ai_lod;
+void SV_AILod_NoteSound (edict_t *ent, const vec3_t origin);
 
 qboolean SV_CheckBottom (edict_t *ent);
 qboolean SV_movestep (edict_t *ent, vec3_t move, qboolean relink);
 
 void SV_WriteClientdataToMessage (client_t *client, sizebuf_t *msg);
 
+//sv_demo.c, server side recording of every player at once
+#define SV_DEMO_PEXT2	PEXT2_REPLACEMENTDELTAS	//what server demos are written for
+void SV_Demo_Init (void);
+sizebuf_t *SV_DemoBuffer (qboolean reliable);
+// NULL unless a server demo is being recorded. broadcasts that don't pass
+// through sv.datagram or sv.reliable_datagram are copied here.
+void SV_Demo_Frame (void);
+// writes the current frame, from the snapshot stage of SV_SendClientMessages
+void SV_Demo_NewMap (void);
+void SV_Demo_Stop (void);
+
+//sv_replay.c, deterministic reruns of everything clients sent
+void SV_Replay_Init (void);
+qboolean SV_Replay_Playing (void);
+qboolean SV_MenuPaused (void);	// single player is stopped by the console or menus
+void SV_Replay_FrameBegin (void);
+void SV_Replay_FrameEnd (void);
+void SV_Replay_RunClients (void);	// replaces the network reads while playing
+void SV_Replay_RecordConnect (int slot);
+void SV_Replay_RecordMessage (int slot);	// net_message, before it's parsed
+void SV_Replay_RecordDrop (int slot);
+void SV_Replay_ReadsDone (void);
+void SV_Replay_Shutdown (void);
+
+int SV_Rand (void);	// 0 to 0x7fff, from a seed replays can repeat
+void SV_SeedRandom (unsigned int seed);
+
+//sv_metrics.c, counters and gauges for scrapers
+typedef struct
+{
+	qboolean		active;		// someone may ask, so the timers are worth reading
+	double			qctime;		// seconds in server qc, outermost calls only
+	unsigned int	signonhits, signonmisses;
+	unsigned int	fatpvshits, fatpvsmisses;
+} svmetrics_t;
+extern svmetrics_t svmetrics;
+void SV_Metrics_Init (void);
+void SV_Metrics_Tick (double seconds);
+void SV_Metrics_Poll (void);
+void SV_Metrics_Shutdown (void);
+
 void SV_MoveToGoal (void);
 
 void SV_ConnectClient (int clientnum);	//called from the netcode to add new clients. also called from pr_ext to spawn new botclients.
 void SV_CheckForNewClients (void);
 void SV_RunClients (void);
+qboolean SV_ReadClientMessage (void);	// parses net_message from host_client
 void SV_SaveSpawnparms ();
 void SV_SpawnServer (const char *server);
 
@@ -2491,21 +2491,21 @@ void S_Voip_Transmit(unsigned char clc, sizebuf_t *buf)
 				byte b;
 				unsigned short s;
 				int i = LittleLong (5+outpos);
-				fwrite (&i, 4, 1, cls.demofile);
+				CL_DemoWrite (&i, 4);
 				for (i = 0; i < 3; i++)
 				{
 					float f = LittleFloat (cl.viewangles[i]);
-					fwrite (&f, 4, 1, cls.demofile);
+					CL_DemoWrite (&f, 4);
 				}
 				b = clc;
-				fwrite (&b, 1, 1, cls.demofile);
+				CL_DemoWrite (&b, 1);
 				b = (s_voip.enccodec<<4) | (s_voip.generation & 0x0f);
-				fwrite (&b, 1, 1, cls.demofile);
+				CL_DemoWrite (&b, 1);
 				b = initseq;
-				fwrite (&b, 1, 1, cls.demofile);
+				CL_DemoWrite (&b, 1);
 				s = outpos;
-				fwrite (&s, 2, 1, cls.demofile);
-				fwrite (outbuf, outpos, 1, cls.demofile);
+				CL_DemoWrite (&s, 2);
+				CL_DemoWrite (outbuf, outpos);
 			}
 		}
 
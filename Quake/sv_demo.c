@@ -0,0 +1,702 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// sv_demo.c -- server side demos of every player at once
+
+#include "quakedef.h"
+
+/*
+==============================================================================
+
+SERVER DEMOS
+
+sv_record writes a regular .dem that playdemo understands, but from the
+server's point of view rather than one client's. Entities are sent with
+the fte replacement deltas against the previous frame, culled against
+everything any player can see. Each player's view (angles, stats, damage)
+goes in its own svcqss_mvdplayer block, and the client only parses the one
+it is following (see demo_view).
+
+Messages are handed to a demostream, which compresses and writes them on
+its own thread, so recording costs the server frame little more than the
+deltas themselves.
+
+Not recorded: anything sent to a single player (centerprints, MSG_ONE
+writes, unicast multicasts), csqc entities, and the extra stats that
+only predinfo clients are sent.
+
+==============================================================================
+*/
+
+cvar_t	sv_demo_compress = {"sv_demo_compress", "1", CVAR_ARCHIVE};
+
+static struct
+{
+	demostream_t	*file;
+	char			name[MAX_OSPATH];
+	qboolean		needsignon;		// new map (or just started), serverinfo goes before the next frame
+	qboolean		resetents;		// the client has no entities yet
+
+	// what the demo has been told so far
+	entity_state_t	*ents;
+	byte			*present;
+	int				numents, maxents;
+	char			names[MAX_SCOREBOARD][32];
+	int				colors[MAX_SCOREBOARD];
+	int				frags[MAX_SCOREBOARD];
+
+	byte			*pvs;			// union of every player's fat pvs
+	int				pvsbytes;
+
+	// broadcasts since the last frame
+	sizebuf_t		reliable;
+	sizebuf_t		datagram;
+	byte			reliable_buf[MAX_MSGLEN];
+	byte			datagram_buf[MAX_DATAGRAM];
+
+	sizebuf_t		msg;			// the demo message being built
+	byte			msg_buf[MAX_MSGLEN];
+	vec3_t			angles;			// for the demo message header
+} svdemo;
+
+/*
+==================
+SV_DemoBuffer
+==================
+*/
+sizebuf_t *SV_DemoBuffer (qboolean reliable)
+{
+	if (!svdemo.file)
+		return NULL;
+	return reliable ? &svdemo.reliable : &svdemo.datagram;
+}
+
+/*
+==================
+SV_Demo_WriteMessage
+
+Queues the current message in the same framing as client demos
+==================
+*/
+static void SV_Demo_WriteMessage (void)
+{
+	int		len;
+	int		i;
+	float	f;
+
+	if (!svdemo.msg.cursize)
+		return;
+
+	len = LittleLong (svdemo.msg.cursize);
+	DemoStream_Write (svdemo.file, &len, 4);
+	for (i = 0; i < 3; i++)
+	{
+		f = LittleFloat (svdemo.angles[i]);
+		DemoStream_Write (svdemo.file, &f, 4);
+	}
+	DemoStream_Write (svdemo.file, svdemo.msg.data, svdemo.msg.cursize);
+	SZ_Clear (&svdemo.msg);
+}
+
+/*
+==================
+SV_Demo_Append
+
+Adds whole messages, starting a new demo message if they don't fit
+==================
+*/
+static void SV_Demo_Append (const byte *data, int size)
+{
+	if (svdemo.msg.cursize + size > svdemo.msg.maxsize)
+		SV_Demo_WriteMessage ();
+	if (size > svdemo.msg.maxsize)
+	{
+		Con_DPrintf ("SV_Demo_Append: %i byte message dropped\n", size);
+		return;
+	}
+	SZ_Write (&svdemo.msg, data, size);
+}
+
+static void SV_Demo_AppendBuffer (sizebuf_t *buf)
+{
+	if (buf->overflowed)
+		Con_DPrintf ("server demo: %i bytes of broadcasts lost\n", buf->cursize);
+	else
+		SV_Demo_Append (buf->data, buf->cursize);
+	SZ_Clear (buf);
+}
+
+/*
+==================
+SV_Demo_WriteSignon
+
+Everything a client is sent on connecting: serverinfo, the prespawn data
+and the spawn data, in that order.
+==================
+*/
+static void SV_Demo_WriteSignon (void)
+{
+	byte		buf[MAX_DATAGRAM];
+	sizebuf_t	item;
+	const char	**s, *noise;
+	client_t	*client;
+	int			i;
+
+	SV_Demo_WriteMessage ();
+	SZ_Clear (&svdemo.reliable);
+	SZ_Clear (&svdemo.datagram);
+
+	memset (&item, 0, sizeof(item));
+	item.data = buf;
+	item.maxsize = sizeof(buf);
+
+// serverinfo
+	MSG_WriteByte (&svdemo.msg, svc_print);
+	MSG_WriteString (&svdemo.msg, va("%c\nServer demo recorded by "ENGINE_NAME_AND_VER"\n", 2));
+	MSG_WriteByte (&svdemo.msg, svc_serverinfo);
+	MSG_WriteLong (&svdemo.msg, PROTOCOL_FTE_PEXT2);
+	MSG_WriteLong (&svdemo.msg, SV_DEMO_PEXT2);
+	MSG_WriteLong (&svdemo.msg, sv.protocol);
+	if (sv.protocol == PROTOCOL_RMQ)
+		MSG_WriteLong (&svdemo.msg, sv.protocolflags);
+	MSG_WriteByte (&svdemo.msg, svs.maxclients);
+	if (!coop.value && deathmatch.value)
+		MSG_WriteByte (&svdemo.msg, GAME_DEATHMATCH);
+	else
+		MSG_WriteByte (&svdemo.msg, GAME_COOP);
+	MSG_WriteString (&svdemo.msg, PR_GetString(qcvm->edicts->v.message));
+	for (i = 1, s = sv.model_precache+1; *s && i < MAX_MODELS; s++, i++)
+		MSG_WriteString (&svdemo.msg, *s);
+	MSG_WriteByte (&svdemo.msg, 0);
+	MSG_WriteByte (&svdemo.msg, 0);	// sounds all go as svcdp_precache with the rest of the prespawn data
+	if (qcvm->edicts->v.sounds == -1 && *(noise = PR_GetString(qcvm->edicts->v.noise)) && !strchr(noise, '\"') && !strchr(noise, '\n'))
+	{
+		MSG_WriteByte (&svdemo.msg, svc_stufftext);
+		MSG_WriteString (&svdemo.msg, va("music \"%s\"\n", noise));
+	}
+	else
+	{
+		MSG_WriteByte (&svdemo.msg, svc_cdtrack);
+		MSG_WriteByte (&svdemo.msg, qcvm->edicts->v.sounds);
+		MSG_WriteByte (&svdemo.msg, qcvm->edicts->v.sounds);
+	}
+	MSG_WriteByte (&svdemo.msg, svc_setview);
+	MSG_WriteShort (&svdemo.msg, 1);
+	MSG_WriteByte (&svdemo.msg, svc_signonnum);
+	MSG_WriteByte (&svdemo.msg, 1);
+	SV_Demo_WriteMessage ();
+
+// prespawn
+	SV_WriteSignonData (SV_DEMO_PEXT2, SV_Demo_Append);
+	SV_Demo_Append (sv.signon.data, sv.signon.cursize);
+	MSG_WriteByte (&item, svc_signonnum);
+	MSG_WriteByte (&item, 2);
+	SV_Demo_Append (item.data, item.cursize);
+	SZ_Clear (&item);
+
+// spawn
+	for (i = 0, client = svs.clients; i < svs.maxclients; i++, client++)
+	{
+		q_strlcpy (svdemo.names[i], client->knowntoqc?client->name:"", sizeof(svdemo.names[i]));
+		svdemo.colors[i] = client->knowntoqc?client->colors:0;
+		svdemo.frags[i] = client->knowntoqc?client->old_frags:0;
+		if (!client->knowntoqc)
+			continue;
+		MSG_WriteByte (&item, svc_updatename);
+		MSG_WriteByte (&item, i);
+		MSG_WriteString (&item, svdemo.names[i]);
+		MSG_WriteByte (&item, svc_updatecolors);
+		MSG_WriteByte (&item, i);
+		MSG_WriteByte (&item, svdemo.colors[i]);
+		MSG_WriteByte (&item, svc_updatefrags);
+		MSG_WriteByte (&item, i);
+		MSG_WriteShort (&item, svdemo.frags[i]);
+		SV_Demo_Append (item.data, item.cursize);
+		SZ_Clear (&item);
+	}
+	for (i = 0; i < MAX_LIGHTSTYLES; i++)
+	{
+		if (!sv.lightstyles[i])
+			continue;
+		if (i > 0xff)
+		{
+			MSG_WriteByte (&item, svc_stufftext);
+			MSG_WriteString (&item, va("//ls %i \"%s\"\n", i, sv.lightstyles[i]));
+		}
+		else
+		{
+			MSG_WriteByte (&item, svc_lightstyle);
+			MSG_WriteByte (&item, i);
+			MSG_WriteString (&item, sv.lightstyles[i]);
+		}
+		SV_Demo_Append (item.data, item.cursize);
+		SZ_Clear (&item);
+	}
+	MSG_WriteByte (&item, svc_updatestat);
+	MSG_WriteByte (&item, STAT_TOTALSECRETS);
+	MSG_WriteLong (&item, pr_global_struct->total_secrets);
+	MSG_WriteByte (&item, svc_updatestat);
+	MSG_WriteByte (&item, STAT_TOTALMONSTERS);
+	MSG_WriteLong (&item, pr_global_struct->total_monsters);
+	MSG_WriteByte (&item, svc_updatestat);
+	MSG_WriteByte (&item, STAT_SECRETS);
+	MSG_WriteLong (&item, pr_global_struct->found_secrets);
+	MSG_WriteByte (&item, svc_updatestat);
+	MSG_WriteByte (&item, STAT_MONSTERS);
+	MSG_WriteLong (&item, pr_global_struct->killed_monsters);
+	MSG_WriteByte (&item, svc_signonnum);
+	MSG_WriteByte (&item, 3);
+	SV_Demo_Append (item.data, item.cursize);
+	SV_Demo_WriteMessage ();
+
+	svdemo.numents = 0;
+	svdemo.resetents = true;
+	svdemo.needsignon = false;
+}
+
+/*
+==================
+SV_Demo_UpdateScores
+
+Names, colours and frags aren't all broadcast the same way, so just
+watch them for changes.
+==================
+*/
+static void SV_Demo_UpdateScores (void)
+{
+	byte		buf[128];
+	sizebuf_t	item;
+	client_t	*client;
+	const char	*name;
+	int			i, colors, frags;
+
+	memset (&item, 0, sizeof(item));
+	item.data = buf;
+	item.maxsize = sizeof(buf);
+
+	for (i = 0, client = svs.clients; i < svs.maxclients; i++, client++)
+	{
+		name = client->knowntoqc?client->name:"";
+		colors = client->knowntoqc?client->colors:0;
+		frags = client->knowntoqc?(int)client->edict->v.frags:0;
+		if (strcmp (name, svdemo.names[i]))
+		{
+			q_strlcpy (svdemo.names[i], name, sizeof(svdemo.names[i]));
+			MSG_WriteByte (&item, svc_updatename);
+			MSG_WriteByte (&item, i);
+			MSG_WriteString (&item, svdemo.names[i]);
+		}
+		if (colors != svdemo.colors[i])
+		{
+			svdemo.colors[i] = colors;
+			MSG_WriteByte (&item, svc_updatecolors);
+			MSG_WriteByte (&item, i);
+			MSG_WriteByte (&item, colors);
+		}
+		if (frags != svdemo.frags[i])
+		{
+			svdemo.frags[i] = frags;
+			MSG_WriteByte (&item, svc_updatefrags);
+			MSG_WriteByte (&item, i);
+			MSG_WriteShort (&item, frags);
+		}
+		SV_Demo_Append (item.data, item.cursize);
+		SZ_Clear (&item);
+	}
+}
+
+/*
+==================
+SV_Demo_VisibleSet
+
+Everything any player can see. NULL when nobody is playing, so the demo
+still shows the whole map.
+==================
+*/
+static byte *SV_Demo_VisibleSet (void)
+{
+	client_t	*client;
+	vec3_t		org;
+	qboolean	any = false;
+	int			i;
+
+	svdemo.pvsbytes = (qcvm->worldmodel->numleafs+7)>>3;
+	svdemo.pvs = (byte *) realloc (svdemo.pvs, svdemo.pvsbytes);
+	memset (svdemo.pvs, 0, svdemo.pvsbytes);
+
+	for (i = 0, client = svs.clients; i < svs.maxclients; i++, client++)
+	{
+		if (!client->active || !client->spawned)
+			continue;
+		VectorAdd (client->edict->v.origin, client->edict->v.view_ofs, org);
+		Mod_OrVis (svdemo.pvs, SV_FatPVS (org, qcvm->worldmodel), svdemo.pvsbytes);
+		any = true;
+	}
+	return any ? svdemo.pvs : NULL;
+}
+
+/*
+==================
+SV_Demo_BuildState
+
+Same culling as a client's snapshot, minus the per-client special cases
+==================
+*/
+static qboolean SV_Demo_BuildState (int e, edict_t *ent, byte *pvs, entity_state_t *state)
+{
+	edict_t		*parent;
+	eval_t		*val;
+	int			i;
+	qboolean	isplayer = e <= svs.maxclients && svs.clients[e-1].active;
+
+	if (ent->free)
+		return false;
+	if (!isplayer)
+	{
+		val = GetEdictFieldValue(ent, qcvm->extfields.emiteffectnum);
+		if ((!ent->v.modelindex || !PR_GetString(ent->v.model)[0]) && !(val && val->_float))
+			return false;
+		val = GetEdictFieldValue(ent, qcvm->extfields.viewmodelforclient);
+		if (val && val->edict)
+			return false;	// someone's viewmodel, their stats cover it
+		if (ent->alpha == ENTALPHA_ZERO && !ent->v.effects)
+			return false;
+
+		parent = ent;
+		while ((val = GetEdictFieldValue(parent, qcvm->extfields.tag_entity)) && val->edict)
+			parent = PROG_TO_EDICT(val->edict);
+		if (pvs && parent->num_leafs && parent->num_leafs < MAX_ENT_LEAFS)
+		{
+			for (i = 0; i < parent->num_leafs; i++)
+				if (pvs[parent->leafnums[i] >> 3] & (1 << (parent->leafnums[i]&7)))
+					break;
+			if (i == parent->num_leafs)
+				return false;
+		}
+	}
+
+	SV_BuildEntityState (ent, state);
+	if (isplayer)
+	{	// any of them might be the one being watched, so they all get velocity for view bob
+		if ((int)ent->v.flags & FL_ONGROUND)
+			state->eflags |= EFLAGS_ONGROUND;
+		state->velocity[0] = ent->v.velocity[0]*8;
+		state->velocity[1] = ent->v.velocity[1]*8;
+		state->velocity[2] = ent->v.velocity[2]*8;
+	}
+	return true;
+}
+
+static void SV_Demo_BeginEntities (void)
+{
+	MSG_WriteByte (&svdemo.msg, svcfte_updateentities);
+	MSG_WriteFloat (&svdemo.msg, qcvm->time);
+}
+
+static void SV_Demo_WriteEntityNum (int e, qboolean remove)
+{
+	if (e > 0x3fff)
+	{
+		MSG_WriteShort (&svdemo.msg, (remove?0xc000:0x4000)|(e&0x3fff));
+		MSG_WriteByte (&svdemo.msg, e>>14);
+	}
+	else
+		MSG_WriteShort (&svdemo.msg, (remove?0x8000:0)|e);
+}
+
+/*
+==================
+SV_Demo_WriteEntities
+
+Deltas every visible entity against what the demo was last told
+==================
+*/
+static void SV_Demo_WriteEntities (void)
+{
+	entity_state_t	state;
+	unsigned int	bits;
+	edict_t			*ent;
+	byte			*pvs = SV_Demo_VisibleSet ();
+	int				e, numents = qcvm->num_edicts;
+
+	if (numents > svdemo.maxents)
+	{
+		svdemo.ents = (entity_state_t *) realloc (svdemo.ents, sizeof(*svdemo.ents)*numents);
+		svdemo.present = (byte *) realloc (svdemo.present, numents);
+		memset (svdemo.present+svdemo.maxents, 0, numents-svdemo.maxents);
+		svdemo.maxents = numents;
+	}
+
+	if (svdemo.msg.cursize + 64 > svdemo.msg.maxsize)
+		SV_Demo_WriteMessage ();
+	SV_Demo_BeginEntities ();
+	if (svdemo.resetents)
+	{
+		SV_Demo_WriteEntityNum (0, true);
+		memset (svdemo.present, 0, svdemo.maxents);
+		svdemo.resetents = false;
+	}
+
+	for (e = 1; e < q_max(numents, svdemo.numents); e++)
+	{
+		if (svdemo.msg.cursize + 128 > svdemo.msg.maxsize)
+		{	// split it, the client doesn't care
+			MSG_WriteShort (&svdemo.msg, 0);
+			SV_Demo_WriteMessage ();
+			SV_Demo_BeginEntities ();
+		}
+
+		ent = EDICT_NUM(e);
+		if (e < numents && SV_Demo_BuildState (e, ent, pvs, &state))
+		{
+			if (svdemo.present[e])
+				bits = MSGFTE_DeltaCalcBits (&svdemo.ents[e], &state);
+			else
+				bits = UF_RESET | MSGFTE_DeltaCalcBits (&ent->baseline, &state);
+			if (bits)
+			{
+				SV_Demo_WriteEntityNum (e, false);
+				MSGFTE_WriteEntityUpdate (bits, &state, &svdemo.msg, SV_DEMO_PEXT2, sv.protocolflags);
+			}
+			svdemo.ents[e] = state;
+			svdemo.present[e] = true;
+		}
+		else if (svdemo.present[e])
+		{
+			SV_Demo_WriteEntityNum (e, true);
+			svdemo.present[e] = false;
+		}
+	}
+	svdemo.numents = numents;
+	MSG_WriteShort (&svdemo.msg, 0);
+}
+
+/*
+==================
+SV_Demo_WritePlayers
+
+One block per player with their view of things. The first player's
+angles also go in the message header, for anyone not following a player.
+==================
+*/
+static void SV_Demo_WritePlayers (void)
+{
+	byte		buf[1024];
+	sizebuf_t	item;
+	client_t	*client;
+	edict_t		*ent, *other;
+	qboolean	first = true;
+	int			i, j, k;
+
+	memset (&item, 0, sizeof(item));
+	item.data = buf;
+	item.maxsize = sizeof(buf);
+
+	for (i = 0, client = svs.clients; i < svs.maxclients; i++, client++)
+	{
+		if (!client->active || !client->spawned)
+			continue;
+		ent = client->edict;
+		if (first)
+		{
+			VectorCopy (ent->v.v_angle, svdemo.angles);
+			first = false;
+		}
+
+		MSG_WriteByte (&item, svcqss_mvdplayer);
+		MSG_WriteByte (&item, i);
+		MSG_WriteShort (&item, 0);	// length, filled in below
+		for (j = 0; j < 3; j++)
+			MSG_WriteAngle16 (&item, ent->v.v_angle[j], sv.protocolflags);
+		j = item.cursize;
+
+		MSG_WriteByte (&item, svc_setview);
+		MSG_WriteShort (&item, NUM_FOR_EDICT(ent));
+		if ((ent->v.dmg_take || ent->v.dmg_save) && client->netconnection)
+		{	// not cleared, the player's own datagram does that (bots never clear it)
+			other = PROG_TO_EDICT(ent->v.dmg_inflictor);
+			MSG_WriteByte (&item, svc_damage);
+			MSG_WriteByte (&item, ent->v.dmg_save);
+			MSG_WriteByte (&item, ent->v.dmg_take);
+			for (k = 0; k < 3; k++)
+				MSG_WriteCoord (&item, other->v.origin[k] + 0.5*(other->v.mins[k] + other->v.maxs[k]), sv.protocolflags);
+		}
+		SV_WriteClientdataToMessage (client, &item);
+
+		item.data[2] = (item.cursize - j) & 0xff;
+		item.data[3] = (item.cursize - j) >> 8;
+		SV_Demo_Append (item.data, item.cursize);
+		SZ_Clear (&item);
+	}
+}
+
+/*
+==================
+SV_Demo_Frame
+==================
+*/
+void SV_Demo_Frame (void)
+{
+	if (!svdemo.file || sv.state != ss_active)
+		return;
+
+	if (svdemo.needsignon)
+		SV_Demo_WriteSignon ();
+
+	SV_Demo_AppendBuffer (&svdemo.reliable);
+	SV_Demo_UpdateScores ();
+	SV_Demo_Append (sv.datagram.data, sv.datagram.cursize);
+	SV_Demo_AppendBuffer (&svdemo.datagram);
+
+	// players last, so the last message of a frame always has the view
+	SV_Demo_WriteEntities ();
+	SV_Demo_WritePlayers ();
+	SV_Demo_WriteMessage ();
+}
+
+/*
+==================
+SV_Demo_NewMap
+
+Called once the server has spawned a map, after any level change
+==================
+*/
+void SV_Demo_NewMap (void)
+{
+	if (!svdemo.file)
+		return;
+	svdemo.needsignon = true;
+	SZ_Clear (&svdemo.reliable);
+	SZ_Clear (&svdemo.datagram);
+}
+
+/*
+==================
+SV_Demo_Stop
+==================
+*/
+void SV_Demo_Stop (void)
+{
+	if (!svdemo.file)
+		return;
+
+	SZ_Clear (&svdemo.msg);
+	MSG_WriteByte (&svdemo.msg, svc_disconnect);
+	SV_Demo_WriteMessage ();
+	DemoStream_Close (svdemo.file);
+	svdemo.file = NULL;
+
+	free (svdemo.ents);
+	free (svdemo.present);
+	free (svdemo.pvs);
+	svdemo.ents = NULL;
+	svdemo.present = NULL;
+	svdemo.pvs = NULL;
+	svdemo.numents = svdemo.maxents = 0;
+
+	Con_Printf ("Completed server demo %s\n", svdemo.name);
+}
+
+/*
+==================
+SV_Record_f
+
+sv_record <demoname>
+==================
+*/
+static void SV_Record_f (void)
+{
+	FILE	*f;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (Cmd_Argc() != 2)
+	{
+		Con_Printf ("sv_record <demoname> : record every player on this server\n");
+		return;
+	}
+	if (!sv.active)
+	{
+		Con_Printf ("Not running a server\n");
+		return;
+	}
+	if (strstr(Cmd_Argv(1), ".."))
+	{
+		Con_Printf ("Relative pathnames are not allowed.\n");
+		return;
+	}
+
+	SV_Demo_Stop ();
+
+	q_snprintf (svdemo.name, sizeof(svdemo.name), "%s/%s", com_gamedir, Cmd_Argv(1));
+	COM_AddExtension (svdemo.name, ".dem", sizeof(svdemo.name));
+	f = fopen (svdemo.name, "wb");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't create %s\n", svdemo.name);
+		return;
+	}
+	svdemo.file = DemoStream_OpenWrite (f, sv_demo_compress.value != 0);
+	DemoStream_Write (svdemo.file, "-1\n", 3);
+	Con_Printf ("recording server demo to %s%s.\n", svdemo.name, DemoStream_IsCompressed (svdemo.file) ? " (compressed)" : "");
+
+	SZ_Clear (&svdemo.msg);
+	SV_Demo_NewMap ();
+}
+
+/*
+==================
+SV_Stop_f
+==================
+*/
+static void SV_Stop_f (void)
+{
+	if (cmd_source != src_command)
+		return;
+
+	if (!svdemo.file)
+	{
+		Con_Printf ("Not recording a server demo.\n");
+		return;
+	}
+	SV_Demo_Stop ();
+}
+
+/*
+==================
+SV_Demo_Init
+==================
+*/
+void SV_Demo_Init (void)
+{
+	svdemo.reliable.data = svdemo.reliable_buf;
+	svdemo.reliable.maxsize = sizeof(svdemo.reliable_buf);
+	svdemo.reliable.allowoverflow = true;
+	svdemo.datagram.data = svdemo.datagram_buf;
+	svdemo.datagram.maxsize = sizeof(svdemo.datagram_buf);
+	svdemo.datagram.allowoverflow = true;
+	svdemo.msg.data = svdemo.msg_buf;
+	svdemo.msg.maxsize = sizeof(svdemo.msg_buf);
+
+	Cvar_RegisterVariable (&sv_demo_compress);
+	Cmd_AddCommand ("sv_record", SV_Record_f);
+	Cmd_AddCommand ("sv_stop", SV_Stop_f);
+}
@@ -33,8 +33,29 @@ int				sv_protocol = PROTOCOL_RMQ;//spike -- enough maps need this now that we c
 unsigned int	sv_protocol_pext1 = PEXT1_SUPPORTED_SERVER; //spike
 unsigned int	sv_protocol_pext2 = PEXT2_SUPPORTED_SERVER; //spike
 
+static unsigned int	sv_randseed = 1;
+
 //============================================================================
 
+/*
+==================
+SV_Rand
+
+The server's own random numbers. rand() is shared with the client, which
+reseeds it for its effects, so replays couldn't repeat it.
+==================
+*/
+int SV_Rand (void)
+{
+	sv_randseed = sv_randseed * 214013 + 2531011;
+	return (sv_randseed >> 16) & 0x7fff;
+}
+
+void SV_SeedRandom (unsigned int seed)
+{
+	sv_randseed = seed;
+}
+
 void SV_CalcStats(client_t *client, int *statsi, float *statsf, const char **statss)
 {
 	size_t i;
@@ -88,29 +109,29 @@ void SV_CalcStats(client_t *client, int *statsi, float *statsf, const char **sta
 		statsf[STAT_PUNCHANGLE_Y] = ent->v.punchangle[1];
 		statsf[STAT_PUNCHANGLE_Z] = ent->v.punchangle[2];
 	}
-/*
 	if (client->protocol_pext2 & PEXT2_PREDINFO)
 	{	//prediction needs some info on the server's rules
-		statsf[STAT_MOVEVARS_FRICTION] = sv_friction.value;
-		statsf[STAT_MOVEVARS_WATERFRICTION] = sv_waterfriction.value;
-		statsf[STAT_MOVEVARS_TICRATE] = host_maxfps.value;
-		statsf[STAT_MOVEVARS_TIMESCALE] = sv_gamespeed.value;
-		statsf[STAT_MOVEVARS_GRAVITY] = sv_gravity.value;
-		statsf[STAT_MOVEVARS_STOPSPEED] = sv_stopspeed.value;
-		statsf[STAT_MOVEVARS_MAXSPEED] = client->maxspeed;
-		statsf[STAT_MOVEVARS_SPECTATORMAXSPEED] = sv_spectatormaxspeed.value;
-		statsf[STAT_MOVEVARS_ACCELERATE] = sv_accelerate.value;
-		statsf[STAT_MOVEVARS_AIRACCELERATE] = sv_airaccelerate.value;
-		statsf[STAT_MOVEVARS_WATERACCELERATE] = sv_wateraccelerate.value;
-		statsf[STAT_MOVEVARS_ENTGRAVITY] = client->entgravity/sv_gravity.value;
-		statsf[STAT_MOVEVARS_JUMPVELOCITY] = sv_jumpvelocity.value;	//bah
-		statsf[STAT_MOVEVARS_EDGEFRICTION] = sv_edgefriction.value;
-		statsf[STAT_MOVEVARS_MAXAIRSPEED] = client->maxspeed;
-		statsf[STAT_MOVEVARS_STEPHEIGHT] = 18;
+		movevars_t mv;
+		SV_MoveVars (ent, &mv);
+		statsf[STAT_MOVEVARS_FRICTION] = mv.friction;
+		statsf[STAT_MOVEVARS_WATERFRICTION] = mv.friction;
+		statsf[STAT_MOVEVARS_TICRATE] = 1.0/72;	//not really, we run client movement at whatever rate they send
+		statsf[STAT_MOVEVARS_TIMESCALE] = 1;
+		statsf[STAT_MOVEVARS_GRAVITY] = mv.gravity;
+		statsf[STAT_MOVEVARS_STOPSPEED] = mv.stopspeed;
+		statsf[STAT_MOVEVARS_MAXSPEED] = mv.maxspeed;
+		statsf[STAT_MOVEVARS_SPECTATORMAXSPEED] = mv.maxspeed;
+		statsf[STAT_MOVEVARS_ACCELERATE] = mv.accelerate;
+		statsf[STAT_MOVEVARS_AIRACCELERATE] = mv.accelerate;
+		statsf[STAT_MOVEVARS_WATERACCELERATE] = mv.accelerate;
+		statsf[STAT_MOVEVARS_ENTGRAVITY] = mv.entgravity;
+		statsf[STAT_MOVEVARS_JUMPVELOCITY] = mv.jumpvelocity;	//bah, this is really up to the qc
+		statsf[STAT_MOVEVARS_EDGEFRICTION] = mv.edgefriction;
+		statsf[STAT_MOVEVARS_MAXAIRSPEED] = 30;
+		statsf[STAT_MOVEVARS_STEPHEIGHT] = mv.stepheight;
 //		statsf[STAT_MOVEVARS_AIRACCEL_QW] = 0;
 //		statsf[STAT_MOVEVARS_AIRACCEL_SIDEWAYS_FRICTION] = sv_gravity.value;
 	}
-*/
 
 	for (i = 0; i < sv.numcustomstats; i++)
 	{
@@ -182,7 +203,7 @@ static unsigned int SVFTE_DeltaPredCalcBits(entity_state_t *from, entity_state_t
 	return bits;
 }
 
-static unsigned int MSGFTE_DeltaCalcBits(entity_state_t *from, entity_state_t *to)
+unsigned int MSGFTE_DeltaCalcBits(entity_state_t *from, entity_state_t *to)
 {
 	unsigned int bits = 0;
 
@@ -278,7 +299,7 @@ static unsigned int MSGFTE_DeltaCalcBits(entity_state_t *from, entity_state_t *t
 	return bits;
 }
 
-static void MSGFTE_WriteEntityUpdate(unsigned int bits, entity_state_t *state, sizebuf_t *msg, unsigned int pext2, unsigned int protocolflags)
+void MSGFTE_WriteEntityUpdate(unsigned int bits, entity_state_t *state, sizebuf_t *msg, unsigned int pext2, unsigned int protocolflags)
 {
 	unsigned int predbits = 0;
 	if (bits & UF_MOVETYPE)
@@ -601,8 +622,16 @@ void SVFTE_DestroyFrames(client_t *client)
 	if (client->pendingentities_bits)
 		free(client->pendingentities_bits);
 	client->pendingentities_bits = NULL;
+	if (client->pendingentities_senttime)
+		free(client->pendingentities_senttime);
+	client->pendingentities_senttime = NULL;
 	client->numpendingentities = 0;
 
+	if (client->sendorder)
+		free(client->sendorder);
+	client->sendorder = NULL;
+	client->numsendorder = client->maxsendorder = 0;
+
 	if (client->pendingcsqcentities_bits)
 		free(client->pendingcsqcentities_bits);
 	client->pendingcsqcentities_bits = NULL;
@@ -644,6 +673,7 @@ static void SVFTE_SetupFrames(client_t *client)
 
 	client->numpendingentities = qcvm->num_edicts;
 	client->pendingentities_bits = calloc(client->numpendingentities, sizeof(*client->pendingentities_bits));
+	client->pendingentities_senttime = calloc(client->numpendingentities, sizeof(*client->pendingentities_senttime));
 
 	client->pendingentities_bits[0] = UF_REMOVE;
 
@@ -805,6 +835,8 @@ static void SVFTE_CalcEntityDeltas(client_t *client)
 		int newmax = qcvm->num_edicts+64;
 		client->pendingentities_bits = realloc(client->pendingentities_bits, sizeof(*client->pendingentities_bits) * newmax);
 		memset(client->pendingentities_bits+client->numpendingentities, 0, sizeof(*client->pendingentities_bits)*(newmax-client->numpendingentities));
+		client->pendingentities_senttime = realloc(client->pendingentities_senttime, sizeof(*client->pendingentities_senttime) * newmax);
+		memset(client->pendingentities_senttime+client->numpendingentities, 0, sizeof(*client->pendingentities_senttime)*(newmax-client->numpendingentities));
 		client->numpendingentities = newmax;
 	}
 
@@ -864,11 +896,100 @@ static void SVFTE_CalcEntityDeltas(client_t *client)
 	snapshot_numents = 0;
 	snapshot_maxents = oldstop-olds;
 }
+static struct entity_num_state_s *SVFTE_FindState(client_t *client, size_t entnum)
+{	//previousentities is sorted, so binary search it
+	size_t lo = 0, hi = client->numpreviousentities, mid;
+	while (lo < hi)
+	{
+		mid = (lo+hi)/2;
+		if (client->previousentities[mid].num < entnum)
+			lo = mid+1;
+		else
+			hi = mid;
+	}
+	if (lo < client->numpreviousentities && client->previousentities[lo].num == entnum)
+		return &client->previousentities[lo];
+	return NULL;
+}
+static int SVFTE_ComparePriority(const void *a, const void *b)
+{
+	const struct entity_priority_s *ea = a, *eb = b;
+	if (ea->priority != eb->priority)
+		return (ea->priority < eb->priority)?1:-1;	//highest first
+	return (ea->num > eb->num)?1:-1;
+}
+/*
+SVFTE_PrioritiseEntities
+
+Works out which order to send the pending entity updates in. Clients without
+a rate limit get everything anyway so they just get edict order, without any
+sendorder being built, but when there's a byte budget the updates that matter most should go first, with
+the rest deferred to later frames:
+  closer to the viewer is more important
+  the longer since it was last updated the more important
+  the more that changed the more important (new ents most of all)
+Removes are tiny and leave stale ents visible, so they always go early.
+*/
+static void SVFTE_PrioritiseEntities(client_t *client)
+{
+	struct entity_num_state_s *state = client->previousentities, *stateend = state + client->numpreviousentities;
+	struct entity_priority_s *e;
+	unsigned int entbits, b, changes;
+	size_t entnum;
+	vec3_t org, delta;
+	float dist;
+
+	client->prioritised = SV_ClientRate(client) != 0;
+	if (!client->prioritised)
+	{	//no budget to worry about, the writer can just walk the entities.
+		client->numsendorder = client->numpendingentities;
+		return;
+	}
+
+	if (client->maxsendorder < client->numpendingentities)
+	{
+		client->maxsendorder = client->numpendingentities;
+		client->sendorder = realloc(client->sendorder, sizeof(*client->sendorder)*client->maxsendorder);
+	}
+	client->numsendorder = 0;
+	VectorAdd(client->edict->v.origin, client->edict->v.view_ofs, org);
+
+	for (entnum = 0; entnum < client->numpendingentities; entnum++)
+	{
+		entbits = client->pendingentities_bits[entnum];
+		if (!(entbits & ~UF_RESET2))
+			continue;
+		e = &client->sendorder[client->numsendorder++];
+		e->num = entnum;
+
+		if (!entnum || (entbits & UF_REMOVE))
+		{	//world reset must come first
+			e->priority = entnum?1e9:1e10;
+			continue;
+		}
+		while (state<stateend && state->num < entnum)
+			state++;
+		if (state<stateend && state->num == entnum)
+			VectorSubtract(state->state.origin, org, delta);
+		else
+			VectorCopy(vec3_origin, delta);
+		dist = VectorLength(delta);
+
+		for (changes = 0, b = entbits & ~(UF_RESET|UF_RESET2); b; b &= b-1)
+			changes++;
+		if (entbits & (UF_RESET|UF_RESET2))
+			changes += 16;
+
+		e->priority = (1 + changes) * (1 + 10*(qcvm->time - client->pendingentities_senttime[entnum])) / (1 + dist/256);
+	}
+	qsort(client->sendorder, client->numsendorder, sizeof(*client->sendorder), SVFTE_ComparePriority);
+}
+
 static void SVFTE_WriteEntitiesToClient(client_t *client, sizebuf_t *msg, size_t overflowsize)
 {
-	struct entity_num_state_s *state, *stateend;
+	struct entity_num_state_s *state, *walk = client->previousentities, *walkend = walk + client->numpreviousentities;
 	unsigned int entbits, logbits, netbits;
-	size_t entnum;
+	size_t entnum, order;
 	int sequence = NET_QSocketGetSequenceOut(client->netconnection);
 	size_t origmaxsize = msg->maxsize;
 	size_t rollbacksize;	//I'm too lazy to figure out sizes (especially if someone updates this for bone states or whatever)
@@ -878,17 +999,15 @@ static void SVFTE_WriteEntitiesToClient(client_t *client, sizebuf_t *msg, size_t
 
 	msg->maxsize = overflowsize;
 
-	state = client->previousentities;
-	stateend = state + client->numpreviousentities;
-
 	MSG_WriteByte(msg, svcfte_updateentities);
 
 	frame->numents = 0;
 	if (client->protocol_pext2 & PEXT2_PREDINFO)
 		MSG_WriteShort(msg, (client->lastmovemessage&0xffff));
 	MSG_WriteFloat(msg, frame->timestamp);	//should be the time the last physics frame was run.
-	for (entnum = client->snapshotresume; entnum < client->numpendingentities; entnum++)
+	for (order = client->snapshotresume; order < client->numsendorder; order++)
 	{
+		entnum = client->prioritised ? client->sendorder[order].num : order;
 		entbits = client->pendingentities_bits[entnum];
 		if (!(entbits & ~UF_RESET2))
 			continue;	//nothing to send (if reset2 is still set, then leave it pending until there's more data
@@ -909,9 +1028,15 @@ static void SVFTE_WriteEntitiesToClient(client_t *client, sizebuf_t *msg, size_t
 		}
 		else
 		{
-			while (state<stateend && state->num < entnum)
-				state++;
-			if (state<stateend && state->num == entnum)
+			if (client->prioritised)
+				state = SVFTE_FindState(client, entnum);	//sendorder isn't necessarily ascending
+			else
+			{	//but edict order is
+				while (walk < walkend && walk->num < entnum)
+					walk++;
+				state = (walk < walkend && walk->num == entnum) ? walk : NULL;
+			}
+			if (state)
 			{
 				if (entbits & UF_RESET2)
 				{
@@ -958,12 +1083,13 @@ static void SVFTE_WriteEntitiesToClient(client_t *client, sizebuf_t *msg, size_t
 		frame->ents[frame->numents].ebits = logbits;
 		frame->ents[frame->numents].csqcbits = 0;
 		frame->numents++;
+		client->pendingentities_senttime[entnum] = qcvm->time;
 	}
 	msg->maxsize = origmaxsize;
 	MSG_WriteShort(msg, 0);	//eom
 
 	//remember how far we got, so we can keep things flushed, instead of only updating the first N entities.
-	client->snapshotresume = entnum;
+	client->snapshotresume = order;
 
 
 	if (msg->cursize > 1024 && dev_peakstats.packetsize <= 1024)
@@ -1148,7 +1274,6 @@ void SV_BuildEntityState(edict_t *ent, entity_state_t *state)
 	state->velocity[0] = state->velocity[1] = state->velocity[2] = 0;
 }
 
-byte *SV_FatPVS (vec3_t org, qmodel_t *worldmodel);
 static void SVFTE_BuildSnapshotForClient (client_t *client)
 {
 	unsigned int	e, i;
@@ -1256,7 +1381,12 @@ invisible:
 			ents[numents].state.modelindex = 0;
 		if (ent == clent)	//add velocity, but we only care for the local player (should add prediction for other entities some time too).
 		{
-			ents[numents].state.pmovetype = 0;//ent->v.movetype;	//fixme: we don't do prediction, so don't tell the client that it can try
+			//only stock movement is something the client can predict. the ladder hack and custom qc physics are not.
+			if ((client->protocol_pext2 & PEXT2_PREDINFO) && !qcvm->extfuncs.SV_RunClientCommand && !ent->onladder &&
+				((int)ent->v.movetype == MOVETYPE_WALK || (int)ent->v.movetype == MOVETYPE_FLY || (int)ent->v.movetype == MOVETYPE_NOCLIP))
+				ents[numents].state.pmovetype = ent->v.movetype;
+			else
+				ents[numents].state.pmovetype = 0;
 			if ((int)ent->v.flags & FL_ONGROUND)
 				eflags |= EFLAGS_ONGROUND;
 			ents[numents].state.velocity[0] = ent->v.velocity[0]*8;
@@ -1458,6 +1588,10 @@ void SV_Init (void)
 	extern	cvar_t	sv_freezenonclients;
 	extern	cvar_t	sv_gameplayfix_spawnbeforethinks;
 	extern	cvar_t	sv_gameplayfix_bouncedownslopes;
+	extern	cvar_t	sv_entitysleep;
+	extern	cvar_t	sv_ai_lod_farinterval;
+	extern	cvar_t	sv_ai_lod_waketime;
+	extern	cvar_t	sv_ai_lod_soundradius;
 	extern	cvar_t	sv_gameplayfix_setmodelrealbox;	//spike: 1 to replicate a quakespasm bug, 0 for actual vanilla compat.
 	extern	cvar_t	sv_friction;
 	extern	cvar_t	sv_edgefriction;
@@ -1474,6 +1608,13 @@ void SV_Init (void)
 	extern	cvar_t	rcon_password;	//spike, proquake-compatible rcon
 	extern	cvar_t	sv_sound_watersplash;	//spike - making these changable is handy...
 	extern	cvar_t	sv_sound_land;			//spike - and also mutable...
+	extern	cvar_t	pr_areaqueries;
+	extern	cvar_t	sv_maxrate;
+	extern	cvar_t	sv_download_maxrate;
+	extern	cvar_t	sv_download_share;
+	extern	cvar_t	sv_download_frompaks;
+	extern	cvar_t	sv_netcompression;
+	extern	cvar_t	sv_phs;
 
 
 	Cvar_RegisterVariable (&sv_maxvelocity);
@@ -1492,12 +1633,24 @@ void SV_Init (void)
 	Cvar_RegisterVariable (&sv_freezenonclients);
 	Cvar_RegisterVariable (&sv_gameplayfix_spawnbeforethinks);
 	Cvar_RegisterVariable (&sv_gameplayfix_bouncedownslopes);
+	Cvar_RegisterVariable (&sv_entitysleep);
+	Cvar_RegisterVariable (&sv_ai_lod);
+	Cvar_RegisterVariable (&sv_ai_lod_farinterval);
+	Cvar_RegisterVariable (&sv_ai_lod_waketime);
+	Cvar_RegisterVariable (&sv_ai_lod_soundradius);
 	Cvar_RegisterVariable (&sv_gameplayfix_setmodelrealbox);
 	Cvar_RegisterVariable (&pr_checkextension);
+	Cvar_RegisterVariable (&pr_areaqueries);
 	Cvar_RegisterVariable (&sv_altnoclip); //johnfitz
 
 	Cvar_RegisterVariable (&sv_sound_watersplash); //spike
 	Cvar_RegisterVariable (&sv_sound_land); //spike
+	Cvar_RegisterVariable (&sv_maxrate);
+	Cvar_RegisterVariable (&sv_download_maxrate);
+	Cvar_RegisterVariable (&sv_download_share);
+	Cvar_RegisterVariable (&sv_download_frompaks);
+	Cvar_RegisterVariable (&sv_netcompression);
+	Cvar_RegisterVariable (&sv_phs);
 
 	if (isDedicated)
 		sv_public.string = "1";
@@ -1538,6 +1691,10 @@ void SV_Init (void)
 	Sys_Printf ("Server using protocol %i%s (%s%s)\n", sv_protocol, sv_protocol_pext2?"+":"", sv_protocol_pext2?"FTE-":"", p);
 
 	SV_VoiceInit();
+	SV_Demo_Init();
+	SV_Replay_Init();
+	SV_Metrics_Init();
+	SV_SeedRandom ((unsigned int) (Sys_DoubleTime () * 1000000));
 }
 
 /*
@@ -1548,6 +1705,276 @@ EVENT MESSAGES
 =============================================================================
 */
 
+/*
+==================
+PHS
+
+The potentially hearable set of a leaf is every leaf that can see any leaf
+visible from it. Rows are built when the map loads until a work budget runs
+out, and on first use after that so that huge maps don't stall the load.
+==================
+*/
+#define PHS_PRECOMPUTE_BUDGET	(1u<<27)		//byte merges spent at load
+#define PHS_MAXCACHE			(64*1024*1024)	//beyond this, rows are rebuilt each time
+
+cvar_t	sv_phs = {"sv_phs", "1", CVAR_NONE};	//filter attenuated sounds+effects by phs/pvs
+
+static struct
+{
+	qmodel_t	*model;
+	int			bytes;
+	byte		**rows;		//[numleafs], NULL until built
+	byte		*scratch;
+	byte		*temprow;	//for when the cache is full
+	int			numrows;
+	size_t		cached;
+} sv_phs_cache;
+
+/*
+==================
+SV_ClearPHS
+==================
+*/
+static void SV_ClearPHS (void)
+{
+	int i;
+	if (sv_phs_cache.rows)
+	{
+		for (i = 0; i < sv_phs_cache.numrows; i++)
+			free (sv_phs_cache.rows[i]);
+		free (sv_phs_cache.rows);
+	}
+	free (sv_phs_cache.scratch);
+	free (sv_phs_cache.temprow);
+	memset (&sv_phs_cache, 0, sizeof(sv_phs_cache));
+}
+
+/*
+==================
+SV_BuildPHSRow
+
+Returns the number of visible leafs that were merged.
+==================
+*/
+static int SV_BuildPHSRow (int leafnum, byte *row)
+{
+	qmodel_t	*model = sv_phs_cache.model;
+	byte		*scratch = sv_phs_cache.scratch;
+	int			i, count = 0;
+
+	memcpy (scratch, Mod_LeafPVS (&model->leafs[leafnum+1], model), sv_phs_cache.bytes);
+	memcpy (row, scratch, sv_phs_cache.bytes);
+	for (i = 0; i < model->numleafs; i++)
+	{
+		if (!scratch[i>>3])
+		{
+			i |= 7;
+			continue;
+		}
+		if (!(scratch[i>>3] & (1<<(i&7))))
+			continue;
+		Mod_OrVis (row, Mod_LeafPVS (&model->leafs[i+1], model), sv_phs_cache.bytes);
+		count++;
+	}
+	return count;
+}
+
+static void SV_SetupPHS (qmodel_t *model)
+{
+	SV_ClearPHS ();
+	sv_phs_cache.model = model;
+	sv_phs_cache.bytes = (model->numleafs+7)>>3;
+	sv_phs_cache.numrows = model->numleafs;
+	sv_phs_cache.rows = (byte **) calloc (model->numleafs, sizeof(*sv_phs_cache.rows));
+	sv_phs_cache.scratch = (byte *) malloc (sv_phs_cache.bytes);
+	sv_phs_cache.temprow = (byte *) malloc (sv_phs_cache.bytes);
+	if (!sv_phs_cache.rows || !sv_phs_cache.scratch || !sv_phs_cache.temprow)
+		Sys_Error ("SV_SetupPHS: out of memory on %i leafs", model->numleafs);
+}
+
+//returns NULL once the cache is full
+static byte *SV_AllocPHSRow (int leafnum)
+{
+	byte *row;
+	if (sv_phs_cache.cached + sv_phs_cache.bytes > PHS_MAXCACHE)
+		return NULL;
+	row = (byte *) malloc (sv_phs_cache.bytes);
+	if (row)
+	{
+		sv_phs_cache.rows[leafnum] = row;
+		sv_phs_cache.cached += sv_phs_cache.bytes;
+	}
+	return row;
+}
+
+/*
+==================
+SV_LeafPHS
+==================
+*/
+byte *SV_LeafPHS (mleaf_t *leaf, qmodel_t *model)
+{
+	int leafnum;
+	byte *row;
+
+	if (!model->visdata || leaf == model->leafs)
+		return Mod_NoVisPVS (model);
+
+	if (sv_phs_cache.model != model)
+		SV_SetupPHS (model);
+
+	leafnum = leaf - model->leafs - 1;
+	if (sv_phs_cache.rows[leafnum])
+		return sv_phs_cache.rows[leafnum];
+
+	row = SV_AllocPHSRow (leafnum);
+	SV_BuildPHSRow (leafnum, row?row:sv_phs_cache.temprow);
+	return row?row:sv_phs_cache.temprow;
+}
+
+/*
+==================
+SV_CalcPHS
+
+Called once the world is loaded.
+==================
+*/
+static void SV_CalcPHS (void)
+{
+	qmodel_t		*model = qcvm->worldmodel;
+	unsigned int	work = 0;
+	int				i;
+
+	SV_ClearPHS ();
+	if (!model->visdata)
+		return;
+	SV_SetupPHS (model);
+	for (i = 0; i < model->numleafs && work < PHS_PRECOMPUTE_BUDGET; i++)
+	{
+		byte *row = SV_AllocPHSRow (i);
+		if (!row)
+			break;
+		work += (1 + SV_BuildPHSRow (i, row)) * (unsigned int)sv_phs_cache.bytes;
+	}
+	Con_DPrintf ("Precomputed %i of %i phs rows\n", i, model->numleafs);
+}
+
+/*
+==================
+SV_ClientInSet
+
+Checks whether a client's view is inside a pvs/phs row.
+==================
+*/
+static qboolean SV_ClientInSet (client_t *client, byte *set)
+{
+	vec3_t	org;
+	int		leafnum;
+
+	VectorAdd (client->edict->v.origin, client->edict->v.view_ofs, org);
+	leafnum = Mod_PointInLeaf (org, qcvm->worldmodel) - qcvm->worldmodel->leafs - 1;
+	return leafnum < 0 || (set[leafnum>>3] & (1<<(leafnum&7)));
+}
+
+static void SV_MulticastInternal (qboolean reliable, byte *pvs, unsigned int requireext2)
+{
+	unsigned int i;
+	sizebuf_t *demo;
+
+	//sv.datagram and sv.reliable_datagram already go into server demos
+	if ((pvs || requireext2) && !(requireext2 & ~SV_DEMO_PEXT2) && (demo = SV_DemoBuffer (reliable)))
+		SZ_Write (demo, sv.multicast.data, sv.multicast.cursize);
+
+	if (!pvs)
+	{
+		if (!requireext2)
+			SZ_Write((reliable?&sv.reliable_datagram:&sv.datagram), sv.multicast.data, sv.multicast.cursize);
+		else
+		{
+			for (i = 0; i < (unsigned int)svs.maxclients; i++)
+			{
+				if (!svs.clients[i].active)
+					continue;
+				if (!(svs.clients[i].protocol_pext2 & requireext2))
+					continue;
+				SZ_Write((reliable?&svs.clients[i].message:&svs.clients[i].datagram), sv.multicast.data, sv.multicast.cursize);
+			}
+		}
+	}
+	else
+	{
+		for (i = 0; i < (unsigned int)svs.maxclients; i++)
+		{
+			if (!svs.clients[i].active)
+				continue;
+
+			if (requireext2 && !(svs.clients[i].protocol_pext2 & requireext2))
+				continue;
+
+			if (SV_ClientInSet(&svs.clients[i], pvs))
+			{
+				//they can see it. add it in to whichever buffer is appropriate.
+				if (reliable)
+					SZ_Write(&svs.clients[i].message, sv.multicast.data, sv.multicast.cursize);
+				else
+					SZ_Write(&svs.clients[i].datagram, sv.multicast.data, sv.multicast.cursize);
+			}
+		}
+	}
+}
+/*
+==================
+SV_Multicast
+
+Sends sv.multicast to every client whose view is in the set picked by 'to'.
+==================
+*/
+//FIXME: shouldn't really be using pext2, but we don't track the earlier extensions, and it should be safe enough.
+void SV_Multicast (multicast_t to, float *org, int msg_entity, unsigned int requireext2)
+{
+	unsigned int i;
+
+	if (to == MULTICAST_INIT && sv.state != ss_loading)
+	{
+		SZ_Write (&sv.signon, sv.multicast.data, sv.multicast.cursize);
+		to = MULTICAST_ALL_R;	//and send to players that are already on
+	}
+
+	switch(to)
+	{
+	case MULTICAST_INIT:
+		SZ_Write (&sv.signon, sv.multicast.data, sv.multicast.cursize);
+		break;
+	case MULTICAST_ALL_R:
+	case MULTICAST_ALL_U:
+		SV_MulticastInternal(to==MULTICAST_ALL_R, NULL, requireext2);
+		break;
+	case MULTICAST_PHS_R:
+	case MULTICAST_PHS_U:
+		SV_MulticastInternal(to==MULTICAST_PHS_R, sv_phs.value?SV_LeafPHS(Mod_PointInLeaf(org, qcvm->worldmodel), qcvm->worldmodel):NULL, requireext2);
+		break;
+	case MULTICAST_PVS_R:
+	case MULTICAST_PVS_U:
+		SV_MulticastInternal(to==MULTICAST_PVS_R, Mod_LeafPVS(Mod_PointInLeaf(org, qcvm->worldmodel), qcvm->worldmodel), requireext2);
+		break;
+	case MULTICAST_ONE_R:
+	case MULTICAST_ONE_U:
+		i = msg_entity-1;
+		if (i >= (unsigned int)svs.maxclients)
+			break;
+		//a unicast, which ignores pvs.
+		//(unlike vanilla this allows unicast unreliables, so woo)
+		if (svs.clients[i].active)
+		{
+			SZ_Write(((to==MULTICAST_ONE_R)?&svs.clients[i].message:&svs.clients[i].datagram), sv.multicast.data, sv.multicast.cursize);
+		}
+		break;
+	default:
+		break;
+	}
+	SZ_Clear(&sv.multicast);
+}
+
 /*
 ==================
 SV_StartParticle
@@ -1561,10 +1988,10 @@ void SV_StartParticle (vec3_t org, vec3_t dir, int color, int count)
 
 	if (sv.datagram.cursize > MAX_DATAGRAM-16)
 		return;
-	MSG_WriteByte (&sv.datagram, svc_particle);
-	MSG_WriteCoord (&sv.datagram, org[0], sv.protocolflags);
-	MSG_WriteCoord (&sv.datagram, org[1], sv.protocolflags);
-	MSG_WriteCoord (&sv.datagram, org[2], sv.protocolflags);
+	MSG_WriteByte (&sv.multicast, svc_particle);
+	MSG_WriteCoord (&sv.multicast, org[0], sv.protocolflags);
+	MSG_WriteCoord (&sv.multicast, org[1], sv.protocolflags);
+	MSG_WriteCoord (&sv.multicast, org[2], sv.protocolflags);
 	for (i=0 ; i<3 ; i++)
 	{
 		v = dir[i]*16;
@@ -1572,10 +1999,64 @@ void SV_StartParticle (vec3_t org, vec3_t dir, int color, int count)
 			v = 127;
 		else if (v < -128)
 			v = -128;
-		MSG_WriteChar (&sv.datagram, v);
+		MSG_WriteChar (&sv.multicast, v);
+	}
+	MSG_WriteByte (&sv.multicast, count);
+	MSG_WriteByte (&sv.multicast, color);
+	SV_Multicast (sv_phs.value?MULTICAST_PVS_U:MULTICAST_ALL_U, org, 0, 0);
+}
+
+static void SV_WriteStartSound (sizebuf_t *msg, unsigned int pext2, int client_mask, edict_t *entity, unsigned int ent, int channel, unsigned int sound_num, int volume, float attenuation, float speed, float timeoffset, const vec3_t org)
+{
+	int i;
+
+	// directed messages go only to the entity the are targeted on
+	MSG_WriteByte (msg, svc_sound);
+	MSG_WriteByte (msg, client_mask&0xff);
+	if (client_mask & SND_FTE_MOREFLAGS)
+		MSG_WriteUInt64 (msg, client_mask>>8);
+	if (client_mask & SND_VOLUME)
+		MSG_WriteByte (msg, volume);
+	if (client_mask & SND_ATTENUATION)
+		MSG_WriteByte (msg, attenuation*64);
+
+	//spike -- stuff
+	if (client_mask & SND_FTE_PITCHADJ)
+		MSG_WriteByte (msg, CLAMP(1, speed*100, 255));
+	if (client_mask & SND_FTE_TIMEOFS)
+		MSG_WriteShort (msg, CLAMP(-32768, timeoffset*1000, 32767));
+	if (client_mask & SND_FTE_VELOCITY)
+	{
+		MSG_WriteShort (msg, CLAMP(-32768, entity->v.velocity[0]*8, 32767));
+		MSG_WriteShort (msg, CLAMP(-32768, entity->v.velocity[1]*8, 32767));
+		MSG_WriteShort (msg, CLAMP(-32768, entity->v.velocity[2]*8, 32767));
+	}
+	if (client_mask & SND_DP_PITCH)
+		MSG_WriteShort (msg, CLAMP(-32768, speed*4000, 32767));
+	//end spike
+
+	//johnfitz -- PROTOCOL_FITZQUAKE
+	if (client_mask & SND_LARGEENTITY)
+	{
+		if ((pext2 & PEXT2_REPLACEMENTDELTAS) && ent > 0x7fff)
+		{
+			MSG_WriteShort(msg, (ent>>8) | 0x8000);
+			MSG_WriteByte(msg, ent & 0xff);
+		}
+		else
+			MSG_WriteShort (msg, ent);
+		MSG_WriteByte (msg, channel);
 	}
-	MSG_WriteByte (&sv.datagram, count);
-	MSG_WriteByte (&sv.datagram, color);
+	else
+		MSG_WriteShort (msg, (ent<<3) | channel);
+	if ((client_mask & SND_LARGESOUND) || sv.protocol == PROTOCOL_VERSION_BJP3)
+		MSG_WriteShort (msg, sound_num);
+	else
+		MSG_WriteByte (msg, sound_num);
+	//johnfitz
+
+	for (i = 0; i < 3; i++)
+		MSG_WriteCoord (msg, org[i], sv.protocolflags);
 }
 
 /*
@@ -1600,6 +2081,8 @@ void SV_StartSound2 (edict_t *entity, float *origin, int channel, const char *sa
 	int			p;
 	client_t	*cl;
 	sizebuf_t	*msg;
+	vec3_t		org;
+	byte		*phs;
 
 	if (volume < 0)
 		Host_Error ("SV_StartSound: volume = %i", volume);
@@ -1661,11 +2144,27 @@ void SV_StartSound2 (edict_t *entity, float *origin, int channel, const char *sa
 	if (timeoffset)					field_mask |= SND_FTE_TIMEOFS;
 	//
 
+	if (attenuation)
+		SV_AILod_NoteSound (entity, origin);
+
+	if (origin)
+		VectorCopy (origin, org);
+	else for (i = 0; i < 3; i++)
+		org[i] = entity->v.origin[i]+0.5*(entity->v.mins[i]+entity->v.maxs[i]);
+
+	//attenuated sounds only go to clients that might hear them
+	if (attenuation && sv_phs.value && !(flags & CF_UNICAST))
+		phs = SV_LeafPHS (Mod_PointInLeaf (org, qcvm->worldmodel), qcvm->worldmodel);
+	else
+		phs = NULL;
+
 	for (p = 0; p < svs.maxclients; p++)
 	{
 		cl = &svs.clients[p];
 		if (!cl->active || !cl->spawned)
 			continue;
+		if (phs && !SV_ClientInSet (cl, phs))
+			continue;
 
 		if (ent >= cl->limit_entities)
 			continue;
@@ -1683,60 +2182,12 @@ void SV_StartSound2 (edict_t *entity, float *origin, int channel, const char *sa
 		client_mask = field_mask;
 		if (!(cl->protocol_pext2&PEXT2_REPLACEMENTDELTAS))
 			client_mask &= (SND_VOLUME|SND_ATTENUATION|SND_LARGEENTITY|SND_LARGESOUND);
-
-		// directed messages go only to the entity the are targeted on
-		MSG_WriteByte (msg, svc_sound);
-		MSG_WriteByte (msg, client_mask&0xff);
-		if (client_mask & SND_FTE_MOREFLAGS)
-			MSG_WriteUInt64 (msg, client_mask>>8);
-		if (client_mask & SND_VOLUME)
-			MSG_WriteByte (msg, volume);
-		if (client_mask & SND_ATTENUATION)
-			MSG_WriteByte (msg, attenuation*64);
-
-		//spike -- stuff
-		if (client_mask & SND_FTE_PITCHADJ)
-			MSG_WriteByte (msg, CLAMP(1, speed*100, 255));
-		if (client_mask & SND_FTE_TIMEOFS)
-			MSG_WriteShort (msg, CLAMP(-32768, timeoffset*1000, 32767));
-		if (client_mask & SND_FTE_VELOCITY)
-		{
-			MSG_WriteShort (msg, CLAMP(-32768, entity->v.velocity[0]*8, 32767));
-			MSG_WriteShort (msg, CLAMP(-32768, entity->v.velocity[1]*8, 32767));
-			MSG_WriteShort (msg, CLAMP(-32768, entity->v.velocity[2]*8, 32767));
-		}
-		if (client_mask & SND_DP_PITCH)
-			MSG_WriteShort (msg, CLAMP(-32768, speed*4000, 32767));
-		//end spike
-
-		//johnfitz -- PROTOCOL_FITZQUAKE
-		if (client_mask & SND_LARGEENTITY)
-		{
-			if ((cl->protocol_pext2 & PEXT2_REPLACEMENTDELTAS) && ent > 0x7fff)
-			{
-				MSG_WriteShort(msg, (ent>>8) | 0x8000);
-				MSG_WriteByte(msg, ent & 0xff);
-			}
-			else
-				MSG_WriteShort (msg, ent);
-			MSG_WriteByte (msg, channel);
-		}
-		else
-			MSG_WriteShort (msg, (ent<<3) | channel);
-		if ((client_mask & SND_LARGESOUND) || sv.protocol == PROTOCOL_VERSION_BJP3)
-			MSG_WriteShort (msg, sound_num);
-		else
-			MSG_WriteByte (msg, sound_num);
-		//johnfitz
-
-		for (i = 0; i < 3; i++)
-		{
-			if (origin)
-				MSG_WriteCoord (msg, origin[i], sv.protocolflags);
-			else
-				MSG_WriteCoord (msg, entity->v.origin[i]+0.5*(entity->v.mins[i]+entity->v.maxs[i]), sv.protocolflags);
-		}
+		SV_WriteStartSound (msg, cl->protocol_pext2, client_mask, entity, ent, channel, sound_num, volume, attenuation, speed, timeoffset, org);
 	}
+
+	//server demos hear everything that isn't aimed at one player
+	if (!(flags & CF_UNICAST) && !((field_mask & (SND_LARGEENTITY|SND_LARGESOUND)) && sv.protocol == PROTOCOL_NETQUAKE) && (msg = SV_DemoBuffer (flags & CF_RELIABLE)))
+		SV_WriteStartSound (msg, SV_DEMO_PEXT2, field_mask, entity, ent, channel, sound_num, volume, attenuation, speed, timeoffset, org);
 }
 void SV_StartSound (edict_t *entity, float *origin, int channel, const char *sample, int volume, float attenuation)
 {
@@ -1768,6 +2219,7 @@ void SV_SendServerinfo (client_t *client)
 	qboolean truncated = false;
 
 	SV_VoiceInitClient(client);
+	SV_ReleaseSignonCache(client);
 
 	client->spawned = false;		// need prespawn, spawn, etc
 
@@ -2052,6 +2504,8 @@ retry:
 	}
 }
 
+cvar_t	sv_netcompression = {"sv_netcompression", "1", CVAR_NONE};	//allow PEXT2_ZLIBSTREAM for clients that support it
+
 void SV_Pext_f(void)
 {
 	//this only makes sense on the server. the clientside part only takes the form of 'cmd pext', for compat with clients that don't support this.
@@ -2067,6 +2521,8 @@ void SV_Pext_f(void)
 			Con_Printf ("  Replacement Entity Deltas\n");
 		if (cl.protocol_pext2 & PEXT2_PREDINFO)
 			Con_Printf ("  Replacement Stats ('predinfo')\n");
+		if (cl.protocol_pext2 & PEXT2_ZLIBSTREAM)
+			Con_Printf ("  Deflated Reliables\n");
 		if (cl.protocol == PROTOCOL_NETQUAKE)
 			Con_Printf ("  vanilla(15)\n");
 		else if (cl.protocol == PROTOCOL_FITZQUAKE)
@@ -2095,6 +2551,11 @@ void SV_Pext_f(void)
 			//else some other extension that we don't know
 		}
 
+		if (!sv_netcompression.value)
+			host_client->protocol_pext2 &= ~PEXT2_ZLIBSTREAM;
+		if (host_client->protocol_pext2 & PEXT2_ZLIBSTREAM)
+			NET_QSocketSetCompression(host_client->netconnection, true);	//takes effect from the serverinfo onwards
+
 		host_client->pextknown = true;
 		SV_SendServerinfo(host_client);
 	}
@@ -2131,6 +2592,7 @@ void SV_ConnectClient (int clientnum)
 // set up the client_t
 	netconnection = client->netconnection;
 	net_activeconnections++;
+	SV_Replay_RecordConnect (clientnum);
 
 	if (sv.loadgame)
 		memcpy (spawn_parms, client->spawn_parms, sizeof(spawn_parms));
@@ -2182,6 +2644,9 @@ void SV_CheckForNewClients (void)
 	struct qsocket_s	*ret;
 	int				i;
 
+	if (SV_Replay_Playing ())
+		return;	// recorded connects arrive with the reads
+
 //
 // check for new connections
 //
@@ -2236,14 +2701,61 @@ crosses a waterline.
 =============================================================================
 */
 
+#define FATPVS_MAXLEAFS	32	//leaf sets bigger than this are merged without being remembered
+#define FATPVS_MEMO		16
+
 static int	fatbytes;
 static byte	*fatpvs;
 static int	fatpvs_capacity;
 
+static int	fatleafs[FATPVS_MAXLEAFS];
+static int	fatnumleafs;	//-1 once there's too many to remember
+
+// players standing together touch the same leafs, and the rows behind them
+// never change, so merged sets are kept until the map does
+static struct
+{
+	int				sequence;	//mvisrows_t.sequence of the model they came from
+	int				numleafs;
+	int				leafs[FATPVS_MAXLEAFS];
+	byte			*pvs;
+	int				capacity;
+	unsigned int	used;
+} fatmemo[FATPVS_MEMO];
+static unsigned int	fatmemo_clock;
+
+static void SV_AddFatLeaf (int leafnum, qmodel_t *worldmodel)
+{
+	int i, j;
+
+	if (fatnumleafs < 0)
+	{
+		Mod_OrVis (fatpvs, Mod_LeafPVS (&worldmodel->leafs[leafnum], worldmodel), fatbytes);
+		return;
+	}
+
+	// keep them sorted, so the same set is always spelled the same way
+	for (i = 0; i < fatnumleafs && fatleafs[i] < leafnum; i++)
+		;
+	if (i < fatnumleafs && fatleafs[i] == leafnum)
+		return;
+	if (fatnumleafs == FATPVS_MAXLEAFS)
+	{
+		Q_memset (fatpvs, 0, fatbytes);
+		for (j = 0; j < fatnumleafs; j++)
+			Mod_OrVis (fatpvs, Mod_LeafPVS (&worldmodel->leafs[fatleafs[j]], worldmodel), fatbytes);
+		Mod_OrVis (fatpvs, Mod_LeafPVS (&worldmodel->leafs[leafnum], worldmodel), fatbytes);
+		fatnumleafs = -1;
+		return;
+	}
+	for (j = fatnumleafs; j > i; j--)
+		fatleafs[j] = fatleafs[j-1];
+	fatleafs[i] = leafnum;
+	fatnumleafs++;
+}
+
 void SV_AddToFatPVS (vec3_t org, mnode_t *node, qmodel_t *worldmodel) //johnfitz -- added worldmodel as a parameter
 {
-	int		i;
-	byte	*pvs;
 	mplane_t	*plane;
 	float	d;
 
@@ -2253,11 +2765,7 @@ void SV_AddToFatPVS (vec3_t org, mnode_t *node, qmodel_t *worldmodel) //johnfitz
 		if (node->contents < 0)
 		{
 			if (node->contents != CONTENTS_SOLID)
-			{
-				pvs = Mod_LeafPVS ( (mleaf_t *)node, worldmodel); //johnfitz -- worldmodel as a parameter
-				for (i=0 ; i<fatbytes ; i++)
-					fatpvs[i] |= pvs[i];
-			}
+				SV_AddFatLeaf ((mleaf_t *)node - worldmodel->leafs, worldmodel); //johnfitz -- worldmodel as a parameter
 			return;
 		}
 
@@ -2285,6 +2793,9 @@ given point.
 */
 byte *SV_FatPVS (vec3_t org, qmodel_t *worldmodel) //johnfitz -- added worldmodel as a parameter
 {
+	mvisrows_t	*vr = worldmodel->visrows;
+	int			i, best;
+
 	fatbytes = (worldmodel->numleafs+7)>>3; // ericw -- was +31, assumed to be a bug/typo
 	if (fatpvs == NULL || fatbytes > fatpvs_capacity)
 	{
@@ -2293,10 +2804,52 @@ byte *SV_FatPVS (vec3_t org, qmodel_t *worldmodel) //johnfitz -- added worldmode
 		if (!fatpvs)
 			Sys_Error ("SV_FatPVS: realloc() failed on %d bytes", fatpvs_capacity);
 	}
-	
-	Q_memset (fatpvs, 0, fatbytes);
+
+	fatnumleafs = 0;
 	SV_AddToFatPVS (org, worldmodel->nodes, worldmodel); //johnfitz -- worldmodel as a parameter
-	return fatpvs;
+	if (fatnumleafs < 0)
+		return fatpvs;
+
+	if (!vr || vr->numleafs != worldmodel->numleafs)
+	{	// nothing to key a memo on
+		Q_memset (fatpvs, 0, fatbytes);
+		for (i = 0; i < fatnumleafs; i++)
+			Mod_OrVis (fatpvs, Mod_LeafPVS (&worldmodel->leafs[fatleafs[i]], worldmodel), fatbytes);
+		return fatpvs;
+	}
+
+	best = 0;
+	for (i = 0; i < FATPVS_MEMO; i++)
+	{
+		if (fatmemo[i].sequence == vr->sequence && fatmemo[i].numleafs == fatnumleafs
+			&& !memcmp (fatmemo[i].leafs, fatleafs, fatnumleafs * sizeof(int)))
+		{
+			if (qcvm == &sv.qcvm)
+				svmetrics.fatpvshits++;	//the client's renderer uses this too
+			fatmemo[i].used = ++fatmemo_clock;
+			return fatmemo[i].pvs;
+		}
+		if (fatmemo[i].used < fatmemo[best].used)
+			best = i;
+	}
+
+	if (qcvm == &sv.qcvm)
+		svmetrics.fatpvsmisses++;
+	if (fatmemo[best].pvs == NULL || fatbytes > fatmemo[best].capacity)
+	{
+		fatmemo[best].capacity = fatbytes;
+		fatmemo[best].pvs = (byte *) realloc (fatmemo[best].pvs, fatmemo[best].capacity);
+		if (!fatmemo[best].pvs)
+			Sys_Error ("SV_FatPVS: realloc() failed on %d bytes", fatmemo[best].capacity);
+	}
+	Q_memset (fatmemo[best].pvs, 0, fatbytes);
+	for (i = 0; i < fatnumleafs; i++)
+		Mod_OrVis (fatmemo[best].pvs, Mod_LeafPVS (&worldmodel->leafs[fatleafs[i]], worldmodel), fatbytes);
+	fatmemo[best].sequence = vr->sequence;
+	fatmemo[best].numleafs = fatnumleafs;
+	memcpy (fatmemo[best].leafs, fatleafs, fatnumleafs * sizeof(int));
+	fatmemo[best].used = ++fatmemo_clock;
+	return fatmemo[best].pvs;
 }
 
 /*
@@ -2809,9 +3362,80 @@ void SV_PresendClientDatagram (client_t *client)
 		return; //brute force networking.
 	SVFTE_BuildSnapshotForClient(client);
 	SVFTE_CalcEntityDeltas(client);
+	SVFTE_PrioritiseEntities(client);
 	client->snapshotresume = 0;
 }
 
+/*
+==============================================================================
+
+RATE LIMITING
+
+Each client gets a token bucket that fills at its rate in bytes per second.
+Datagrams are only sent while there are tokens left, so a client on a slow
+link gets a steady trickle instead of bursts followed by stalls.
+
+==============================================================================
+*/
+
+cvar_t	sv_maxrate = {"sv_maxrate", "0", CVAR_NONE};	//bytes/sec cap for every client, 0 for no cap
+
+/*
+=======================
+SV_ClientRate
+
+The rate we're limiting the client to, or 0 for no limit.
+=======================
+*/
+int SV_ClientRate (client_t *client)
+{
+	int rate = client->rate;
+	if (sv_maxrate.value > 0 && (!rate || rate > sv_maxrate.value))
+		rate = sv_maxrate.value;
+	if (rate && rate < 1000)
+		rate = 1000;	//anything less is just going to break
+	return rate;
+}
+
+/*
+=======================
+SV_RateRefill
+=======================
+*/
+static void SV_RateRefill (client_t *client)
+{
+	int rate = SV_ClientRate(client);
+
+	if (realtime - client->ratestatstime >= 1)
+	{
+		client->ratebps = client->ratebytes / (realtime - client->ratestatstime);
+		client->ratebytes = 0;
+		client->ratestatstime = realtime;
+	}
+
+	if (rate)
+	{
+		client->ratetokens += (realtime - client->ratetime) * rate;
+		if (client->ratetokens > rate * 0.25)
+			client->ratetokens = rate * 0.25;	//don't let an idle client save up for a huge burst
+	}
+	else
+		client->ratetokens = 0;
+	client->ratetime = realtime;
+}
+
+/*
+=======================
+SV_RateSpent
+=======================
+*/
+static void SV_RateSpent (client_t *client, int bytes)
+{
+	client->ratebytes += bytes;
+	if (SV_ClientRate(client))
+		client->ratetokens -= bytes;
+}
+
 /*
 =======================
 SV_SendClientDatagram
@@ -2829,12 +3453,18 @@ qboolean SV_SendClientDatagram (client_t *client)
 		return true;
 	}
 
+	SV_RateRefill (client);
+	if (client->spawned && SV_ClientRate(client) && client->ratetokens < 0)
+	{	//choked. reliables still go out, everything else waits for the bucket to fill.
+		if (client->protocol_pext2 & PEXT2_REPLACEMENTDELTAS)
+			client->deferredents = client->numsendorder - client->snapshotresume;
+		return true;
+	}
+
 	msg.allowoverflow = false;
 	msg.data = buf;
 	msg.maxsize = q_min(sizeof(buf), client->limit_unreliable);
 	msg.cursize = 0;
-	if (client->download.file)
-		msg.maxsize /= 2;	//make sure there's space for download data
 
 	host_client = client;
 	if (client->spawned)
@@ -2854,10 +3484,13 @@ qboolean SV_SendClientDatagram (client_t *client)
 			//this delta protocol doesn't wipe old state just because there's a new packet.
 			//the server isn't required to sync with the client frames either
 			//so we can just spam multiple packets to keep our udp data under the MTU
-			while (client->snapshotresume < client->numpendingentities)
+			while (client->snapshotresume < client->numsendorder)
 			{
+				SV_RateSpent (client, msg.cursize);
 				NET_SendUnreliableMessage (client->netconnection, &msg);
 				SZ_Clear(&msg);
+				if (SV_ClientRate(client) && client->ratetokens < 0)
+					break;	//out of budget, the rest are deferred (lowest priority last)
 				SVFTE_WriteEntitiesToClient(client, &msg, sizeof(buf));
 				SVFTE_WriteCSQCEntitiesToClient(client, &msg, sizeof(buf));
 			}
@@ -2889,10 +3522,19 @@ qboolean SV_SendClientDatagram (client_t *client)
 	SV_VoiceSendPacket(client, &msg);
 
 	msg.maxsize = q_min(sizeof(buf), client->limit_unreliable);
-	Host_AppendDownloadData(client, &msg);
+	while (Host_AppendDownloadData(client, &msg))
+	{	//more download data than fits, send it in extra packets rather than squeezing the game data
+		SV_RateSpent (client, msg.cursize);
+		NET_SendUnreliableMessage (client->netconnection, &msg);
+		SZ_Clear(&msg);
+	}
+
 
+	if (client->spawned && (client->protocol_pext2 & PEXT2_REPLACEMENTDELTAS))
+		client->deferredents = client->numsendorder - client->snapshotresume;
 
 // send the datagram
+	SV_RateSpent (client, msg.cursize);
 	if (msg.cursize && NET_SendUnreliableMessage (client->netconnection, &msg) == -1)
 	{
 		SV_DropClient (false);// if the message couldn't send, kick off
@@ -2911,6 +3553,7 @@ void SV_UpdateToReliableMessages (void)
 {
 	int			i, j;
 	client_t *client;
+	sizebuf_t *demo;
 
 // check for changes to be sent over the reliable streams
 	for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
@@ -2936,6 +3579,8 @@ void SV_UpdateToReliableMessages (void)
 			continue;
 		SZ_Write (&client->message, sv.reliable_datagram.data, sv.reliable_datagram.cursize);
 	}
+	if ((demo = SV_DemoBuffer (true)))
+		SZ_Write (demo, sv.reliable_datagram.data, sv.reliable_datagram.cursize);
 
 	SZ_Clear (&sv.reliable_datagram);
 }
@@ -2985,122 +3630,329 @@ qboolean SV_SendPrespawnModelPrecaches(void)
 	host_client->signon_models = idx;
 	return idx < host_client->limit_models;
 }
-qboolean SV_SendPrespawnSoundPrecaches(void)
+
+/*
+==============================================================================
+
+SIGNON CACHE
+
+The bulk of the prespawn data (svc_precache'd sounds and particles,
+baselines, statics and ambient sounds) is identical for every client with
+the same extensions and limits, so rather than re-serialising it for each
+one it's built once into a cache and clients are just fed copies of the
+bytes. The cache is split at message boundaries into chunks of around an
+mtu, and each frame a client gets as many whole chunks as fit into its
+reliable buffer.
+
+Late precaches, statics etc change the cache's signature, so the next
+client to connect gets a rebuilt copy. Clients already part way through
+keep the one they started with (they'll have seen the reliable broadcast
+for late precaches anyway).
+
+==============================================================================
+*/
+
+#define SIGNON_CHUNKSIZE	1400
+
+typedef struct signoncache_s
 {
-	int idx = host_client->signon_sounds;
-	size_t maxsize = host_client->message.maxsize;	//we can go quite large
-	if (!host_client->protocol_pext2)
-		return false;	//unsupported by this client...
-	for (;idx < host_client->limit_sounds;idx++)
+	struct signoncache_s *next;
+
+	//what it was built for
+	unsigned int	pext2;
+	unsigned int	limit_models;
+	unsigned int	limit_sounds;
+	unsigned int	firstsound;		//sounds below this were already in the serverinfo
+	unsigned int	signature[6];	//how much stuff there was to send when it was built
+
+	qboolean		stale;			//freed when the last user is done with it
+	int				users;
+
+	byte			*data;
+	size_t			size, maxsize;
+	size_t			*chunks;		//start offset of each chunk
+	int				numchunks, maxchunks;
+} signoncache_t;
+static signoncache_t *signoncaches;
+
+static void SV_SignonCacheSignature (unsigned int *sig)
+{
+	int i;
+	memset (sig, 0, sizeof(unsigned int)*6);
+	for (i = 0; i < MAX_SOUNDS && sv.sound_precache[i]; i++)
+		sig[0]++;
+	for (i = 0; i < MAX_PARTICLETYPES; i++)
+		if (sv.particle_precache[i])
+			sig[1]++;
+	sig[2] = qcvm->num_edicts;
+	sig[3] = sv.num_statics;
+	sig[4] = sv.num_ambients;
+	for (i = 0; i < MAX_MODELS && sv.model_precache[i]; i++)
+		sig[5]++;
+}
+
+static void SV_FreeSignonCache (signoncache_t *c)
+{
+	signoncache_t **link;
+	for (link = &signoncaches; *link; link = &(*link)->next)
 	{
-		if (!sv.sound_precache[idx])
-			continue;
-		if (host_client->message.cursize + 4+strlen(sv.sound_precache[idx]) > maxsize)
+		if (*link == c)
+		{
+			*link = c->next;
 			break;
-		MSG_WriteByte(&host_client->message, svcdp_precache);
-		MSG_WriteShort(&host_client->message, 0x8000 | idx);
-		MSG_WriteString(&host_client->message, sv.sound_precache[idx]);
+		}
 	}
-	host_client->signon_sounds = idx;
-	return idx < host_client->limit_sounds;
+	free (c->data);
+	free (c->chunks);
+	free (c);
 }
-int SV_SendPrespawnParticlePrecaches(int idx)
+
+/*
+================
+SV_FlushSignonCaches
+
+Called when the map changes.
+================
+*/
+void SV_FlushSignonCaches (void)
 {
-	size_t maxsize = host_client->message.maxsize;	//we can go quite large
-	if (!host_client->protocol_pext2)
-		return -1;	//unsupported by this client.
-	for (;;idx++)
+	signoncache_t *c, *next;
+	for (c = signoncaches; c; c = next)
 	{
-		if (idx == MAX_PARTICLETYPES)
-			return -1;
-		if (!sv.particle_precache[idx])
-			continue;
-		if (host_client->message.cursize + 4+strlen(sv.particle_precache[idx]) > maxsize)
-			break;
-		MSG_WriteByte(&host_client->message, svcdp_precache);
-		MSG_WriteShort(&host_client->message, 0x4000 | idx);
-		MSG_WriteString(&host_client->message, sv.particle_precache[idx]);
+		next = c->next;
+		c->stale = true;
+		if (!c->users)
+			SV_FreeSignonCache (c);
 	}
-	return idx;
 }
-int SV_SendPrespawnStatics(int idx)
+
+/*
+================
+SV_ReleaseSignonCache
+================
+*/
+void SV_ReleaseSignonCache (client_t *client)
 {
-	entity_state_t *svent;
-	int maxsize = host_client->message.maxsize - 128;	//we can go quite large
+	signoncache_t *c = client->signoncache;
+	if (!c)
+		return;
+	client->signoncache = NULL;
+	if (!--c->users && c->stale)
+		SV_FreeSignonCache (c);
+}
 
-	while (1)
+static void SV_SignonCacheAppend (signoncache_t *c, sizebuf_t *item)
+{
+	if (!item->cursize)
+		return;
+	if (c->size + item->cursize > c->maxsize)
 	{
-		if (idx >= sv.num_statics)
-			return -1;
-		svent = &sv.static_entities[idx];
-
-		if (host_client->message.cursize > maxsize)
-			break;
-		idx++;
-
-		if (svent->modelindex >= host_client->limit_models)
-			continue;
-		if (memcmp(&nullentitystate, svent, sizeof(nullentitystate)))
-			MSG_WriteStaticOrBaseLine(&host_client->message, -1, svent, host_client->protocol_pext2, sv.protocol, sv.protocolflags);
+		c->maxsize = (c->size + item->cursize)*2;
+		c->data = (byte *) realloc (c->data, c->maxsize);
+	}
+	if (!c->numchunks || c->size + item->cursize - c->chunks[c->numchunks-1] > SIGNON_CHUNKSIZE)
+	{	//start a new chunk
+		if (c->numchunks == c->maxchunks)
+		{
+			c->maxchunks += 64;
+			c->chunks = (size_t *) realloc (c->chunks, sizeof(*c->chunks)*c->maxchunks);
+		}
+		c->chunks[c->numchunks++] = c->size;
 	}
-	return idx;
+	memcpy (c->data + c->size, item->data, item->cursize);
+	c->size += item->cursize;
+	SZ_Clear (item);
 }
-int SV_SendAmbientSounds(int idx)
+
+static void SV_BuildSignonCache (signoncache_t *c)
 {
-	struct	ambientsound_s *snd;
-	int maxsize = host_client->message.maxsize - 128;	//we can go quite large
-	qboolean large;
-	size_t i;
+	byte		itembuf[MAX_DATAGRAM];
+	sizebuf_t	item;
+	struct ambientsound_s *snd;
+	entity_state_t *st;
+	edict_t		*ent;
+	unsigned int idx;
+	int			i;
 
-	while (1)
+	memset (&item, 0, sizeof(item));
+	item.data = itembuf;
+	item.maxsize = sizeof(itembuf);
+
+	if (c->pext2)
 	{
-		if (idx >= sv.num_ambients)
-			return -1;
-		snd = &sv.ambientsounds[idx];
+		for (idx = c->firstsound; idx < c->limit_sounds; idx++)
+		{
+			if (!sv.sound_precache[idx])
+				continue;
+			MSG_WriteByte (&item, svcdp_precache);
+			MSG_WriteShort (&item, 0x8000 | idx);
+			MSG_WriteString (&item, sv.sound_precache[idx]);
+			SV_SignonCacheAppend (c, &item);
+		}
+		for (idx = 0; idx < MAX_PARTICLETYPES; idx++)
+		{
+			if (!sv.particle_precache[idx])
+				continue;
+			MSG_WriteByte (&item, svcdp_precache);
+			MSG_WriteShort (&item, 0x4000 | idx);
+			MSG_WriteString (&item, sv.particle_precache[idx]);
+			SV_SignonCacheAppend (c, &item);
+		}
+	}
 
-		if (host_client->message.cursize > maxsize)
-			break;
-		idx++;
+	for (i = 0; i < qcvm->num_edicts; i++)
+	{
+		ent = EDICT_NUM(i);
+		if (memcmp(&nullentitystate, &ent->baseline, sizeof(nullentitystate)))
+		{
+			MSG_WriteStaticOrBaseLine (&item, i, &ent->baseline, c->pext2, sv.protocol, sv.protocolflags);
+			SV_SignonCacheAppend (c, &item);
+		}
+	}
 
-		if (snd->soundindex >= host_client->limit_sounds)
+	for (i = 0; i < sv.num_statics; i++)
+	{
+		st = &sv.static_entities[i];
+		if (st->modelindex >= c->limit_models)
+			continue;
+		if (memcmp(&nullentitystate, st, sizeof(nullentitystate)))
+		{
+			MSG_WriteStaticOrBaseLine (&item, -1, st, c->pext2, sv.protocol, sv.protocolflags);
+			SV_SignonCacheAppend (c, &item);
+		}
+	}
+
+	for (i = 0; i < sv.num_ambients; i++)
+	{
+		qboolean large;
+		int j;
+
+		snd = &sv.ambientsounds[i];
+		if (snd->soundindex >= c->limit_sounds)
 			continue;
 
 		large = (snd->soundindex > 255);
 		if (large)
-			MSG_WriteByte (&host_client->message,svc_spawnstaticsound2);	//johnfitz -- PROTOCOL_FITZQUAKE
+			MSG_WriteByte (&item, svc_spawnstaticsound2);	//johnfitz -- PROTOCOL_FITZQUAKE
 		else
-			MSG_WriteByte (&host_client->message,svc_spawnstaticsound);
-		for (i = 0; i < 3; i++)
-			MSG_WriteCoord(&host_client->message, snd->origin[i], sv.protocolflags);
+			MSG_WriteByte (&item, svc_spawnstaticsound);
+		for (j = 0; j < 3; j++)
+			MSG_WriteCoord (&item, snd->origin[j], sv.protocolflags);
 		if (large)
-			MSG_WriteShort(&host_client->message, snd->soundindex);
+			MSG_WriteShort (&item, snd->soundindex);
 		else
-			MSG_WriteByte (&host_client->message, snd->soundindex);
-		MSG_WriteByte (&host_client->message, snd->volume*255);
-		MSG_WriteByte (&host_client->message, snd->attenuation*64);
+			MSG_WriteByte (&item, snd->soundindex);
+		MSG_WriteByte (&item, snd->volume*255);
+		MSG_WriteByte (&item, snd->attenuation*64);
+		SV_SignonCacheAppend (c, &item);
 	}
-	return idx;
 }
-int SV_SendPrespawnBaselines(int idx)
+
+/*
+================
+SV_WriteSignonData
+
+Builds the same prespawn data for a server demo, which has no limits to
+speak of, and hands it over a chunk at a time. Not cached, it's only
+needed once per map.
+================
+*/
+void SV_WriteSignonData (unsigned int pext2, void (*write) (const byte *data, int size))
 {
-	edict_t *svent;
-	int maxsize = host_client->message.maxsize - 128;	//we can go quite large
+	signoncache_t c;
+	int i;
 
-	while (1)
+	memset (&c, 0, sizeof(c));
+	c.pext2 = pext2;
+	c.limit_models = MAX_MODELS;
+	c.limit_sounds = MAX_SOUNDS;
+	c.firstsound = pext2?1:MAX_SOUNDS;
+	SV_BuildSignonCache (&c);
+	for (i = 0; i < c.numchunks; i++)
+		write (c.data + c.chunks[i], ((i+1 < c.numchunks)?c.chunks[i+1]:c.size) - c.chunks[i]);
+	free (c.data);
+	free (c.chunks);
+}
+
+/*
+================
+SV_GetSignonCache
+
+Finds (or builds) the cache that matches what the client can accept.
+================
+*/
+static signoncache_t *SV_GetSignonCache (client_t *client)
+{
+	signoncache_t *c;
+	unsigned int sig[6];
+	unsigned int firstsound = client->protocol_pext2?client->signon_sounds:client->limit_sounds;
+
+	SV_SignonCacheSignature (sig);
+	for (c = signoncaches; c; c = c->next)
 	{
-		if (idx >= qcvm->num_edicts)
-			return -1;
-		svent = EDICT_NUM(idx);
+		if (c->stale)
+			continue;
+		if (c->pext2 != client->protocol_pext2 || c->limit_models != client->limit_models || c->limit_sounds != client->limit_sounds || c->firstsound != firstsound)
+			continue;
+		if (!memcmp(c->signature, sig, sizeof(sig)))
+		{
+			svmetrics.signonhits++;
+			return c;
+		}
 
-		if (host_client->message.cursize > maxsize)
-			break;
+		//something was added since, don't let anyone else use it.
+		c->stale = true;
+		if (!c->users)
+			SV_FreeSignonCache (c);
+		break;
+	}
 
-		if (memcmp(&nullentitystate, &svent->baseline, sizeof(nullentitystate)))
-			MSG_WriteStaticOrBaseLine(&host_client->message, idx, &svent->baseline, host_client->protocol_pext2, sv.protocol, sv.protocolflags);
+	svmetrics.signonmisses++;
+	c = (signoncache_t *) calloc (1, sizeof(*c));
+	c->pext2 = client->protocol_pext2;
+	c->limit_models = client->limit_models;
+	c->limit_sounds = client->limit_sounds;
+	c->firstsound = firstsound;
+	memcpy (c->signature, sig, sizeof(sig));
+	SV_BuildSignonCache (c);
+	c->next = signoncaches;
+	signoncaches = c;
+	return c;
+}
 
-		idx++;
+/*
+================
+SV_SendPrespawnCache
+
+Copies as many chunks of the client's signon cache into its reliable
+message as will fit. Returns -1 once it's all been sent.
+================
+*/
+int SV_SendPrespawnCache (int idx)
+{
+	signoncache_t *c = host_client->signoncache;
+	size_t start, end;
+
+	if (!c)
+	{
+		c = host_client->signoncache = SV_GetSignonCache (host_client);
+		c->users++;
+		idx = 0;
+	}
+
+	for (; idx < c->numchunks; idx++)
+	{
+		start = c->chunks[idx];
+		end = (idx+1 < c->numchunks)?c->chunks[idx+1]:c->size;
+		if (host_client->message.cursize + (end-start) > (size_t)host_client->message.maxsize - 128)
+			break;	//leave a little space for anything else that gets broadcast
+		SZ_Write (&host_client->message, c->data+start, end-start);
 	}
-	return idx;
+	if (idx < c->numchunks)
+		return idx;
+
+	SV_ReleaseSignonCache (host_client);
+	return -1;
 }
 
 /*
@@ -3123,6 +3975,8 @@ void SV_SendClientMessages (void)
 		SV_PresendClientDatagram (host_client);	//generates client snapshots (and updates csqc pending flags)
 	}
 
+	SV_Demo_Frame ();
+
 // build individual updates
 	for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
 	{
@@ -3170,44 +4024,9 @@ void SV_SendClientMessages (void)
 					host_client->sendsignon++;
 				}
 			}
-			if (host_client->sendsignon == PRESPAWN_SOUNDS)
-			{
-				if (!SV_SendPrespawnSoundPrecaches())
-				{
-					host_client->signonidx = 0;
-					host_client->sendsignon++;
-				}
-			}
-			if (host_client->sendsignon == PRESPAWN_PARTICLES)
-			{
-				host_client->signonidx = SV_SendPrespawnParticlePrecaches(host_client->signonidx);
-				if (host_client->signonidx < 0)
-				{
-					host_client->signonidx = 0;
-					host_client->sendsignon++;
-				}
-			}
-			if (host_client->sendsignon == PRESPAWN_BASELINES)
-			{
-				host_client->signonidx = SV_SendPrespawnBaselines(host_client->signonidx);
-				if (host_client->signonidx < 0)
-				{
-					host_client->signonidx = 0;
-					host_client->sendsignon++;
-				}
-			}
-			if (host_client->sendsignon == PRESPAWN_STATICS)
-			{
-				host_client->signonidx = SV_SendPrespawnStatics(host_client->signonidx);
-				if (host_client->signonidx < 0)
-				{
-					host_client->signonidx = 0;
-					host_client->sendsignon++;
-				}
-			}
-			if (host_client->sendsignon == PRESPAWN_AMBIENTS)
+			if (host_client->sendsignon == PRESPAWN_CACHED)
 			{
-				host_client->signonidx = SV_SendAmbientSounds(host_client->signonidx);
+				host_client->signonidx = SV_SendPrespawnCache(host_client->signonidx);
 				if (host_client->signonidx < 0)
 				{
 					host_client->signonidx = 0;
@@ -3248,6 +4067,7 @@ void SV_SendClientMessages (void)
 				SV_DropClient (false);	// went to another level
 			else
 			{
+				SV_RateSpent (host_client, host_client->message.cursize);
 				if (NET_SendMessage (host_client->netconnection
 				, &host_client->message) == -1)
 					SV_DropClient (false);	// if the message couldn't send, kick off
@@ -3442,6 +4262,7 @@ void SV_SpawnServer (const char *server)
 //
 	if (sv.active)
 		SV_SendReconnect ();
+	SV_FlushSignonCaches ();
 
 //
 // make cvars consistant
@@ -3549,6 +4370,7 @@ void SV_SpawnServer (const char *server)
 // clear world interaction links
 //
 	SV_ClearWorld ();
+	SV_CalcPHS ();
 
 	sv.sound_precache[0] = dummy;
 	sv.model_precache[0] = dummy;
@@ -3615,6 +4437,7 @@ void SV_SpawnServer (const char *server)
 		if (host_client->active)
 			SV_SendServerinfo (host_client);
 	}
+	SV_Demo_NewMap ();
 
 	Con_DPrintf ("Server spawned.\n");
 }
@@ -0,0 +1,375 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// sv_metrics.c -- server metrics for scrapers, in the prometheus text format
+
+#include "q_stdinc.h"
+#include "arch_def.h"
+#include "net_sys.h"
+#include "quakedef.h"
+#include "net_defs.h"
+#include "net_dgrm.h"
+
+/*
+==============================================================================
+
+SERVER METRICS
+
+With sv_metrics_port set, a udp socket on that port answers any packet
+from this machine with the server's counters and gauges as prometheus
+text. Anything further afield should go through a local agent.
+
+The per-frame work is a couple of timer reads and a histogram bucket;
+everything else is read from where it already lives when a scrape comes in.
+
+==============================================================================
+*/
+
+cvar_t	sv_metrics_port = {"sv_metrics_port", "0", CVAR_NONE};	// 0 for no listener
+
+svmetrics_t	svmetrics;
+
+// tick duration buckets, seconds
+static const double	metrics_buckets[] = {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1};
+#define NUM_METRICS_BUCKETS	countof(metrics_buckets)
+
+static struct
+{
+	int				landriver;
+	sys_socket_t	socket;
+	int				port;
+
+	unsigned int	ticks;
+	unsigned int	buckets[NUM_METRICS_BUCKETS];	// not cumulative until they're written
+	double			ticktime;
+
+	char			text[60000];
+	int				textlen;
+} metrics = {-1, INVALID_SOCKET};
+
+/*
+==================
+SV_Metrics_Tick
+
+A server frame took this long
+==================
+*/
+void SV_Metrics_Tick (double seconds)
+{
+	int i;
+
+	metrics.ticks++;
+	metrics.ticktime += seconds;
+	for (i = 0; i < (int)NUM_METRICS_BUCKETS; i++)
+	{
+		if (seconds <= metrics_buckets[i])
+		{
+			metrics.buckets[i]++;
+			break;
+		}
+	}
+}
+
+/*
+==================
+SV_Metrics_Printf
+==================
+*/
+static void SV_Metrics_Printf (const char *fmt, ...) FUNC_PRINTF(1,2);
+static void SV_Metrics_Printf (const char *fmt, ...)
+{
+	va_list	argptr;
+	int		len, space = sizeof(metrics.text) - metrics.textlen;
+
+	if (space <= 1)
+		return;
+	va_start (argptr, fmt);
+	len = q_vsnprintf (metrics.text + metrics.textlen, space, fmt, argptr);
+	va_end (argptr);
+	if (len < 0 || len >= space)
+		metrics.textlen = sizeof(metrics.text) - 1;	// truncated
+	else
+		metrics.textlen += len;
+}
+
+static void SV_Metrics_Header (const char *name, const char *type, const char *help)
+{
+	SV_Metrics_Printf ("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/*
+==================
+SV_Metrics_Label
+
+Player names as label values. Quake's high characters are folded down and
+anything that would upset the format is replaced.
+==================
+*/
+static const char *SV_Metrics_Label (const char *in)
+{
+	static char	out[64];
+	size_t		o = 0;
+	int			c;
+
+	for (; *in && o + 2 < sizeof(out); in++)
+	{
+		c = *in & 0x7f;
+		if (c == '\\' || c == '"')
+			out[o++] = '\\';
+		else if (c < ' ')
+			c = '_';
+		out[o++] = c;
+	}
+	out[o] = 0;
+	return out;
+}
+
+/*
+==================
+SV_Metrics_Build
+==================
+*/
+static void SV_Metrics_Build (void)
+{
+	memstats_t		mem;
+	dgrmstats_t		net;
+	client_t		*client;
+	unsigned int	cumulative;
+	int				i, j, active, clients;
+	float			ping;
+	const char		*name;
+
+	metrics.textlen = 0;
+
+	SV_Metrics_Header ("quake_server_tick_seconds", "histogram", "Time taken by each server frame.");
+	for (i = 0, cumulative = 0; i < (int)NUM_METRICS_BUCKETS; i++)
+	{
+		cumulative += metrics.buckets[i];
+		SV_Metrics_Printf ("quake_server_tick_seconds_bucket{le=\"%g\"} %u\n", metrics_buckets[i], cumulative);
+	}
+	SV_Metrics_Printf ("quake_server_tick_seconds_bucket{le=\"+Inf\"} %u\n", metrics.ticks);
+	SV_Metrics_Printf ("quake_server_tick_seconds_sum %f\n", metrics.ticktime);
+	SV_Metrics_Printf ("quake_server_tick_seconds_count %u\n", metrics.ticks);
+
+	SV_Metrics_Header ("quake_server_qc_seconds_total", "counter", "Time spent running server qc.");
+	SV_Metrics_Printf ("quake_server_qc_seconds_total %f\n", svmetrics.qctime);
+
+	SV_Metrics_Header ("quake_server_active", "gauge", "1 while a map is running.");
+	SV_Metrics_Printf ("quake_server_active %i\n", sv.active ? 1 : 0);
+
+	if (sv.active)
+	{
+		PR_SwitchQCVM (&sv.qcvm);
+		for (i = 0, active = 0; i < qcvm->num_edicts; i++)
+			if (!EDICT_NUM(i)->free)
+				active++;
+		SV_Metrics_Header ("quake_server_edicts", "gauge", "Edicts in use.");
+		SV_Metrics_Printf ("quake_server_edicts %i\n", active);
+		SV_Metrics_Header ("quake_server_edicts_max", "gauge", "Edicts the map may use.");
+		SV_Metrics_Printf ("quake_server_edicts_max %i\n", qcvm->max_edicts);
+		SV_Metrics_Header ("quake_server_time_seconds", "gauge", "Game time on the current map.");
+		SV_Metrics_Printf ("quake_server_time_seconds %f\n", qcvm->time);
+		PR_SwitchQCVM (NULL);
+	}
+
+	for (i = 0, clients = 0, client = svs.clients; i < svs.maxclients; i++, client++)
+		if (client->active)
+			clients++;
+	SV_Metrics_Header ("quake_server_clients", "gauge", "Connected clients, bots included.");
+	SV_Metrics_Printf ("quake_server_clients %i\n", clients);
+	SV_Metrics_Header ("quake_server_clients_max", "gauge", "Client slots.");
+	SV_Metrics_Printf ("quake_server_clients_max %i\n", svs.maxclients);
+
+	// per client
+	SV_Metrics_Header ("quake_client_ping_seconds", "gauge", "Average ping over the last few frames.");
+	for (i = 0, client = svs.clients; i < svs.maxclients; i++, client++)
+	{
+		if (!client->active || !client->netconnection)
+			continue;
+		for (j = 0, ping = 0; j < NUM_PING_TIMES; j++)
+			ping += client->ping_times[j];
+		name = SV_Metrics_Label (client->name);
+		SV_Metrics_Printf ("quake_client_ping_seconds{slot=\"%i\",name=\"%s\"} %f\n", i, name, ping / NUM_PING_TIMES);
+	}
+	SV_Metrics_Header ("quake_client_loss_ratio", "gauge", "Unreliable packets from the client that never arrived, over the connection.");
+	for (i = 0, client = svs.clients; i < svs.maxclients; i++, client++)
+	{
+		struct qsocket_s *s = client->netconnection;
+		if (!client->active || !s)
+			continue;
+		SV_Metrics_Printf ("quake_client_loss_ratio{slot=\"%i\",name=\"%s\"} %f\n", i, SV_Metrics_Label (client->name),
+						   (s->datagramsIn + s->droppedIn) ? (double)s->droppedIn / (s->datagramsIn + s->droppedIn) : 0.0);
+	}
+	SV_Metrics_Header ("quake_client_send_bytes_per_second", "gauge", "Bytes sent to the client over the last second.");
+	for (i = 0, client = svs.clients; i < svs.maxclients; i++, client++)
+	{
+		if (!client->active || !client->netconnection)
+			continue;
+		SV_Metrics_Printf ("quake_client_send_bytes_per_second{slot=\"%i\",name=\"%s\"} %u\n", i, SV_Metrics_Label (client->name), client->ratebps);
+	}
+	SV_Metrics_Header ("quake_client_received_bytes_total", "counter", "Bytes received from the client, headers included.");
+	for (i = 0, client = svs.clients; i < svs.maxclients; i++, client++)
+	{
+		if (!client->active || !client->netconnection)
+			continue;
+		SV_Metrics_Printf ("quake_client_received_bytes_total{slot=\"%i\",name=\"%s\"} %u\n", i, SV_Metrics_Label (client->name), client->netconnection->bytesIn);
+	}
+
+	// network
+	Datagram_GetStats (&net);
+	SV_Metrics_Header ("quake_net_packets_sent_total", "counter", "Packets sent.");
+	SV_Metrics_Printf ("quake_net_packets_sent_total %i\n", net.packetsSent);
+	SV_Metrics_Header ("quake_net_packets_resent_total", "counter", "Reliable packets sent again.");
+	SV_Metrics_Printf ("quake_net_packets_resent_total %i\n", net.packetsReSent);
+	SV_Metrics_Header ("quake_net_packets_received_total", "counter", "Packets received.");
+	SV_Metrics_Printf ("quake_net_packets_received_total %i\n", net.packetsReceived);
+	SV_Metrics_Header ("quake_net_packets_duplicate_total", "counter", "Reliable packets received twice.");
+	SV_Metrics_Printf ("quake_net_packets_duplicate_total %i\n", net.duplicates);
+	SV_Metrics_Header ("quake_net_packets_short_total", "counter", "Packets too short to use.");
+	SV_Metrics_Printf ("quake_net_packets_short_total %i\n", net.shortPackets);
+	SV_Metrics_Header ("quake_net_packets_dropped_total", "counter", "Unreliable packets that never arrived.");
+	SV_Metrics_Printf ("quake_net_packets_dropped_total %i\n", net.droppedDatagrams);
+	SV_Metrics_Header ("quake_net_messages_sent_total", "counter", "Messages sent.");
+	SV_Metrics_Printf ("quake_net_messages_sent_total{reliable=\"1\"} %i\n", messagesSent);
+	SV_Metrics_Printf ("quake_net_messages_sent_total{reliable=\"0\"} %i\n", unreliableMessagesSent);
+	SV_Metrics_Header ("quake_net_messages_received_total", "counter", "Messages received.");
+	SV_Metrics_Printf ("quake_net_messages_received_total{reliable=\"1\"} %i\n", messagesReceived);
+	SV_Metrics_Printf ("quake_net_messages_received_total{reliable=\"0\"} %i\n", unreliableMessagesReceived);
+
+	// memory
+	Memory_GetStats (&mem);
+	SV_Metrics_Header ("quake_hunk_bytes", "gauge", "The hunk, by what it's used for.");
+	SV_Metrics_Printf ("quake_hunk_bytes{use=\"low\"} %i\n", mem.hunklow);
+	SV_Metrics_Printf ("quake_hunk_bytes{use=\"high\"} %i\n", mem.hunkhigh);
+	SV_Metrics_Printf ("quake_hunk_bytes{use=\"free\"} %i\n", mem.hunksize - mem.hunklow - mem.hunkhigh);
+	SV_Metrics_Header ("quake_zone_bytes", "gauge", "The zone, by what it's used for.");
+	SV_Metrics_Printf ("quake_zone_bytes{use=\"used\"} %i\n", mem.zonesize - mem.zonefree);
+	SV_Metrics_Printf ("quake_zone_bytes{use=\"free\"} %i\n", mem.zonefree);
+
+	// caches
+	SV_Metrics_Header ("quake_cache_lookups_total", "counter", "Cache lookups, by cache and whether they found anything.");
+	SV_Metrics_Printf ("quake_cache_lookups_total{cache=\"data\",result=\"hit\"} %u\n", mem.cachehits);
+	SV_Metrics_Printf ("quake_cache_lookups_total{cache=\"data\",result=\"miss\"} %u\n", mem.cachemisses);
+	SV_Metrics_Printf ("quake_cache_lookups_total{cache=\"signon\",result=\"hit\"} %u\n", svmetrics.signonhits);
+	SV_Metrics_Printf ("quake_cache_lookups_total{cache=\"signon\",result=\"miss\"} %u\n", svmetrics.signonmisses);
+	SV_Metrics_Printf ("quake_cache_lookups_total{cache=\"fatpvs\",result=\"hit\"} %u\n", svmetrics.fatpvshits);
+	SV_Metrics_Printf ("quake_cache_lookups_total{cache=\"fatpvs\",result=\"miss\"} %u\n", svmetrics.fatpvsmisses);
+	if (sv.qcvm.worldmodel && sv.qcvm.worldmodel->visrows)
+	{
+		SV_Metrics_Printf ("quake_cache_lookups_total{cache=\"pvs\",result=\"hit\"} %u\n", sv.qcvm.worldmodel->visrows->hits);
+		SV_Metrics_Printf ("quake_cache_lookups_total{cache=\"pvs\",result=\"miss\"} %u\n", sv.qcvm.worldmodel->visrows->misses);
+	}
+}
+
+/*
+==================
+SV_Metrics_Local
+
+Only this machine gets an answer
+==================
+*/
+static qboolean SV_Metrics_Local (struct qsockaddr *addr)
+{
+	const char *s = net_landrivers[metrics.landriver].AddrToString (addr, false);
+	return !strncmp (s, "127.", 4) || !strncmp (s, "[0:0:0:0:0:0:0:1]", 17) || !strncmp (s, "[::1]", 5);
+}
+
+/*
+==================
+SV_Metrics_Close
+==================
+*/
+static void SV_Metrics_Close (void)
+{
+	if (metrics.socket != INVALID_SOCKET)
+		net_landrivers[metrics.landriver].Close_Socket (metrics.socket);
+	metrics.socket = INVALID_SOCKET;
+	metrics.port = 0;
+	svmetrics.active = false;
+}
+
+/*
+==================
+SV_Metrics_Poll
+
+Opens or closes the listener to match sv_metrics_port, and answers anyone
+asking. Called every host frame.
+==================
+*/
+void SV_Metrics_Poll (void)
+{
+	struct qsockaddr	addr;
+	byte				request[64];
+	int					port = (int)sv_metrics_port.value;
+	int					i;
+
+	if (port != metrics.port)
+	{
+		SV_Metrics_Close ();
+		if (port <= 0 || port > 65535)
+			return;
+		for (i = 0; i < net_numlandrivers; i++)
+			if (net_landrivers[i].initialized)
+				break;
+		if (i == net_numlandrivers)
+			return;
+		metrics.landriver = i;
+		metrics.socket = net_landrivers[i].Open_Socket (port);
+		if (metrics.socket == INVALID_SOCKET)
+		{
+			Con_Printf ("sv_metrics_port: couldn't open port %i\n", port);
+			Cvar_SetValueQuick (&sv_metrics_port, 0);
+			return;
+		}
+		metrics.port = port;
+		svmetrics.active = true;
+		Con_Printf ("Metrics on %s port %i\n", net_landrivers[i].name, port);
+	}
+	if (metrics.socket == INVALID_SOCKET)
+		return;
+
+	while (net_landrivers[metrics.landriver].Read (metrics.socket, request, sizeof(request), &addr) > 0)
+	{
+		if (!SV_Metrics_Local (&addr))
+			continue;
+		SV_Metrics_Build ();
+		net_landrivers[metrics.landriver].Write (metrics.socket, (byte *)metrics.text, metrics.textlen, &addr);
+	}
+}
+
+/*
+==================
+SV_Metrics_Init
+==================
+*/
+void SV_Metrics_Init (void)
+{
+	Cvar_RegisterVariable (&sv_metrics_port);
+}
+
+/*
+==================
+SV_Metrics_Shutdown
+==================
+*/
+void SV_Metrics_Shutdown (void)
+{
+	SV_Metrics_Close ();
+}
@@ -49,6 +49,11 @@ cvar_t	sv_nostep = {"sv_nostep","0",CVAR_NONE};
 cvar_t	sv_freezenonclients = {"sv_freezenonclients","0",CVAR_NONE};
 cvar_t	sv_gameplayfix_spawnbeforethinks = {"sv_gameplayfix_spawnbeforethinks","0",CVAR_NONE};
 cvar_t	sv_gameplayfix_bouncedownslopes = {"sv_gameplayfix_bouncedownslopes","0",CVAR_NONE};	//fixes grenades making horrible noises on slopes.
+cvar_t	sv_entitysleep = {"sv_entitysleep","1",CVAR_NONE};	//skip physics for resting toss/bounce/step ents until something disturbs them.
+cvar_t	sv_ai_lod = {"sv_ai_lod","0",CVAR_NONE};	//throttle monsters that no client can see or hear.
+cvar_t	sv_ai_lod_farinterval = {"sv_ai_lod_farinterval","0.3",CVAR_NONE};	//how often audible-but-not-visible monsters get to run.
+cvar_t	sv_ai_lod_waketime = {"sv_ai_lod_waketime","3",CVAR_NONE};	//how long damage or a nearby noise keeps a monster at full rate.
+cvar_t	sv_ai_lod_soundradius = {"sv_ai_lod_soundradius","1000",CVAR_NONE};	//how far a noise carries to dormant monsters.
 
 cvar_t	sv_sound_watersplash	= {"sv_sound_watersplash",	"misc/h2ohit1.wav", CVAR_NONE};
 cvar_t	sv_sound_land			= {"sv_sound_land",			"demon/dland2.wav", CVAR_NONE};
@@ -195,6 +200,8 @@ void SV_Impact (edict_t *e1, edict_t *e2)
 	old_self = pr_global_struct->self;
 	old_other = pr_global_struct->other;
 
+	e1->sleeping = e2->sleeping = false;
+
 	pr_global_struct->time = qcvm->time;
 	if (e1->v.touch && e1->v.solid != SOLID_NOT)
 	{
@@ -555,6 +562,7 @@ static qboolean SV_PushMoveAngles (edict_t *pusher, float movetime)
 		if ((pusher->v.movetype == MOVETYPE_PUSH) || (PROG_TO_EDICT(check->v.groundentity) == pusher))
 		{
 			// move this entity
+			check->sleeping = false;
 			pushed_p->ent = check;
 			VectorCopy (check->v.origin, pushed_p->origin);
 			VectorCopy (check->v.angles, pushed_p->angles);
@@ -755,6 +763,8 @@ void SV_PushMove (edict_t *pusher, float movetime)
 			}
 		}
 
+		check->sleeping = false;
+
 	// remove the onground flag for non-players
 		if (check->v.movetype != MOVETYPE_WALK)
 			if (!pr_checkextension.value || PROG_TO_EDICT(check->v.groundentity) != pusher) //unless they're already riding us (prevents grenade sound spam)
@@ -1535,8 +1545,286 @@ void SV_Physics_Step (edict_t *ent)
 }
 
 
+/*
+===============================================================================
+
+AI LOD
+
+Horde maps can have far more monsters than anyone can see. With sv_ai_lod
+set, each server frame merges the pvs and phs of every spawned client's
+view leaf, and monsters are classed as near (in a client's pvs), far (only
+in the phs) or dormant (neither). Far monsters only run every
+sv_ai_lod_farinterval seconds and dormant ones don't run at all, until
+they come into view, get hurt, or hear a noise.
+
+Only FL_MONSTER ents that are on the ground are affected by default, qc can
+override that per entity with the ai_lod field.
+===============================================================================
+*/
+
+#define AILOD_MAXSOUNDS	64
+static struct
+{
+	qmodel_t	*model;
+	int			bytes;
+	byte		*pvs;		//merged over all clients
+	byte		*phs;
+	mleaf_t		*leafs[MAX_SCOREBOARD];	//client view leafs the sets were built from
+	qboolean	active;		//sets are valid for this frame
+
+	struct
+	{
+		vec3_t	org;
+		float	time;
+	} sounds[AILOD_MAXSOUNDS];
+	unsigned int	numsounds;	//wraps
+} ailod;
+
+/*
+=============
+SV_AILod_NoteSound
+
+Called for each attenuated sound the server starts. The entity making the
+noise is obviously awake, and dormant monsters nearby will hear it.
+=============
+*/
+void SV_AILod_NoteSound (edict_t *ent, const vec3_t origin)
+{
+	int i;
+	float *org;
+
+	if (!sv_ai_lod.value)
+		return;
+
+	ent->lodwake = sv.qcvm.time;
+	org = ailod.sounds[ailod.numsounds % AILOD_MAXSOUNDS].org;
+	if (origin)
+		VectorCopy (origin, org);
+	else for (i = 0; i < 3; i++)
+		org[i] = ent->v.origin[i]+0.5*(ent->v.mins[i]+ent->v.maxs[i]);
+	ailod.sounds[ailod.numsounds % AILOD_MAXSOUNDS].time = sv.qcvm.time;
+	ailod.numsounds++;
+}
+
+/*
+=============
+SV_AILod_AddLeaf
+
+Merges a leaf's pvs and phs into the sets. This is only done when a client
+moves into a new leaf.
+=============
+*/
+static void SV_AILod_AddLeaf (mleaf_t *leaf, qmodel_t *worldmodel)
+{
+	Mod_OrVis (ailod.pvs, Mod_LeafPVS (leaf, worldmodel), ailod.bytes);
+	Mod_OrVis (ailod.phs, SV_LeafPHS (leaf, worldmodel), ailod.bytes);
+}
+
+/*
+=============
+SV_AILod_Setup
+
+Rebuilds the merged sets if any client changed leaf since the last frame.
+=============
+*/
+static void SV_AILod_Setup (void)
+{
+	qmodel_t	*worldmodel = qcvm->worldmodel;
+	client_t	*cl;
+	mleaf_t		*leaf;
+	qboolean	changed = false, anyone = false;
+	vec3_t		org;
+	int			i, j;
+
+	ailod.active = false;
+	if (!sv_ai_lod.value || qcvm != &sv.qcvm || !worldmodel || !worldmodel->visdata)
+		return;	//no vis means everything is visible anyway
+
+	if (ailod.model != worldmodel)
+	{
+		ailod.model = worldmodel;
+		ailod.bytes = (worldmodel->numleafs+7)>>3;
+		ailod.pvs = (byte *) realloc (ailod.pvs, ailod.bytes);
+		ailod.phs = (byte *) realloc (ailod.phs, ailod.bytes);
+		if (!ailod.pvs || !ailod.phs)
+			Sys_Error ("SV_AILod_Setup: realloc() failed on %d bytes", ailod.bytes);
+		memset (ailod.leafs, 0, sizeof(ailod.leafs));
+		ailod.numsounds = 0;
+		changed = true;
+	}
+
+	for (i = 0, cl = svs.clients; i < svs.maxclients; i++, cl++)
+	{
+		leaf = NULL;
+		if (cl->active && cl->spawned && !cl->edict->free)
+		{
+			VectorAdd (cl->edict->v.origin, cl->edict->v.view_ofs, org);
+			leaf = Mod_PointInLeaf (org, worldmodel);
+			anyone = true;
+		}
+		if (ailod.leafs[i] != leaf)
+		{
+			ailod.leafs[i] = leaf;
+			changed = true;
+		}
+	}
+	if (!anyone)
+		return;	//nobody to save time for, and monsters still need to settle while clients connect
+
+	if (changed)
+	{
+		memset (ailod.pvs, 0, ailod.bytes);
+		memset (ailod.phs, 0, ailod.bytes);
+		for (i = 0; i < svs.maxclients; i++)
+		{
+			if (!ailod.leafs[i])
+				continue;
+			for (j = 0; j < i; j++)
+				if (ailod.leafs[j] == ailod.leafs[i])
+					break;
+			if (j == i)	//don't redo clients sharing a leaf
+				SV_AILod_AddLeaf (ailod.leafs[i], worldmodel);
+		}
+	}
+	ailod.active = true;
+}
+
+/*
+=============
+SV_AILod_Classify
+=============
+*/
+static int SV_AILod_Classify (edict_t *ent)
+{
+	eval_t		*val;
+	float		mode, radius;
+	vec3_t		delta;
+	qboolean	audible = false;
+	unsigned int i, l;
+
+	val = GetEdictFieldValue (ent, qcvm->extfields.ai_lod);
+	mode = val ? val->_float : 0;
+	if (mode > 0)
+		return AILOD_NEAR;	//qc wants it to always run
+	if (!mode && !((int)ent->v.flags & FL_MONSTER))
+		return AILOD_NEAR;
+	if (!((int)ent->v.flags & FL_ONGROUND))
+		return AILOD_NEAR;	//don't leave things hanging in the air
+	if (qcvm->time - ent->lodwake < sv_ai_lod_waketime.value)
+		return AILOD_NEAR;	//recently hurt or noisy
+	if (!ent->num_leafs || ent->num_leafs >= MAX_ENT_LEAFS)
+		return AILOD_NEAR;	//not linked, or too big to say
+
+	for (i = 0; i < ent->num_leafs; i++)
+	{
+		l = ent->leafnums[i];
+		if (ailod.pvs[l>>3] & (1<<(l&7)))
+			return AILOD_NEAR;
+		if (ailod.phs[l>>3] & (1<<(l&7)))
+			audible = true;
+	}
+	if (audible)
+		return AILOD_FAR;
+
+	//dormant, unless something made a noise nearby
+	radius = sv_ai_lod_soundradius.value * sv_ai_lod_soundradius.value;
+	for (i = 0; i < AILOD_MAXSOUNDS && i < ailod.numsounds; i++)
+	{
+		if (qcvm->time - ailod.sounds[i].time >= sv_ai_lod_waketime.value)
+			continue;
+		VectorSubtract (ent->v.origin, ailod.sounds[i].org, delta);
+		if (DotProduct (delta, delta) < radius)
+		{
+			ent->lodwake = qcvm->time;
+			return AILOD_NEAR;
+		}
+	}
+	return AILOD_DORMANT;
+}
+
+/*
+=============
+SV_AILod_Skip
+
+Returns true if the entity should not run this frame.
+=============
+*/
+static qboolean SV_AILod_Skip (edict_t *ent)
+{
+	ent->lodclass = SV_AILod_Classify (ent);
+	switch (ent->lodclass)
+	{
+	case AILOD_DORMANT:
+		return true;
+	case AILOD_FAR:
+		if (qcvm->time < ent->lodnext)
+			return true;
+		ent->lodnext = qcvm->time + sv_ai_lod_farinterval.value;
+		return false;
+	default:
+		return false;
+	}
+}
+
 //============================================================================
 
+/*
+=============
+SV_CheckSleep
+
+A toss/bounce/step entity that has come to rest on the world (or on
+something else that never moves) will not do anything until it thinks, is
+touched, is pushed, or qc changes its movement fields. Flag it so that
+SV_Physics can skip it until one of those happens.
+=============
+*/
+static void SV_CheckSleep (edict_t *ent)
+{
+	edict_t *ground;
+
+	if (ent->free || !sv_entitysleep.value)
+		return;
+	if (!((int)ent->v.flags & FL_ONGROUND))
+		return;
+	if (ent->v.velocity[0] || ent->v.velocity[1] || ent->v.velocity[2])
+		return;
+	if (ent->v.avelocity[0] || ent->v.avelocity[1] || ent->v.avelocity[2])
+		return;
+	ground = PROG_TO_EDICT(ent->v.groundentity);
+	if (ground != qcvm->edicts && (ground->free || ground->v.movetype != MOVETYPE_NONE))
+		return;
+	if (ground != qcvm->edicts)
+		ground->sleptupon = true;
+	ent->sleeping = true;
+}
+
+/*
+=============
+SV_WakeGrounded
+
+Its ground is being moved, relinked or freed, so anything asleep on it has to
+find out whether it's still supported.
+=============
+*/
+void SV_WakeGrounded (edict_t *ground)
+{
+	edict_t	*ent;
+	int		i, num;
+
+	if (!ground->sleptupon)
+		return;
+	ground->sleptupon = false;
+	num = EDICT_TO_PROG(ground);
+	for (i = 1, ent = NEXT_EDICT(qcvm->edicts); i < qcvm->num_edicts; i++, ent = NEXT_EDICT(ent))
+	{
+		if (ent->sleeping && ent->v.groundentity == num)
+		{
+			ent->sleeping = false;
+			ent->v.flags = (int)ent->v.flags & ~FL_ONGROUND;	//or it'd just hang there
+		}
+	}
+}
+
 /*
 ================
 SV_Physics
@@ -1595,6 +1883,9 @@ void SV_Physics (void)
 	else
 		entity_cap = qcvm->num_edicts; 
 
+	qcvm->sleeping_edicts = 0;
+	SV_AILod_Setup ();
+
 	//for (i=0 ; i<sv.num_edicts ; i++, ent = NEXT_EDICT(ent))
 	for (i=0 ; i<entity_cap ; i++, ent = NEXT_EDICT(ent))
 	{
@@ -1606,6 +1897,24 @@ void SV_Physics (void)
 			SV_LinkEdict (ent, true);	// force retouch even for stationary
 		}
 
+		if (ent->sleeping)
+		{	//nothing to do unless its time to think
+			if (ent->v.nextthink <= 0 || ent->v.nextthink > qcvm->time + host_frametime)
+			{
+				qcvm->sleeping_edicts++;
+				continue;
+			}
+			ent->sleeping = false;
+		}
+
+		if (ailod.active && i > svs.maxclients)
+		{
+			if (SV_AILod_Skip (ent))
+				continue;
+		}
+		else
+			ent->lodclass = AILOD_NEAR;
+
 		if (i > 0 && i <= svs.maxclients && qcvm == &sv.qcvm)
 			SV_Physics_Client (ent, i);
 		else if ((val = GetEdictFieldValue(ent, qcvm->extfields.customphysics)) && val->function)
@@ -1621,10 +1930,17 @@ void SV_Physics (void)
 		else if (ent->v.movetype == MOVETYPE_NOCLIP)
 			SV_Physics_Noclip (ent);
 		else if (ent->v.movetype == MOVETYPE_STEP)
+		{
 			SV_Physics_Step (ent);
+			SV_CheckSleep (ent);
+		}
 		else if (ent->v.movetype == MOVETYPE_TOSS
-		|| ent->v.movetype == MOVETYPE_EXT_BOUNCEMISSILE
-		|| ent->v.movetype == MOVETYPE_BOUNCE
+		|| ent->v.movetype == MOVETYPE_BOUNCE)
+		{
+			SV_Physics_Toss (ent);
+			SV_CheckSleep (ent);
+		}
+		else if (ent->v.movetype == MOVETYPE_EXT_BOUNCEMISSILE
 		|| ent->v.movetype == MOVETYPE_FLY
 		|| ent->v.movetype == MOVETYPE_FLYMISSILE)
 			SV_Physics_Toss (ent);
@@ -0,0 +1,844 @@
+/*
+Copyright (C) 1996-2001 Id Software, Inc.
+Copyright (C) 2010-2014 QuakeSpasm developers
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// sv_replay.c -- deterministic recording and replay of everything a server is sent
+
+#include "q_stdinc.h"
+#include "arch_def.h"
+#include "net_sys.h"
+#include "quakedef.h"
+#include "net_defs.h"
+#include "net_loop.h"
+
+/*
+==============================================================================
+
+SERVER REPLAYS
+
+replay_record starts a map and writes down everything the server can't
+work out for itself: the random seed and gameplay cvars it started with,
+each frame's clock, and every message, connect and drop from clients.
+replay_play starts the same map and feeds that back in at the same virtual
+times, through loopback sockets that nobody is listening to, so a game
+can be rerun on a dedicated server with no network and no players.
+
+Every frame ends with a checksum of the edicts, so a replay that goes its
+own way says which frame it happened on. The time each server frame took
+is kept, and summarised like timedemo when the replay ends.
+
+Not covered: console commands typed on the server while recording, and qc
+builtins that read the wall clock or the filesystem.
+
+==============================================================================
+*/
+
+cvar_t	replay_csv = {"replay_csv", "0", CVAR_NONE};	// write <gamedir>/replay_<name>.csv
+
+#define REPLAY_VERSION	1
+
+enum
+{
+	RP_END,
+	RP_FRAME,		// double realtime, double frametime, byte menupaused
+	RP_CONNECT,		// byte slot, byte angle hack, string address
+	RP_MESSAGE,		// byte slot, short length, data
+	RP_DROP,		// byte slot
+	RP_READDONE,	// the end of SV_RunClients' reads
+	RP_CHECKSUM		// long
+};
+
+// cvars that change what the game does, rather than how it's shown or sent
+static const char *replay_cvars[] =
+{
+	"skill", "deathmatch", "coop", "teamplay", "fraglimit", "timelimit",
+	"noexit", "samelevel", "pausable", "temp1", "saved1", "saved2", "saved3", "saved4",
+	"sv_gravity", "sv_friction", "sv_edgefriction", "sv_stopspeed", "sv_maxspeed",
+	"sv_accelerate", "sv_maxvelocity", "sv_nostep", "sv_freezenonclients",
+	"sv_altnoclip", "sv_ai_lod"
+};
+
+static struct
+{
+	FILE		*file;
+	char		name[MAX_QPATH];
+	qboolean	recording;
+	qboolean	playing;
+	double		realbase;		// realtime when it started
+	double		framestart;
+
+	// playback
+	qboolean	menupaused;
+	int			frame;
+	int			mismatches, firstmismatch;
+	qsocket_t	*sinks[MAX_SCOREBOARD];	// the far ends of the virtual clients' sockets
+	float		*frames;		// ms
+	int			numframes, maxframes;
+	double		starttime;
+} replay;
+
+/*
+==================
+Replay file helpers
+
+Little endian, doubles included, so that the clocks come back bit for bit.
+==================
+*/
+static void Replay_WriteByte (int c)
+{
+	fputc (c & 0xff, replay.file);
+}
+
+static void Replay_WriteLong (int l)
+{
+	l = LittleLong (l);
+	fwrite (&l, 4, 1, replay.file);
+}
+
+static void Replay_WriteDouble (double d)
+{
+	byte	b[8], t;
+	int		i;
+
+	memcpy (b, &d, 8);
+	if (host_bigendian)
+		for (i = 0; i < 4; i++)
+		{
+			t = b[i];
+			b[i] = b[7-i];
+			b[7-i] = t;
+		}
+	fwrite (b, 8, 1, replay.file);
+}
+
+static void Replay_WriteString (const char *s)
+{
+	fwrite (s, strlen(s) + 1, 1, replay.file);
+}
+
+static int Replay_ReadByte (void)
+{
+	return fgetc (replay.file);
+}
+
+static int Replay_ReadLong (void)
+{
+	int l = 0;
+	if (fread (&l, 4, 1, replay.file) != 1)
+		return 0;
+	return LittleLong (l);
+}
+
+static double Replay_ReadDouble (void)
+{
+	byte	b[8], t;
+	double	d;
+	int		i;
+
+	if (fread (b, 8, 1, replay.file) != 1)
+		return 0;
+	if (host_bigendian)
+		for (i = 0; i < 4; i++)
+		{
+			t = b[i];
+			b[i] = b[7-i];
+			b[7-i] = t;
+		}
+	memcpy (&d, b, 8);
+	return d;
+}
+
+static void Replay_ReadString (char *out, size_t outsize)
+{
+	size_t	i = 0;
+	int		c;
+
+	while ((c = fgetc (replay.file)) != EOF && c)
+		if (i + 1 < outsize)
+			out[i++] = c;
+	out[i] = 0;
+}
+
+/*
+==================
+SV_Replay_Checksum
+
+fnv-1a over the parts of each edict that a divergence would show up in
+==================
+*/
+static unsigned int SV_Replay_Hash (unsigned int hash, const void *data, size_t len)
+{
+	const byte *b = (const byte *) data;
+	while (len--)
+		hash = (hash ^ *b++) * 16777619u;
+	return hash;
+}
+
+static unsigned int SV_Replay_Checksum (void)
+{
+	unsigned int	hash = 2166136261u;
+	edict_t			*ent;
+	int				i;
+
+	hash = SV_Replay_Hash (hash, &qcvm->time, sizeof(qcvm->time));
+	hash = SV_Replay_Hash (hash, &qcvm->num_edicts, sizeof(qcvm->num_edicts));
+	for (i = 0; i < qcvm->num_edicts; i++)
+	{
+		ent = EDICT_NUM(i);
+		hash = SV_Replay_Hash (hash, &ent->free, sizeof(ent->free));
+		if (ent->free)
+			continue;
+		hash = SV_Replay_Hash (hash, ent->v.origin, sizeof(ent->v.origin));
+		hash = SV_Replay_Hash (hash, ent->v.angles, sizeof(ent->v.angles));
+		hash = SV_Replay_Hash (hash, ent->v.velocity, sizeof(ent->v.velocity));
+		hash = SV_Replay_Hash (hash, &ent->v.frame, sizeof(ent->v.frame));
+		hash = SV_Replay_Hash (hash, &ent->v.modelindex, sizeof(ent->v.modelindex));
+		hash = SV_Replay_Hash (hash, &ent->v.health, sizeof(ent->v.health));
+		hash = SV_Replay_Hash (hash, &ent->v.nextthink, sizeof(ent->v.nextthink));
+	}
+	return hash;
+}
+
+/*
+==================
+SV_MenuPaused
+
+Single player stops while the console or a menu is up. A replay goes by
+whether it did when it was recorded, not by what's on screen now.
+==================
+*/
+qboolean SV_MenuPaused (void)
+{
+	if (replay.playing)
+		return replay.menupaused;
+	return svs.maxclients <= 1 && key_dest != key_game;
+}
+
+qboolean SV_Replay_Playing (void)
+{
+	return replay.playing;
+}
+
+/*
+==============================================================================
+
+RECORDING
+
+==============================================================================
+*/
+
+void SV_Replay_RecordConnect (int slot)
+{
+	qsocket_t *sock = svs.clients[slot].netconnection;
+
+	if (!replay.recording || !sock)
+		return;
+	Replay_WriteByte (RP_CONNECT);
+	Replay_WriteByte (slot);
+	Replay_WriteByte (sock->proquake_angle_hack);
+	Replay_WriteString (NET_QSocketGetTrueAddressString (sock));
+}
+
+void SV_Replay_RecordMessage (int slot)
+{
+	if (!replay.recording)
+		return;
+	Replay_WriteByte (RP_MESSAGE);
+	Replay_WriteByte (slot);
+	Replay_WriteByte (net_message.cursize & 0xff);
+	Replay_WriteByte (net_message.cursize >> 8);
+	fwrite (net_message.data, net_message.cursize, 1, replay.file);
+}
+
+void SV_Replay_RecordDrop (int slot)
+{
+	if (!replay.recording)
+		return;
+	Replay_WriteByte (RP_DROP);
+	Replay_WriteByte (slot);
+}
+
+void SV_Replay_ReadsDone (void)
+{
+	if (replay.recording)
+		Replay_WriteByte (RP_READDONE);
+}
+
+/*
+==============================================================================
+
+PLAYBACK
+
+==============================================================================
+*/
+
+static int SV_Replay_Compare (const void *a, const void *b)
+{
+	float fa = *(const float *)a, fb = *(const float *)b;
+	return (fa > fb) - (fa < fb);
+}
+
+/*
+==================
+SV_Replay_CSV
+==================
+*/
+static void SV_Replay_CSV (void)
+{
+	char	name[MAX_OSPATH];
+	FILE	*f;
+	int		i;
+
+	q_snprintf (name, sizeof(name), "%s/replay_%s.csv", com_gamedir, replay.name);
+	COM_CreatePath (name);
+	f = fopen (name, "w");
+	if (!f)
+	{
+		Con_Printf ("ERROR: couldn't open file %s.\n", name);
+		return;
+	}
+	fprintf (f, "frame,ms\n");
+	for (i = 0; i < replay.numframes; i++)
+		fprintf (f, "%i,%.3f\n", i, replay.frames[i]);
+	fclose (f);
+	Con_Printf ("Wrote %s\n", name);
+}
+
+/*
+==================
+SV_Replay_Report
+==================
+*/
+static void SV_Replay_Report (void)
+{
+	float	*sorted;
+	double	total;
+	int		i, n = replay.numframes;
+
+	Con_Printf ("replay %s: %i frames, %.1f game seconds in %.1f seconds\n", replay.name,
+				n, realtime - replay.realbase, Sys_DoubleTime () - replay.starttime);
+	if (n && (sorted = (float *) malloc (sizeof(*sorted) * n)))
+	{
+		memcpy (sorted, replay.frames, sizeof(*sorted) * n);
+		qsort (sorted, n, sizeof(*sorted), SV_Replay_Compare);
+		for (i = 0, total = 0; i < n; i++)
+			total += sorted[i];
+		Con_Printf ("server frame ms: avg %.3f min %.3f p50 %.3f p95 %.3f p99 %.3f max %.3f\n",
+					total / n, sorted[0], sorted[(n-1) * 50 / 100], sorted[(n-1) * 95 / 100],
+					sorted[(n-1) * 99 / 100], sorted[n-1]);
+		free (sorted);
+		if (replay_csv.value)
+			SV_Replay_CSV ();
+	}
+	if (replay.mismatches)
+		Con_Printf ("DIVERGED at frame %i, %i frames differ\n", replay.firstmismatch, replay.mismatches);
+	else
+		Con_Printf ("no divergence\n");
+}
+
+/*
+==================
+SV_Replay_Connect
+
+Gives a recorded client a loopback socket whose other end is only drained
+==================
+*/
+static void SV_Replay_Connect (int slot, int anglehack, const char *address)
+{
+	qsocket_t	*sock, *sink;
+	int			i, olddriver = net_driverlevel;
+
+	if (slot >= svs.maxclients || svs.clients[slot].active)
+		return;
+
+	for (i = 0; i < net_numdrivers; i++)
+		if (net_drivers[i].Init == Loop_Init)
+			break;
+	if (i == net_numdrivers)
+		return;
+	net_driverlevel = i;
+	sock = NET_NewQSocket ();
+	net_driverlevel = olddriver;
+	if (!sock)
+	{
+		Con_Printf ("SV_Replay_Connect: no qsocket available\n");
+		return;
+	}
+
+	sink = (qsocket_t *) calloc (1, sizeof(*sink));
+	if (!sink)
+		Sys_Error ("SV_Replay_Connect: out of memory");
+	sink->canSend = true;
+	sink->driverdata = sock;
+	sock->driverdata = sink;
+	sock->proquake_angle_hack = sink->proquake_angle_hack = anglehack;
+	q_strlcpy (sock->trueaddress, address, sizeof(sock->trueaddress));
+	q_strlcpy (sock->maskedaddress, address, sizeof(sock->maskedaddress));
+	replay.sinks[slot] = sink;
+
+	svs.clients[slot].netconnection = sock;
+	SV_ConnectClient (slot);
+}
+
+/*
+==================
+SV_Replay_Pump
+
+Applies the recorded events up to the stage marker. Returns false once the
+replay has stopped, whether it reached its end or was damaged.
+==================
+*/
+static void SV_Replay_Stop (qboolean report);
+
+static qboolean SV_Replay_Pump (int stage)
+{
+	char	address[NET_NAMELEN];
+	int		type, slot, anglehack, len;
+
+	while (1)
+	{
+		type = Replay_ReadByte ();
+		if (type == stage)
+			return true;
+		switch (type)
+		{
+		case RP_CONNECT:
+			slot = Replay_ReadByte ();
+			anglehack = Replay_ReadByte ();
+			Replay_ReadString (address, sizeof(address));
+			SV_Replay_Connect (slot, anglehack, address);
+			break;
+		case RP_MESSAGE:
+			slot = Replay_ReadByte ();
+			len = Replay_ReadByte ();
+			len |= Replay_ReadByte () << 8;
+			SZ_Clear (&net_message);
+			if (len > net_message.maxsize || fread (net_message.data, len, 1, replay.file) != 1)
+				goto broken;
+			net_message.cursize = len;
+			if (slot >= svs.maxclients || !replay.sinks[slot])
+				break;
+			host_client = &svs.clients[slot];
+			if (!host_client->active || host_client->netconnection != replay.sinks[slot]->driverdata)
+				break;
+			sv_player = host_client->edict;
+			if (!SV_ReadClientMessage ())
+				SV_DropClient (false);
+			break;
+		case RP_DROP:
+			slot = Replay_ReadByte ();
+			if (slot >= svs.maxclients || !replay.sinks[slot])
+				break;
+			host_client = &svs.clients[slot];
+			// drops the game decided on will already have happened
+			if (host_client->active && host_client->netconnection == replay.sinks[slot]->driverdata)
+				SV_DropClient (false);
+			break;
+		case RP_END:
+			if (stage != RP_FRAME)
+				goto broken;	// recordings only end between frames
+			SV_Replay_Stop (true);
+			return false;
+		default:
+			goto broken;
+		}
+	}
+
+broken:
+	Con_Printf ("replay %s is damaged or truncated\n", replay.name);
+	SV_Replay_Stop (true);
+	return false;
+}
+
+/*
+==================
+SV_Replay_RunClients
+
+Stands in for the network reads of SV_RunClients
+==================
+*/
+void SV_Replay_RunClients (void)
+{
+	SV_Replay_Pump (RP_READDONE);
+}
+
+/*
+==================
+SV_Replay_DrainSinks
+
+Nobody reads what the server sends to a virtual client, but the loopback
+driver needs it read to keep reliables flowing.
+==================
+*/
+static void SV_Replay_DrainSinks (void)
+{
+	int i;
+
+	for (i = 0; i < MAX_SCOREBOARD; i++)
+	{
+		if (!replay.sinks[i])
+			continue;
+		if (!replay.sinks[i]->driverdata)
+		{	// the server closed its end
+			free (replay.sinks[i]);
+			replay.sinks[i] = NULL;
+			continue;
+		}
+		while (Loop_GetMessage (replay.sinks[i]) > 0)
+			;
+	}
+	SZ_Clear (&net_message);
+}
+
+/*
+==============================================================================
+
+FRAMES
+
+==============================================================================
+*/
+
+/*
+==================
+SV_Replay_FrameBegin
+
+Called before each server frame. Playback sets the clocks from the recording.
+==================
+*/
+void SV_Replay_FrameBegin (void)
+{
+	if (replay.recording)
+	{
+		Replay_WriteByte (RP_FRAME);
+		Replay_WriteDouble (realtime - replay.realbase);
+		Replay_WriteDouble (host_frametime);
+		Replay_WriteByte (SV_MenuPaused ());
+	}
+	else if (replay.playing)
+	{
+		if (!SV_Replay_Pump (RP_FRAME))
+			return;
+		realtime = replay.realbase + Replay_ReadDouble ();
+		host_frametime = Replay_ReadDouble ();
+		replay.menupaused = Replay_ReadByte ();
+	}
+	replay.framestart = Sys_DoubleTime ();
+}
+
+/*
+==================
+SV_Replay_FrameEnd
+==================
+*/
+void SV_Replay_FrameEnd (void)
+{
+	float			ms = (Sys_DoubleTime () - replay.framestart) * 1000;
+	unsigned int	checksum;
+
+	if (replay.recording)
+	{
+		Replay_WriteByte (RP_CHECKSUM);
+		Replay_WriteLong (SV_Replay_Checksum ());
+	}
+	else if (replay.playing)
+	{
+		if (!SV_Replay_Pump (RP_CHECKSUM))
+			return;
+		checksum = (unsigned int) Replay_ReadLong ();
+		if (checksum != SV_Replay_Checksum ())
+		{
+			if (!replay.mismatches++)
+			{
+				replay.firstmismatch = replay.frame;
+				Con_Printf ("replay %s diverged at frame %i\n", replay.name, replay.frame);
+			}
+		}
+		SV_Replay_DrainSinks ();
+
+		if (replay.numframes == replay.maxframes)
+		{
+			replay.maxframes = replay.maxframes ? replay.maxframes * 2 : 4096;
+			replay.frames = (float *) realloc (replay.frames, sizeof(*replay.frames) * replay.maxframes);
+			if (!replay.frames)
+				Sys_Error ("SV_Replay_FrameEnd: out of memory");
+		}
+		replay.frames[replay.numframes++] = ms;
+		replay.frame++;
+	}
+}
+
+/*
+==================
+SV_Replay_Stop
+
+Ends a recording, or a replay along with its virtual clients
+==================
+*/
+static void SV_Replay_Stop (qboolean report)
+{
+	client_t	*oldclient = host_client;
+	qcvm_t		*oldvm = qcvm;
+	int			i;
+
+	if (replay.recording)
+	{
+		Replay_WriteByte (RP_END);
+		Con_Printf ("Completed replay %s\n", replay.name);
+	}
+	if (replay.playing)
+	{
+		replay.playing = false;
+		if (report)
+			SV_Replay_Report ();
+		// nobody is going to send anything more for them
+		if (sv.active)
+		{
+			PR_SwitchQCVM (NULL);
+			PR_SwitchQCVM (&sv.qcvm);
+			for (i = 0, host_client = svs.clients; i < svs.maxclients; i++, host_client++)
+				if (host_client->active && replay.sinks[i] && host_client->netconnection == replay.sinks[i]->driverdata)
+					SV_DropClient (false);
+			PR_SwitchQCVM (NULL);
+			PR_SwitchQCVM (oldvm);
+		}
+		host_client = oldclient;
+		SV_Replay_DrainSinks ();
+		for (i = 0; i < MAX_SCOREBOARD; i++)
+			if (replay.sinks[i])
+			{	// the server didn't close them
+				replay.sinks[i]->driverdata = NULL;
+				free (replay.sinks[i]);
+				replay.sinks[i] = NULL;
+			}
+		free (replay.frames);
+		replay.frames = NULL;
+		replay.numframes = replay.maxframes = 0;
+	}
+	if (replay.file)
+		fclose (replay.file);
+	replay.file = NULL;
+	replay.recording = false;
+}
+
+/*
+==================
+SV_Replay_Shutdown
+
+The server is going away
+==================
+*/
+void SV_Replay_Shutdown (void)
+{
+	SV_Replay_Stop (true);
+}
+
+/*
+==============================================================================
+
+COMMANDS
+
+==============================================================================
+*/
+
+/*
+==================
+SV_ReplayRecord_f
+
+replay_record <name> <map>
+==================
+*/
+static void SV_ReplayRecord_f (void)
+{
+	char			name[MAX_OSPATH];
+	unsigned int	seed;
+	size_t			i;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (Cmd_Argc() != 3)
+	{
+		Con_Printf ("replay_record <name> <map> : start a map, recording everything clients send\n");
+		return;
+	}
+	if (strstr(Cmd_Argv(1), ".."))
+	{
+		Con_Printf ("Relative pathnames are not allowed.\n");
+		return;
+	}
+
+	// the seed has to be in place before the map spawns its entities
+	seed = (unsigned int) (Sys_DoubleTime () * 1000) ^ (unsigned int) rand ();
+	SV_SeedRandom (seed);
+	Cmd_ExecuteString (va("map \"%s\"", Cmd_Argv(2)), src_command);
+	if (!sv.active)
+		return;
+
+	q_strlcpy (replay.name, Cmd_Argv(1), sizeof(replay.name));
+	COM_StripExtension (replay.name, replay.name, sizeof(replay.name));
+	q_snprintf (name, sizeof(name), "%s/%s.rpl", com_gamedir, replay.name);
+	COM_CreatePath (name);
+	replay.file = fopen (name, "wb");
+	if (!replay.file)
+	{
+		Con_Printf ("ERROR: couldn't create %s\n", name);
+		return;
+	}
+
+	fwrite ("QSRP", 4, 1, replay.file);
+	Replay_WriteLong (REPLAY_VERSION);
+	Replay_WriteLong (seed);
+	Replay_WriteLong (svs.maxclients);
+	Replay_WriteString (Cmd_Argv(2));
+	Replay_WriteLong (countof(replay_cvars));
+	for (i = 0; i < countof(replay_cvars); i++)
+	{
+		Replay_WriteString (replay_cvars[i]);
+		Replay_WriteString (Cvar_VariableString (replay_cvars[i]));
+	}
+
+	replay.recording = true;
+	replay.realbase = realtime;
+	Con_Printf ("recording replay %s\n", name);
+}
+
+/*
+==================
+SV_ReplayPlay_f
+
+replay_play <name>
+==================
+*/
+static void SV_ReplayPlay_f (void)
+{
+	char			name[MAX_OSPATH], map[MAX_QPATH];
+	char			cvar[64], value[256];
+	byte			magic[4];
+	unsigned int	seed;
+	int				i, n, maxclients;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (Cmd_Argc() != 2)
+	{
+		Con_Printf ("replay_play <name> : rerun a recorded game, headless, and time it\n");
+		return;
+	}
+	if (strstr(Cmd_Argv(1), ".."))
+	{
+		Con_Printf ("Relative pathnames are not allowed.\n");
+		return;
+	}
+
+	CL_Disconnect ();
+	Host_ShutdownServer (false);
+
+	q_strlcpy (replay.name, Cmd_Argv(1), sizeof(replay.name));
+	COM_StripExtension (replay.name, replay.name, sizeof(replay.name));
+	q_snprintf (name, sizeof(name), "%s/%s.rpl", com_gamedir, replay.name);
+	replay.file = fopen (name, "rb");
+	if (!replay.file)
+	{
+		Con_Printf ("ERROR: couldn't open %s\n", name);
+		return;
+	}
+	if (fread (magic, 4, 1, replay.file) != 1 || memcmp (magic, "QSRP", 4) || Replay_ReadLong () != REPLAY_VERSION)
+	{
+		Con_Printf ("%s is not a replay this engine understands\n", name);
+		SV_Replay_Stop (false);
+		return;
+	}
+	seed = Replay_ReadLong ();
+	maxclients = Replay_ReadLong ();
+	Replay_ReadString (map, sizeof(map));
+
+	// maxplayers resets deathmatch, so it goes before the cvars
+	Cmd_ExecuteString (va("maxplayers %i", maxclients), src_command);
+	if (svs.maxclients != maxclients)
+	{
+		Con_Printf ("replay needs maxplayers %i\n", maxclients);
+		SV_Replay_Stop (false);
+		return;
+	}
+
+	n = Replay_ReadLong ();
+	for (i = 0; i < n; i++)
+	{
+		Replay_ReadString (cvar, sizeof(cvar));
+		Replay_ReadString (value, sizeof(value));
+		if (Cvar_FindVar (cvar))
+			Cvar_Set (cvar, value);
+	}
+	if (feof (replay.file))
+	{
+		Con_Printf ("%s is truncated\n", name);
+		SV_Replay_Stop (false);
+		return;
+	}
+
+	// the same as the map command, except that there's no local client
+	key_dest = key_game;
+	svs.serverflags = 0;
+	SV_SeedRandom (seed);
+	PR_SwitchQCVM (&sv.qcvm);
+	SV_SpawnServer (map);
+	PR_SwitchQCVM (NULL);
+	if (!sv.active)
+	{
+		SV_Replay_Stop (false);
+		return;
+	}
+
+	replay.playing = true;
+	replay.realbase = realtime;
+	replay.starttime = Sys_DoubleTime ();
+	replay.frame = replay.mismatches = replay.firstmismatch = 0;
+	Con_Printf ("playing replay %s\n", name);
+}
+
+/*
+==================
+SV_ReplayStop_f
+==================
+*/
+static void SV_ReplayStop_f (void)
+{
+	if (cmd_source != src_command)
+		return;
+	if (!replay.file)
+	{
+		Con_Printf ("Not recording or playing a replay.\n");
+		return;
+	}
+	SV_Replay_Stop (true);
+}
+
+/*
+==================
+SV_Replay_Init
+==================
+*/
+void SV_Replay_Init (void)
+{
+	Cvar_RegisterVariable (&replay_csv);
+	Cmd_AddCommand ("replay_record", SV_ReplayRecord_f);
+	Cmd_AddCommand ("replay_play", SV_ReplayPlay_f);
+	Cmd_AddCommand ("replay_stop", SV_ReplayStop_f);
+}
@@ -29,16 +29,7 @@ extern	cvar_t	sv_friction;
 cvar_t	sv_edgefriction = {"edgefriction", "2", CVAR_NONE};
 extern	cvar_t	sv_stopspeed;
 
-static	vec3_t		forward, right, up;
-
-// world
-float	*angles;
-float	*origin;
-float	*velocity;
-
-qboolean	onground;
-
-usercmd_t	cmd;
+extern	cvar_t	sv_gravity;
 
 cvar_t	sv_idealpitchscale = {"sv_idealpitchscale","0.8",CVAR_NONE};
 cvar_t	sv_altnoclip = {"sv_altnoclip","1",CVAR_ARCHIVE}; //johnfitz
@@ -114,13 +105,26 @@ void SV_SetIdealPitch (void)
 }
 
 
+/*
+===============================================================================
+
+PLAYER MOVEMENT
+
+Shared by SV_ClientThink and the client's movement prediction, so everything
+comes from the pmove_t instead of edicts and server cvars. The server still
+runs its own SV_WalkMove for the authoritative collision; PM_PlayerMove is a
+port of it for the client, which can only see bsp models.
+
+===============================================================================
+*/
+
 /*
 ==================
-SV_UserFriction
+PM_UserFriction
 
 ==================
 */
-void SV_UserFriction (void)
+static void PM_UserFriction (pmove_t *pm)
 {
 	float	*vel;
 	float	speed, newspeed, control;
@@ -128,28 +132,28 @@ void SV_UserFriction (void)
 	float	friction;
 	trace_t	trace;
 
-	vel = velocity;
+	vel = pm->velocity;
 
 	speed = sqrt(vel[0]*vel[0] +vel[1]*vel[1]);
 	if (!speed)
 		return;
 
 // if the leading edge is over a dropoff, increase friction
-	start[0] = stop[0] = origin[0] + vel[0]/speed*16;
-	start[1] = stop[1] = origin[1] + vel[1]/speed*16;
-	start[2] = origin[2] + sv_player->v.mins[2];
+	start[0] = stop[0] = pm->origin[0] + vel[0]/speed*16;
+	start[1] = stop[1] = pm->origin[1] + vel[1]/speed*16;
+	start[2] = pm->origin[2] + pm->mins[2];
 	stop[2] = start[2] - 34;
 
-	trace = SV_Move (start, vec3_origin, vec3_origin, stop, true, sv_player);
+	trace = pm->trace (pm, start, vec3_origin, vec3_origin, stop);
 
 	if (trace.fraction == 1.0)
-		friction = sv_friction.value*sv_edgefriction.value;
+		friction = pm->vars->friction*pm->vars->edgefriction;
 	else
-		friction = sv_friction.value;
+		friction = pm->vars->friction;
 
 // apply friction
-	control = speed < sv_stopspeed.value ? sv_stopspeed.value : speed;
-	newspeed = speed - host_frametime*control*friction;
+	control = speed < pm->vars->stopspeed ? pm->vars->stopspeed : speed;
+	newspeed = speed - pm->frametime*control*friction;
 
 	if (newspeed < 0)
 		newspeed = 0;
@@ -162,29 +166,29 @@ void SV_UserFriction (void)
 
 /*
 ==============
-SV_Accelerate
+PM_Accelerate
 ==============
 */
 cvar_t	sv_maxspeed = {"sv_maxspeed", "320", CVAR_NOTIFY|CVAR_SERVERINFO};
 cvar_t	sv_accelerate = {"sv_accelerate", "10", CVAR_NONE};
-void SV_Accelerate (float wishspeed, const vec3_t wishdir)
+static void PM_Accelerate (pmove_t *pm, float wishspeed, const vec3_t wishdir)
 {
 	int			i;
 	float		addspeed, accelspeed, currentspeed;
 
-	currentspeed = DotProduct (velocity, wishdir);
+	currentspeed = DotProduct (pm->velocity, wishdir);
 	addspeed = wishspeed - currentspeed;
 	if (addspeed <= 0)
 		return;
-	accelspeed = sv_accelerate.value*host_frametime*wishspeed;
+	accelspeed = pm->vars->accelerate*pm->frametime*wishspeed;
 	if (accelspeed > addspeed)
 		accelspeed = addspeed;
 
 	for (i=0 ; i<3 ; i++)
-		velocity[i] += accelspeed*wishdir[i];
+		pm->velocity[i] += accelspeed*wishdir[i];
 }
 
-void SV_AirAccelerate (float wishspeed, vec3_t wishveloc)
+static void PM_AirAccelerate (pmove_t *pm, float wishspeed, vec3_t wishveloc)
 {
 	int			i;
 	float		addspeed, wishspd, accelspeed, currentspeed;
@@ -192,82 +196,70 @@ void SV_AirAccelerate (float wishspeed, vec3_t wishveloc)
 	wishspd = VectorNormalize (wishveloc);
 	if (wishspd > 30)
 		wishspd = 30;
-	currentspeed = DotProduct (velocity, wishveloc);
+	currentspeed = DotProduct (pm->velocity, wishveloc);
 	addspeed = wishspd - currentspeed;
 	if (addspeed <= 0)
 		return;
 //	accelspeed = sv_accelerate.value * host_frametime;
-	accelspeed = sv_accelerate.value*wishspeed * host_frametime;
+	accelspeed = pm->vars->accelerate*wishspeed * pm->frametime;
 	if (accelspeed > addspeed)
 		accelspeed = addspeed;
 
 	for (i=0 ; i<3 ; i++)
-		velocity[i] += accelspeed*wishveloc[i];
-}
-
-
-void DropPunchAngle (void)
-{
-	float	len;
-
-	len = VectorNormalize (sv_player->v.punchangle);
-
-	len -= 10*host_frametime;
-	if (len < 0)
-		len = 0;
-	VectorScale (sv_player->v.punchangle, len, sv_player->v.punchangle);
+		pm->velocity[i] += accelspeed*wishveloc[i];
 }
 
 /*
 ===================
-SV_WaterMove
+PM_WaterMove
 
 ===================
 */
-void SV_WaterMove (void)
+static void PM_WaterMove (pmove_t *pm)
 {
 	int		i;
+	vec3_t	forward, right, up;
 	vec3_t	wishvel;
 	float	speed, newspeed, wishspeed, addspeed, accelspeed;
 
 //
 // user intentions
 //
-	AngleVectors (sv_player->v.v_angle, forward, right, up);
+	AngleVectors (pm->v_angle, forward, right, up);
 
 	for (i=0 ; i<3 ; i++)
-		wishvel[i] = forward[i]*cmd.forwardmove + right[i]*cmd.sidemove;
+		wishvel[i] = forward[i]*pm->cmd.forwardmove + right[i]*pm->cmd.sidemove;
 
-	if (sv_player->onladder)
+	if (pm->onladder)
 	{
 		wishvel[2] *= 1+fabs(wishvel[2]/200)*9;	//exaggerate vertical movement.
-		if (sv_player->v.button2)
+		if (pm->cmd.buttons & 2)
 			wishvel[2] += 400; //make jump climb (you can turn around and move off to fall)
 	}
 
-	if (!cmd.forwardmove && !cmd.sidemove && !cmd.upmove && !sv_player->onladder)
+	if (!pm->cmd.forwardmove && !pm->cmd.sidemove && !pm->cmd.upmove && !pm->onladder)
 		wishvel[2] -= 60;		// drift towards bottom
 	else
-		wishvel[2] += cmd.upmove;
+		wishvel[2] += pm->cmd.upmove;
 
 	wishspeed = VectorLength(wishvel);
-	if (wishspeed > sv_maxspeed.value)
+	if (wishspeed > pm->vars->maxspeed)
 	{
-		VectorScale (wishvel, sv_maxspeed.value/wishspeed, wishvel);
-		wishspeed = sv_maxspeed.value;
+		VectorScale (wishvel, pm->vars->maxspeed/wishspeed, wishvel);
+		wishspeed = pm->vars->maxspeed;
 	}
 	wishspeed *= 0.7;
 
 //
 // water friction
 //
-	speed = VectorLength (velocity);
+	speed = VectorLength (pm->velocity);
 	if (speed)
 	{
-		newspeed = speed - host_frametime * speed * sv_friction.value;
+		newspeed = speed - pm->frametime * speed * pm->vars->friction;
 		if (newspeed < 0)
 			newspeed = 0;
-		VectorScale (velocity, newspeed/speed, velocity);
+		VectorScale (pm->velocity, newspeed/speed, pm->velocity);
 	}
 	else
 		newspeed = 0;
@@ -283,99 +275,524 @@ void SV_WaterMove (void)
 		return;
 
 	VectorNormalize (wishvel);
-	accelspeed = sv_accelerate.value * wishspeed * host_frametime;
+	accelspeed = pm->vars->accelerate * wishspeed * pm->frametime;
 	if (accelspeed > addspeed)
 		accelspeed = addspeed;
 
 	for (i=0 ; i<3 ; i++)
-		velocity[i] += accelspeed * wishvel[i];
-}
-
-void SV_WaterJump (void)
-{
-	if (qcvm->time > sv_player->v.teleport_time
-	|| !sv_player->v.waterlevel)
-	{
-		sv_player->v.flags = (int)sv_player->v.flags & ~FL_WATERJUMP;
-		sv_player->v.teleport_time = 0;
-	}
-	sv_player->v.velocity[0] = sv_player->v.movedir[0];
-	sv_player->v.velocity[1] = sv_player->v.movedir[1];
+		pm->velocity[i] += accelspeed * wishvel[i];
 }
 
 /*
 ===================
-SV_NoclipMove -- johnfitz
+PM_NoclipMove -- johnfitz
 
-new, alternate noclip. old noclip is still handled in SV_AirMove
+new, alternate noclip. old noclip is still handled in PM_AirMove
 ===================
 */
-void SV_NoclipMove (void)
+static void PM_NoclipMove (pmove_t *pm)
 {
-	AngleVectors (sv_player->v.v_angle, forward, right, up);
+	vec3_t	forward, right, up;
+	float	*velocity = pm->velocity;
 
-	velocity[0] = forward[0]*cmd.forwardmove + right[0]*cmd.sidemove;
-	velocity[1] = forward[1]*cmd.forwardmove + right[1]*cmd.sidemove;
-	velocity[2] = forward[2]*cmd.forwardmove + right[2]*cmd.sidemove;
-	velocity[2] += cmd.upmove*2; //doubled to match running speed
+	AngleVectors (pm->v_angle, forward, right, up);
 
-	if (VectorLength (velocity) > sv_maxspeed.value)
+	velocity[0] = forward[0]*pm->cmd.forwardmove + right[0]*pm->cmd.sidemove;
+	velocity[1] = forward[1]*pm->cmd.forwardmove + right[1]*pm->cmd.sidemove;
+	velocity[2] = forward[2]*pm->cmd.forwardmove + right[2]*pm->cmd.sidemove;
+	velocity[2] += pm->cmd.upmove*2; //doubled to match running speed
+
+	if (VectorLength (velocity) > pm->vars->maxspeed)
 	{
 		VectorNormalize (velocity);
-		VectorScale (velocity, sv_maxspeed.value, velocity);
+		VectorScale (velocity, pm->vars->maxspeed, velocity);
 	}
 }
 
 /*
 ===================
-SV_AirMove
+PM_AirMove
 ===================
 */
-void SV_AirMove (void)
+static void PM_AirMove (pmove_t *pm)
 {
 	int			i;
+	vec3_t		forward, right, up;
 	vec3_t		wishvel, wishdir;
 	float		wishspeed;
 	float		fmove, smove;
 
-	AngleVectors (sv_player->v.angles, forward, right, up);
+	AngleVectors (pm->angles, forward, right, up);
 
-	fmove = cmd.forwardmove;
-	smove = cmd.sidemove;
+	fmove = pm->cmd.forwardmove;
+	smove = pm->cmd.sidemove;
 
 // hack to not let you back into teleporter
-	if (qcvm->time < sv_player->v.teleport_time && fmove < 0)
+	if (pm->noretreat && fmove < 0)
 		fmove = 0;
 
 	for (i=0 ; i<3 ; i++)
 		wishvel[i] = forward[i]*fmove + right[i]*smove;
 
-	if ( (int)sv_player->v.movetype != MOVETYPE_WALK)
-		wishvel[2] = cmd.upmove;
+	if (pm->movetype != MOVETYPE_WALK)
+		wishvel[2] = pm->cmd.upmove;
 	else
 		wishvel[2] = 0;
 
 	VectorCopy (wishvel, wishdir);
 	wishspeed = VectorNormalize(wishdir);
-	if (wishspeed > sv_maxspeed.value)
+	if (wishspeed > pm->vars->maxspeed)
 	{
-		VectorScale (wishvel, sv_maxspeed.value/wishspeed, wishvel);
-		wishspeed = sv_maxspeed.value;
+		VectorScale (wishvel, pm->vars->maxspeed/wishspeed, wishvel);
+		wishspeed = pm->vars->maxspeed;
 	}
 
-	if ( sv_player->v.movetype == MOVETYPE_NOCLIP)
+	if (pm->movetype == MOVETYPE_NOCLIP)
 	{	// noclip
-		VectorCopy (wishvel, velocity);
+		VectorCopy (wishvel, pm->velocity);
 	}
-	else if ( onground )
+	else if (pm->onground)
 	{
-		SV_UserFriction ();
-		SV_Accelerate (wishspeed, wishdir);
+		PM_UserFriction (pm);
+		PM_Accelerate (pm, wishspeed, wishdir);
 	}
 	else
 	{	// not on ground, so little effect on velocity
-		SV_AirAccelerate (wishspeed, wishvel);
+		PM_AirAccelerate (pm, wishspeed, wishvel);
+	}
+}
+
+/*
+===================
+PM_PlayerInput
+
+Turns the player's intended movement into velocity, like vanilla's
+SV_ClientThink always has.
+===================
+*/
+void PM_PlayerInput (pmove_t *pm)
+{
+	//johnfitz -- alternate noclip
+	if (pm->movetype == MOVETYPE_NOCLIP && pm->altnoclip)
+		PM_NoclipMove (pm);
+	else if ((pm->waterlevel >= 2||pm->onladder) && pm->movetype != MOVETYPE_NOCLIP)
+		PM_WaterMove (pm);
+	else
+		PM_AirMove (pm);
+	//johnfitz
+}
+
+/*
+============
+PM_FlyMove
+
+SV_FlyMove for a pmove_t. Anything the trace hits counts as solid bsp.
+============
+*/
+#define	MAX_CLIP_PLANES	5
+static int PM_FlyMove (pmove_t *pm, float time, trace_t *steptrace)
+{
+	int			bumpcount, numbumps;
+	vec3_t		dir;
+	float		d;
+	int			numplanes;
+	vec3_t		planes[MAX_CLIP_PLANES];
+	vec3_t		primal_velocity, original_velocity, new_velocity;
+	int			i, j;
+	trace_t		trace;
+	vec3_t		end;
+	float		time_left;
+	int			blocked;
+
+	numbumps = 4;
+
+	blocked = 0;
+	VectorCopy (pm->velocity, original_velocity);
+	VectorCopy (pm->velocity, primal_velocity);
+	numplanes = 0;
+
+	time_left = time;
+
+	for (bumpcount=0 ; bumpcount<numbumps ; bumpcount++)
+	{
+		if (!pm->velocity[0] && !pm->velocity[1] && !pm->velocity[2])
+			break;
+
+		for (i=0 ; i<3 ; i++)
+			end[i] = pm->origin[i] + time_left * pm->velocity[i];
+
+		trace = pm->trace (pm, pm->origin, pm->mins, pm->maxs, end);
+
+		if (trace.allsolid)
+		{	// entity is trapped in another solid
+			VectorCopy (vec3_origin, pm->velocity);
+			return 3;
+		}
+
+		if (trace.fraction > 0)
+		{	// actually covered some distance
+			VectorCopy (trace.endpos, pm->origin);
+			VectorCopy (pm->velocity, original_velocity);
+			numplanes = 0;
+		}
+
+		if (trace.fraction == 1)
+			 break;		// moved the entire distance
+
+		if (trace.plane.normal[2] > 0.7)
+		{
+			blocked |= 1;		// floor
+			pm->onground = true;
+		}
+		if (!trace.plane.normal[2])
+		{
+			blocked |= 2;		// step
+			if (steptrace)
+				*steptrace = trace;	// save for player extrafriction
+		}
+
+		time_left -= time_left * trace.fraction;
+
+	// cliped to another plane
+		if (numplanes >= MAX_CLIP_PLANES)
+		{	// this shouldn't really happen
+			VectorCopy (vec3_origin, pm->velocity);
+			return 3;
+		}
+
+		VectorCopy (trace.plane.normal, planes[numplanes]);
+		numplanes++;
+
+//
+// modify original_velocity so it parallels all of the clip planes
+//
+		for (i=0 ; i<numplanes ; i++)
+		{
+			ClipVelocity (original_velocity, planes[i], new_velocity, 1);
+			for (j=0 ; j<numplanes ; j++)
+				if (j != i)
+				{
+					if (DotProduct (new_velocity, planes[j]) < 0)
+						break;	// not ok
+				}
+			if (j == numplanes)
+				break;
+		}
+
+		if (i != numplanes)
+		{	// go along this plane
+			VectorCopy (new_velocity, pm->velocity);
+		}
+		else
+		{	// go along the crease
+			if (numplanes != 2)
+			{
+				VectorCopy (vec3_origin, pm->velocity);
+				return 7;
+			}
+			CrossProduct (planes[0], planes[1], dir);
+			d = DotProduct (dir, pm->velocity);
+			VectorScale (dir, d, pm->velocity);
+		}
+
+//
+// if original velocity is against the original velocity, stop dead
+// to avoid tiny occilations in sloping corners
+//
+		if (DotProduct (pm->velocity, primal_velocity) <= 0)
+		{
+			VectorCopy (vec3_origin, pm->velocity);
+			return blocked;
+		}
+	}
+
+	return blocked;
+}
+
+static trace_t PM_PushEntity (pmove_t *pm, vec3_t push)
+{
+	trace_t	trace;
+	vec3_t	end;
+
+	VectorAdd (pm->origin, push, end);
+	trace = pm->trace (pm, pm->origin, pm->mins, pm->maxs, end);
+	VectorCopy (trace.endpos, pm->origin);
+	return trace;
+}
+
+static void PM_WallFriction (pmove_t *pm, trace_t *trace)
+{
+	vec3_t		forward, right, up;
+	float		d, i;
+	vec3_t		into, side;
+
+	AngleVectors (pm->v_angle, forward, right, up);
+	d = DotProduct (trace->plane.normal, forward);
+
+	d += 0.5;
+	if (d >= 0)
+		return;
+
+// cut the tangential velocity
+	i = DotProduct (trace->plane.normal, pm->velocity);
+	VectorScale (trace->plane.normal, i, into);
+	VectorSubtract (pm->velocity, into, side);
+
+	pm->velocity[0] = side[0] * (1 + d);
+	pm->velocity[1] = side[1] * (1 + d);
+}
+
+static int PM_TryUnstick (pmove_t *pm, vec3_t oldvel)
+{
+	static const float nudges[8][2] = {{2,0},{0,2},{-2,0},{0,-2},{2,2},{-2,2},{2,-2},{-2,-2}};
+	int		i;
+	vec3_t	oldorg;
+	vec3_t	dir;
+	int		clip;
+	trace_t	steptrace;
+
+	VectorCopy (pm->origin, oldorg);
+	for (i=0 ; i<8 ; i++)
+	{
+// try pushing a little in an axial direction
+		dir[0] = nudges[i][0];
+		dir[1] = nudges[i][1];
+		dir[2] = 0;
+		PM_PushEntity (pm, dir);
+
+// retry the original move
+		pm->velocity[0] = oldvel[0];
+		pm->velocity[1] = oldvel[1];
+		pm->velocity[2] = 0;
+		clip = PM_FlyMove (pm, 0.1, &steptrace);
+
+		if ( fabs(oldorg[1] - pm->origin[1]) > 4
+		|| fabs(oldorg[0] - pm->origin[0]) > 4 )
+			return clip;
+
+// go back to the original pos and try again
+		VectorCopy (oldorg, pm->origin);
 	}
+
+	VectorCopy (vec3_origin, pm->velocity);
+	return 7;		// still not moving
+}
+
+/*
+=====================
+PM_WalkMove
+
+SV_WalkMove for a pmove_t.
+======================
+*/
+static void PM_WalkMove (pmove_t *pm)
+{
+	vec3_t		upmove, downmove;
+	vec3_t		oldorg, oldvel;
+	vec3_t		nosteporg, nostepvel;
+	int			clip;
+	qboolean	oldonground;
+	trace_t		steptrace, downtrace;
+
+//
+// do a regular slide move unless it looks like you ran into a step
+//
+	oldonground = pm->onground;
+	pm->onground = false;
+
+	VectorCopy (pm->origin, oldorg);
+	VectorCopy (pm->velocity, oldvel);
+
+	clip = PM_FlyMove (pm, pm->frametime, &steptrace);
+
+	if ( !(clip & 2) )
+		return;		// move didn't block on a step
+
+	if (!oldonground && pm->waterlevel == 0)
+		return;		// don't stair up while jumping
+
+	VectorCopy (pm->origin, nosteporg);
+	VectorCopy (pm->velocity, nostepvel);
+
+//
+// try moving up and forward to go up a step
+//
+	VectorCopy (oldorg, pm->origin);	// back to start pos
+
+	VectorCopy (vec3_origin, upmove);
+	VectorCopy (vec3_origin, downmove);
+	upmove[2] = pm->vars->stepheight;
+	downmove[2] = -pm->vars->stepheight + oldvel[2]*pm->frametime;
+
+// move up
+	PM_PushEntity (pm, upmove);
+
+// move forward
+	pm->velocity[0] = oldvel[0];
+	pm->velocity[1] = oldvel[1];
+	pm->velocity[2] = 0;
+	clip = PM_FlyMove (pm, pm->frametime, &steptrace);
+
+// check for stuckness, possibly due to the limited precision of floats
+// in the clipping hulls
+	if (clip)
+	{
+		if ( fabs(oldorg[1] - pm->origin[1]) < 0.03125
+		&& fabs(oldorg[0] - pm->origin[0]) < 0.03125 )
+		{	// stepping up didn't make any progress
+			clip = PM_TryUnstick (pm, oldvel);
+		}
+	}
+
+// extra friction based on view angle
+	if ( clip & 2 )
+		PM_WallFriction (pm, &steptrace);
+
+// move down
+	downtrace = PM_PushEntity (pm, downmove);
+
+	if (downtrace.plane.normal[2] > 0.7)
+		pm->onground = true;
+	else
+	{
+// if the push down didn't end up on good ground, use the move without
+// the step up.  This happens near wall / slope combinations, and can
+// cause the player to hop up higher on a slope too steep to climb
+		VectorCopy (nosteporg, pm->origin);
+		VectorCopy (nostepvel, pm->velocity);
+	}
+}
+
+/*
+=============
+PM_CheckWater
+
+SV_CheckWater without the ladder support.
+=============
+*/
+static qboolean PM_CheckWater (pmove_t *pm)
+{
+	vec3_t	point;
+
+	point[0] = pm->origin[0];
+	point[1] = pm->origin[1];
+	point[2] = pm->origin[2] + pm->mins[2] + 1;
+
+	pm->waterlevel = 0;
+	if (pm->pointcontents (pm, point) <= CONTENTS_WATER)
+	{
+		pm->waterlevel = 1;
+		point[2] = pm->origin[2] + (pm->mins[2] + pm->maxs[2])*0.5;
+		if (pm->pointcontents (pm, point) <= CONTENTS_WATER)
+		{
+			pm->waterlevel = 2;
+			point[2] = pm->origin[2] + pm->viewheight;
+			if (pm->pointcontents (pm, point) <= CONTENTS_WATER)
+				pm->waterlevel = 3;
+		}
+	}
+	return pm->waterlevel > 1;
+}
+
+/*
+=============
+PM_PlayerMove
+
+Runs one input frame of a player using the stock rules: SV_ClientThink,
+the default qc's PlayerPreThink jumping, then SV_Physics_Client.
+=============
+*/
+void PM_PlayerMove (pmove_t *pm)
+{
+	if (pm->movetype == MOVETYPE_NONE)
+		return;
+
+	if (!pm->dead)
+		PM_PlayerInput (pm);
+
+	//this is what the default qc does for jumping
+	if (!(pm->cmd.buttons & 2))
+		pm->jumpreleased = true;
+	else if (pm->movetype == MOVETYPE_WALK && !pm->dead)
+	{
+		if (pm->waterlevel >= 2)
+			pm->velocity[2] = 100;	//swimming up, assumes water rather than slime/lava
+		else if (pm->onground && pm->jumpreleased)
+		{
+			pm->jumpreleased = false;
+			pm->onground = false;
+			pm->velocity[2] += pm->vars->jumpvelocity;
+		}
+	}
+
+	switch (pm->movetype)
+	{
+	case MOVETYPE_WALK:
+		if (!PM_CheckWater (pm))
+			pm->velocity[2] -= pm->vars->entgravity * pm->vars->gravity * pm->frametime;
+		PM_WalkMove (pm);
+		break;
+	case MOVETYPE_FLY:
+		PM_FlyMove (pm, pm->frametime, NULL);
+		break;
+	case MOVETYPE_NOCLIP:
+		VectorMA (pm->origin, pm->frametime, pm->velocity, pm->origin);
+		break;
+	}
+}
+
+//============================================================================
+
+void DropPunchAngle (void)
+{
+	float	len;
+
+	len = VectorNormalize (sv_player->v.punchangle);
+
+	len -= 10*host_frametime;
+	if (len < 0)
+		len = 0;
+	VectorScale (sv_player->v.punchangle, len, sv_player->v.punchangle);
+}
+
+void SV_WaterJump (void)
+{
+	if (qcvm->time > sv_player->v.teleport_time
+	|| !sv_player->v.waterlevel)
+	{
+		sv_player->v.flags = (int)sv_player->v.flags & ~FL_WATERJUMP;
+		sv_player->v.teleport_time = 0;
+	}
+	sv_player->v.velocity[0] = sv_player->v.movedir[0];
+	sv_player->v.velocity[1] = sv_player->v.movedir[1];
+}
+
+static trace_t SV_PM_Trace (pmove_t *pm, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end)
+{
+	return SV_Move (start, mins, maxs, end, MOVE_NOMONSTERS, pm->ctx);
+}
+
+/*
+===================
+SV_MoveVars
+
+The server's movement rules, also sent to predinfo clients as stats.
+===================
+*/
+void SV_MoveVars (edict_t *ent, movevars_t *vars)
+{
+	eval_t	*val;
+
+	vars->gravity = sv_gravity.value;
+	val = GetEdictFieldValue(ent, qcvm->extfields.gravity);
+	vars->entgravity = (val && val->_float)?val->_float:1.0;
+	vars->friction = sv_friction.value;
+	vars->edgefriction = sv_edgefriction.value;
+	vars->stopspeed = sv_stopspeed.value;
+	vars->maxspeed = sv_maxspeed.value;
+	vars->accelerate = sv_accelerate.value;
+	vars->jumpvelocity = 270;	//the default qc's PlayerJump
+	vars->stepheight = 18;	//STEPSIZE in sv_phys.c
 }
 
 /*
@@ -389,15 +806,13 @@ the angle fields specify an exact angular motion in degrees
 void SV_ClientThink (void)
 {
 	vec3_t		v_angle;
+	float		*angles;
+	movevars_t	vars;
+	pmove_t		pm;
 
 	if (sv_player->v.movetype == MOVETYPE_NONE)
 		return;
 
-	onground = (int)sv_player->v.flags & FL_ONGROUND;
-
-	origin = sv_player->v.origin;
-	velocity = sv_player->v.velocity;
-
 	DropPunchAngle ();
 
 //
@@ -409,7 +824,6 @@ void SV_ClientThink (void)
 //
 // angles
 // show 1/3 the pitch angle and all the roll angle
-	cmd = host_client->cmd;
 	angles = sv_player->v.angles;
 
 	VectorAdd (sv_player->v.v_angle, sv_player->v.punchangle, v_angle);
@@ -428,14 +842,30 @@ void SV_ClientThink (void)
 //
 // walk
 //
-	//johnfitz -- alternate noclip
-	if (sv_player->v.movetype == MOVETYPE_NOCLIP && sv_altnoclip.value)
-		SV_NoclipMove ();
-	else if ((sv_player->v.waterlevel >= 2||sv_player->onladder) && sv_player->v.movetype != MOVETYPE_NOCLIP)
-		SV_WaterMove ();
-	else
-		SV_AirMove ();
-	//johnfitz
+	SV_MoveVars (sv_player, &vars);
+	memset (&pm, 0, sizeof(pm));
+	pm.vars = &vars;
+	pm.cmd = host_client->cmd;
+	pm.cmd.buttons = sv_player->v.button2?2:0;
+	pm.frametime = host_frametime;
+	pm.movetype = sv_player->v.movetype;
+	pm.waterlevel = sv_player->v.waterlevel;
+	pm.onladder = sv_player->onladder;
+	pm.onground = ((int)sv_player->v.flags & FL_ONGROUND)?true:false;
+	pm.noretreat = qcvm->time < sv_player->v.teleport_time;
+	pm.altnoclip = sv_altnoclip.value;
+	VectorCopy (sv_player->v.angles, pm.angles);
+	VectorCopy (sv_player->v.v_angle, pm.v_angle);
+	VectorCopy (sv_player->v.mins, pm.mins);
+	VectorCopy (sv_player->v.maxs, pm.maxs);
+	VectorCopy (sv_player->v.origin, pm.origin);
+	VectorCopy (sv_player->v.velocity, pm.velocity);
+	pm.trace = SV_PM_Trace;
+	pm.ctx = sv_player;
+
+	PM_PlayerInput (&pm);
+
+	VectorCopy (pm.velocity, sv_player->v.velocity);
 }
 
 
@@ -794,7 +1224,9 @@ void SV_RunClients (void)
 	//Spike -- reworked this to query the network code for an active connection.
 	//this allows the network code to serve multiple clients with the same listening port.
 	//this solves server-side nats, which is important for coop etc.
-	while(1)
+	if (SV_Replay_Playing ())
+		SV_Replay_RunClients ();
+	else while(1)
 	{
 		struct qsocket_s *sock = NET_GetServerMessage();
 		if (!sock)
@@ -805,6 +1237,7 @@ void SV_RunClients (void)
 			if (host_client->netconnection == sock)
 			{
 				sv_player = host_client->edict;
+				SV_Replay_RecordMessage (i);
 				if (!SV_ReadClientMessage ())
 				{
 					SV_DropClient (false);	// client misbehaved...
@@ -813,6 +1246,7 @@ void SV_RunClients (void)
 			}
 		}
 	}
+	SV_Replay_ReadsDone ();
 
 	//then do the per-frame stuff
 	for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
@@ -847,7 +1281,7 @@ void SV_RunClients (void)
 		}
 
 // always pause in single player if in console or menus
-		if (!sv.paused && (svs.maxclients > 1 || key_dest == key_game) )
+		if (!sv.paused && !SV_MenuPaused ())
 			SV_ClientThink ();
 	}
 }
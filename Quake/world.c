@@ -311,6 +311,80 @@ SV_AreaTriggerEdicts ( edict_t *ent, areanode_t *node, edict_t **list, int *list
 		SV_AreaTriggerEdicts ( ent, node->children[1], list, listcount, listspace );
 }
 
+/*
+====================
+SV_AreaEdictsR
+
+Walks the area nodes that overlap the given box, collecting every linked
+(non-SOLID_NOT) edict whose absbox intersects it.
+====================
+*/
+static void SV_AreaEdictsR (areanode_t *node, const vec3_t mins, const vec3_t maxs, edict_t **list, int *listcount, const int listspace)
+{
+	link_t		*l, *start;
+	edict_t		*check;
+	int			pass;
+
+	for (pass = 0; pass < 2; pass++)
+	{
+		start = pass?&node->trigger_edicts:&node->solid_edicts;
+		for (l = start->next ; l != start ; l = l->next)
+		{
+			check = EDICT_FROM_AREA(l);
+			if (check->free)
+				continue;
+			if (mins[0] > check->v.absmax[0]
+			|| mins[1] > check->v.absmax[1]
+			|| mins[2] > check->v.absmax[2]
+			|| maxs[0] < check->v.absmin[0]
+			|| maxs[1] < check->v.absmin[1]
+			|| maxs[2] < check->v.absmin[2] )
+				continue;
+
+			if (*listcount == listspace)
+				return; // should never happen
+			list[(*listcount)++] = check;
+		}
+	}
+
+// recurse down both sides
+	if (node->axis == -1)
+		return;
+
+	if ( maxs[node->axis] > node->dist )
+		SV_AreaEdictsR ( node->children[0], mins, maxs, list, listcount, listspace );
+	if ( mins[node->axis] < node->dist )
+		SV_AreaEdictsR ( node->children[1], mins, maxs, list, listcount, listspace );
+}
+
+static int SV_AreaEdicts_Compare (const void *a, const void *b)
+{
+	const edict_t *ea = *(edict_t *const*)a, *eb = *(edict_t *const*)b;
+	return (ea > eb) - (ea < eb);
+}
+
+/*
+====================
+SV_AreaEdicts
+
+Fills list with the edicts whose absbox overlaps the mins/maxs box, using the
+area nodes instead of scanning every edict. The results are sorted by edict
+number so that chains built from them match the order of a linear walk.
+Returns the number of edicts written.
+====================
+*/
+int SV_AreaEdicts (const vec3_t mins, const vec3_t maxs, edict_t **list, int listspace)
+{
+	int listcount = 0;
+
+	if (!qcvm->numareanodes)
+		return 0;
+	SV_AreaEdictsR (qcvm->areanodes, mins, maxs, list, &listcount, listspace);
+	if (listcount > 1)
+		qsort (list, listcount, sizeof(*list), SV_AreaEdicts_Compare);
+	return listcount;
+}
+
 /*
 ====================
 SV_TouchLinks
@@ -361,6 +435,7 @@ void SV_TouchLinks (edict_t *ent)
 		old_self = pr_global_struct->self;
 		old_other = pr_global_struct->other;
 
+		touch->sleeping = false;
 		pr_global_struct->self = EDICT_TO_PROG(touch);
 		pr_global_struct->other = EDICT_TO_PROG(ent);
 		pr_global_struct->time = qcvm->time;
@@ -435,6 +510,8 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 	if (ent == qcvm->edicts)
 		return;		// don't add the world
 
+	SV_WakeGrounded (ent);	// it may have moved out from under something
+
 	if (ent->free)
 		return;
 
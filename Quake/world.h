@@ -42,6 +42,47 @@ typedef struct
 	int		contents;		// spike -- the content type(s) that we found.
 } trace_t;
 
+typedef struct
+{
+	float	gravity;
+	float	entgravity;
+	float	friction;
+	float	edgefriction;
+	float	stopspeed;
+	float	maxspeed;
+	float	accelerate;
+	float	jumpvelocity;
+	float	stepheight;
+} movevars_t;
+
+typedef struct pmove_s
+{
+	const movevars_t	*vars;
+	usercmd_t	cmd;
+	float		frametime;
+
+	vec3_t		angles;		// body angles, pitch is -v_angle/3
+	vec3_t		v_angle;
+	int			movetype;
+	int			waterlevel;
+	float		viewheight;
+	qboolean	onladder;
+	qboolean	dead;
+	qboolean	noretreat;	// just teleported, don't walk back in
+	qboolean	altnoclip;
+	qboolean	jumpreleased;
+	vec3_t		mins, maxs;
+
+	// updated by the move
+	vec3_t		origin;
+	vec3_t		velocity;
+	qboolean	onground;
+
+	trace_t		(*trace) (struct pmove_s *pm, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end);
+	int			(*pointcontents) (struct pmove_s *pm, vec3_t p);
+	void		*ctx;
+} pmove_t;
+
 
 #define	MOVE_NORMAL		0
 #define	MOVE_NOMONSTERS	1
@@ -64,6 +105,10 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers);
 // sets ent->v.absmin and ent->v.absmax
 // if touchtriggers, calls prog functions for the intersected triggers
 
+int SV_AreaEdicts (const vec3_t mins, const vec3_t maxs, edict_t **list, int listspace);
+// fills list with the linked edicts whose absmin/absmax overlap the box, in
+// ascending edict order. SOLID_NOT edicts are never linked and are not returned.
+
 int SV_PointContentsAllBsps(vec3_t p, edict_t *forent); //check all SOLID_BSP ents
 int SV_PointContents (vec3_t p);
 int SV_TruePointContents (vec3_t p);
@@ -90,6 +135,20 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
 qboolean SV_RecursiveHullCheck (hull_t *hull, vec3_t p1, vec3_t p2, trace_t *trace, unsigned int hitcontents);
+int SV_HullPointContents (hull_t *hull, int num, vec3_t p);
+int ClipVelocity (vec3_t in, vec3_t normal, vec3_t out, float overbounce);
+
+void PM_PlayerInput (pmove_t *pm);
+// turns the cmd into velocity, without moving
+void PM_PlayerMove (pmove_t *pm);
+// runs a full input frame of stock player physics, for prediction
+void SV_MoveVars (edict_t *ent, movevars_t *vars);
+
+byte *SV_LeafPHS (mleaf_t *leaf, qmodel_t *model);
+// returns the potentially hearable set of a leaf, same layout as Mod_LeafPVS.
+// like Mod_LeafPVS, the result may be clobbered by the next call.
+byte *SV_FatPVS (vec3_t org, qmodel_t *worldmodel);
+// the union of the pvs of every leaf within 8 units of org. also clobbered by the next call.
 
 qmodel_t *PR_CSQC_GetModel(int idx);
 #endif	/* _QUAKE_WORLD_H */
@@ -611,6 +611,7 @@ typedef struct cache_system_s
 cache_system_t *Cache_TryAlloc (int size, qboolean nobottom);
 
 cache_system_t	cache_head;
+static unsigned int	cache_hits, cache_misses;	// Cache_Check, for Memory_GetStats
 
 /*
 ===========
@@ -891,7 +892,11 @@ void *Cache_Check (cache_user_t *c)
 	cache_system_t	*cs;
 
 	if (!c->data)
+	{
+		cache_misses++;
 		return NULL;
+	}
+	cache_hits++;
 
 	cs = ((cache_system_t *)c->data) - 1;
 
@@ -994,3 +999,26 @@ void Memory_Init (void *buf, int size)
 	Cmd_AddCommand ("hunk_print", Hunk_Print_f); //johnfitz
 }
 
+/*
+========================
+Memory_GetStats
+
+Walks the zone, so it's for the occasional query rather than every frame
+========================
+*/
+void Memory_GetStats (memstats_t *st)
+{
+	memblock_t	*block;
+
+	st->hunksize = hunk_size;
+	st->hunklow = hunk_low_used;
+	st->hunkhigh = hunk_high_used;
+	st->zonesize = mainzone->size;
+	st->zonefree = 0;
+	for (block = mainzone->blocklist.next; block != &mainzone->blocklist; block = block->next)
+		if (!block->tag)
+			st->zonefree += block->size;
+	st->cachehits = cache_hits;
+	st->cachemisses = cache_misses;
+}
+
@@ -91,6 +91,14 @@ Zone block
 
 void Memory_Init (void *buf, int size);
 
+typedef struct
+{
+	int		hunksize, hunklow, hunkhigh;
+	int		zonesize, zonefree;
+	unsigned int	cachehits, cachemisses;
+} memstats_t;
+void Memory_GetStats (memstats_t *st);
+
 void Z_Free (void *ptr);
 void *Z_Malloc (int size);			// returns 0 filled memory
 void *Z_Realloc (void *ptr, int size);